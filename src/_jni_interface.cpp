@@ -11,15 +11,23 @@
 //       of what ABI the DLL is compiled for.)
 //==============================================================================
 
+#include "arena.h"
+#include "buffer_pool.h"
 #include "com.h"
 #include "global_refs.h"
+#include "heap.h"
 #include "jni_exception.h"
 #include "jni_util.h"
+#include "jsdi_callback.h"
 #include "jsdi_windows.h"
+#include "jstring_cache.h"
 #include "log.h"
+#include "marshall_plan.h"
 #include "marshalling.h"
 #include "seh.h"
 #include "suneido_protocol.h"
+#include "thunk.h"
+#include "thunk_slab.h"
 #include "version.h"
 
 #include <cassert>
@@ -190,6 +198,123 @@ JNIEXPORT jobject JNICALL Java_suneido_jsdi_JSDI_logThreshold
     return result;
 }
 
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    setStringCacheCapacity
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_JSDI_setStringCacheCapacity
+  (JNIEnv * env, jclass, jint capacity)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    if (capacity < 0)
+        std::ostringstream() << "invalid string cache capacity: " << capacity
+                             << throw_cpp<std::invalid_argument>();
+    jstring_cache::instance().set_capacity(env,
+                                           static_cast<size_t>(capacity));
+    LOG_INFO("setStringCacheCapacity( " << capacity << " )");
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    flushStringCache
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_JSDI_flushStringCache
+  (JNIEnv * env, jclass)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    jstring_cache::instance().flush(env);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    stringCacheStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_JSDI_stringCacheStats
+  (JNIEnv * env, jclass)
+{
+    jlongArray result(nullptr);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    auto const stats(jstring_cache::instance().stats());
+    jlong const values[] =
+    {
+        static_cast<jlong>(stats.capacity),
+        static_cast<jlong>(stats.size),
+        static_cast<jlong>(stats.hits),
+        static_cast<jlong>(stats.misses)
+    };
+    jsize const N(static_cast<jsize>(array_length(values)));
+    result = env->NewLongArray(N);
+    JNI_EXCEPTION_CHECK(env);
+    if (! result) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+    env->SetLongArrayRegion(result, 0, N, values);
+    JNI_EXCEPTION_CHECK(env);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    memoryStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_JSDI_memoryStats
+  (JNIEnv * env, jclass)
+{
+    jlongArray result(nullptr);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    // Each counter is read separately with a relaxed load, so the values are
+    // a snapshot that may be slightly out of step with each other. Counts of
+    // allocations only ever increase: sample them twice to get a rate.
+    auto const heaps(heap::total_stats());
+    jlong const values[] =
+    {
+        /*  0 */ static_cast<jlong>(heap::count()),
+        /*  1 */ static_cast<jlong>(heaps.live_bytes),
+        /*  2 */ static_cast<jlong>(heaps.live_blocks),
+        /*  3 */ static_cast<jlong>(heaps.peak_bytes),
+        /*  4 */ static_cast<jlong>(heaps.allocations),
+        /*  5 */ static_cast<jlong>(thunk::live_count()),
+        /*  6 */ static_cast<jlong>(thunk::clearing_count()),
+        /*  7 */ static_cast<jlong>(thunk_slab_allocator::total_slab_count() *
+                                    thunk_slab_allocator::SLAB_BYTES),
+        /*  8 */ static_cast<jlong>(jsdi_callback_base::global_ref_count()),
+        /*  9 */ static_cast<jlong>(buffer_pool::process_buffer_bytes()),
+        /* 10 */ static_cast<jlong>(arena::process_high_water_mark()),
+        /* 11 */ static_cast<jlong>(arena::chunk_allocation_count())
+    };
+    jsize const N(static_cast<jsize>(array_length(values)));
+    result = env->NewLongArray(N);
+    JNI_EXCEPTION_CHECK(env);
+    if (! result) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+    env->SetLongArrayRegion(result, 0, N, values);
+    JNI_EXCEPTION_CHECK(env);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    getVariableIndirect
+ * Signature: (JII)Ljava/lang/Object;
+ */
+JNIEXPORT jobject JNICALL Java_suneido_jsdi_JSDI_getVariableIndirect
+  (JNIEnv * env, jclass, jlong frameHandle, jint viIndex, jint viInst)
+{
+    jobject result(nullptr);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    char const * const str(
+        lazy_vi_frame::find(frameHandle)->vi_ptr(viIndex));
+    result = seh::convert_to_cpp(&unmarshaller_vi::make_vi_object, env, str,
+                                 viInst);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
 //==============================================================================
 //                    JAVA CLASS: suneido.jsdi.DllFactory
 //==============================================================================
@@ -292,6 +417,7 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutIndirect(
     jintArray ptrArray)
 {
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("structAddr => "   << reinterpret_cast<void *>(structAddr) <<
               ", sizeDirect => " << sizeDirect);
     struct_check_size(sizeDirect);
@@ -299,11 +425,13 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutIndirect(
     // See note above: critical arrays safe here.
     const jni_array_region<jint> ptr_array(env, ptrArray);
     jni_critical_array<jlong> data_(env, data);
-    unmarshaller_indirect u(sizeDirect,
-                            data_.size() * sizeof(decltype(data_)::value_type),
-                            ptr_array.begin(), ptr_array.end());
-    u.unmarshall_indirect(ptr, // SEH-safe
-                          reinterpret_cast<marshall_word_t *>(data_.data()));
+    // Reuse this thread's plan, and its compiled unmarshaller, if the last
+    // structure copied out with per-call arrays was the same type.
+    marshall_plan const& plan(marshall_plan::this_thread_last(
+        sizeDirect, data_.size() * sizeof(decltype(data_)::value_type),
+        ptr_array.data(), ptr_array.size(), nullptr, 0));
+    plan.unmarshaller().unmarshall_indirect(
+        ptr, reinterpret_cast<marshall_word_t *>(data_.data())); // SEH-safe
     JNI_EXCEPTION_SAFE_CPP_END(env);
 }
 
@@ -317,6 +445,7 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutVariableIndirect(
     jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
 {
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("structAddr => "   << reinterpret_cast<void *>(structAddr) <<
               ", sizeDirect => " << sizeDirect);
     struct_check_size(sizeDirect);
@@ -326,11 +455,62 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutVariableIndirect(
     jni_array<jlong> data_(env, data);
     const jni_array_region<jint> ptr_array(env, ptrArray);
     const jni_array_region<jint> vi_inst_array(env, viInstArray);
-    unmarshaller_vi u(sizeDirect,
-                      data_.size() * sizeof(decltype(data_)::value_type),
-                      ptr_array.begin(), ptr_array.end(), vi_inst_array.size());
-    u.unmarshall_vi(ptr, reinterpret_cast<marshall_word_t *>(data_.data()),
-                    env, viArray, vi_inst_array.begin()); // SEH-safe
+    // See copyOutIndirect about reusing this thread's plan.
+    marshall_plan const& plan(marshall_plan::this_thread_last(
+        sizeDirect, data_.size() * sizeof(decltype(data_)::value_type),
+        ptr_array.data(), ptr_array.size(), vi_inst_array.data(),
+        vi_inst_array.size()));
+    plan.unmarshaller().unmarshall_vi(
+        ptr, reinterpret_cast<marshall_word_t *>(data_.data()), env, viArray,
+        plan.vi_inst_array()); // SEH-safe
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_type_Structure
+ * Method:    copyOutIndirectPlan
+ * Signature: (J[JJ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutIndirectPlan(
+    JNIEnv * env, jclass, jlong structAddr, jlongArray data, jlong planHandle)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    marshall_plan const& plan(marshall_plan::from_handle(planHandle));
+    LOG_TRACE("structAddr => " << reinterpret_cast<void *>(structAddr) <<
+              ", plan => "     << &plan);
+    struct_check_size(plan.size_direct());
+    auto ptr(struct_get_ptr(structAddr));
+    // See note above: critical arrays safe here.
+    jni_critical_array<jlong> data_(env, data);
+    plan.check_data(data_.size(), 0);
+    plan.unmarshaller().unmarshall_indirect(
+        ptr, reinterpret_cast<marshall_word_t *>(data_.data())); // SEH-safe
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_type_Structure
+ * Method:    copyOutVariableIndirectPlan
+ * Signature: (J[JJ[Ljava/lang/Object;)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutVariableIndirectPlan(
+    JNIEnv * env, jclass, jlong structAddr, jlongArray data, jlong planHandle,
+    jobjectArray viArray)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    marshall_plan const& plan(marshall_plan::from_handle(planHandle));
+    LOG_TRACE("structAddr => " << reinterpret_cast<void *>(structAddr) <<
+              ", plan => "     << &plan);
+    struct_check_size(plan.size_direct());
+    auto ptr(struct_get_ptr(structAddr));
+    // Can't use critical arrays here: see copyOutVariableIndirect.
+    jni_array<jlong> data_(env, data);
+    plan.check_data(data_.size(), env->GetArrayLength(viArray));
+    plan.unmarshaller().unmarshall_vi(
+        ptr, reinterpret_cast<marshall_word_t *>(data_.data()), env, viArray,
+        plan.vi_inst_array()); // SEH-safe
     JNI_EXCEPTION_SAFE_CPP_END(env);
 }
 
@@ -495,6 +675,7 @@ JNIEXPORT jobject JNICALL Java_suneido_jsdi_com_COMobject_callMethodByName(
 {
     jobject result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     IDispatch * idisp(reinterpret_cast<IDispatch *>(ptrToIDispatch));
     DISPID dispid_(seh::convert_to_cpp(com::get_dispid_of_name, idisp, env, name));
     // Check the dispid array before calling the method so that we don't throw
@@ -517,6 +698,7 @@ JNIEXPORT jobject JNICALL Java_suneido_jsdi_com_COMobject_callMethodByDispId(
 {
     jobject result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     IDispatch * idisp(reinterpret_cast<IDispatch *>(ptrToIDispatch));
     result = seh::convert_to_cpp(com::call_method, idisp,
                                  static_cast<DISPID>(dispid), env, args);
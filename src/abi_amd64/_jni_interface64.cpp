@@ -9,18 +9,27 @@
 // desc: JVM's interface for functionality specific to the amd64 ABI
 //==============================================================================
 
+#include "arena.h"
 #include "global_refs.h"
 #include "jni_exception.h"
 #include "jsdi_callback.h"
 #include "log.h"
+#include "marshall_plan.h"
 #include "marshalling.h"
+#include "message_filter.h"
 #include "seh.h"
 
+#include "call_batch64.h"
+#include "fast_call64.h"
 #include "invoke64.h"
+#include "invoke64_stub.h"
+#include "jsdi_callback64.h"
 #include "thunk64.h"
 
 #include <algorithm>
+#include <limits>
 #include <ostream>
+#include <sstream>
 #include <cassert>
 
 using namespace jsdi;
@@ -59,6 +68,24 @@ jlong call_fast(JNIEnv * env, jlong funcPtr, ArgTypes ... args)
     return r;
 }
 
+template<typename ... ArgTypes>
+jlong call_fast_fp(JNIEnv * env, jlong funcPtr, jint registers,
+                   jint returnType, ArgTypes ... args)
+{
+    uint64_t r(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    LOG_TRACE("funcPtr => " << reinterpret_cast<void *>(funcPtr) << ", " <<
+              "registers => " << registers << ", returnType => " << returnType
+                              << ", args => " << to_list(args...));
+    param_register_types const registers_(static_cast<uint32_t>(registers));
+    auto invoker(fast_call64::get<sizeof...(ArgTypes)>(
+        registers_, static_cast<param_register_type>(returnType)));
+    r = seh::convert_to_cpp(invoker, reinterpret_cast<void *>(funcPtr),
+                            static_cast<uint64_t>(args)...);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return static_cast<jlong>(r);
+}
+
 template<typename T>
 jlong coerce_to_jlong(T value)
 { return *reinterpret_cast<jlong const *>(&value); }
@@ -67,16 +94,23 @@ template<>
 jlong coerce_to_jlong<float>(float value)
 { return coerce_to_jlong(static_cast<double>(value)); }
 
+// Enough for the argument block of any but the most unusual direct call, so
+// that the arguments are copied onto the stack rather than into the arena.
+constexpr jsize DIRECT_STORAGE_WORDS = 128;
+
 jlong call_direct_nofp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
                        jlongArray args)
 {
     uint64_t result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", args => " << args);
+    jlong storage[DIRECT_STORAGE_WORDS];
 #pragma warning(push) // TODO: remove after http://goo.gl/SvVcbg fixed
 #pragma warning(disable:4592)
-    jni_array_region<jlong> args_(env, args, min_whole_words(sizeDirect));
+    jni_array_region<jlong> args_(env, args, min_whole_words(sizeDirect),
+                                  storage, DIRECT_STORAGE_WORDS);
 #pragma warning(pop)
     result = invoke64::basic(sizeDirect, args_.data(),
                              reinterpret_cast<void *>(funcPtr));
@@ -93,6 +127,7 @@ jlong call_direct_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
 {
     jlong result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", registers " << registers
                                << ", args => " << args);
@@ -109,15 +144,53 @@ jlong call_direct_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
     return result;
 }
 
+// A Java long[] is sized by the Java-side marshaller together with the pointer
+// array, so the native side trusts it, as it always has.
+template<typename ArgsContainer>
+inline void check_args(ArgsContainer const&, jint, jint const *, jsize, jsize)
+{ }
+
+// A direct buffer is sized by whoever allocated it, which need not be the
+// marshaller, so check that the call can't read or write past its end. Since
+// ptrs_init_vi() tells byte offsets from vi indices by the size of the block,
+// a variable indirect call needs a buffer whose capacity is exactly sizeTotal.
+inline void check_args(jni_direct_buffer<jlong> const& args, jint sizeDirect,
+                       jint const * ptr_array, jsize ptr_array_size,
+                       jsize vi_count)
+{
+    static_assert(sizeof(jlong) == sizeof(marshall_word_t),
+                  "direct buffer must hold marshall words");
+    if (std::numeric_limits<jint>::max() / static_cast<jsize>(sizeof(jlong)) <
+        args.size())
+    {
+        std::ostringstream() << "direct buffer too large: " << args.size()
+                             << " words" << throw_cpp<std::invalid_argument>();
+    }
+    jint const size_total(args.size() * static_cast<jint>(sizeof(jlong)));
+    if (sizeDirect < 0 || size_total < sizeDirect)
+    {
+        std::ostringstream() << "sizeDirect => " << sizeDirect
+                             << " exceeds direct buffer capacity "
+                             << size_total
+                             << throw_cpp<std::out_of_range>();
+    }
+    marshalling_roundtrip::ptrs_check(size_total, ptr_array, ptr_array_size,
+                                      vi_count);
+}
+
+template<typename ArgsContainer = jni_array<jlong>>
 jlong call_indirect_nofp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
-                         jlongArray args, jintArray ptrArray)
+                         typename ArgsContainer::array_type args,
+                         jintArray ptrArray)
 {
     uint64_t result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", args => " << args);
-    jni_array<jlong> args_(env, args);
+    ArgsContainer args_(env, args);
     jni_array_region<jint> ptr_array(env, ptrArray);
+    check_args(args_, sizeDirect, ptr_array.data(), ptr_array.size(), 0);
     marshalling_roundtrip::ptrs_init(args_.data(), ptr_array.data(),
                                      ptr_array.size());
     result = invoke64::basic(sizeDirect, args_.data(),
@@ -128,19 +201,23 @@ jlong call_indirect_nofp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
 
 template<
     typename ReturnType,
-    ReturnType (*InvokeFunc)(size_t, const void *, void *, param_register_types)
+    ReturnType (*InvokeFunc)(size_t, const void *, void *, param_register_types),
+    typename ArgsContainer = jni_array<jlong>
 >
 jlong call_indirect_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
-                       jlongArray args, jint registers, jintArray ptrArray)
+                       typename ArgsContainer::array_type args, jint registers,
+                       jintArray ptrArray)
 {
     jlong result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", registers " << registers
                                << ", args => " << args);
-    jni_array<jlong> args_(env, args);
+    ArgsContainer args_(env, args);
     jni_array_region<jint> ptr_array(env, ptrArray);
     param_register_types const registers_(static_cast<uint32_t>(registers));
+    check_args(args_, sizeDirect, ptr_array.data(), ptr_array.size(), 0);
     marshalling_roundtrip::ptrs_init(args_.data(), ptr_array.data(),
                                      ptr_array.size());
     ReturnType return_value = InvokeFunc(sizeDirect, args_.data(),
@@ -151,6 +228,33 @@ jlong call_indirect_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
     return result;
 }
 
+template<
+    typename ReturnType,
+    ReturnType (*InvokeFunc)(size_t, const void *, void *, param_register_types)
+>
+jlong call_indirect_plan(JNIEnv * env, jlong funcPtr, jlong planHandle,
+                         jlongArray args, jint registers)
+{
+    jlong result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    marshall_plan const& plan(marshall_plan::from_handle(planHandle));
+    LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
+              "plan => " << &plan << ", registers " << registers
+                         << ", args => " << args);
+    jni_array<jlong> args_(env, args);
+    plan.check_data(args_.size(), 0);
+    param_register_types const registers_(static_cast<uint32_t>(registers));
+    marshalling_roundtrip::ptrs_init(args_.data(), plan.ptr_array(),
+                                     plan.ptr_array_size());
+    ReturnType return_value = InvokeFunc(plan.size_direct(), args_.data(),
+                                         reinterpret_cast<void *>(funcPtr),
+                                         registers_);
+    result = coerce_to_jlong(return_value);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
 template<typename Value, typename CoercedValue>
 void call_vi_coerce(Value const& x, CoercedValue& y, marshalling_vi_container&)
 { *reinterpret_cast<Value *>(&y) = x; }
@@ -166,22 +270,26 @@ void call_vi_coerce(const uint64_t& x, jbyte *& y, marshalling_vi_container& z)
 template<
     typename ReturnType,
     ReturnType (*InvokeFunc)(size_t, const void *, void *, param_register_types),
-    typename CoerceReturnType = jlong
+    typename CoerceReturnType = jlong,
+    typename ArgsContainer = jni_array<jlong>
 >
 CoerceReturnType
-    call_vi_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect, jlongArray args,
-               jint registers, jintArray ptrArray, jobjectArray viArray,
-               jintArray viInstArray)
+    call_vi_fp(JNIEnv * env, jlong funcPtr, jint sizeDirect,
+               typename ArgsContainer::array_type args, jint registers,
+               jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
 {
     CoerceReturnType result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", registers " << registers
                                << ", args => " << args);
-    jni_array<jlong> args_(env, args);
+    ArgsContainer args_(env, args);
     jni_array_region<jint> ptr_array(env, ptrArray);
     marshalling_vi_container vi_array_cpp(env->GetArrayLength(viArray), env,
                                           viArray);
+    check_args(args_, sizeDirect, ptr_array.data(), ptr_array.size(),
+               static_cast<jsize>(vi_array_cpp.size()));
     marshalling_roundtrip::ptrs_init_vi(args_.data(), args_.size(),
                                         ptr_array.data(), ptr_array.size(),
                                         env, viArray, vi_array_cpp);
@@ -198,6 +306,120 @@ CoerceReturnType
     return result;
 }
 
+template<
+    typename ReturnType,
+    ReturnType (*InvokeFunc)(size_t, const void *, void *, param_register_types),
+    typename CoerceReturnType = jlong
+>
+CoerceReturnType
+    call_vi_plan(JNIEnv * env, jlong funcPtr, jlong planHandle, jlongArray args,
+                 jint registers, jobjectArray viArray)
+{
+    CoerceReturnType result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    marshall_plan const& plan(marshall_plan::from_handle(planHandle));
+    LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
+              "plan => " << &plan << ", registers " << registers
+                         << ", args => " << args);
+    jni_array<jlong> args_(env, args);
+    plan.check_data(args_.size(), env->GetArrayLength(viArray));
+    marshalling_vi_container vi_array_cpp(plan.vi_count(), env, viArray);
+    marshalling_roundtrip::ptrs_init_vi(args_.data(), args_.size(),
+                                        plan.ptr_array(), plan.ptr_array_size(),
+                                        env, viArray, vi_array_cpp);
+    param_register_types const registers_(static_cast<uint32_t>(registers));
+    ReturnType return_value = InvokeFunc(plan.size_direct(), args_.data(),
+                                         reinterpret_cast<void *>(funcPtr),
+                                         registers_);
+    JNI_EXCEPTION_CHECK(env);
+    call_vi_coerce<ReturnType, CoerceReturnType>(return_value, result,
+                                                 vi_array_cpp);
+    marshalling_roundtrip::ptrs_finish_vi(viArray, vi_array_cpp,
+                                          plan.vi_inst_array(),
+                                          plan.vi_count());
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+template<
+    typename ReturnType,
+    ReturnType (invoke64_stub::*InvokeFunc)(const void *, void *) const
+>
+jlong call_stub(JNIEnv * env, jlong stubHandle, jlong funcPtr, jlongArray args)
+{
+    jlong result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    static_assert(sizeof(invoke64_stub *) <= sizeof(jlong), "fatal data loss");
+    auto stub(reinterpret_cast<invoke64_stub const *>(stubHandle));
+    LOG_TRACE("stub => " << stub << ", funcPtr => "
+                         << reinterpret_cast<void *>(funcPtr) << ", args => "
+                         << args);
+    jsize const size_direct(
+        static_cast<jsize>(stub->signature().args_size_bytes));
+#pragma warning(push) // TODO: remove after http://goo.gl/SvVcbg fixed
+#pragma warning(disable:4592)
+    jni_array_region<jlong> args_(env, args, min_whole_words(size_direct));
+#pragma warning(pop)
+    ReturnType return_value = (stub->*InvokeFunc)(
+        args_.data(), reinterpret_cast<void *>(funcPtr));
+    result = coerce_to_jlong(return_value);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+// Instantiates the jsdi_callback_fast which matches a run-time register type
+// encoding. Only FLOAT registers are treated specially by jsdi_callback_fast,
+// so DOUBLE registers are folded into UINT64 to keep the number of
+// instantiations down.
+template<int N>
+struct fast_callback_registers
+{
+    static const size_t value = static_cast<size_t>(N) < NUM_PARAM_REGISTERS
+                              ? static_cast<size_t>(N)
+                              : NUM_PARAM_REGISTERS;
+};
+
+template<int N, uint32_t RegisterTypes, size_t Remaining>
+struct fast_callback_factory
+{
+    static const size_t K = fast_callback_registers<N>::value - Remaining;
+
+    static jsdi_callback_base * make(JNIEnv * env, jobject callback,
+                                     jobject bound_value, jint size_direct,
+                                     param_register_types registers)
+    {
+        return FLOAT == registers[K]
+            ? fast_callback_factory<
+                  N, RegisterTypes | (FLOAT << (030 - 010 * K)), Remaining - 1
+              >::make(env, callback, bound_value, size_direct, registers)
+            : fast_callback_factory<N, RegisterTypes, Remaining - 1>::make(
+                  env, callback, bound_value, size_direct, registers);
+    }
+};
+
+template<int N, uint32_t RegisterTypes>
+struct fast_callback_factory<N, RegisterTypes, 0>
+{
+    static jsdi_callback_base * make(JNIEnv * env, jobject callback,
+                                     jobject bound_value, jint size_direct,
+                                     param_register_types)
+    {
+        return new jsdi_callback_fast<N, RegisterTypes>(
+            env, callback, bound_value, size_direct);
+    }
+};
+
+template<int N>
+jsdi_callback_base * make_fast_callback(JNIEnv * env, jobject callback,
+                                        jobject bound_value, jint size_direct,
+                                        param_register_types registers)
+{
+    return fast_callback_factory<
+        N, 0, fast_callback_registers<N>::value
+    >::make(env, callback, bound_value, size_direct, registers);
+}
 
 // FIXME: The thunks are being allocated on a heap that has static storage
 //        duration, so this can't well have it too or there's likely to be some
@@ -257,6 +479,97 @@ JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callJ4
   (JNIEnv * env, jclass, jlong funcPtr, jlong a, jlong b, jlong c, jlong d)
 { return call_fast(env, funcPtr, a, b, c, d); }
 
+static_assert(MAX_FAST_CALL64_ARGS ==
+                  suneido_jsdi_abi_amd64_NativeCall64_MAX_FAST_CALL_PARAMS,
+              "Java and C++ disagree on maximum fast call parameters");
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast0
+ * Signature: (JII)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast0
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType)
+{ return call_fast_fp(env, funcPtr, registers, returnType); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast1
+ * Signature: (JIIJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast1
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast2
+ * Signature: (JIIJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast2
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a, b); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast3
+ * Signature: (JIIJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast3
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a, b, c); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast4
+ * Signature: (JIIJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast4
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c, jlong d)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a, b, c, d); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast5
+ * Signature: (JIIJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast5
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c, jlong d, jlong e)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a, b, c, d, e); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast6
+ * Signature: (JIIJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast6
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c, jlong d, jlong e, jlong f)
+{ return call_fast_fp(env, funcPtr, registers, returnType, a, b, c, d, e, f); }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast7
+ * Signature: (JIIJJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast7
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c, jlong d, jlong e, jlong f, jlong g)
+{
+    return call_fast_fp(env, funcPtr, registers, returnType,
+                        a, b, c, d, e, f, g);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast8
+ * Signature: (JIIJJJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast8
+  (JNIEnv * env, jclass, jlong funcPtr, jint registers, jint returnType, jlong a, jlong b, jlong c, jlong d, jlong e, jlong f, jlong g, jlong h)
+{
+    return call_fast_fp(env, funcPtr, registers, returnType,
+                        a, b, c, d, e, f, g, h);
+}
+
 /*
  * Class:     suneido_jsdi_abi_amd64_NativeCall64
  * Method:    callDirectNoFpReturnInt64
@@ -400,6 +713,318 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndi
         viArray, viInstArray);
 }
 
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferNoFpReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferNoFpReturnInt64
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jintArray ptrArray)
+{
+    return call_indirect_nofp<jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, ptrArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnInt64
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray)
+{
+    return call_indirect_fp<uint64_t, invoke64::fp, jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnFloat
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnFloat
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray)
+{
+    return call_indirect_fp<float, invoke64::return_float,
+                            jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnDouble
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnDouble
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray)
+{
+    return call_indirect_fp<double, invoke64::return_double,
+                            jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnInt64
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
+{
+    return call_vi_fp<uint64_t, invoke64::fp, jlong, jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray,
+        viArray, viInstArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnFloat
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnFloat
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
+{
+    return call_vi_fp<float, invoke64::return_float, jlong,
+                      jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray,
+        viArray, viInstArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnDouble
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnDouble
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
+{
+    return call_vi_fp<double, invoke64::return_double, jlong,
+                      jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray,
+        viArray, viInstArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnVariableIndirect
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnVariableIndirect
+  (JNIEnv * env, jclass, jlong funcPtr, jint sizeDirect, jobject args, jint registers, jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
+{
+    call_vi_fp<uint64_t, invoke64::fp, jbyte *, jni_direct_buffer<jlong>>(
+        env, funcPtr, sizeDirect, args, registers, ptrArray,
+        viArray, viInstArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    newMarshallPlan
+ * Signature: (II[I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_newMarshallPlan
+  (JNIEnv * env, jclass, jint sizeDirect, jint sizeTotal, jintArray ptrArray, jintArray viInstArray)
+{
+    jlong result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    jni_array_region<jint> ptr_array(env, ptrArray);
+    jni_array_region<jint> vi_inst_array(env, viInstArray);
+    marshall_plan * plan(new marshall_plan(
+        sizeDirect, sizeTotal, ptr_array.data(), ptr_array.size(),
+        vi_inst_array.data(), vi_inst_array.size()));
+    LOG_DEBUG("newMarshallPlan( sizeDirect => " << sizeDirect
+              << ", sizeTotal => " << sizeTotal << ", ptrArray => "
+              << ptrArray << ", viInstArray => " << viInstArray << " ) => "
+              << plan);
+    result = plan->to_handle();
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    deleteMarshallPlan
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_deleteMarshallPlan
+  (JNIEnv * env, jclass, jlong planHandle)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    LOG_DEBUG("deleteMarshallPlan( " << planHandle << " )");
+    delete &marshall_plan::from_handle(planHandle);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnInt64
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnInt64
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers)
+{
+    return call_indirect_plan<uint64_t, invoke64::fp>(env, funcPtr, planHandle,
+                                                      args, registers);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnFloat
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnFloat
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers)
+{
+    return call_indirect_plan<float, invoke64::return_float>(
+        env, funcPtr, planHandle, args, registers);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnDouble
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnDouble
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers)
+{
+    return call_indirect_plan<double, invoke64::return_double>(
+        env, funcPtr, planHandle, args, registers);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnInt64
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnInt64
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers, jobjectArray viArray)
+{
+    return call_vi_plan<uint64_t, invoke64::fp>(env, funcPtr, planHandle, args,
+                                                registers, viArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnFloat
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnFloat
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers, jobjectArray viArray)
+{
+    return call_vi_plan<float, invoke64::return_float>(
+        env, funcPtr, planHandle, args, registers, viArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnDouble
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnDouble
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers, jobjectArray viArray)
+{
+    return call_vi_plan<double, invoke64::return_double>(
+        env, funcPtr, planHandle, args, registers, viArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnVariableIndirect
+ * Signature: (JJ[JI[Ljava/lang/Object;)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnVariableIndirect
+  (JNIEnv * env, jclass, jlong funcPtr, jlong planHandle, jlongArray args, jint registers, jobjectArray viArray)
+{
+    call_vi_plan<uint64_t, invoke64::fp, jbyte *>(env, funcPtr, planHandle,
+                                                  args, registers, viArray);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    compileStub
+ * Signature: (III)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_compileStub
+  (JNIEnv * env, jclass, jint sizeDirect, jint registers, jint returnType)
+{
+    jlong result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    LOG_DEBUG("compileStub( sizeDirect => " << sizeDirect << ", registers => "
+              << registers << ", returnType => " << returnType << " )");
+    if (! (static_cast<jint>(UINT64) <= returnType &&
+           returnType <= static_cast<jint>(FLOAT)))
+    {
+        std::ostringstream() << "invalid stub return type: " << returnType
+                             << throw_cpp<std::invalid_argument>();
+    }
+    param_register_types const registers_(static_cast<uint32_t>(registers));
+    const invoke64_stub& stub(invoke64_stub::get(
+        stub_signature(static_cast<size_t>(sizeDirect), registers_,
+                       static_cast<param_register_type>(returnType))));
+    result = reinterpret_cast<jlong>(&stub);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnInt64
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnInt64
+  (JNIEnv * env, jclass, jlong stubHandle, jlong funcPtr, jlongArray args)
+{
+    return call_stub<uint64_t, &invoke64_stub::call>(env, stubHandle, funcPtr,
+                                                     args);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnFloat
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnFloat
+  (JNIEnv * env, jclass, jlong stubHandle, jlong funcPtr, jlongArray args)
+{
+    return call_stub<float, &invoke64_stub::return_float>(env, stubHandle,
+                                                          funcPtr, args);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnDouble
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnDouble
+  (JNIEnv * env, jclass, jlong stubHandle, jlong funcPtr, jlongArray args)
+{
+    return call_stub<double, &invoke64_stub::return_double>(env, stubHandle,
+                                                            funcPtr, args);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callBatch
+ * Signature: ([J[J)I
+ */
+JNIEXPORT jint JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callBatch
+  (JNIEnv * env, jclass, jlongArray program, jlongArray results)
+{
+    jint result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    LOG_TRACE("program => " << program << ", results => " << results);
+    // The program is copied because the pointer fixups modify it. The results
+    // array is pinned so that if a call faults, the results of the preceding
+    // calls are committed back to the Java array when it is released.
+    jni_array_region<jlong> program_(env, program);
+    jni_array<jlong> results_(env, results);
+    result = static_cast<jint>(call_batch64::run(
+        program_.data(), program_.size(), results_.data(), results_.size()));
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
 //==============================================================================
 //             JAVA CLASS: suneido.jsdi.abi.amd64.ThunkManager64
 //==============================================================================
@@ -409,43 +1034,61 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndi
 /*
  * Class:     suneido_jsdi_abi_amd64_ThunkManager64
  * Method:    newThunk64
- * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;III[II[J)V
+ * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[IIZIIZ[J)V
  */
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_newThunk64(
   JNIEnv * env, jclass, jobject callback, jobject boundValue, jint sizeDirect,
   jint sizeTotal, jintArray ptrArray, jint variableIndirectCount,
-  jint registerUsage, jint numParams, jboolean makeFastCall,
+  jboolean lazyVariableIndirect, jint registerUsage, jint numParams, jboolean makeFastCall,
   jlongArray outThunkAddrs)
 {
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     LOG_DEBUG("newThunk64( sizeDirect => " << sizeDirect << ", sizeTotal => "
               << sizeTotal << ", viCount => " << variableIndirectCount
+              << ", lazyVi => " << lazyVariableIndirect
               << ", registerUsage => " << registerUsage << ", numParams => "
               << numParams << ", makeFastCall => " << makeFastCall << " )");
+    param_register_types const registers(static_cast<uint32_t>(registerUsage));
     std::shared_ptr<jsdi::callback> callback_ptr;
     if (makeFastCall)
     {
         switch (numParams)
         {
             case 0:
-                callback_ptr.reset(new jsdi_callback_fast0(env, callback,
-                                   boundValue, sizeDirect));
+                callback_ptr.reset(make_fast_callback<0>(
+                    env, callback, boundValue, sizeDirect, registers));
                 break;
             case 1:
-                callback_ptr.reset(new jsdi_callback_fast1(env, callback,
-                                   boundValue, sizeDirect));
+                callback_ptr.reset(make_fast_callback<1>(
+                    env, callback, boundValue, sizeDirect, registers));
                 break;
             case 2:
-                callback_ptr.reset(new jsdi_callback_fast2(env, callback,
-                                   boundValue, sizeDirect));
+                callback_ptr.reset(make_fast_callback<2>(
+                    env, callback, boundValue, sizeDirect, registers));
                 break;
             case 3:
-                callback_ptr.reset(new jsdi_callback_fast3(env, callback,
-                                   boundValue, sizeDirect));
+                callback_ptr.reset(make_fast_callback<3>(
+                    env, callback, boundValue, sizeDirect, registers));
                 break;
             case 4:
-                callback_ptr.reset(new jsdi_callback_fast4(env, callback,
-                                   boundValue, sizeDirect));
+                callback_ptr.reset(make_fast_callback<4>(
+                    env, callback, boundValue, sizeDirect, registers));
+                break;
+            case 5:
+                callback_ptr.reset(make_fast_callback<5>(
+                    env, callback, boundValue, sizeDirect, registers));
+                break;
+            case 6:
+                callback_ptr.reset(make_fast_callback<6>(
+                    env, callback, boundValue, sizeDirect, registers));
+                break;
+            case 7:
+                callback_ptr.reset(make_fast_callback<7>(
+                    env, callback, boundValue, sizeDirect, registers));
+                break;
+            case 8:
+                callback_ptr.reset(make_fast_callback<8>(
+                    env, callback, boundValue, sizeDirect, registers));
                 break;
             default:
                 LOG_WARN("can't make a fastcall for " << numParams
@@ -474,11 +1117,11 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_newThunk64(
             callback_ptr.reset(
                 new jsdi_callback_vi(env, callback, boundValue, sizeDirect,
                                      sizeTotal, ptr_array.begin(),
-                                     ptr_array.size(), variableIndirectCount));
+                                     ptr_array.size(), variableIndirectCount,
+                                     JNI_FALSE != lazyVariableIndirect));
         }
     }
     assert(callback_ptr);
-    param_register_types const registers(static_cast<uint32_t>(registerUsage));
     size_t const num_register_params = std::min(static_cast<size_t>(numParams),
                                                 NUM_PARAM_REGISTERS);
     jni_array<jlong> out_thunk_addrs(env, outThunkAddrs);
@@ -510,3 +1153,178 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_deleteThunk64
     seh::convert_to_cpp(clear_func);
     JNI_EXCEPTION_SAFE_CPP_END(env);
 }
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_ThunkManager64
+ * Method:    setMessageFilter64
+ * Signature: (J[IJZ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_setMessageFilter64
+  (JNIEnv * env, jclass, jlong thunkObjectAddr, jintArray messages,
+   jlong prevWndProc, jboolean unicode)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    static_assert(sizeof(thunk64 *) <= sizeof(jlong), "fatal data loss");
+    auto thunk(reinterpret_cast<thunk64 *>(thunkObjectAddr));
+    std::unique_ptr<message_filter> filter;
+    if (messages)
+    {
+        jni_array_region<jint> messages_(env, messages);
+        filter.reset(
+            new message_filter(messages_.data(), messages_.size(),
+                               reinterpret_cast<void *>(prevWndProc),
+                               JNI_FALSE != unicode));
+    }
+    thunk->callback_ptr()->set_filter(std::move(filter));
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_ThunkManager64
+ * Method:    messageFilterStats64
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_messageFilterStats64
+  (JNIEnv * env, jclass, jlong thunkObjectAddr)
+{
+    jlongArray result(nullptr);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    auto thunk(reinterpret_cast<thunk64 *>(thunkObjectAddr));
+    message_filter const * const filter(thunk->callback_ptr()->filter());
+    if (filter)
+    {
+        jlong const values[] =
+        {
+            static_cast<jlong>(filter->filtered_count()),
+            static_cast<jlong>(filter->delivered_count())
+        };
+        jsize const N(static_cast<jsize>(array_length(values)));
+        result = env->NewLongArray(N);
+        JNI_EXCEPTION_CHECK(env);
+        if (! result) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+        env->SetLongArrayRegion(result, 0, N, values);
+        JNI_EXCEPTION_CHECK(env);
+    }
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// call_direct_nofp() as it was before jni_array_region had an inline buffer
+// and caller storage: the arguments were always copied into an array drawn
+// from the thread's arena.
+jlong call_direct_nofp_arena(JNIEnv * env, jlong funcPtr, jint sizeDirect,
+                             jlongArray args)
+{
+    uint64_t result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
+    jsize const size(min_whole_words(sizeDirect));
+    arena_allocator<jlong> allocator;
+    jlong * const args_(allocator.allocate(size));
+    env->GetLongArrayRegion(args, 0, size, args_);
+    result = invoke64::basic(sizeDirect, args_,
+                             reinterpret_cast<void *>(funcPtr));
+    allocator.deallocate(args_, size);
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return static_cast<jlong>(result);
+}
+
+} // anonymous namespace
+
+TEST(call_direct_nofp_timing,
+    // Times a direct call end to end, from the JNI entry point through
+    // invoke64::basic() and back, with the arguments copied into the arena as
+    // call_direct_nofp() used to and into stack storage as it does now. Only
+    // the results are asserted; timings are logged.
+    typedef std::chrono::high_resolution_clock clock;
+    constexpr int N = 1000000;
+    constexpr jsize NARGS = 6;
+    jsdi::test_java_vm vm;
+    JNIEnv * const env(vm.env_of_creating_thread());
+    jlong const values[NARGS] = { 1, 2, 3, 4, 5, 6 };
+    jlongArray args(env->NewLongArray(NARGS));
+    env->SetLongArrayRegion(args, 0, NARGS, values);
+    jlong const func_ptr(reinterpret_cast<jlong>(TestSumSixInt32s));
+    jint const size_direct(NARGS * sizeof(jlong));
+    int64_t sum_arena(0), sum_storage(0);
+    auto t0 = clock::now();
+    for (int k = 0; k < N; ++k)
+        sum_arena += static_cast<int32_t>(
+            call_direct_nofp_arena(env, func_ptr, size_direct, args));
+    auto t1 = clock::now();
+    for (int k = 0; k < N; ++k)
+        sum_storage += static_cast<int32_t>(
+            Java_suneido_jsdi_abi_amd64_NativeCall64_callDirectNoFpReturnInt64(
+                env, nullptr, func_ptr, size_direct, args));
+    auto t2 = clock::now();
+    env->DeleteLocalRef(args);
+    assert_equals(21LL * N, sum_arena);
+    assert_equals(sum_arena, sum_storage);
+    using std::chrono::nanoseconds;
+    using std::chrono::duration_cast;
+    LOG_INFO("callDirectNoFpReturnInt64: arena => "
+             << duration_cast<nanoseconds>(t1 - t0).count() / N
+             << "ns, stack storage => "
+             << duration_cast<nanoseconds>(t2 - t1).count() / N
+             << "ns per call");
+);
+
+TEST(indirect_buffer_bounds,
+    // A direct buffer call whose sizeDirect or pointer pairs don't fit in the
+    // buffer must raise a Java exception without touching the buffer.
+    jsdi::test_java_vm vm;
+    JNIEnv * const env(vm.env_of_creating_thread());
+    marshall_word_t storage[2] = { 0, 0 };
+    std::memcpy(&storage[1], "hello", 6);
+    jobject buffer(env->NewDirectByteBuffer(storage, sizeof(storage)));
+    assert_true(buffer);
+    jlong const func_ptr(reinterpret_cast<jlong>(TestStrLen));
+    struct { jint size_direct; jint ptr_pair[2]; bool ok; } const cases[] =
+    {
+        {  8, {  0,  8 }, true  },
+        {  8, {  0, -1 }, true  }, // null pointer
+        { 24, {  0,  8 }, false }, // sizeDirect exceeds the capacity
+        {  8, {  0, 17 }, false }, // points past the end of the buffer
+        {  8, {  9,  8 }, false }, // pointer overlaps the end of the buffer
+        {  8, { -8,  8 }, false },
+    };
+    for (auto const& c : cases)
+    {
+        storage[0] = 0;
+        jintArray ptr_array(env->NewIntArray(2));
+        env->SetIntArrayRegion(ptr_array, 0, 2, c.ptr_pair);
+        jlong const result(
+            Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferNoFpReturnInt64(
+                env, nullptr, func_ptr, c.size_direct, buffer, ptr_array));
+        env->DeleteLocalRef(ptr_array);
+        if (c.ok)
+        {
+            assert_false(env->ExceptionCheck());
+            assert_equals(0 <= c.ptr_pair[1] ? 5 : 0,
+                          static_cast<int32_t>(result));
+        }
+        else
+        {
+            assert_true(env->ExceptionCheck());
+            env->ExceptionClear();
+            assert_equals(0, storage[0]);
+        }
+    }
+    env->DeleteLocalRef(buffer);
+);
+
+#endif // __NOTEST__
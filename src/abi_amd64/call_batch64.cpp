@@ -0,0 +1,371 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: call_batch64.cpp
+// auth: Victor Schappert
+// date: 20140905
+// desc: Interpreter for batches of native calls
+//==============================================================================
+
+#include "call_batch64.h"
+
+#include "invoke64.h"
+
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace jsdi {
+namespace abi_amd64 {
+
+namespace {
+
+inline size_t record_size(marshall_word_t const * header)
+{
+    return call_batch64::HEADER_SIZE +
+        min_whole_words(static_cast<jsize>(
+            header[call_batch64::SIZE_TOTAL_INDEX])) +
+        static_cast<size_t>(header[call_batch64::NUM_PTR_PAIRS_INDEX]);
+}
+
+void check_record(marshall_word_t const * header, size_t remaining)
+{
+    if (remaining < call_batch64::HEADER_SIZE)
+    {
+        std::ostringstream() << "truncated batch call header"
+                             << throw_cpp<std::invalid_argument>();
+    }
+    marshall_word_t const size_direct(header[call_batch64::SIZE_DIRECT_INDEX]);
+    marshall_word_t const size_total(header[call_batch64::SIZE_TOTAL_INDEX]);
+    marshall_word_t const return_type(header[call_batch64::RETURN_TYPE_INDEX]);
+    marshall_word_t const num_ptr_pairs(
+        header[call_batch64::NUM_PTR_PAIRS_INDEX]);
+    if (size_direct < 0 ||
+        0 != size_direct % static_cast<jsize>(sizeof(marshall_word_t)) ||
+        size_total < size_direct ||
+        std::numeric_limits<jsize>::max() < size_total)
+    {
+        std::ostringstream() << "invalid batch call sizes: sizeDirect => "
+                             << size_direct << ", sizeTotal => " << size_total
+                             << throw_cpp<std::invalid_argument>();
+    }
+    if (! (UINT64 <= return_type && return_type <= FLOAT))
+    {
+        std::ostringstream() << "invalid batch call return type: "
+                             << return_type
+                             << throw_cpp<std::invalid_argument>();
+    }
+    // Throws std::invalid_argument if the encoding isn't valid
+    param_register_types(static_cast<uint32_t>(
+        header[call_batch64::REGISTERS_INDEX]));
+    if (num_ptr_pairs < 0 ||
+        remaining - call_batch64::HEADER_SIZE <
+            static_cast<size_t>(num_ptr_pairs) ||
+        remaining < record_size(header))
+    {
+        std::ostringstream() << "truncated batch call record"
+                             << throw_cpp<std::invalid_argument>();
+    }
+    // marshalling_roundtrip::ptrs_init() trusts the pointer pairs, so check
+    // that each one writes a whole pointer within the record's data and points
+    // within the data, or is null.
+    marshalling_roundtrip::ptrs_check(
+        static_cast<jint>(size_total),
+        reinterpret_cast<jint const *>(
+            header + call_batch64::HEADER_SIZE +
+            min_whole_words(static_cast<jsize>(size_total))),
+        static_cast<jsize>(2 * num_ptr_pairs), 0);
+}
+
+marshall_word_t invoke(marshall_word_t * header)
+{
+    size_t const size_direct(
+        static_cast<size_t>(header[call_batch64::SIZE_DIRECT_INDEX]));
+    marshall_word_t const * args(header + call_batch64::HEADER_SIZE);
+    void * func_ptr(
+        reinterpret_cast<void *>(header[call_batch64::FUNC_PTR_INDEX]));
+    param_register_types const registers(
+        static_cast<uint32_t>(header[call_batch64::REGISTERS_INDEX]));
+    switch (header[call_batch64::RETURN_TYPE_INDEX])
+    {
+        case UINT64:
+            return static_cast<marshall_word_t>(
+                registers.has_fp()
+                    ? invoke64::fp(size_direct, args, func_ptr, registers)
+                    : invoke64::basic(size_direct, args, func_ptr));
+        case DOUBLE:
+        {
+            double const d(invoke64::return_double(size_direct, args, func_ptr,
+                                                   registers));
+            return *reinterpret_cast<marshall_word_t const *>(&d);
+        }
+        case FLOAT:
+        {
+            double const d(invoke64::return_float(size_direct, args, func_ptr,
+                                                  registers));
+            return *reinterpret_cast<marshall_word_t const *>(&d);
+        }
+        default:
+            assert(!"control should never pass here");
+            return 0;
+    }
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                            struct call_batch64
+//==============================================================================
+
+size_t call_batch64::count(marshall_word_t const * program,
+                           size_t program_size)
+{
+    assert(program || 0 == program_size);
+    size_t result(0), pos(0);
+    while (pos < program_size)
+    {
+        check_record(program + pos, program_size - pos);
+        pos += record_size(program + pos);
+        ++result;
+    }
+    return result;
+}
+
+size_t call_batch64::run(marshall_word_t * program, size_t program_size,
+                         marshall_word_t * results, size_t results_size)
+{
+    size_t const num_calls(count(program, program_size));
+    if (results_size < num_calls)
+    {
+        std::ostringstream() << "batch has " << num_calls
+                             << " calls but results array has room for "
+                             << results_size
+                             << throw_cpp<std::invalid_argument>();
+    }
+    marshall_word_t * header(program);
+    for (size_t k = 0; k < num_calls; ++k)
+    {
+        marshall_word_t * args(header + HEADER_SIZE);
+        jsize const num_ptr_pairs(
+            static_cast<jsize>(header[NUM_PTR_PAIRS_INDEX]));
+        if (0 < num_ptr_pairs)
+        {
+            static_assert(2 * sizeof(jint) == sizeof(marshall_word_t),
+                          "pointer pair must occupy exactly one word");
+            marshall_word_t const * ptr_pairs(
+                args + min_whole_words(
+                           static_cast<jsize>(header[SIZE_TOTAL_INDEX])));
+            marshalling_roundtrip::ptrs_init(
+                args, reinterpret_cast<jint const *>(ptr_pairs),
+                2 * num_ptr_pairs);
+        }
+        results[k] = invoke(header);
+        header += record_size(header);
+    }
+    return num_calls;
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#include "seh.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace jsdi;
+using namespace jsdi::abi_amd64;
+
+namespace {
+
+struct batch_builder
+{
+    std::vector<marshall_word_t> program;
+
+    void add(void * func_ptr, std::vector<marshall_word_t> const& args,
+             param_register_types registers = param_register_types(),
+             param_register_type return_type = UINT64,
+             std::vector<jint> const& ptr_array = std::vector<jint>())
+    {
+        assert(0 == ptr_array.size() % 2);
+        jsize const size(static_cast<jsize>(
+            args.size() * sizeof(marshall_word_t)));
+        program.push_back(reinterpret_cast<marshall_word_t>(func_ptr));
+        program.push_back(size);
+        program.push_back(size);
+        program.push_back(registers.encoding());
+        program.push_back(return_type);
+        program.push_back(ptr_array.size() / 2);
+        program.insert(program.end(), args.begin(), args.end());
+        for (size_t k = 0; k < ptr_array.size(); k += 2)
+        {
+            marshall_word_t pair(0);
+            std::memcpy(&pair, &ptr_array[k], sizeof(pair));
+            program.push_back(pair);
+        }
+    }
+
+    size_t run(std::vector<marshall_word_t>& results)
+    {
+        results.assign(call_batch64::count(program.data(), program.size()), 0);
+        return call_batch64::run(program.data(), program.size(),
+                                 results.data(), results.size());
+    }
+};
+
+template<typename T>
+marshall_word_t word(T value)
+{
+    marshall_word_t result(0);
+    std::memcpy(&result, &value, sizeof(value));
+    return result;
+}
+
+template<typename T>
+T unword(marshall_word_t value)
+{ return *reinterpret_cast<T const *>(&value); }
+
+} // anonymous namespace
+
+TEST(batch_empty,
+    std::vector<marshall_word_t> results;
+    assert_equals(0, batch_builder().run(results));
+);
+
+TEST(batch_mixed,
+    batch_builder b;
+    std::vector<marshall_word_t> results;
+    b.add(TestSumTwoInt32s, { 1, 2 });
+    b.add(TestSumTwoDoubles, { word(1.5), word(2.0) },
+          param_register_types(DOUBLE, DOUBLE, UINT64, UINT64), DOUBLE);
+    b.add(TestSumTwoFloats, { word(0.5f), word(-1.0f) },
+          param_register_types(FLOAT, FLOAT, UINT64, UINT64), FLOAT);
+    b.add(TestSumSixInt32s, { 1, 2, 3, 4, 5, 6 });
+    b.add(TestStrLen, { 0, word('H' | 'e' << 8 | 'y' << 16) },
+          param_register_types(), UINT64, { 0, sizeof(marshall_word_t) });
+    assert_equals(5, b.run(results));
+    assert_equals(3, static_cast<int32_t>(results[0]));
+    assert_equals(3.5, unword<double>(results[1]));
+    assert_equals(-0.5, unword<double>(results[2]));
+    assert_equals(21, static_cast<int32_t>(results[3]));
+    assert_equals(3, static_cast<int32_t>(results[4]));
+);
+
+TEST(batch_invalid,
+    // A malformed record anywhere in the program must prevent any call from
+    // being made.
+    int32_t src(0x19820207), dst(0);
+    {
+        batch_builder b;
+        std::vector<marshall_word_t> results(2);
+        b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+        b.add(TestSumTwoInt32s, { 1, 2 }, param_register_types(),
+              static_cast<param_register_type>(3));
+        bool caught(false);
+        try
+        {
+            call_batch64::run(b.program.data(), b.program.size(),
+                              results.data(), results.size());
+        }
+        catch (std::invalid_argument const&)
+        { caught = true; }
+        assert_true(caught);
+        assert_equals(0, dst);
+    }
+    {
+        batch_builder b;
+        b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+        b.program.pop_back(); // truncate
+        bool caught(false);
+        try
+        { call_batch64::count(b.program.data(), b.program.size()); }
+        catch (std::invalid_argument const&)
+        { caught = true; }
+        assert_true(caught);
+    }
+    {
+        batch_builder b;
+        marshall_word_t result(0);
+        b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+        b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+        bool caught(false);
+        try
+        { call_batch64::run(b.program.data(), b.program.size(), &result, 1); }
+        catch (std::invalid_argument const&)
+        { caught = true; }
+        assert_true(caught);
+        assert_equals(0, dst);
+    }
+);
+
+TEST(batch_ptr_out_of_range,
+    // A pointer pair outside the marshalled data must be rejected before any
+    // call is made.
+    int32_t src(0x20140905), dst(0);
+    std::vector<std::vector<jint>> const bad_pairs =
+    {
+        { -8, 0 },
+        { 9, 0 },   // the pointer would overlap the end of the data
+        { 16, 0 },
+        { 0, 17 },
+        { 0, -2 },
+    };
+    for (auto const& pairs : bad_pairs)
+    {
+        batch_builder b;
+        std::vector<marshall_word_t> results(2);
+        b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+        b.add(TestStrLen, { 0, 0 }, param_register_types(), UINT64, pairs);
+        bool caught(false);
+        try
+        {
+            call_batch64::run(b.program.data(), b.program.size(),
+                              results.data(), results.size());
+        }
+        catch (std::out_of_range const&)
+        { caught = true; }
+        assert_true(caught);
+        assert_equals(0, dst);
+    }
+    // The edges of the data are fine, as is a null pointer.
+    batch_builder b;
+    b.add(TestStrLen, { 0, 0 }, param_register_types(), UINT64,
+          { 8, 16, 0, marshalling_roundtrip::UNKNOWN_LOCATION });
+    assert_equals(1, call_batch64::count(b.program.data(), b.program.size()));
+);
+
+TEST(batch_seh,
+    // Execution must stop at the first fault, with the results of the calls
+    // before it available.
+    int32_t src(0x19900606), dst(0);
+    batch_builder b;
+    std::vector<marshall_word_t> results(3, -1);
+    b.add(TestSumTwoInt32s, { 5, 6 });
+    b.add(TestDivideTwoInt32s, { 1, 0 });
+    b.add(TestCopyInt32Value, { word(&src), word(&dst) });
+    bool caught(false);
+    try
+    {
+        call_batch64::run(b.program.data(), b.program.size(), results.data(),
+                          results.size());
+    }
+    catch (seh_exception const& e)
+    { caught = std::string("win32 exception: INT_DIVIDE_BY_ZERO") == e.what(); }
+    assert_true(caught);
+    assert_equals(11, static_cast<int32_t>(results[0]));
+    assert_equals(-1, results[1]);
+    assert_equals(0, dst);
+);
+
+#endif // __NOTEST__
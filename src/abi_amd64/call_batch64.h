@@ -0,0 +1,112 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_CALL_BATCH64_H___
+#define __INCLUDED_CALL_BATCH64_H___
+
+/**
+ * \file call_batch64.h
+ * \author Victor Schappert
+ * \since 20140905
+ * \brief Executes a packed sequence of native calls in one JNI transition
+ */
+
+#include "marshalling.h"
+#include "util.h"
+
+namespace jsdi {
+namespace abi_amd64 {
+
+/**
+ * \brief Interprets a packed "batch program" describing a sequence of
+ *        independent native function calls
+ * \author Victor Schappert
+ * \since 20140905
+ * \see invoke64
+ *
+ * A batch program is an array of \link jsdi::marshall_word_t\endlink words
+ * containing one record per call. Each record consists of a header of
+ * #HEADER_SIZE words, laid out as given by the <code>*_INDEX</code>
+ * enumerators, followed by:
+ *
+ * - the marshalled argument data, occupying
+ *   <code>min_whole_words(sizeTotal)</code> words, of which the first
+ *   <code>sizeDirect</code> bytes are the arguments passed to the function; and
+ * - <code>numPtrPairs</code> pointer fixup words, each of which holds two
+ *   <code>jint</code> values, in memory order, with the same meaning as a pair
+ *   of entries in the pointer array given to
+ *   \link marshalling_roundtrip::ptrs_init(marshall_word_t *, const jint *, jsize)
+ *   marshalling_roundtrip::ptrs_init(...)\endlink.
+ *
+ * The return type word must be a valid \link param_register_type\endlink. As
+ * with the individual <code>NativeCall64.call*</code> entry points, a
+ * <code>float</code> return value is widened to <code>double</code> and
+ * stored as the bit pattern of the <code>double</code>.
+ */
+struct call_batch64 : private non_instantiable
+{
+        /**
+         * \brief Positions of the fields in each call record header
+         * \see #HEADER_SIZE
+         */
+        enum
+        {
+            /** \brief Address of the function to call */
+            FUNC_PTR_INDEX,
+            /** \brief Size, in bytes, of the arguments passed directly */
+            SIZE_DIRECT_INDEX,
+            /** \brief Size, in bytes, of the marshalled argument data */
+            SIZE_TOTAL_INDEX,
+            /** \brief Encoded \link param_register_types\endlink */
+            REGISTERS_INDEX,
+            /** \brief \link param_register_type\endlink of return value */
+            RETURN_TYPE_INDEX,
+            /** \brief Number of pointer fixup words following the data */
+            NUM_PTR_PAIRS_INDEX,
+            /** \brief Number of words in a call record header */
+            HEADER_SIZE
+        };
+
+        /**
+         * \brief Validates a batch program and counts the calls in it
+         * \param program Pointer to the batch program
+         * \param program_size Number of words in <code>program</code>
+         * \return Number of call records in <code>program</code>
+         * \throws std::invalid_argument If <code>program</code> is not
+         *         well-formed
+         * \throws std::out_of_range If a pointer fixup in
+         *         <code>program</code> lies outside its call's data
+         */
+        static size_t count(marshall_word_t const * program,
+                            size_t program_size);
+
+        /**
+         * \brief Executes every call in a batch program in order
+         * \param program Pointer to the batch program, which is modified by
+         *        the pointer fixups
+         * \param program_size Number of words in <code>program</code>
+         * \param results Array to receive the return value of each call
+         * \param results_size Number of words in <code>results</code>
+         * \return Number of calls executed
+         * \throws std::invalid_argument If <code>program</code> is not
+         *         well-formed or <code>results</code> is too small, in which
+         *         case no calls are made
+         * \throws std::out_of_range If a pointer fixup in
+         *         <code>program</code> lies outside its call's data, in which
+         *         case no calls are made
+         * \throws jsdi::seh_exception If a call raises a structured exception
+         *         handling exception
+         *
+         * Execution stops at the first call which raises an exception. The
+         * results of all the calls that completed before it have already been
+         * stored in <code>results</code> by that point.
+         */
+        static size_t run(marshall_word_t * program, size_t program_size,
+                          marshall_word_t * results, size_t results_size);
+};
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_CALL_BATCH64_H___
@@ -0,0 +1,158 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: fast_call64.cpp
+// auth: Victor Schappert
+// date: 20140904
+// desc: Tests for compiler-generated fast calls
+//==============================================================================
+
+#include "fast_call64.h"
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#include "test64.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace jsdi::abi_amd64;
+using namespace jsdi::abi_amd64::test64;
+
+namespace {
+
+uint64_t call_n(void * f, param_register_types register_types,
+                param_register_type return_type,
+                const std::vector<uint64_t>& a)
+{
+    switch (a.size())
+    {
+        case 0: return fast_call64::call(f, register_types, return_type);
+        case 1: return fast_call64::call(f, register_types, return_type, a[0]);
+        case 2: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1]);
+        case 3: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2]);
+        case 4: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2], a[3]);
+        case 5: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2], a[3], a[4]);
+        case 6: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2], a[3], a[4], a[5]);
+        case 7: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2], a[3], a[4], a[5], a[6]);
+        case 8: return fast_call64::call(f, register_types, return_type, a[0],
+                                         a[1], a[2], a[3], a[4], a[5], a[6],
+                                         a[7]);
+        default:
+            assert(!"control should never pass here");
+            return 0;
+    }
+}
+
+template<typename T>
+T from_word(uint64_t w)
+{ return *reinterpret_cast<T const *>(&w); }
+
+} // anonymous namespace
+
+TEST(fast_call_int32,
+    assert_equals(
+        1,
+        static_cast<int32_t>(fast_call64::call(
+            reinterpret_cast<void *>(TestInt32), param_register_types(),
+            UINT64, 1ULL)));
+    assert_equals(
+        1 + 2 + 3 + 4 + 5 + 6 + 7 + 8,
+        static_cast<int32_t>(fast_call64::call(
+            reinterpret_cast<void *>(TestSumEightInt32s),
+            param_register_types(), UINT64, 1ULL, 2ULL, 3ULL, 4ULL, 5ULL, 6ULL,
+            7ULL, 8ULL)));
+);
+
+TEST(fast_call_fp_comprehensive,
+    std::vector<uint64_t> args;
+    std::for_each(
+        test64::FP_FUNCTIONS.begin, test64::FP_FUNCTIONS.end,
+        [this, &args](auto f)
+        {
+            if (MAX_FAST_CALL64_ARGS < f->func.nargs) return;
+#if !defined(_WIN64)
+            // Under System V, floating-point parameters after the fourth go
+            // in SSE registers, which fast_call64 can't describe.
+            if (std::any_of(f->func.arg_types.begin() +
+                                std::min(f->func.nargs, NUM_PARAM_REGISTERS),
+                            f->func.arg_types.end(),
+                            [](param_register_type t) { return UINT64 != t; }))
+                return;
+#endif // !defined(_WIN64)
+            size_t sum(0);
+            args.resize(f->func.nargs);
+            for (size_t i = 0; i < f->func.nargs; ++i)
+            {
+                sum += i;
+                switch (f->func.arg_types[i])
+                {
+                    case param_register_type::UINT64:
+                        args[i] = static_cast<uint64_t>(i);
+                        break;
+                    case param_register_type::DOUBLE:
+                        assert_true(copy_to(static_cast<double>(i), &args[i], 1));
+                        break;
+                    case param_register_type::FLOAT:
+                        args[i] = 0;
+                        assert_true(copy_to(static_cast<float>(i), &args[i], 1));
+                        break;
+                    default:
+                        assert(false || !"control should never pass here");
+                }
+            } // for(args)
+            uint64_t result = call_n(f->func.ptr, f->func.register_types,
+                                     UINT64, args);
+            assert_equals(sum, result);
+        } // lambda
+    ); // std::for_each(FP_FUNCTIONS)
+);
+
+TEST(fast_call_return_fp,
+    uint64_t a(0), b(0);
+    assert_true(copy_to(-2300.5, &a, 1));
+    assert_true(copy_to(-2.0, &b, 1));
+    param_register_types rt(DOUBLE, DOUBLE, UINT64, UINT64);
+    assert_equals(1.0, from_word<double>(fast_call64::call(
+        reinterpret_cast<void *>(TestReturn1_0Double), rt, DOUBLE)));
+    assert_equals(-2302.5, from_word<double>(fast_call64::call(
+        reinterpret_cast<void *>(TestSumTwoDoubles), rt, DOUBLE, a, b)));
+    a = b = 0;
+    assert_true(copy_to(10.0f, &a, 1));
+    assert_true(copy_to(-1.0f, &b, 1));
+    rt = param_register_types(FLOAT, FLOAT, UINT64, UINT64);
+    // Float return values are widened to double.
+    assert_equals(1.0, from_word<double>(fast_call64::call(
+        reinterpret_cast<void *>(TestReturn1_0Float), rt, FLOAT)));
+    assert_equals(9.0, from_word<double>(fast_call64::call(
+        reinterpret_cast<void *>(TestSumTwoFloats), rt, FLOAT, a, b)));
+);
+
+TEST(fast_call_invalid_return_type,
+    bool caught(false);
+    try
+    {
+        fast_call64::get<2>(param_register_types(),
+                            static_cast<param_register_type>(3));
+    }
+    catch (const std::invalid_argument&)
+    { caught = true; }
+    assert_true(caught);
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,229 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_FAST_CALL64_H___
+#define __INCLUDED_FAST_CALL64_H___
+
+/**
+ * \file fast_call64.h
+ * \author Victor Schappert
+ * \since 20140904
+ * \brief Compiler-generated direct calls for functions with a small number of
+ *        mixed integer and floating-point parameters
+ */
+
+#include "register64.h"
+#include "util.h"
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace jsdi {
+namespace abi_amd64 {
+
+/**
+ * \brief Maximum number of arguments which can be passed to a function invoked
+ *        via \link fast_call64\endlink
+ * \see fast_call64
+ */
+constexpr size_t MAX_FAST_CALL64_ARGS = 8;
+
+/**
+ * \brief Invokes functions taking up to #MAX_FAST_CALL64_ARGS parameters by
+ *        calling them through a function pointer of the correct C++ type.
+ * \author Victor Schappert
+ * \since 20140904
+ * \see invoke64
+ *
+ * Unlike \link invoke64\endlink, which copies the arguments from an array into
+ * registers and onto the stack at run time, this structure lets the compiler
+ * set up the call. For every argument count, it generates one function for
+ * each combination of the register types of the first four parameters and the
+ * return type. It then selects the right one from a table based on the
+ * \link param_register_types\endlink. The arguments are passed as individual
+ * 64-bit words, so no argument array is required.
+ *
+ * A parameter of type param_register_type#FLOAT is passed as a
+ * <code>double</code> whose low-order 32 bits are the <code>float</code>
+ * value. Both the Windows x64 and System V ABIs pass a <code>float</code> in
+ * the low-order 32 bits of an SSE register, so this is indistinguishable to
+ * the callee. Parameters after the fourth are always passed as 64-bit
+ * integers, as in \link invoke64\endlink.
+ *
+ * The return value is always a 64-bit word. A <code>double</code> return value
+ * is returned as its bit pattern, and a <code>float</code> return value is
+ * first widened to <code>double</code>.
+ */
+struct fast_call64 : private non_instantiable
+{
+    private:
+
+        template<size_t>
+        struct word { typedef uint64_t type; };
+
+        template<uint32_t FpMask, size_t I>
+        struct param_type
+        {
+            typedef typename std::conditional<
+                I < NUM_PARAM_REGISTERS && 0 != (FpMask & (1u << I)),
+                double,
+                uint64_t
+            >::type type;
+        };
+
+        template<typename T>
+        static T from_word(uint64_t w)
+        { return *reinterpret_cast<T const *>(&w); }
+
+        static uint64_t to_word(uint64_t x)
+        { return x; }
+
+        static uint64_t to_word(double x)
+        { return *reinterpret_cast<uint64_t const *>(&x); }
+
+        static uint64_t to_word(float x)
+        { return to_word(static_cast<double>(x)); }
+
+        template<typename ReturnType, uint32_t FpMask, size_t ... I>
+        static uint64_t invoke(void * func_ptr, typename word<I>::type ... args)
+        {
+            typedef ReturnType (* func_t)(
+                typename param_type<FpMask, I>::type ...);
+            return to_word(reinterpret_cast<func_t>(func_ptr)(
+                from_word<typename param_type<FpMask, I>::type>(args)...));
+        }
+
+        template<typename Indices>
+        struct arity;
+
+        template<size_t ... I>
+        struct arity<std::index_sequence<I...>>
+        {
+            typedef uint64_t (* invoker)(void *, typename word<I>::type ...);
+
+            static const size_t NUM_MASKS =
+                1u << (sizeof...(I) < NUM_PARAM_REGISTERS
+                           ? sizeof...(I)
+                           : NUM_PARAM_REGISTERS);
+
+            template<typename ReturnType, size_t ... Mask>
+            static invoker get(uint32_t fp_mask, std::index_sequence<Mask...>)
+            {
+                static invoker const TABLE[] =
+                { &invoke<ReturnType, static_cast<uint32_t>(Mask), I...>... };
+                return TABLE[fp_mask];
+            }
+        };
+
+        static uint32_t fp_mask(param_register_types register_types,
+                                size_t num_args);
+
+    public:
+
+        /**
+         * \brief Type of the function which invokes a function taking
+         *        <code>NumArgs</code> parameters
+         * \tparam NumArgs Number of arguments in the range [0 ..
+         *         #MAX_FAST_CALL64_ARGS]
+         * \see #get(param_register_types, param_register_type)
+         *
+         * The invoker takes the pointer to the function to invoke, followed by
+         * the <code>NumArgs</code> arguments, and returns the invoked
+         * function's return value as a 64-bit word.
+         */
+        template<size_t NumArgs>
+        using invoker =
+            typename arity<std::make_index_sequence<NumArgs>>::invoker;
+
+        /**
+         * \brief Returns the invoker for a function taking
+         *        <code>NumArgs</code> parameters with the given register types
+         *        and return type
+         * \param register_types Register types of the first four parameters
+         * \param return_type Return type of the function to be invoked
+         * \tparam NumArgs Number of arguments in the range [0 ..
+         *         #MAX_FAST_CALL64_ARGS]
+         * \return Invoker function
+         * \throws std::invalid_argument If <code>return_type</code> is not a
+         *         valid param_register_type
+         * \see #call(void *, param_register_types, param_register_type,
+         *            Args ...)
+         *
+         * Because the invoker is a plain function pointer, the caller can wrap
+         * the call in whatever exception handling it requires.
+         */
+        template<size_t NumArgs>
+        static invoker<NumArgs> get(param_register_types register_types,
+                                    param_register_type return_type);
+
+        /**
+         * \brief Invokes a function taking <code>sizeof...(Args)</code>
+         *        parameters
+         * \param func_ptr Pointer to the function to call
+         * \param register_types Register types of the first four parameters
+         * \param return_type Return type of <code>func_ptr</code>
+         * \param args Arguments, each of which must be a 64-bit word
+         * \return Return value of <code>func_ptr</code> as a 64-bit word
+         * \throws std::invalid_argument If <code>return_type</code> is not a
+         *         valid param_register_type
+         * \see #get(param_register_types, param_register_type)
+         */
+        template<typename ... Args>
+        static uint64_t call(void * func_ptr,
+                             param_register_types register_types,
+                             param_register_type return_type, Args ... args);
+};
+
+inline uint32_t fast_call64::fp_mask(param_register_types register_types,
+                                     size_t num_args)
+{
+    uint32_t result(0);
+    size_t const n(num_args < NUM_PARAM_REGISTERS ? num_args
+                                                  : NUM_PARAM_REGISTERS);
+    for (size_t k = 0; k < n; ++k)
+        if (UINT64 != register_types[k]) result |= 1u << k;
+    return result;
+}
+
+template<size_t NumArgs>
+fast_call64::invoker<NumArgs> fast_call64::get(
+    param_register_types register_types, param_register_type return_type)
+{
+    static_assert(NumArgs <= MAX_FAST_CALL64_ARGS, "too many arguments");
+    typedef arity<std::make_index_sequence<NumArgs>> arity_t;
+    typedef std::make_index_sequence<arity_t::NUM_MASKS> masks_t;
+    uint32_t const mask(fp_mask(register_types, NumArgs));
+    switch (return_type)
+    {
+        case UINT64:
+            return arity_t::template get<uint64_t>(mask, masks_t());
+        case DOUBLE:
+            return arity_t::template get<double>(mask, masks_t());
+        case FLOAT:
+            return arity_t::template get<float>(mask, masks_t());
+        default:
+            std::ostringstream() << "invalid fast call return type: "
+                                 << return_type
+                                 << throw_cpp<std::invalid_argument>();
+            return nullptr; // Squelch compiler warning
+    }
+}
+
+template<typename ... Args>
+inline uint64_t fast_call64::call(void * func_ptr,
+                                  param_register_types register_types,
+                                  param_register_type return_type,
+                                  Args ... args)
+{
+    return get<sizeof...(Args)>(register_types, return_type)(
+        func_ptr, static_cast<uint64_t>(args)...);
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_FAST_CALL64_H___
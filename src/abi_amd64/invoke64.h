@@ -28,6 +28,10 @@ namespace abi_amd64 {
  * \since 20140819
  * \see thunk64
  *
+ * On System V platforms (<em>ie</em> when <code>_WIN64</code> is not defined),
+ * the functions in this structure are implemented by forwarding to
+ * \link sysv_invoke\endlink instead of the Windows x64 assembly routines.
+ *
  * \remark
  * The functions in this namespace use \link SEH_CONVERT_TO_CPP_BEGIN\endlink
  * and \link SEH_CONVERT_TO_CPP_END\endlink to rethrow non-fatal structured
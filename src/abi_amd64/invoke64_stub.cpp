@@ -0,0 +1,633 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: invoke64_stub.cpp
+// auth: Victor Schappert
+// date: 20140901
+// desc: Per-signature compiled invocation stubs
+//==============================================================================
+
+#include "invoke64_stub.h"
+
+#include "heap.h"
+#include "log.h"
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#include "seh.h"
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#if !defined(_WIN32)
+// See thunk_sysv.cpp.
+extern "C" void __register_frame(void *);
+extern "C" void __deregister_frame(void *);
+// There are no structured exceptions to convert. C++ exceptions thrown by the
+// invoked function propagate through the stub using its call frame
+// information.
+#define SEH_CONVERT_TO_CPP_BEGIN {
+#define SEH_CONVERT_TO_CPP_END   }
+#endif
+
+namespace jsdi {
+namespace abi_amd64 {
+
+//==============================================================================
+//                        struct invoke64_stub_block
+//==============================================================================
+
+namespace {
+
+#if defined(_WIN32)
+
+enum
+{
+    UNWIND_INFO_SIZE          = 8,
+    UWOP_ALLOC_LARGE          = 1,
+    UWOP_ALLOC_SMALL          = 2,
+    MAX_ALLOC_SMALL_BYTES     = 128,
+};
+
+void encode_unwind_info(uint8_t * unwind_info, size_t prologue_size,
+                        size_t frame_size)
+{
+    // The stub prologue consists of a single 'sub rsp, imm32'. The 4-bit
+    // operation info of UWOP_ALLOC_SMALL holds (size - 8) / 8, so it can only
+    // describe frames of 8 to 128 bytes. Larger frames use UWOP_ALLOC_LARGE
+    // with the size divided by 8 in the next slot.
+    assert(0 < frame_size && 0 == frame_size % 8 && frame_size < 0x80000);
+    std::fill(unwind_info, unwind_info + UNWIND_INFO_SIZE, 0);
+    unwind_info[0] = 0x01; // version 1, flags 0
+    unwind_info[1] = static_cast<uint8_t>(prologue_size);
+    unwind_info[2] = MAX_ALLOC_SMALL_BYTES < frame_size ? 2 : 1;
+    unwind_info[3] = 0x00; // no frame register
+    unwind_info[4] = static_cast<uint8_t>(prologue_size);
+    if (MAX_ALLOC_SMALL_BYTES < frame_size)
+    {
+        unwind_info[5] = UWOP_ALLOC_LARGE;
+        unwind_info[6] = static_cast<uint8_t>((frame_size / 8) & 0xff);
+        unwind_info[7] = static_cast<uint8_t>((frame_size / 8) >> 010);
+    }
+    else
+        unwind_info[5] = static_cast<uint8_t>(
+            ((frame_size - 8) / 8) << 4 | UWOP_ALLOC_SMALL);
+}
+
+#else
+
+enum
+{
+    CIE_SIZE                  = 24,
+    FDE_SIZE                  = 48,
+    FDE_OFFSET_CIE_POINTER    =  4,
+    FDE_OFFSET_PC_BEGIN       =  8,
+    FDE_OFFSET_PC_RANGE       = 16,
+    FDE_OFFSET_INSTRUCTIONS   = 25,
+    EH_FRAME_TERMINATOR_SIZE  =  4,
+    EH_FRAME_SIZE             = CIE_SIZE + FDE_SIZE + EH_FRAME_TERMINATOR_SIZE,
+};
+
+// Same CIE as the System V thunks use (see thunk_sysv.cpp): the CFA is rsp+8
+// on entry and the return address is at cfa-8.
+constexpr uint8_t CIE[CIE_SIZE] =
+{
+    0x14, 0x00, 0x00, 0x00,         // length: 20 bytes follow
+    0x00, 0x00, 0x00, 0x00,         // CIE id
+    0x01,                           // version
+    'z', 'R', 0x00,                 // augmentation: pointer encoding follows
+    0x01,                           // code alignment factor: 1
+    0x78,                           // data alignment factor: -8
+    0x10,                           // return address register: rip (16)
+    0x01,                           // augmentation data length
+    0x00,                           // FDE pointer encoding: DW_EH_PE_absptr
+    0x0c, 0x07, 0x08,               // DW_CFA_def_cfa: rsp+8
+    0x90, 0x01,                     // DW_CFA_offset: rip at cfa-8
+    0x00, 0x00                      // DW_CFA_nop (padding)
+};
+
+constexpr uint8_t DW_CFA_NOP             = 0x00;
+constexpr uint8_t DW_CFA_ADVANCE_LOC     = 0x40;
+constexpr uint8_t DW_CFA_ADVANCE_LOC4    = 0x04;
+constexpr uint8_t DW_CFA_DEF_CFA_OFFSET  = 0x0e;
+constexpr uint8_t DW_CFA_OFFSET_RBX      = 0x83;
+constexpr uint8_t DW_CFA_RESTORE_RBX     = 0xc3;
+
+// Builds the .eh_frame blob, one CIE and one FDE, describing a System V stub
+// (see stub_compiler64.cpp). The stub pushes rbx, then moves rsp down by the
+// rest of its frame at the end of its prologue, and undoes both in the last
+// three instructions: 'add rsp, imm32', 'pop rbx', and 'ret'.
+void encode_eh_frame(uint8_t * eh_frame, const void * code, size_t code_size,
+                     size_t prologue_size, size_t frame_size)
+{
+    assert(0 < prologue_size && prologue_size - 1 < 0x40);
+    assert(0 == frame_size % 8 && frame_size + 8 < 0x200000);
+    std::fill(eh_frame, eh_frame + EH_FRAME_SIZE, 0);
+    std::copy(CIE, CIE + CIE_SIZE, eh_frame);
+    uint8_t * const fde(eh_frame + CIE_SIZE);
+    uint32_t const length(FDE_SIZE - 4);
+    uint32_t const cie_pointer(CIE_SIZE + FDE_OFFSET_CIE_POINTER);
+    uint64_t const pc_begin(reinterpret_cast<uint64_t>(code));
+    uint64_t const pc_range(code_size);
+    std::memcpy(fde, &length, sizeof(length));
+    std::memcpy(fde + FDE_OFFSET_CIE_POINTER, &cie_pointer,
+                sizeof(cie_pointer));
+    std::memcpy(fde + FDE_OFFSET_PC_BEGIN, &pc_begin, sizeof(pc_begin));
+    std::memcpy(fde + FDE_OFFSET_PC_RANGE, &pc_range, sizeof(pc_range));
+    uint8_t * cfa(fde + FDE_OFFSET_INSTRUCTIONS); // augmentation length is 0
+    // After 'push rbx'
+    *cfa++ = DW_CFA_ADVANCE_LOC | 1;
+    *cfa++ = DW_CFA_DEF_CFA_OFFSET;
+    *cfa++ = 16;
+    *cfa++ = DW_CFA_OFFSET_RBX;
+    *cfa++ = 2;                     // rbx at cfa-16
+    // After 'sub rsp, imm32', the last instruction of the prologue
+    *cfa++ = static_cast<uint8_t>(DW_CFA_ADVANCE_LOC | (prologue_size - 1));
+    *cfa++ = DW_CFA_DEF_CFA_OFFSET;
+    for (size_t x = frame_size + 8; ; )  // ULEB128
+    {
+        uint8_t const low(static_cast<uint8_t>(x & 0x7f));
+        x >>= 7;
+        if (! x) { *cfa++ = low; break; }
+        *cfa++ = low | 0x80;
+    }
+    // After 'add rsp, imm32'
+    uint32_t const body_size(static_cast<uint32_t>(code_size - 2 -
+                                                   prologue_size));
+    *cfa++ = DW_CFA_ADVANCE_LOC4;
+    std::memcpy(cfa, &body_size, sizeof(body_size));
+    cfa += sizeof(body_size);
+    *cfa++ = DW_CFA_DEF_CFA_OFFSET;
+    *cfa++ = 16;
+    // After 'pop rbx'
+    *cfa++ = DW_CFA_ADVANCE_LOC | 1;
+    *cfa++ = DW_CFA_DEF_CFA_OFFSET;
+    *cfa++ = 8;
+    *cfa++ = DW_CFA_RESTORE_RBX;
+    assert(cfa <= fde + FDE_SIZE);
+    std::fill(cfa, fde + FDE_SIZE, DW_CFA_NOP);
+    // The zero terminator was written by the initial fill.
+}
+
+#endif // defined(_WIN32)
+
+} // anonymous namespace
+
+struct invoke64_stub_block
+{
+    //
+    // DATA
+    //
+#if defined(_WIN32)
+    alignas(8)  RUNTIME_FUNCTION    d_exception_data;
+    alignas(8)  uint8_t             d_unwind_info[UNWIND_INFO_SIZE];
+#else
+    alignas(8)  uint8_t             d_eh_frame[EH_FRAME_SIZE];
+#endif
+    alignas(16) uint8_t             d_instructions[1]; // Actually variable size
+    //
+    // STATICS
+    //
+    static size_t size_bytes(size_t code_size);
+    //
+    // HELPERS
+    //
+    void register_exception_data(size_t code_size, size_t prologue_size,
+                                 size_t frame_size);
+    void unregister_exception_data();
+};
+
+inline size_t invoke64_stub_block::size_bytes(size_t code_size)
+{ return offsetof(invoke64_stub_block, d_instructions) + code_size; }
+
+#if defined(_WIN32)
+
+void invoke64_stub_block::register_exception_data(size_t code_size,
+                                                  size_t prologue_size,
+                                                  size_t frame_size)
+{
+    encode_unwind_info(d_unwind_info, prologue_size, frame_size);
+    uint8_t * const base(reinterpret_cast<uint8_t *>(this));
+    d_exception_data.BeginAddress = static_cast<ULONG>(d_instructions - base);
+    d_exception_data.EndAddress = static_cast<ULONG>(
+                                      d_instructions - base + code_size);
+    d_exception_data.UnwindInfoAddress = static_cast<ULONG>(
+                                             d_unwind_info - base);
+    if (! RtlAddFunctionTable(&d_exception_data, 1,
+                              reinterpret_cast<DWORD64>(this)))
+    {
+        LOG_ERROR("Unable to register exception data: RtlAddFunctionTable("
+                  << &d_exception_data << ", " << 1 << ", " << this
+                  << ") failed and GetLastError() returned " << GetLastError());
+        throw std::runtime_error("Stub cannot register exception data");
+    }
+}
+
+inline void invoke64_stub_block::unregister_exception_data()
+{ RtlDeleteFunctionTable(&d_exception_data); }
+
+#else
+
+void invoke64_stub_block::register_exception_data(size_t code_size,
+                                                  size_t prologue_size,
+                                                  size_t frame_size)
+{
+    encode_eh_frame(d_eh_frame, d_instructions, code_size, prologue_size,
+                    frame_size);
+    __register_frame(d_eh_frame);
+}
+
+inline void invoke64_stub_block::unregister_exception_data()
+{ __deregister_frame(d_eh_frame); }
+
+#endif // defined(_WIN32)
+
+//==============================================================================
+//                        struct invoke64_stub_cache
+//==============================================================================
+
+struct invoke64_stub_cache
+{
+    //
+    // DATA
+    //
+    std::mutex                                   d_mutex;
+    heap                                         d_heap;
+    std::unordered_map<uint64_t, invoke64_stub *> d_stubs;
+    //
+    // CONSTRUCTORS
+    //
+    invoke64_stub_cache();
+    ~invoke64_stub_cache();
+    //
+    // STATICS
+    //
+    static invoke64_stub_cache& instance();
+};
+
+inline invoke64_stub_cache::invoke64_stub_cache()
+    : d_heap("invoke64_stub", true)
+{ }
+
+invoke64_stub_cache::~invoke64_stub_cache()
+{
+    // Only runs at process exit. The stubs' exception data must be
+    // unregistered before the heap holding it is destroyed.
+    for (auto i = d_stubs.begin(), e = d_stubs.end(); i != e; ++i)
+    {
+        i->second->d_block->unregister_exception_data();
+        d_heap.free(i->second->d_block);
+        delete i->second;
+    }
+}
+
+invoke64_stub_cache& invoke64_stub_cache::instance()
+{
+    // Function-local static avoids static initialization order trouble since
+    // stubs may be requested during the initialization of other statics.
+    static invoke64_stub_cache cache;
+    return cache;
+}
+
+//==============================================================================
+//                           class invoke64_stub
+//==============================================================================
+
+namespace {
+
+typedef uint64_t (* stub_func)(const void *, void *);
+typedef double (* stub_func_double)(const void *, void *);
+typedef float (* stub_func_float)(const void *, void *);
+
+} // anonymous namespace
+
+invoke64_stub::invoke64_stub(const stub_signature& signature)
+    : d_signature(signature)
+    , d_block(nullptr)
+{
+    std::vector<uint8_t> code;
+    size_t const prologue_size(
+        stub_compiler64::compile(NATIVE_STUB_ABI, signature, code));
+    size_t const frame_size(
+        stub_compiler64::frame_size(NATIVE_STUB_ABI, signature));
+    // NOTE: Called by invoke64_stub_cache with its mutex held.
+    heap& h(invoke64_stub_cache::instance().d_heap);
+    d_block = static_cast<invoke64_stub_block *>(
+        h.alloc(invoke64_stub_block::size_bytes(code.size())));
+    std::copy(code.begin(), code.end(), d_block->d_instructions);
+    try
+    { d_block->register_exception_data(code.size(), prologue_size, frame_size); }
+    catch (...)
+    {
+        h.free(d_block);
+        throw;
+    }
+    LOG_DEBUG("Compiled invoke64_stub ( args_size_bytes => "
+              << signature.args_size_bytes << ", register_types => "
+              << signature.register_types.encoding() << ", return_type => "
+              << signature.return_type << " ) at " << code_addr() << " ("
+              << code.size() << " bytes)");
+}
+
+const invoke64_stub& invoke64_stub::get(const stub_signature& signature)
+{
+    invoke64_stub_cache& cache(invoke64_stub_cache::instance());
+    uint64_t const key(signature.key());
+    std::lock_guard<std::mutex> lock(cache.d_mutex);
+    auto i = cache.d_stubs.find(key);
+    if (cache.d_stubs.end() != i) return *i->second;
+    invoke64_stub * stub(new invoke64_stub(signature));
+    cache.d_stubs.insert(std::make_pair(key, stub));
+    return *stub;
+}
+
+size_t invoke64_stub::count()
+{
+    invoke64_stub_cache& cache(invoke64_stub_cache::instance());
+    std::lock_guard<std::mutex> lock(cache.d_mutex);
+    return cache.d_stubs.size();
+}
+
+void * invoke64_stub::code_addr() const
+{ return d_block->d_instructions; }
+
+uint64_t invoke64_stub::call(const void * args_ptr, void * func_ptr) const
+{
+    assert(UINT64 == d_signature.return_type);
+    stub_func const f(reinterpret_cast<stub_func>(code_addr()));
+    SEH_CONVERT_TO_CPP_BEGIN
+    return f(args_ptr, func_ptr);
+    SEH_CONVERT_TO_CPP_END
+    return uint64_t(0); // Squelch compiler warning
+}
+
+double invoke64_stub::return_double(const void * args_ptr,
+                                    void * func_ptr) const
+{
+    assert(DOUBLE == d_signature.return_type);
+    stub_func_double const f(reinterpret_cast<stub_func_double>(code_addr()));
+    SEH_CONVERT_TO_CPP_BEGIN
+    return f(args_ptr, func_ptr);
+    SEH_CONVERT_TO_CPP_END
+    return 0.0; // Squelch compiler warning
+}
+
+float invoke64_stub::return_float(const void * args_ptr, void * func_ptr) const
+{
+    assert(FLOAT == d_signature.return_type);
+    stub_func_float const f(reinterpret_cast<stub_func_float>(code_addr()));
+    SEH_CONVERT_TO_CPP_BEGIN
+    return f(args_ptr, func_ptr);
+    SEH_CONVERT_TO_CPP_END
+    return 0.0f; // Squelch compiler warning
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#if defined(_WIN32)
+#include "invoke64.h"
+#else
+#include "sysv_invoke.h"
+#endif
+#include "test64.h"
+
+#include <chrono>
+
+using namespace jsdi::abi_amd64;
+using namespace jsdi::abi_amd64::test64;
+
+namespace {
+
+#if defined(_WIN32)
+typedef invoke64 generic_invoke;
+const char * const GENERIC_INVOKE_NAME = "invoke64::basic()";
+
+uint64_t divide(uint64_t a, uint64_t b)
+{ return a / b; /* if b == 0, raises EXCEPTION_INT_DIVIDE_BY_ZERO */ }
+#else
+typedef sysv_invoke generic_invoke;
+const char * const GENERIC_INVOKE_NAME = "sysv_invoke::basic()";
+
+uint64_t throw_runtime_error(uint64_t)
+{ throw std::runtime_error("thrown through stub"); }
+#endif
+
+} // anonymous namespace
+
+TEST(stub_cached,
+    stub_signature const sig(16, param_register_types(), UINT64);
+    const invoke64_stub& a(invoke64_stub::get(sig));
+    const invoke64_stub& b(invoke64_stub::get(sig));
+    assert_true(&a == &b);
+    const invoke64_stub& c(
+        invoke64_stub::get(stub_signature(16, param_register_types(), DOUBLE)));
+    assert_true(&a != &c);
+);
+
+TEST(stub_basic,
+    constexpr size_t N = 9;
+    // NOTE: See sysv_invoke.cpp for why the casts are needed.
+    void * f[] =
+    {
+        reinterpret_cast<void *>(TestInt32),
+        reinterpret_cast<void *>(TestSumTwoInt32s),
+        reinterpret_cast<void *>(TestSumThreeInt32s),
+        reinterpret_cast<void *>(TestSumFourInt32s),
+        reinterpret_cast<void *>(TestSumFiveInt32s),
+        reinterpret_cast<void *>(TestSumSixInt32s),
+        reinterpret_cast<void *>(TestSumSevenInt32s),
+        reinterpret_cast<void *>(TestSumEightInt32s),
+        reinterpret_cast<void *>(TestSumNineInt32s)
+    };
+    uint64_t a[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        int32_t sum(0);
+        for (size_t j = 0; j <= i; ++j)
+        {
+            a[j] = i + j;
+            sum += static_cast<int32_t>(a[j]);
+        }
+        const invoke64_stub& stub(invoke64_stub::get(
+            stub_signature((i + 1) * sizeof(uint64_t), param_register_types(),
+                           UINT64)));
+        assert_equals(sum, static_cast<int32_t>(stub.call(a, f[i])));
+    }
+);
+
+TEST(stub_fp_comprehensive,
+    std::vector<uint64_t> args;
+    std::for_each(
+        test64::FP_FUNCTIONS.begin, test64::FP_FUNCTIONS.end,
+        [this, &args](auto f)
+        {
+#if !defined(_WIN32)
+            // See sysv_invoke.cpp: the register types only describe four
+            // parameters, so a later floating-point parameter can't be placed
+            // correctly under System V.
+            if (std::any_of(f->func.arg_types.begin() +
+                                std::min(f->func.nargs, NUM_PARAM_REGISTERS),
+                            f->func.arg_types.end(),
+                            [](param_register_type t) { return UINT64 != t; }))
+                return;
+#endif
+            size_t sum(0);
+            args.resize(std::max(f->func.nargs, size_t(1)));
+            for (size_t i = 0; i < f->func.nargs; ++i)
+            {
+                sum += i;
+                switch (f->func.arg_types[i])
+                {
+                    case param_register_type::UINT64:
+                        args[i] = static_cast<uint64_t>(i);
+                        break;
+                    case param_register_type::DOUBLE:
+                        assert_true(copy_to(static_cast<double>(i), &args[i], 1));
+                        break;
+                    case param_register_type::FLOAT:
+                        assert_true(copy_to(static_cast<float>(i), &args[i], 1));
+                        break;
+                    default:
+                        assert(false || !"control should never pass here");
+                }
+            } // for(args)
+            const invoke64_stub& stub(invoke64_stub::get(
+                stub_signature(f->func.nargs * sizeof(uint64_t),
+                               f->func.register_types, UINT64)));
+            assert_equals(sum, stub.call(&args[0], f->func.ptr));
+        } // lambda
+    ); // std::for_each(FP_FUNCTIONS)
+);
+
+TEST(stub_return_fp,
+    uint64_t args[2];
+    assert_true(copy_to(-2300.5, &args[0], 1));
+    assert_true(copy_to(-2.0, &args[1], 1));
+    param_register_types const rt(DOUBLE, DOUBLE, UINT64, UINT64);
+    const invoke64_stub& d(
+        invoke64_stub::get(stub_signature(2 * sizeof(uint64_t), rt, DOUBLE)));
+    assert_equals(-2302.5, d.return_double(
+        args, reinterpret_cast<void *>(TestSumTwoDoubles)));
+    assert_true(copy_to(10.0f, &args[0], 1));
+    assert_true(copy_to(-1.0f, &args[1], 1));
+    const invoke64_stub& f(invoke64_stub::get(
+        stub_signature(2 * sizeof(uint64_t),
+                       param_register_types(FLOAT, FLOAT, UINT64, UINT64),
+                       FLOAT)));
+    assert_equals(9.0f, f.return_float(
+        args, reinterpret_cast<void *>(TestSumTwoFloats)));
+);
+
+#if defined(_WIN32)
+
+TEST(stub_seh,
+    uint64_t a[] = { 0, 0 };
+    bool caught = false;
+    const invoke64_stub& stub(invoke64_stub::get(
+        stub_signature(sizeof(a), param_register_types(), UINT64)));
+    try
+    { stub.call(a, divide); }
+    catch (jsdi::seh_exception const& e)
+    { caught = std::string("win32 exception: INT_DIVIDE_BY_ZERO") == e.what(); }
+    assert_true(caught);
+);
+
+TEST(stub_unwind_info,
+    uint8_t info[UNWIND_INFO_SIZE];
+    // Largest frame UWOP_ALLOC_SMALL can describe: one unwind code
+    encode_unwind_info(info, 7, 128);
+    assert_equals(1, info[2]);
+    assert_equals(7, info[4]);
+    assert_equals((15 << 4) | UWOP_ALLOC_SMALL, info[5]);
+    // Anything larger needs UWOP_ALLOC_LARGE and a second slot
+    encode_unwind_info(info, 7, 136);
+    assert_equals(2, info[2]);
+    assert_equals(7, info[4]);
+    assert_equals(UWOP_ALLOC_LARGE, info[5]);
+    assert_equals(136 / 8, info[6]);
+    assert_equals(0, info[7]);
+    encode_unwind_info(info, 7, 8);
+    assert_equals(1, info[2]);
+    assert_equals(UWOP_ALLOC_SMALL, info[5]);
+);
+
+TEST(stub_seh_large_frame,
+    // Sixteen argument words give a 136-byte frame, which is just too big for
+    // UWOP_ALLOC_SMALL, so the unwinder must be given UWOP_ALLOC_LARGE.
+    uint64_t a[16] = { 0 };
+    assert_equals(136U, stub_compiler64::frame_size(
+        WIN_X64, stub_signature(sizeof(a), param_register_types(), UINT64)));
+    bool caught = false;
+    const invoke64_stub& stub(invoke64_stub::get(
+        stub_signature(sizeof(a), param_register_types(), UINT64)));
+    try
+    { stub.call(a, divide); }
+    catch (jsdi::seh_exception const& e)
+    { caught = std::string("win32 exception: INT_DIVIDE_BY_ZERO") == e.what(); }
+    assert_true(caught);
+);
+
+#else
+
+TEST(stub_unwind,
+    // A C++ exception can only propagate through the stub if the unwinder has
+    // its call frame information. The 40-argument stub has a frame too big
+    // for a one-byte CFA offset.
+    uint64_t a[40] = { 0 };
+    assert_equals(280U, stub_compiler64::frame_size(
+        SYSV, stub_signature(sizeof(a), param_register_types(), UINT64)));
+    size_t const sizes[] = { sizeof(uint64_t), sizeof(a) };
+    for (size_t size : sizes)
+    {
+        bool caught = false;
+        const invoke64_stub& stub(invoke64_stub::get(
+            stub_signature(size, param_register_types(), UINT64)));
+        try
+        { stub.call(a, reinterpret_cast<void *>(throw_runtime_error)); }
+        catch (std::runtime_error const& e)
+        { caught = std::string("thrown through stub") == e.what(); }
+        assert_true(caught);
+    }
+);
+
+#endif // defined(_WIN32)
+
+TEST(stub_vs_invoke64_timing,
+    // Compares the per-call cost of the generic invocation function
+    // (invoke64::basic() on Windows, sysv_invoke::basic() elsewhere) against a
+    // compiled stub. Only the results are asserted; timings are logged.
+    typedef std::chrono::high_resolution_clock clock;
+    constexpr int N = 1000000;
+    uint64_t a[] = { 1, 2, 3, 4, 5, 6 };
+    void * const f(reinterpret_cast<void *>(TestSumSixInt32s));
+    const invoke64_stub& stub(invoke64_stub::get(
+        stub_signature(sizeof(a), param_register_types(), UINT64)));
+    uint64_t sum_generic(0), sum_stub(0);
+    auto t0 = clock::now();
+    for (int k = 0; k < N; ++k)
+        sum_generic += generic_invoke::basic(sizeof(a), a, f);
+    auto t1 = clock::now();
+    for (int k = 0; k < N; ++k)
+        sum_stub += stub.call(a, f);
+    auto t2 = clock::now();
+    assert_equals(sum_generic, sum_stub);
+    log_timing(GENERIC_INVOKE_NAME, t1 - t0, N);
+    log_timing("invoke64_stub::call()", t2 - t1, N);
+);
+
+#endif // __NOTEST__
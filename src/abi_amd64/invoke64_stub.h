@@ -0,0 +1,155 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_INVOKE64_STUB_H___
+#define __INCLUDED_INVOKE64_STUB_H___
+
+/**
+ * \file invoke64_stub.h
+ * \author Victor Schappert
+ * \since 20140901
+ * \brief Per-signature compiled invocation stubs
+ */
+
+#include "stub_compiler64.h"
+
+namespace jsdi {
+namespace abi_amd64 {
+
+struct invoke64_stub_block;
+
+/**
+ * \brief Executable invocation stub compiled for one function signature
+ * \author Victor Schappert
+ * \since 20140901
+ * \see invoke64
+ * \see stub_compiler64
+ *
+ * The functions in \link invoke64\endlink work out at run time, on every call,
+ * how many arguments to pass and which registers to pass them in. Since the
+ * signature of a given <code>dll</code> function never changes, this work can
+ * be done once: an invocation stub is straight-line machine code that places
+ * the arguments of one particular \link stub_signature\endlink and calls the
+ * target function.
+ *
+ * Stubs are obtained from #get(const stub_signature&), which compiles each
+ * distinct signature once and caches the result for the lifetime of the
+ * process. Since the number of distinct signatures is small, stubs are not
+ * freed until the process exits. This means a stub pointer can be handed to
+ * Java as an opaque handle.
+ *
+ * \remark
+ * Like the functions in \link invoke64\endlink, the invocation functions of
+ * this class rethrow non-fatal structured exception handling exceptions as
+ * jsdi::seh_exception. On platforms other than Windows, the stubs are
+ * described to the unwinder so that C++ exceptions can propagate through them.
+ */
+class invoke64_stub : private non_copyable
+{
+        //
+        // DATA
+        //
+
+        stub_signature        d_signature;
+        invoke64_stub_block * d_block;
+
+        //
+        // CONSTRUCTORS
+        //
+
+        invoke64_stub(const stub_signature& signature);
+
+        friend struct invoke64_stub_cache;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the stub for the given signature, compiling it if
+         *        necessary
+         * \param signature Signature of the function(s) to be invoked
+         * \return Reference to a stub which remains valid for the lifetime of
+         *         the process
+         * \throws std::invalid_argument If <code>signature</code> is invalid
+         * \throws std::bad_alloc If executable memory for the stub cannot be
+         *         allocated
+         *
+         * This function is thread-safe.
+         */
+        static const invoke64_stub& get(const stub_signature& signature);
+
+        /**
+         * \brief Returns the number of distinct stubs compiled so far
+         * \return Number of stubs
+         */
+        static size_t count();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the signature this stub was compiled for
+         * \return Stub signature
+         */
+        const stub_signature& signature() const;
+
+        /**
+         * \brief Returns the address of the first stub instruction
+         * \return Stub code address
+         */
+        void * code_addr() const;
+
+        /**
+         * \brief Invokes a function whose return value is not floating-point
+         * \param args_ptr Pointer to the arguments, which must meet the
+         *        criteria described in the documentation for
+         *        \link invoke64::basic(size_t, const void *, void *)\endlink
+         *        and contain exactly <code>signature().args_size_bytes</code>
+         *        bytes
+         * \param func_ptr Pointer to the function to invoke, which must have a
+         *        signature matching #signature() const
+         * \return Value returned by <code>func_ptr</code>
+         * \throws jsdi::seh_exception If a structured exception handling
+         *         exception occurs during the invocation
+         * \see #return_double(const void *, void *) const
+         * \see #return_float(const void *, void *) const
+         */
+        uint64_t call(const void * args_ptr, void * func_ptr) const;
+
+        /**
+         * \brief Invokes a function whose return type is <code>double</code>
+         * \param args_ptr Pointer to the arguments
+         * \param func_ptr Pointer to the function to invoke
+         * \return Value returned by <code>func_ptr</code>
+         * \throws jsdi::seh_exception If a structured exception handling
+         *         exception occurs during the invocation
+         * \see #call(const void *, void *) const
+         */
+        double return_double(const void * args_ptr, void * func_ptr) const;
+
+        /**
+         * \brief Invokes a function whose return type is <code>float</code>
+         * \param args_ptr Pointer to the arguments
+         * \param func_ptr Pointer to the function to invoke
+         * \return Value returned by <code>func_ptr</code>
+         * \throws jsdi::seh_exception If a structured exception handling
+         *         exception occurs during the invocation
+         * \see #call(const void *, void *) const
+         */
+        float return_float(const void * args_ptr, void * func_ptr) const;
+};
+
+inline const stub_signature& invoke64_stub::signature() const
+{ return d_signature; }
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_INVOKE64_STUB_H___
@@ -0,0 +1,110 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_JSDI_CALLBACK64_H___
+#define __INCLUDED_JSDI_CALLBACK64_H___
+
+/**
+ * \file jsdi_callback64.h
+ * \author Victor Schappert
+ * \since 20140801
+ * \brief Fast callbacks which decode their register parameters according to
+ *        the amd64 ABI
+ */
+
+#include "jsdi_callback.h"
+
+#include "register64.h"
+
+namespace jsdi {
+namespace abi_amd64 {
+
+//==============================================================================
+//                        struct jsdi_callback_fast
+//==============================================================================
+
+/**
+ * \brief Fast callback for a limited class of situations
+ * \author Victor Schappert
+ * \since 20140801
+ * \see jsdi_callback_direct
+ * \see param_register_types
+ * \tparam N Number of parameters, from 0 to #MAX_FAST_CALLBACK_PARAMS
+ * \tparam RegisterTypes Encoding, as returned by
+ *         param_register_types::encoding(), of the types of the
+ *         parameters passed in registers, or 0 if none of them is a
+ *         <code>float</code>
+ *
+ * This callback may be used when each JSDI parameter type can be marshalled out
+ * of a 64-bit value provided by the caller and no parameter type uses indirect
+ * storage. Each parameter is passed to Java in a <code>long</code>, so a
+ * <code>double</code> or <code>float</code> parameter is passed as its raw
+ * bits. The callback calls the Java method
+ * <code>Callback.invoke</code><em>N</em>, which has one <code>long</code>
+ * parameter for each parameter of the callback.
+ *
+ * A <code>float</code> passed in a register only occupies the low 32 bits of
+ * its slot in the argument array, so the high bits of any register parameter
+ * which <code>RegisterTypes</code> says is a <code>float</code> are cleared
+ * before it is passed to Java.
+ */
+template<int N, uint32_t RegisterTypes>
+struct jsdi_callback_fast : public jsdi_callback_base
+{
+        static_assert(0 <= N && N <= MAX_FAST_CALLBACK_PARAMS,
+                      "too many parameters for a fast callback");
+
+        /**
+         * \brief Constructs a fast callback
+         * \param env Non-NULL pointer to the JNI environment for the current
+         *        thread
+         * \param suneido_callback Non-NULL reference to a Java
+         *        <code>Object</code> of type
+         *        <code>suneido.jsdi.type.Callback</code> (the Java entry-point
+         *        to be invoked when this C++ callback is called)
+         * \param suneido_bound_value Non-NULL reference to a Java
+         *        <code>Object</code> of type
+         *        <code>suneido.language.SuCallable</code> representing the
+         *        Suneido language callable value that is bound to the callback
+         *        (this is the code that is ultimately desired to be called by
+         *        the Suneido programmer)
+         * \param size_direct Size of the on-stack arguments:
+         *        <code>0 &le; size_direct &le; N *
+         *        sizeof(</code>\link marshall_word_t\endlink<code>)</code>
+         */
+        jsdi_callback_fast(JNIEnv * env, jobject suneido_callback,
+                           jobject suneido_bound_value, jint size_direct);
+
+        virtual uint64_t call(marshall_word_t const * args);
+};
+
+template<int N, uint32_t RegisterTypes>
+inline jsdi_callback_fast<N, RegisterTypes>::jsdi_callback_fast(
+    JNIEnv * env, jobject suneido_callback, jobject suneido_bound_value,
+    jint size_direct)
+    : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
+                         size_direct, N)
+{ }
+
+template<int N, uint32_t RegisterTypes>
+uint64_t jsdi_callback_fast<N, RegisterTypes>::call(
+    marshall_word_t const * args)
+{
+    jvalue out_args[N + 1]; // out_args[0] is filled in by call_fast()
+    for (int k = 0; k < N; ++k)
+    {
+        uint32_t const type(static_cast<size_t>(k) < NUM_PARAM_REGISTERS
+            ? (RegisterTypes >> (030 - 010 * k)) & 0xffu
+            : static_cast<uint32_t>(UINT64));
+        out_args[k + 1].j = FLOAT == type
+            ? static_cast<jlong>(static_cast<uint32_t>(args[k]))
+            : args[k];
+    }
+    return call_fast(N, out_args);
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_JSDI_CALLBACK64_H___
@@ -13,6 +13,7 @@
  */
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 
 namespace jsdi {
@@ -130,6 +131,14 @@ class param_register_types
          *          param_register_type#DOUBLE or param_register_type#FLOAT
          */
         bool has_fp() const;
+
+        /**
+         * \brief Returns the encoded value of all four register types
+         * \return Encoding suitable for passing to
+         *         #param_register_types(uint32_t)
+         * \since 20140901
+         */
+        uint32_t encoding() const;
 };
 
 inline param_register_types::param_register_types(param_register_type param0,
@@ -166,6 +175,9 @@ inline param_register_type param_register_types::operator[](
 inline bool param_register_types::has_fp() const
 { return 0 < d_data; }
 
+inline uint32_t param_register_types::encoding() const
+{ return d_data; }
+
 } // namespace abi_amd64
 } // namespace jsdi
  
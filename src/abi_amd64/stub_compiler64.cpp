@@ -0,0 +1,391 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: stub_compiler64.cpp
+// auth: Victor Schappert
+// date: 20140901
+// desc: Generates machine code for x64 invocation stubs
+//==============================================================================
+
+#include "stub_compiler64.h"
+
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+#include <stdexcept>
+
+namespace jsdi {
+namespace abi_amd64 {
+
+//==============================================================================
+//                                INTERNALS
+//==============================================================================
+
+namespace {
+
+enum
+{
+    SYSV_NUM_INT_REGISTERS = 6,
+    SYSV_NUM_SSE_REGISTERS = 8,
+};
+
+// All memory operands below use the [base+disp32] form so that every
+// instruction of a given kind has the same length regardless of the offset.
+
+constexpr uint8_t CODE_SUB_RSP_IMM32[]   = { 0x48, 0x81, 0xec };    // sub  rsp, imm32
+constexpr uint8_t CODE_ADD_RSP_IMM32[]   = { 0x48, 0x81, 0xc4 };    // add  rsp, imm32
+constexpr uint8_t CODE_LOAD_R10[]        = { 0x4d, 0x8b, 0x93 };    // mov  r10, [r11+disp32]
+constexpr uint8_t CODE_STORE_R10[]       = { 0x4c, 0x89, 0x94, 0x24 };
+                                                                    // mov  [rsp+disp32], r10
+constexpr uint8_t CODE_RET               =   0xc3;                  // ret
+
+// Windows x64 specific instructions
+constexpr uint8_t CODE_WIN_X64_ENTRY[]   =
+{
+    0x49, 0x89, 0xcb,                                               // mov  r11, rcx
+    0x48, 0x89, 0xd0,                                               // mov  rax, rdx
+};
+constexpr uint8_t CODE_WIN_X64_CALL[]    = { 0xff, 0xd0 };          // call rax
+
+constexpr uint8_t CODE_WIN_X64_LOAD_INT[NUM_PARAM_REGISTERS][3] =
+{
+    { 0x49, 0x8b, 0x8b },                                           // mov  rcx, [r11+disp32]
+    { 0x49, 0x8b, 0x93 },                                           // mov  rdx, [r11+disp32]
+    { 0x4d, 0x8b, 0x83 },                                           // mov  r8,  [r11+disp32]
+    { 0x4d, 0x8b, 0x8b },                                           // mov  r9,  [r11+disp32]
+};
+
+// System V specific instructions
+constexpr uint8_t CODE_SYSV_ENTRY[]      =
+{
+    0x53,                                                           // push rbx
+    0x48, 0x89, 0xf3,                                               // mov  rbx, rsi
+    0x49, 0x89, 0xfb,                                               // mov  r11, rdi
+};
+constexpr uint8_t CODE_SYSV_MOV_EAX_IMM32 = 0xb8;                   // mov  eax, imm32
+constexpr uint8_t CODE_SYSV_CALL[]       = { 0xff, 0xd3 };          // call rbx
+constexpr uint8_t CODE_SYSV_POP_RBX      =   0x5b;                  // pop  rbx
+
+constexpr uint8_t CODE_SYSV_LOAD_INT[SYSV_NUM_INT_REGISTERS][3] =
+{
+    { 0x49, 0x8b, 0xbb },                                           // mov  rdi, [r11+disp32]
+    { 0x49, 0x8b, 0xb3 },                                           // mov  rsi, [r11+disp32]
+    { 0x49, 0x8b, 0x93 },                                           // mov  rdx, [r11+disp32]
+    { 0x49, 0x8b, 0x8b },                                           // mov  rcx, [r11+disp32]
+    { 0x4d, 0x8b, 0x83 },                                           // mov  r8,  [r11+disp32]
+    { 0x4d, 0x8b, 0x8b },                                           // mov  r9,  [r11+disp32]
+};
+
+// movsd/movss xmmN, [r11+disp32] => <prefix> 0x41 0x0f 0x10 <modrm> disp32
+constexpr uint8_t PREFIX_MOVSD          = 0xf2;
+constexpr uint8_t PREFIX_MOVSS          = 0xf3;
+constexpr uint8_t MODRM_XMM_R11_DISP32  = 0x83;
+
+struct emitter
+{
+    std::vector<uint8_t>& d_code;
+    emitter(std::vector<uint8_t>& code) : d_code(code) { }
+    template<size_t N>
+    void bytes(const uint8_t (& b)[N])
+    { d_code.insert(d_code.end(), b, b + N); }
+    void byte(uint8_t b)
+    { d_code.push_back(b); }
+    void imm32(uint32_t x)
+    {
+        for (int k = 0; k < 4; ++k, x >>= 010)
+            d_code.push_back(static_cast<uint8_t>(x & 0xffu));
+    }
+    void copy_to_stack(size_t arg_offset, size_t stack_offset)
+    {
+        bytes(CODE_LOAD_R10);
+        imm32(static_cast<uint32_t>(arg_offset));
+        bytes(CODE_STORE_R10);
+        imm32(static_cast<uint32_t>(stack_offset));
+    }
+    void load_sse(param_register_type type, size_t xmm, size_t arg_offset)
+    {
+        assert(DOUBLE == type || FLOAT == type);
+        byte(DOUBLE == type ? PREFIX_MOVSD : PREFIX_MOVSS);
+        byte(0x41);
+        byte(0x0f);
+        byte(0x10);
+        byte(static_cast<uint8_t>(MODRM_XMM_R11_DISP32 | (xmm << 3)));
+        imm32(static_cast<uint32_t>(arg_offset));
+    }
+};
+
+inline size_t align16(size_t x)
+{ return (x + 15) & ~static_cast<size_t>(15); }
+
+inline param_register_type arg_type(const stub_signature& signature, size_t k)
+{ return k < NUM_PARAM_REGISTERS ? signature.register_types[k] : UINT64; }
+
+void validate(const stub_signature& signature)
+{
+    if (0 != signature.args_size_bytes % 8 ||
+        stub_compiler64::MAX_ARGS_SIZE_BYTES < signature.args_size_bytes)
+    {
+        std::ostringstream() << "invalid stub argument size: "
+                             << signature.args_size_bytes
+                             << throw_cpp<std::invalid_argument>();
+    }
+}
+
+// Number of 8-byte arguments a System V stub must place on the stack
+size_t sysv_num_stack_args(const stub_signature& signature)
+{
+    const size_t num_args(signature.args_size_bytes / 8);
+    size_t num_int(0), num_sse(0), num_stack(0);
+    for (size_t k = 0; k < num_args; ++k)
+    {
+        if (UINT64 == arg_type(signature, k))
+        {
+            if (num_int < SYSV_NUM_INT_REGISTERS) ++num_int;
+            else ++num_stack;
+        }
+        else if (num_sse < SYSV_NUM_SSE_REGISTERS) ++num_sse;
+        else ++num_stack;
+    }
+    return num_stack;
+}
+
+size_t compile_win_x64(const stub_signature& signature, emitter& e)
+{
+    // Prologue. On entry, rsp is 8 mod 16. The frame size is 8 mod 16 so that
+    // rsp is 16-byte aligned at the point of the call.
+    const size_t frame(stub_compiler64::frame_size(WIN_X64, signature));
+    e.bytes(CODE_SUB_RSP_IMM32);
+    e.imm32(static_cast<uint32_t>(frame));
+    const size_t prologue_size(e.d_code.size());
+    // Body
+    e.bytes(CODE_WIN_X64_ENTRY);
+    const size_t num_args(signature.args_size_bytes / 8);
+    for (size_t k = NUM_PARAM_REGISTERS; k < num_args; ++k)
+        e.copy_to_stack(8 * k, 8 * k);
+    for (size_t k = 0; k < std::min(num_args, NUM_PARAM_REGISTERS); ++k)
+    {
+        const param_register_type type(signature.register_types[k]);
+        if (UINT64 == type)
+        {
+            e.bytes(CODE_WIN_X64_LOAD_INT[k]);
+            e.imm32(static_cast<uint32_t>(8 * k));
+        }
+        else e.load_sse(type, k, 8 * k);
+    }
+    e.bytes(CODE_WIN_X64_CALL);
+    // Epilogue
+    e.bytes(CODE_ADD_RSP_IMM32);
+    e.imm32(static_cast<uint32_t>(frame));
+    e.byte(CODE_RET);
+    return prologue_size;
+}
+
+size_t compile_sysv(const stub_signature& signature, emitter& e)
+{
+    // Prologue. On entry, rsp is 8 mod 16. Pushing rbx makes it 16-byte
+    // aligned, and the frame size is a multiple of 16.
+    const size_t frame(stub_compiler64::frame_size(SYSV, signature));
+    e.bytes(CODE_SYSV_ENTRY);
+    e.bytes(CODE_SUB_RSP_IMM32);
+    e.imm32(static_cast<uint32_t>(frame - 8));
+    const size_t prologue_size(e.d_code.size());
+    // Body: classify each argument and load it into the next free register of
+    // its class, or the next stack slot if the class is exhausted.
+    const size_t num_args(signature.args_size_bytes / 8);
+    size_t num_int(0), num_sse(0), num_stack(0);
+    for (size_t k = 0; k < num_args; ++k)
+    {
+        const param_register_type type(arg_type(signature, k));
+        if (UINT64 == type && num_int < SYSV_NUM_INT_REGISTERS)
+        {
+            e.bytes(CODE_SYSV_LOAD_INT[num_int++]);
+            e.imm32(static_cast<uint32_t>(8 * k));
+        }
+        else if (UINT64 != type && num_sse < SYSV_NUM_SSE_REGISTERS)
+            e.load_sse(type, num_sse++, 8 * k);
+        else
+            e.copy_to_stack(8 * k, 8 * num_stack++);
+    }
+    // Variadic callees expect an upper bound on the number of SSE registers
+    // used in al.
+    e.byte(CODE_SYSV_MOV_EAX_IMM32);
+    e.imm32(static_cast<uint32_t>(num_sse));
+    e.bytes(CODE_SYSV_CALL);
+    // Epilogue
+    e.bytes(CODE_ADD_RSP_IMM32);
+    e.imm32(static_cast<uint32_t>(frame - 8));
+    e.byte(CODE_SYSV_POP_RBX);
+    e.byte(CODE_RET);
+    return prologue_size;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                          struct stub_compiler64
+//==============================================================================
+
+size_t stub_compiler64::compile(stub_abi abi, const stub_signature& signature,
+                                std::vector<uint8_t>& code)
+{
+    validate(signature);
+    emitter e(code);
+    switch (abi)
+    {
+        case WIN_X64:
+            return compile_win_x64(signature, e);
+        case SYSV:
+            return compile_sysv(signature, e);
+        default:
+            assert(!"control should never pass here");
+            return 0;
+    }
+}
+
+size_t stub_compiler64::frame_size(stub_abi abi,
+                                   const stub_signature& signature)
+{
+    switch (abi)
+    {
+        case WIN_X64:
+        {
+            // Stack arguments plus 32 bytes of homespace for the callee
+            const size_t num_args(std::max(signature.args_size_bytes / 8,
+                                           NUM_PARAM_REGISTERS));
+            return align16(8 * num_args) + 8;
+        }
+        case SYSV:
+            // Saved rbx plus the stack arguments
+            return align16(8 * sysv_num_stack_args(signature)) + 8;
+        default:
+            assert(!"control should never pass here");
+            return 0;
+    }
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+using namespace jsdi::abi_amd64;
+
+namespace {
+
+std::vector<uint8_t> compile(stub_abi abi, size_t args_size_bytes,
+                             param_register_types register_types)
+{
+    std::vector<uint8_t> code;
+    stub_compiler64::compile(abi,
+                             stub_signature(args_size_bytes, register_types,
+                                            UINT64),
+                             code);
+    return code;
+}
+
+} // anonymous namespace
+
+TEST(stub_win_x64_noargs,
+    std::vector<uint8_t> code(compile(WIN_X64, 0, param_register_types()));
+    const uint8_t expected[] =
+    {
+        0x48, 0x81, 0xec, 0x28, 0x00, 0x00, 0x00,   // sub  rsp, 40
+        0x49, 0x89, 0xcb,                           // mov  r11, rcx
+        0x48, 0x89, 0xd0,                           // mov  rax, rdx
+        0xff, 0xd0,                                 // call rax
+        0x48, 0x81, 0xc4, 0x28, 0x00, 0x00, 0x00,   // add  rsp, 40
+        0xc3                                        // ret
+    };
+    assert_equals(sizeof(expected), code.size());
+    assert_true(std::equal(code.begin(), code.end(), expected));
+);
+
+TEST(stub_win_x64_mixed,
+    std::vector<uint8_t> code(
+        compile(WIN_X64, 40, param_register_types(UINT64, DOUBLE, FLOAT,
+                                                  UINT64)));
+    const uint8_t expected[] =
+    {
+        0x48, 0x81, 0xec, 0x38, 0x00, 0x00, 0x00,   // sub   rsp, 56
+        0x49, 0x89, 0xcb,                           // mov   r11, rcx
+        0x48, 0x89, 0xd0,                           // mov   rax, rdx
+        0x4d, 0x8b, 0x93, 0x20, 0x00, 0x00, 0x00,   // mov   r10, [r11+32]
+        0x4c, 0x89, 0x94, 0x24, 0x20, 0x00, 0x00, 0x00,
+                                                    // mov   [rsp+32], r10
+        0x49, 0x8b, 0x8b, 0x00, 0x00, 0x00, 0x00,   // mov   rcx, [r11+0]
+        0xf2, 0x41, 0x0f, 0x10, 0x8b, 0x08, 0x00, 0x00, 0x00,
+                                                    // movsd xmm1, [r11+8]
+        0xf3, 0x41, 0x0f, 0x10, 0x93, 0x10, 0x00, 0x00, 0x00,
+                                                    // movss xmm2, [r11+16]
+        0x4d, 0x8b, 0x8b, 0x18, 0x00, 0x00, 0x00,   // mov   r9, [r11+24]
+        0xff, 0xd0,                                 // call  rax
+        0x48, 0x81, 0xc4, 0x38, 0x00, 0x00, 0x00,   // add   rsp, 56
+        0xc3                                        // ret
+    };
+    assert_equals(sizeof(expected), code.size());
+    assert_true(std::equal(code.begin(), code.end(), expected));
+);
+
+TEST(stub_sysv_mixed,
+    std::vector<uint8_t> code(
+        compile(SYSV, 16, param_register_types(DOUBLE, UINT64, UINT64,
+                                               UINT64)));
+    const uint8_t expected[] =
+    {
+        0x53,                                       // push  rbx
+        0x48, 0x89, 0xf3,                           // mov   rbx, rsi
+        0x49, 0x89, 0xfb,                           // mov   r11, rdi
+        0x48, 0x81, 0xec, 0x00, 0x00, 0x00, 0x00,   // sub   rsp, 0
+        0xf2, 0x41, 0x0f, 0x10, 0x83, 0x00, 0x00, 0x00, 0x00,
+                                                    // movsd xmm0, [r11+0]
+        0x49, 0x8b, 0xbb, 0x08, 0x00, 0x00, 0x00,   // mov   rdi, [r11+8]
+        0xb8, 0x01, 0x00, 0x00, 0x00,               // mov   eax, 1
+        0xff, 0xd3,                                 // call  rbx
+        0x48, 0x81, 0xc4, 0x00, 0x00, 0x00, 0x00,   // add   rsp, 0
+        0x5b,                                       // pop   rbx
+        0xc3                                        // ret
+    };
+    assert_equals(sizeof(expected), code.size());
+    assert_true(std::equal(code.begin(), code.end(), expected));
+);
+
+TEST(stub_frame_size,
+    param_register_types const r;
+    assert_equals(40u, stub_compiler64::frame_size(WIN_X64,
+                                                   stub_signature(0, r,
+                                                                  UINT64)));
+    assert_equals(40u, stub_compiler64::frame_size(WIN_X64,
+                                                   stub_signature(32, r,
+                                                                  UINT64)));
+    assert_equals(56u, stub_compiler64::frame_size(WIN_X64,
+                                                   stub_signature(40, r,
+                                                                  UINT64)));
+    assert_equals(8u, stub_compiler64::frame_size(SYSV,
+                                                  stub_signature(48, r,
+                                                                 UINT64)));
+    assert_equals(24u, stub_compiler64::frame_size(SYSV,
+                                                   stub_signature(56, r,
+                                                                  UINT64)));
+    assert_equals(24u, stub_compiler64::frame_size(SYSV,
+                                                   stub_signature(64, r,
+                                                                  UINT64)));
+);
+
+TEST(stub_invalid_size,
+    bool caught(false);
+    try
+    { compile(WIN_X64, 12, param_register_types()); }
+    catch (const std::invalid_argument&)
+    { caught = true; }
+    assert_true(caught);
+);
+
+#endif // __NOTEST__
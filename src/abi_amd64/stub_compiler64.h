@@ -0,0 +1,167 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_STUB_COMPILER64_H___
+#define __INCLUDED_STUB_COMPILER64_H___
+
+/**
+ * \file stub_compiler64.h
+ * \author Victor Schappert
+ * \since 20140901
+ * \brief Generates straight-line x64 machine code which invokes a function
+ *        having a fixed signature
+ */
+
+#include "register64.h"
+#include "util.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace jsdi {
+namespace abi_amd64 {
+
+/**
+ * \brief Enumerates the x64 calling conventions for which
+ *        \link stub_compiler64\endlink can generate code
+ */
+enum stub_abi
+{
+    /** \brief Microsoft Windows x64 calling convention */
+    WIN_X64 = 0x0,
+    /** \brief System V AMD64 calling convention (Linux, BSD, <em>etc.</em>) */
+    SYSV    = 0x1,
+};
+
+/**
+ * \brief The calling convention that is native to the platform being compiled
+ *        for
+ */
+#if defined(_WIN64)
+constexpr stub_abi NATIVE_STUB_ABI = WIN_X64;
+#else
+constexpr stub_abi NATIVE_STUB_ABI = SYSV;
+#endif
+
+/**
+ * \brief Signature of a function invoked through a compiled invocation stub
+ * \author Victor Schappert
+ * \since 20140901
+ * \see stub_compiler64
+ *
+ * Two functions whose signatures compare equal can be invoked through the
+ * same stub.
+ */
+struct stub_signature
+{
+        //
+        // DATA
+        //
+
+        /** \brief Size of the direct argument block, in bytes */
+        size_t               args_size_bytes;
+        /** \brief Register types of the first four parameters */
+        param_register_types register_types;
+        /** \brief Register type of the return value */
+        param_register_type  return_type;
+
+        //
+        // CONSTRUCTORS
+        //
+
+        /**
+         * \brief Constructs a signature
+         * \param args_size_bytes_ Size of the direct arguments, in bytes
+         *        <em>must be a multiple of 8</em>
+         * \param register_types_ Register types of the first four parameters
+         * \param return_type_ Register type of the return value
+         */
+        stub_signature(size_t args_size_bytes_,
+                       param_register_types register_types_,
+                       param_register_type return_type_);
+
+        //
+        // ACCESSORS
+        //
+
+        /**
+         * \brief Returns a unique 64-bit key for this signature
+         * \return Key which is equal for two signatures if, and only if, the
+         *         signatures are equal
+         */
+        uint64_t key() const;
+};
+
+inline stub_signature::stub_signature(size_t args_size_bytes_,
+                                      param_register_types register_types_,
+                                      param_register_type return_type_)
+    : args_size_bytes(args_size_bytes_)
+    , register_types(register_types_)
+    , return_type(return_type_)
+{ }
+
+inline uint64_t stub_signature::key() const
+{
+    return static_cast<uint64_t>(args_size_bytes) << 042 |
+           static_cast<uint64_t>(register_types.encoding()) << 2 |
+           static_cast<uint64_t>(return_type);
+}
+
+/**
+ * \brief Generates machine code for invocation stubs
+ * \author Victor Schappert
+ * \since 20140901
+ * \see invoke64_stub
+ *
+ * An invocation stub is a function with the "C" signature
+ * <code>uint64_t stub(const void * args_ptr, void * func_ptr)</code> which
+ * loads the arguments in <code>args_ptr</code> into the registers and stack
+ * slots dictated by a particular \link stub_signature\endlink and then calls
+ * <code>func_ptr</code>. Because the signature is known when the stub is
+ * generated, the stub contains no loops, jump tables, or branches.
+ *
+ * The stub leaves the invoked function's return value in <code>rax</code> or
+ * <code>xmm0</code>, so it may be called through a function pointer whose
+ * return type is <code>uint64_t</code>, <code>double</code>, or
+ * <code>float</code> as appropriate.
+ *
+ * The compiler itself is independent of the platform it runs on: it can
+ * generate code for either calling convention from \link stub_abi\endlink.
+ */
+struct stub_compiler64 : private non_instantiable
+{
+        enum : size_t
+        {
+            /**
+             * \brief Maximum size of the direct argument block, in bytes
+             */
+            MAX_ARGS_SIZE_BYTES = 0x10000
+        };
+
+        /**
+         * \brief Generates the code for an invocation stub
+         * \param abi Calling convention to generate code for
+         * \param signature Signature of the functions to be invoked by the stub
+         * \param code Vector to which the code bytes are appended
+         * \return Size of the stub's prologue, in bytes
+         * \throws std::invalid_argument If the signature's argument size is
+         *         not a multiple of 8 or is greater than #MAX_ARGS_SIZE_BYTES
+         */
+        static size_t compile(stub_abi abi, const stub_signature& signature,
+                              std::vector<uint8_t>& code);
+
+        /**
+         * \brief Returns the number of bytes by which a stub moves the stack
+         *        pointer in its prologue
+         * \param abi Calling convention of the stub
+         * \param signature Signature of the stub
+         * \return Stack frame size, in bytes, not including the return address
+         */
+        static size_t frame_size(stub_abi abi, const stub_signature& signature);
+};
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_STUB_COMPILER64_H___
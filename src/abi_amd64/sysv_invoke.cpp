@@ -0,0 +1,253 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: sysv_invoke.cpp
+// auth: Victor Schappert
+// date: 20140903
+// desc: System V AMD64 ABI invocation translation unit
+//==============================================================================
+
+#include "sysv_invoke.h"
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+namespace {
+
+// NOTE: The offsets of these members are hard-coded in sysv_invoke_ll.S.
+struct sysv_register_block
+{
+    uint64_t         int_regs[jsdi::abi_amd64::SYSV_NUM_INT_PARAM_REGISTERS];
+    uint64_t         sse_regs[jsdi::abi_amd64::SYSV_NUM_SSE_PARAM_REGISTERS];
+    uint64_t         num_sse;
+    uint64_t         num_stack;
+    const uint64_t * stack_args;
+};
+
+static_assert(std::is_standard_layout<sysv_register_block>::value,
+              "must be standard layout to pass to sysv_invoke_ll");
+static_assert(112 == offsetof(sysv_register_block, num_sse), "check asm");
+static_assert(120 == offsetof(sysv_register_block, num_stack), "check asm");
+static_assert(128 == offsetof(sysv_register_block, stack_args), "check asm");
+
+} // anonymous namespace
+
+extern "C" {
+
+uint64_t sysv_invoke_ll(const sysv_register_block * block, void * func_ptr);
+
+} // extern "C"
+
+namespace jsdi {
+namespace abi_amd64 {
+
+namespace {
+
+// Assigns the arguments to registers. Since only the first four parameters can
+// have a floating-point type, there are never more than four SSE arguments
+// and, once the general-purpose registers run out, every remaining argument
+// goes on the stack. So the stack arguments are always a contiguous tail of
+// 'args_ptr' and don't need to be copied anywhere.
+void classify(size_t args_size_bytes, const void * args_ptr,
+              param_register_types register_types, sysv_register_block& block)
+{
+    assert(0 == args_size_bytes % 8);
+    assert(args_ptr || 0 == args_size_bytes);
+    const uint64_t * args(static_cast<const uint64_t *>(args_ptr));
+    const size_t num_args(args_size_bytes / 8);
+    size_t num_int(0), k(0);
+    block.num_sse = 0;
+    for (; k < num_args; ++k)
+    {
+        param_register_type const type(
+            k < NUM_PARAM_REGISTERS ? register_types[k] : UINT64);
+        if (UINT64 != type)
+            block.sse_regs[block.num_sse++] = args[k];
+        else if (num_int < SYSV_NUM_INT_PARAM_REGISTERS)
+            block.int_regs[num_int++] = args[k];
+        else
+            break;
+    }
+    assert(k == num_args || NUM_PARAM_REGISTERS <= k ||
+           SYSV_NUM_INT_PARAM_REGISTERS == num_int);
+    block.num_stack = num_args - k;
+    block.stack_args = args + k;
+}
+
+// sysv_invoke_ll() leaves the callee's rax and xmm0 untouched, so it can be
+// called through a pointer whose return type is whichever register the callee
+// returns in. The cast goes through the generic function pointer type so the
+// compiler doesn't warn about the incompatible signature.
+template <typename ReturnType>
+ReturnType (*invoke_ll_returning())(const sysv_register_block *, void *)
+{
+    typedef void (*generic_func_ptr)();
+    typedef ReturnType (*func_ptr)(const sysv_register_block *, void *);
+    return reinterpret_cast<func_ptr>(
+        reinterpret_cast<generic_func_ptr>(sysv_invoke_ll));
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                             struct sysv_invoke
+//==============================================================================
+
+uint64_t sysv_invoke::basic(size_t args_size_bytes, const void * args_ptr,
+                            void * func_ptr)
+{ return fp(args_size_bytes, args_ptr, func_ptr, param_register_types()); }
+
+uint64_t sysv_invoke::fp(size_t args_size_bytes, const void * args_ptr,
+                         void * func_ptr, param_register_types register_types)
+{
+    sysv_register_block block;
+    classify(args_size_bytes, args_ptr, register_types, block);
+    return sysv_invoke_ll(&block, func_ptr);
+}
+
+double sysv_invoke::return_double(
+    size_t args_size_bytes, const void * args_ptr, void * func_ptr,
+    param_register_types register_types)
+{
+    sysv_register_block block;
+    classify(args_size_bytes, args_ptr, register_types, block);
+    return invoke_ll_returning<double>()(&block, func_ptr);
+}
+
+float sysv_invoke::return_float(
+    size_t args_size_bytes, const void * args_ptr, void * func_ptr,
+    param_register_types register_types)
+{
+    sysv_register_block block;
+    classify(args_size_bytes, args_ptr, register_types, block);
+    return invoke_ll_returning<float>()(&block, func_ptr);
+}
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#include "test64.h"
+
+#include <algorithm>
+
+using namespace jsdi::abi_amd64;
+using namespace jsdi::abi_amd64::test64;
+
+TEST(sysv_basic_int32,
+    constexpr size_t N = 9;
+    // NOTE: GCC, unlike Visual C++, won't implicitly convert a function
+    //       pointer to void *.
+    void * f[] =
+    {
+        reinterpret_cast<void *>(TestInt32),
+        reinterpret_cast<void *>(TestSumTwoInt32s),
+        reinterpret_cast<void *>(TestSumThreeInt32s),
+        reinterpret_cast<void *>(TestSumFourInt32s),
+        reinterpret_cast<void *>(TestSumFiveInt32s),
+        reinterpret_cast<void *>(TestSumSixInt32s),
+        reinterpret_cast<void *>(TestSumSevenInt32s),
+        reinterpret_cast<void *>(TestSumEightInt32s),
+        reinterpret_cast<void *>(TestSumNineInt32s)
+    };
+    uint64_t a[N];
+    for (size_t i = 0; i < N; ++i)
+    {
+        int32_t sum(0);
+        for (size_t j = 0; j <= i; ++j)
+        {
+            a[j] = i + j;
+            sum += static_cast<int32_t>(a[j]);
+        }
+        int32_t result = static_cast<int32_t>(
+            sysv_invoke::basic((i + 1) * sizeof(uint64_t), a, f[i]));
+        assert_equals(sum, result);
+    }
+);
+
+TEST(sysv_fp_comprehensive,
+    std::vector<uint64_t> args;
+    std::for_each(
+        test64::FP_FUNCTIONS.begin, test64::FP_FUNCTIONS.end,
+        [this, &args](auto f)
+        {
+            // The register types only describe four parameters, so functions
+            // with a floating-point parameter beyond the fourth can't be
+            // invoked correctly under System V.
+            if (std::any_of(f->func.arg_types.begin() +
+                                std::min(f->func.nargs, NUM_PARAM_REGISTERS),
+                            f->func.arg_types.end(),
+                            [](param_register_type t) { return UINT64 != t; }))
+                return;
+            size_t sum(0);
+            args.resize(std::max(f->func.nargs, size_t(1)));
+            for (size_t i = 0; i < f->func.nargs; ++i)
+            {
+                sum += i;
+                switch (f->func.arg_types[i])
+                {
+                    case param_register_type::UINT64:
+                        args[i] = static_cast<uint64_t>(i);
+                        break;
+                    case param_register_type::DOUBLE:
+                        assert_true(copy_to(static_cast<double>(i), &args[i], 1));
+                        break;
+                    case param_register_type::FLOAT:
+                        assert_true(copy_to(static_cast<float>(i), &args[i], 1));
+                        break;
+                    default:
+                        assert(false || !"control should never pass here");
+                }
+            } // for(args)
+            uint64_t result = sysv_invoke::fp(f->func.nargs * sizeof(uint64_t),
+                                              &args[0], f->func.ptr,
+                                              f->func.register_types);
+            assert_equals(sum, result);
+        } // lambda
+    ); // std::for_each(FP_FUNCTIONS)
+);
+
+TEST(sysv_return_double,
+    uint64_t args[2];
+    assert_true(copy_to(-2300.5, &args[0], 1));
+    assert_true(copy_to(-2.0, &args[1], 1));
+    param_register_types rt(DOUBLE, DOUBLE, UINT64, UINT64);
+    assert_equals(
+        1.0,
+        sysv_invoke::return_double(
+            0, args, reinterpret_cast<void *>(TestReturn1_0Double), rt));
+    assert_equals(
+        -2302.5,
+        sysv_invoke::return_double(
+            2 * sizeof(uint64_t), args,
+            reinterpret_cast<void *>(TestSumTwoDoubles), rt));
+);
+
+TEST(sysv_return_float,
+    uint64_t args[2];
+    assert_true(copy_to(10.0f, &args[0], 1));
+    assert_true(copy_to(-1.0f, &args[1], 1));
+    param_register_types rt(FLOAT, FLOAT, UINT64, UINT64);
+    assert_equals(
+        1.0f,
+        sysv_invoke::return_float(
+            0, args, reinterpret_cast<void *>(TestReturn1_0Float), rt));
+    assert_equals(
+        9.0f,
+        sysv_invoke::return_float(
+            2 * sizeof(uint64_t), args,
+            reinterpret_cast<void *>(TestSumTwoFloats), rt));
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,135 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_SYSV_INVOKE_H___
+#define __INCLUDED_SYSV_INVOKE_H___
+
+/**
+ * \file sysv_invoke.h
+ * \author Victor Schappert
+ * \since 20140903
+ * \brief Generic system for invoking functions according to the System V
+ *        AMD64 ABI
+ */
+
+#include "register64.h"
+#include "util.h"
+
+#include <cstdint>
+
+namespace jsdi {
+namespace abi_amd64 {
+
+/**
+ * \brief Number of general-purpose registers used for parameter passing in the
+ *        System V AMD64 ABI
+ *
+ * The registers are, in order: <code>rdi</code>, <code>rsi</code>,
+ * <code>rdx</code>, <code>rcx</code>, <code>r8</code>, <code>r9</code>.
+ */
+constexpr size_t SYSV_NUM_INT_PARAM_REGISTERS = 6;
+
+/**
+ * \brief Number of SSE registers used for parameter passing in the System V
+ *        AMD64 ABI
+ *
+ * The registers are <code>xmm0</code> through <code>xmm7</code>.
+ */
+constexpr size_t SYSV_NUM_SSE_PARAM_REGISTERS = 8;
+
+/**
+ * \brief Contains generic functions for invoking other functions using the
+ *        System V AMD64 ABI.
+ * \author Victor Schappert
+ * \since 20140903
+ * \see invoke64
+ *
+ * This structure has the same interface as \link invoke64\endlink, and the
+ * arguments are given to it in the same form: a block of 8-byte words in
+ * left-to-right order along with the \link param_register_types\endlink of the
+ * first four parameters. Each argument is assigned to the next free
+ * general-purpose or SSE register, according to its type, and once the
+ * registers of a type are exhausted, to the stack. Parameters after the fourth
+ * are always treated as param_register_type#UINT64 because the register types
+ * encoding only describes four parameters.
+ *
+ * On platforms using the System V ABI, \link invoke64\endlink forwards to the
+ * functions in this structure.
+ *
+ * \remark
+ * There is no structured exception handling on System V platforms, so unlike
+ * \link invoke64\endlink, these functions do not convert faults in the invoked
+ * function into C++ exceptions.
+ */
+struct sysv_invoke : private non_instantiable
+{
+        /**
+         * \brief Invokes a function none of whose first four parameters or
+         *        return value has a floating-point type
+         * \param args_size_bytes Size of the arguments pointed-to by
+         *                        <code>args_ptr</code> <em>must be a multiple
+         *                        of 8</em>
+         * \param args_ptr Pointer to the arguments <em>must be 8-byte
+         *                 aligned</em>, may be <code>null</code> <em>only</em>
+         *                 if <code>args_size_bytes</code> is 0
+         * \param func_ptr Pointer to the function to call
+         * \see invoke64::basic(size_t, const void *, void *)
+         */
+        static uint64_t basic(size_t args_size_bytes, const void * args_ptr,
+                              void * func_ptr);
+
+        /**
+         * \brief Invokes a function which may have floating-point parameters
+         *        but does not return a floating-point value
+         * \param args_size_bytes Size of the arguments pointed-to by
+         *                        <code>args_ptr</code> <em>must be a multiple
+         *                        of 8</em>
+         * \param args_ptr Pointer to the arguments
+         * \param func_ptr Pointer to the function to call
+         * \param register_types Register types required for the first four
+         *        parameters
+         * \see invoke64::fp(size_t, const void *, void *, param_register_types)
+         */
+        static uint64_t fp(size_t args_size_bytes, const void * args_ptr,
+                           void * func_ptr,
+                           param_register_types register_types);
+
+        /**
+         * \brief Invokes a function whose return type is <code>double</code>
+         * \param args_size_bytes Size of the arguments pointed-to by
+         *                        <code>args_ptr</code> <em>must be a multiple
+         *                        of 8</em>
+         * \param args_ptr Pointer to the arguments
+         * \param func_ptr Pointer to the function to call
+         * \param register_types Register types required for the first four
+         *        parameters
+         * \see invoke64::return_double(size_t, const void *, void *,
+         *                              param_register_types)
+         */
+        static double return_double(
+            size_t args_size_bytes, const void * args_ptr, void * func_ptr,
+            param_register_types register_types);
+
+        /**
+         * \brief Invokes a function whose return type is <code>float</code>
+         * \param args_size_bytes Size of the arguments pointed-to by
+         *                        <code>args_ptr</code> <em>must be a multiple
+         *                        of 8</em>
+         * \param args_ptr Pointer to the arguments
+         * \param func_ptr Pointer to the function to call
+         * \param register_types Register types required for the first four
+         *        parameters
+         * \see invoke64::return_float(size_t, const void *, void *,
+         *                             param_register_types)
+         */
+        static float return_float(
+            size_t args_size_bytes, const void * args_ptr, void * func_ptr,
+            param_register_types register_types);
+
+}; // struct sysv_invoke
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_SYSV_INVOKE_H___
@@ -18,6 +18,7 @@
 
 #include "register64.h"
 
+#include <cstring>
 #include <vector>
 
 namespace jsdi {
@@ -12,12 +12,18 @@
 #include "thunk64.h"
 
 #include "callback.h"
+#include "epoch.h"
 #include "jsdi_windows.h"
 #include "log.h"
-#include "heap.h"
+#include "thunk_slab.h"
 
-#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <mutex>
 #include <sstream>
+#include <vector>
 
 namespace jsdi {
 namespace abi_amd64 {
@@ -31,91 +37,74 @@ namespace {
 enum
 {
     CODE_SIZE_PROLOGUE                  =  4,
-    CODE_SIZE_FIXED_BODY                = 21,
-    CODE_SIZE_EPILOGUE                  =  5,
-    CODE_SIZE_MAX_MOV_STACK             =  6,
-    CODE_SIZE_MAX_TOTAL                 = CODE_SIZE_PROLOGUE +
-                                          (NUM_PARAM_REGISTERS * CODE_SIZE_MAX_MOV_STACK) +
-                                          CODE_SIZE_FIXED_BODY +
-                                          CODE_SIZE_EPILOGUE,
-    
-    CODE_OFFSET_FIXED_BODY_IMPL_POINTER =  2,
-    CODE_OFFSET_FIXED_BODY_CALL_ADDR    = 17,
-    UNWIND_INFO_SIZE                    =  6,
-};
-
-struct mov_stack
-{
-    uint8_t  instruction[CODE_SIZE_MAX_MOV_STACK];
-    uint8_t  size_bytes;
-};
-
-constexpr uint8_t CODE_PROLOGUE[] =
-{
-   0x48, 0x83, 0xec, 0x28,                              // sub   rsp, 40
-};
-// NOTE: Only 32 bytes technically needed by the thunk code, but need to
-//       allocate 40 bytes instead to ensure we get the stack back to 16 bytes
-//       alignment.
-static_assert(sizeof(CODE_PROLOGUE) == CODE_SIZE_PROLOGUE, "check code");
-
-constexpr mov_stack CODE_MOV_STACK_TABLE[NUM_PARAM_REGISTER_TYPES]
-                                        [NUM_PARAM_REGISTERS] =
-{
-    { // uint64
-        { { 0x48, 0x89, 0x4c, 0x24, 0x30 }, 5 },        // mov   [rsp+48], rcx
-        { { 0x48, 0x89, 0x54, 0x24, 0x38 }, 5 },        // mov   [rsp+56], rdx
-        { { 0x4c, 0x89, 0x44, 0x24, 0x40 }, 5 },        // mov   [rsp+64], r8
-        { { 0x4c, 0x89, 0x4c, 0x24, 0x48 }, 5 },        // mov   [rsp+72], r9
-    },
-    { // double
-        { { 0xf2, 0x0f, 0x11, 0x44, 0x24, 0x30 }, 6 },  // movsd [rsp+48], xmm0
-        { { 0xf2, 0x0f, 0x11, 0x4c, 0x24, 0x38 }, 6 },  // movsd [rsp+56], xmm1
-        { { 0xf2, 0x0f, 0x11, 0x54, 0x24, 0x40 }, 6 },  // movsd [rsp+64], xmm2
-        { { 0xf2, 0x0f, 0x11, 0x5c, 0x24, 0x48 }, 6 },  // movsd [rsp+72], xmm3
-    },
-    { // float
-        { { 0xf3, 0x0f, 0x11, 0x44, 0x24, 0x30 }, 6 },  // movss [rsp+48], xmm0
-        { { 0xf3, 0x0f, 0x11, 0x4c, 0x24, 0x38 }, 6 },  // movss [rsp+56], xmm1
-        { { 0xf3, 0x0f, 0x11, 0x54, 0x24, 0x40 }, 6 },  // movss [rsp+64], xmm2
-        { { 0xf3, 0x0f, 0x11, 0x5c, 0x24, 0x48 }, 6 },  // movss [rsp+72], xmm3
-    }
+    CODE_SIZE_TOTAL                     = 81,
+    CODE_OFFSET_IMPL_DISP               = 51,
+    CODE_OFFSET_AFTER_IMPL_LOAD         = 55,
+    CODE_OFFSET_CALL_DISP               = 67,
+    CODE_OFFSET_AFTER_CALL              = 71,
+    CODE_OFFSET_UNWIND_INFO             = 88,
+    UNWIND_INFO_SIZE                    =  8,
+    CODE_SLOT_SIZE                      = 96,
+    DATA_SLOT_SIZE                      = 16,
 };
 
-constexpr uint8_t CODE_FIXED_BODY[] =
+// NOTE: The stub code is the same for every thunk, whatever its parameter
+//       types, because it lives on a read-execute page and is written exactly
+//       once, when its slab is created (see thunk_slab_allocator). So it spills
+//       both the general-purpose and the floating-point parameter registers,
+//       and the wrapper function works out which of the two to use for each
+//       parameter. Everything specific to a thunk is loaded from the stub's
+//       data slot using RIP-relative addressing.
+constexpr uint8_t CODE[] =
 {
-    0x48, 0xb9, 0x55, 0x55, 0x55, 0x55,                 // mov   rcx, 0x5555555555555555
-                0x55, 0x55, 0x55, 0x55,                 //    Placeholder for
-                                                        //    impl. address
-    0x48, 0x8d, 0x54, 0x24, 0x30,                       // lea   rdx, [rsp+48]
-    0xff, 0x15, 0x66, 0x66, 0x66, 0x66                  // callq [rip+0x66666666]
+    0x48, 0x83, 0xec, 0x48,                             // sub   rsp, 72
+    0x48, 0x89, 0x4c, 0x24, 0x50,                       // mov   [rsp+80], rcx
+    0x48, 0x89, 0x54, 0x24, 0x58,                       // mov   [rsp+88], rdx
+    0x4c, 0x89, 0x44, 0x24, 0x60,                       // mov   [rsp+96], r8
+    0x4c, 0x89, 0x4c, 0x24, 0x68,                       // mov   [rsp+104], r9
+    0xf2, 0x0f, 0x11, 0x44, 0x24, 0x20,                 // movsd [rsp+32], xmm0
+    0xf2, 0x0f, 0x11, 0x4c, 0x24, 0x28,                 // movsd [rsp+40], xmm1
+    0xf2, 0x0f, 0x11, 0x54, 0x24, 0x30,                 // movsd [rsp+48], xmm2
+    0xf2, 0x0f, 0x11, 0x5c, 0x24, 0x38,                 // movsd [rsp+56], xmm3
+    0x48, 0x8b, 0x0d, 0x55, 0x55, 0x55, 0x55,           // mov   rcx, [rip+0x55555555]
+                                                        //    Placeholder for
+                                                        //    RIP-relative addr.
+                                                        //    of impl. address
+    0x48, 0x8d, 0x54, 0x24, 0x50,                       // lea   rdx, [rsp+80]
+    0x4c, 0x8d, 0x44, 0x24, 0x20,                       // lea   r8, [rsp+32]
+    0xff, 0x15, 0x66, 0x66, 0x66, 0x66,                 // callq [rip+0x66666666]
                                                         //    Placeholder for
                                                         //    RIP-relative addr.
                                                         //    of wrapper addr.
+    0x66, 0x48, 0x0f, 0x6e, 0xc0,                       // movq  xmm0, rax
+    0x48, 0x83, 0xc4, 0x48,                             // add   rsp, 72
+    0xc3                                                // retq
 };
-static_assert(sizeof(CODE_FIXED_BODY) == CODE_SIZE_FIXED_BODY, "check code");
+// NOTE: The 72 bytes allocated on the stack are 32 bytes of home space for the
+//       wrapper, 32 bytes to spill the floating-point registers into, and 8
+//       bytes to get the stack back to 16-byte alignment.
+// NOTE: The wrapper returns the callback's result in rax. It is copied into
+//       xmm0 as well so that a callback returning a double or float, whose
+//       result is the raw bits of the floating-point value, returns it where
+//       the caller expects to find it. Since xmm0 is volatile, the copy does
+//       no harm when the caller expects an integer.
+static_assert(sizeof(CODE) == CODE_SIZE_TOTAL, "check code");
+static_assert(CODE_SIZE_TOTAL <= CODE_OFFSET_UNWIND_INFO, "check code");
+static_assert(CODE_OFFSET_UNWIND_INFO + UNWIND_INFO_SIZE <= CODE_SLOT_SIZE,
+              "check code");
 
 #if !defined(_MSC_VER)
 // TODO: Enable these asserts as soon as Microsoft's Visual C++ compiler
 //       properly supports constexpr. It does not as of version 18.00.21114
 //       (November 2013 CTP).
-static_assert(0x55 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_IMPL_POINTER+0], "check code");
-static_assert(0x55 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_IMPL_POINTER+1], "check code");
-static_assert(0x55 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_IMPL_POINTER+1], "check code");
-static_assert(0x55 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_IMPL_POINTER+3], "check code");
-static_assert(0x66 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_CALL_ADDR+0], "check code");
-static_assert(0x66 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_CALL_ADDR+1], "check code");
-static_assert(0x66 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_CALL_ADDR+2], "check code");
-static_assert(0x66 == CODE_FIXED_BODY[CODE_OFFSET_FIXED_BODY_CALL_ADDR+3], "check code");
+static_assert(0x55 == CODE[CODE_OFFSET_IMPL_DISP+0], "check code");
+static_assert(0x55 == CODE[CODE_OFFSET_IMPL_DISP+3], "check code");
+static_assert(0x48 == CODE[CODE_OFFSET_AFTER_IMPL_LOAD], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_CALL_DISP+0], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_CALL_DISP+3], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_AFTER_CALL], "check code");
 #endif
 
-constexpr uint8_t CODE_EPILOGUE[] =
-{
-    0x48, 0x83, 0xc4, 0x28,                             // add   rsp, 40
-    0xc3                                                // retq
-};
-static_assert(sizeof(CODE_EPILOGUE) == CODE_SIZE_EPILOGUE, "check code");
-
 constexpr uint8_t NOP = 0x90;
 
 const uint8_t UNWIND_INFO[UNWIND_INFO_SIZE] =
@@ -124,140 +113,96 @@ const uint8_t UNWIND_INFO[UNWIND_INFO_SIZE] =
     CODE_SIZE_PROLOGUE,
     0x01 /* count of unwind codes = 1 */,
     0x00 /* no frame register needed */,
-    0x42 /* UNWIND CODE #0: UWOP_ALLOC_SMALL, 4 * 8 + 8 = 40 bytes */,
-    0x00 /* UNWIND CODE #1: Not used. (MSFT says we must allocate an even number
-            of UNWIND_CODE's, the last being unused if unnecessary) */
+    CODE_SIZE_PROLOGUE /* UNWIND CODE #0: offset of end of 'sub rsp, 72' */,
+    0x82 /* UNWIND CODE #0: UWOP_ALLOC_SMALL, 8 * 8 + 8 = 72 bytes */,
+    0x00, 0x00 /* UNWIND CODE #1: Not used. (MSFT says we must allocate an
+                  even number of UNWIND_CODE's, the last being unused if
+                  unnecessary) */
 };
 
-typedef uint64_t (* wrapper_func)(thunk64_impl *, const marshall_word_t *);
+typedef uint64_t (* wrapper_func)(thunk64_impl *, marshall_word_t *,
+                                  uint64_t const *);
 
-struct stub_code
+struct stub_data
 {
-    //
-    // DATA
-    //
-    alignas(16) uint8_t             d_instructions[CODE_SIZE_MAX_TOTAL];
-                wrapper_func        d_wrapper_addr;
-    alignas(8)  RUNTIME_FUNCTION    d_exception_data;
-                                    // MSFT says RUNTIME_FUNCTION must be DWORD
-                                    // aligned: http://msdn.microsoft.com/en-us/library/ft9x1kdx.aspx
-    alignas(8)  uint8_t             d_unwind_info[UNWIND_INFO_SIZE];
-                                    // MSFT says UNWIND_INFO must be DWORD
-                                    // aligned...
-    //
-    // CONSTRUCTORS
-    //
-    stub_code(thunk64_impl *, wrapper_func wrapper_addr, size_t,
-              param_register_types);
-    ~stub_code();
-    //
-    // HELPERS
-    //
-    int32_t rip_rel_addr_offset(uint8_t *, uint8_t *);
-    void compile(thunk64_impl *, size_t, param_register_types);
-    void register_exception_data();
+    thunk64_impl * d_impl;
+    wrapper_func   d_wrapper_addr;
 };
+static_assert(sizeof(stub_data) <= DATA_SLOT_SIZE, "check data");
 
-stub_code::stub_code(thunk64_impl * impl_addr, wrapper_func wrapper_addr,
-                     size_t num_param_registers,
-                     param_register_types register_types)
-    : d_wrapper_addr(wrapper_addr)
-{
-    assert(impl_addr || !"thunk implementation cannot be NULL");
-    assert(wrapper_addr || !"wrapper function address cannot be NULL");
-    assert(0 <= num_param_registers && num_param_registers <= NUM_PARAM_REGISTERS);
-    // "Compile" the stub code
-    compile(impl_addr, num_param_registers, register_types);
-    // Create Windows exception unwind data
-    register_exception_data();
-}
-
-stub_code::~stub_code()
-{ RtlDeleteFunctionTable(&d_exception_data); }
+inline stub_data * data_of(thunk_slab_allocator::slot const& s)
+{ return reinterpret_cast<stub_data *>(s.data); }
 
-int32_t stub_code::rip_rel_addr_offset(uint8_t * addr_addr,
-                                       uint8_t * epilogue_start)
+int32_t rip_rel_addr_offset(void * addr_addr, uint8_t * next_instruction)
 {
-    // 'addr_addr' is the address of the memory containing the jump address
-    // 'epilogue_start' is the address of the first epilogue instruction, which
-    // is also the first instruction after the 'call' instruction.
-    assert(addr_addr && epilogue_start);
-    ptrdiff_t offset = addr_addr - epilogue_start;
-    if (!(static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::min()) <= offset &&
-        offset <= static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::max())))
-    {
-        LOG_ERROR("Wrapper indirect offset " << offset << " exceeds 32 bits; "
-                  "addr_addr => " << addr_addr << ", epilogue_start => "
-                  << epilogue_start);
-        std::ostringstream() << "Wrapper indirect address offset " << offset
-                             << " exceeds 32 bits"
-                             << throw_cpp<std::domain_error>();
-    }
+    // 'addr_addr' is the address of the memory containing the address to load
+    // 'next_instruction' is the address of the first instruction after the
+    // one doing the load. The data slot is on the same slab as the code slot,
+    // so the offset always fits into 32 bits.
+    ptrdiff_t const offset(static_cast<uint8_t *>(addr_addr) -
+                           next_instruction);
+    assert(
+        static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::min()) <= offset &&
+        offset <= static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::max()));
     return static_cast<int32_t>(offset);
 }
 
-void stub_code::compile(thunk64_impl * impl_addr, size_t num_param_registers,
-                        param_register_types register_types)
+void write_stub(uint8_t * code, uint8_t * data, wrapper_func wrapper_addr)
 {
-    uint8_t * cursor(d_instructions);
-    cursor = std::copy(CODE_PROLOGUE, CODE_PROLOGUE + CODE_SIZE_PROLOGUE,
-                       cursor);
-    // Insert up to four instructions of the correct type to move data passed
-    // in registers into the stack homespace
-    for (size_t k = 0; k < num_param_registers; ++k)
-    {
-        const mov_stack * inst = &CODE_MOV_STACK_TABLE[register_types[k]][k];
-        cursor = std::copy(inst->instruction,
-                           inst->instruction + inst->size_bytes, cursor);
-    }
-    // Finish copying basic instructions
-    uint8_t * const fixed_start(cursor); // Needed to replace placeholders
-    cursor = std::copy(CODE_FIXED_BODY, CODE_FIXED_BODY + CODE_SIZE_FIXED_BODY,
-                       cursor);
-    cursor = std::copy(CODE_EPILOGUE, CODE_EPILOGUE + CODE_SIZE_EPILOGUE,
-                       cursor);
-    // Fill the rest of the structure with nop instructions
-    assert(cursor <= d_instructions + jsdi::array_length(d_instructions));
-    std::fill(cursor, d_instructions + jsdi::array_length(d_instructions), NOP);
-    // Replace the placeholder bytes for the first argument to the wrapper
-    // function with the address of the thunk implementation.
-    static_assert(8 == sizeof(impl_addr), "check code");
-    std::copy(reinterpret_cast<uint8_t *>(&impl_addr),
-              reinterpret_cast<uint8_t *>(&impl_addr) + sizeof(impl_addr),
-              fixed_start + CODE_OFFSET_FIXED_BODY_IMPL_POINTER);
-    // Replace the placeholder bytes for the rip-relative offset to the memory
-    // location containing the wrapper function (thunk64_impl::wrapper)
-    // with the actual offset.
-    int32_t addr_offset = rip_rel_addr_offset(
-        reinterpret_cast<uint8_t *>(&d_wrapper_addr),
-        fixed_start + CODE_OFFSET_FIXED_BODY_CALL_ADDR + 4);
-    static_assert(4 == sizeof(addr_offset), "check code");
-    std::copy(reinterpret_cast<uint8_t *>(&addr_offset),
-              reinterpret_cast<uint8_t *>(&addr_offset) + sizeof(addr_offset),
-              fixed_start + CODE_OFFSET_FIXED_BODY_CALL_ADDR);
+    stub_data * const d(reinterpret_cast<stub_data *>(data));
+    // "Compile" the stub code, filling the rest of the slot with nop
+    // instructions apart from the unwind data.
+    uint8_t * cursor(std::copy(CODE, CODE + CODE_SIZE_TOTAL, code));
+    std::fill(cursor, code + CODE_SLOT_SIZE, NOP);
+    std::copy(UNWIND_INFO, UNWIND_INFO + UNWIND_INFO_SIZE,
+              code + CODE_OFFSET_UNWIND_INFO);
+    // Replace the placeholder bytes for the rip-relative offsets of the memory
+    // locations containing the thunk implementation address and the wrapper
+    // function (thunk64_impl::wrapper) with the actual offsets.
+    int32_t const impl_offset(rip_rel_addr_offset(
+        &d->d_impl, code + CODE_OFFSET_AFTER_IMPL_LOAD));
+    int32_t const wrapper_offset(rip_rel_addr_offset(
+        &d->d_wrapper_addr, code + CODE_OFFSET_AFTER_CALL));
+    static_assert(4 == sizeof(impl_offset), "check code");
+    std::memcpy(code + CODE_OFFSET_IMPL_DISP, &impl_offset,
+                sizeof(impl_offset));
+    std::memcpy(code + CODE_OFFSET_CALL_DISP, &wrapper_offset,
+                sizeof(wrapper_offset));
+    d->d_wrapper_addr = wrapper_addr;
 }
 
-void stub_code::register_exception_data()
+// Registers a single function table covering every stub in a slab, so the cost
+// of registering the Windows exception unwind data is paid once per slab
+// rather than once per thunk. The table entries are relative to the start of
+// the slab's first code slot and are in address order, as Windows requires.
+void * register_slab(uint8_t * code, size_t num_slots)
 {
-    std::copy(UNWIND_INFO, UNWIND_INFO + UNWIND_INFO_SIZE, d_unwind_info);
-    d_exception_data.BeginAddress = static_cast<ULONG>(
-                                        d_instructions -
-                                        reinterpret_cast<uint8_t *>(this));
-    d_exception_data.EndAddress = static_cast<ULONG>(
-                                      d_instructions -
-                                      reinterpret_cast<uint8_t *>(this) +
-                                      jsdi::array_length(d_instructions)
-                                  );
-    d_exception_data.UnwindInfoAddress = static_cast<ULONG>(
-                                             d_unwind_info -
-                                             reinterpret_cast<uint8_t *>(this));
-    if (! RtlAddFunctionTable(&d_exception_data, 1, reinterpret_cast<DWORD64>(this)))
+    std::unique_ptr<RUNTIME_FUNCTION[]> table(new RUNTIME_FUNCTION[num_slots]);
+    for (size_t k = 0; k < num_slots; ++k)
+    {
+        DWORD const begin(static_cast<DWORD>(k * CODE_SLOT_SIZE));
+        table[k].BeginAddress      = begin;
+        table[k].EndAddress        = begin + CODE_SIZE_TOTAL;
+        table[k].UnwindInfoAddress = begin + CODE_OFFSET_UNWIND_INFO;
+    }
+    if (! RtlAddFunctionTable(table.get(), static_cast<DWORD>(num_slots),
+                              reinterpret_cast<DWORD64>(code)))
     {
         LOG_ERROR("Unable to register exception data: RtlAddFunctionTable("
-                  << &d_exception_data << ', ' << 1 << ', ' << this
+                  << table.get() << ", " << num_slots << ", "
+                  << static_cast<void *>(code)
                   << ") failed and GetLastError() returned " << GetLastError());
         throw std::runtime_error("Thunk cannot register exception data");
     }
+    return table.release();
+}
+
+void unregister_slab(void * registration)
+{
+    RUNTIME_FUNCTION * const table(
+        static_cast<RUNTIME_FUNCTION *>(registration));
+    RtlDeleteFunctionTable(table);
+    delete [] table;
 }
 
 } // anonymous namespace
@@ -266,73 +211,220 @@ void stub_code::register_exception_data()
 //                           struct thunk64_impl
 //==============================================================================
 
-namespace {
-
-heap impl_heap("thunk64_impl", true);
-
-} // anonymous namespace
-
 struct thunk64_impl
 {
     //
     // DATA
     //
 
-    stub_code                   d_code;
-    std::function<void()>       d_setup;
+    thunk_slab_allocator::slot  d_slot;
+    std::atomic<bool>           d_bound;
+    size_t                      d_num_param_registers;
+    param_register_types        d_register_types;
     std::shared_ptr<callback>   d_callback;
-    std::function<void()>       d_teardown;
 
     //
     // CONSTRUCTORS
     //
 
-    thunk64_impl(size_t, param_register_types, const std::function<void()>&,
-                 const std::shared_ptr<callback>&,
-                 const std::function<void()>&);
+    thunk64_impl(size_t, param_register_types,
+                 const std::shared_ptr<callback>&);
+
+    ~thunk64_impl();
 
     //
-    // STATICS
+    // MUTATORS
     //
 
-    static uint64_t wrapper(thunk64_impl *, const marshall_word_t *);
+    void bind(size_t, param_register_types, const std::shared_ptr<callback>&);
+
+    void unbind();
 
     //
-    // ACCESSORS
+    // STATICS
     //
 
-    void * func_addr();
+    static thunk64_impl * acquire(size_t, param_register_types,
+                                  const std::shared_ptr<callback>&);
+
+    static void release(thunk64_impl *);
+
+    static void reclaim();
+
+    static uint64_t wrapper(thunk64_impl *, marshall_word_t *,
+                            uint64_t const *);
+
+    static void write_slot(uint8_t *, uint8_t *);
 
     //
-    // OPERATORS
+    // ACCESSORS
     //
 
-    void * operator new(size_t);
+    void * func_addr();
+};
 
-    void operator delete(void *);
+namespace {
 
-    void * operator new[](size_t) = delete;
-    void operator delete[](void *) = delete;
+thunk_slab_allocator stub_slabs(CODE_SLOT_SIZE, DATA_SLOT_SIZE,
+                                thunk64_impl::write_slot, register_slab,
+                                unregister_slab);
+
+// Implementations released by deleted thunks. Every stub is the same code, and
+// a released implementation keeps its stub, so a new thunk of any signature
+// can take one over just by rebinding it.
+//
+// A native caller which entered a stub before its thunk was cleared may not
+// yet have reached the epoch region in thunk64_impl::wrapper(), so it isn't
+// counted when the thunk is reclaimed. A released implementation is therefore
+// retired, and is only unbound and pooled, or deleted, one full epoch later.
+struct retired_impl
+{
+    thunk64_impl * d_impl;
+    uint64_t       d_epoch;
 };
 
-thunk64_impl::thunk64_impl(
-    size_t num_param_registers, param_register_types register_types,
-    const std::function<void()>& setup,
-    const std::shared_ptr<callback>& callback,
-    const std::function<void()>& teardown)
-    : d_code(this, wrapper, num_param_registers, register_types)
-    , d_setup(setup)
+const size_t MAX_POOLED_IMPLS = 1024;
+std::vector<thunk64_impl *> impl_pool;
+std::vector<retired_impl>   impl_retired;
+std::mutex                  impl_pool_mutex;
+
+} // anonymous namespace
+
+thunk64_impl::thunk64_impl(size_t num_param_registers,
+                           param_register_types register_types,
+                           const std::shared_ptr<callback>& callback)
+    : d_slot(stub_slabs.allocate())
+    , d_bound(true)
+    , d_num_param_registers(num_param_registers)
+    , d_register_types(register_types)
     , d_callback(callback)
-    , d_teardown(teardown)
-{ }
+{
+    assert(num_param_registers <= NUM_PARAM_REGISTERS);
+    data_of(d_slot)->d_impl = this;
+}
 
-uint64_t thunk64_impl::wrapper(thunk64_impl * impl,
-                               const marshall_word_t * args)
+thunk64_impl::~thunk64_impl()
 {
+    data_of(d_slot)->d_impl = nullptr;
+    stub_slabs.free(d_slot);
+}
+
+void thunk64_impl::bind(size_t num_param_registers,
+                        param_register_types register_types,
+                        const std::shared_ptr<callback>& callback)
+{
+    assert(num_param_registers <= NUM_PARAM_REGISTERS);
+    assert(! d_callback || !"thunk implementation already bound");
+    d_num_param_registers = num_param_registers;
+    d_register_types      = register_types;
+    d_callback            = callback;
+    d_bound.store(true);
+}
+
+void thunk64_impl::unbind()
+{
+    assert(! d_bound.load(std::memory_order_relaxed));
+    d_callback.reset();
+}
+
+thunk64_impl * thunk64_impl::acquire(size_t num_param_registers,
+                                     param_register_types register_types,
+                                     const std::shared_ptr<callback>& callback)
+{
+    reclaim();
+    thunk64_impl * impl(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        if (! impl_pool.empty())
+        {
+            impl = impl_pool.back();
+            impl_pool.pop_back();
+        }
+    }
+    if (! impl)
+        return new thunk64_impl(num_param_registers, register_types, callback);
+    // Nothing can be calling the stub because the implementation was retired
+    // for a full epoch after the thunk that released it was deleted, so it is
+    // safe to rebind.
+    impl->bind(num_param_registers, register_types, callback);
+    return impl;
+}
+
+void thunk64_impl::release(thunk64_impl * impl)
+{
+    assert(impl);
+    // A call which enters the wrapper's epoch region after this store sees
+    // that the implementation is unbound. A call which entered it before
+    // holds up the retirement epoch until it has finished.
+    impl->d_bound.store(false);
+    retired_impl const r = { impl, epoch::retire() };
+    {
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        impl_retired.push_back(r);
+    }
+    reclaim();
+}
+
+void thunk64_impl::reclaim()
+{
+    std::vector<thunk64_impl *> safe;
+    {
+        uint64_t const oldest(epoch::oldest_active());
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        auto out(impl_retired.begin());
+        for (auto i = impl_retired.begin(), e = impl_retired.end(); i != e; ++i)
+        {
+            if (epoch::is_safe(i->d_epoch, oldest))
+                safe.push_back(i->d_impl);
+            else
+                *out++ = *i;
+        }
+        impl_retired.erase(out, impl_retired.end());
+    }
+    // Unbind outside the lock, since releasing a callback may in turn release
+    // JNI references.
+    for (auto i = safe.begin(), e = safe.end(); i != e; ++i)
+    {
+        (*i)->unbind();
+        {
+            std::lock_guard<std::mutex> lock(impl_pool_mutex);
+            if (impl_pool.size() < MAX_POOLED_IMPLS)
+            {
+                impl_pool.push_back(*i);
+                continue;
+            }
+        }
+        delete *i;
+    }
+}
+
+uint64_t thunk64_impl::wrapper(thunk64_impl * impl, marshall_word_t * args,
+                               uint64_t const * fp_args)
+{
+    // Enter the epoch region before touching the implementation, so that it
+    // can't be unbound or rebound while this call is using it.
+    epoch_region region;
     uint64_t result(0);
     LOG_TRACE("thunk64_impl::wrapper ( func_addr() => " << impl->func_addr()
               << ", args => " << args << " )");
-    impl->d_setup();
+    if (! impl->d_bound.load())
+    {
+        LOG_ERROR("Thunk at " << impl->func_addr()
+                              << " called after it was deleted");
+        return result;
+    }
+    // The stub spilled the general-purpose registers into the home space,
+    // which is where the arguments are expected, and the floating-point
+    // registers alongside. Replace the home space value of each parameter
+    // that was passed in a floating-point register.
+    if (impl->d_register_types.has_fp())
+    {
+        for (size_t k = 0; k < impl->d_num_param_registers; ++k)
+        {
+            if (param_register_type::UINT64 != impl->d_register_types[k])
+                std::memcpy(&args[k], &fp_args[k], sizeof(uint64_t));
+        }
+    }
     // NOTE: It is [C++] callback's responsibility to ensure that no C++
     //       exceptions propagate out to this level. Furthermore, C++ callback
     //       is responsible for stopping execution and returning the moment a
@@ -340,7 +432,7 @@ uint64_t thunk64_impl::wrapper(thunk64_impl * impl,
     try
     {
         // TODO: Put in SEH blocks here (catch, teardown(), rethrow)
-        result = impl->d_callback->call(args);
+        result = impl->d_callback->invoke(args);
     }
     catch (const std::exception& e)
     {
@@ -352,18 +444,14 @@ uint64_t thunk64_impl::wrapper(thunk64_impl * impl,
         LOG_FATAL("Exception escaped callback");
         std::abort();
     }
-    impl->d_teardown();
     return result;
 }
 
-inline void * thunk64_impl::func_addr()
-{ return d_code.d_instructions; }
-
-void * thunk64_impl::operator new(size_t n)
-{ return impl_heap.alloc(n); }
+void thunk64_impl::write_slot(uint8_t * code, uint8_t * data)
+{ write_stub(code, data, wrapper); }
 
-void thunk64_impl::operator delete(void * ptr)
-{ impl_heap.free(ptr); }
+inline void * thunk64_impl::func_addr()
+{ return d_slot.code; }
 
 //==============================================================================
 //                              class thunk64
@@ -373,12 +461,13 @@ thunk64::thunk64(const std::shared_ptr<callback>& callback_ptr,
                  size_t num_param_registers,
                  param_register_types register_types)
     : thunk(callback_ptr)
-    , d_impl(new thunk64_impl(num_param_registers, register_types,
-          std::bind(std::mem_fn(&thunk64::setup_call), this),
-          callback_ptr,
-          std::bind(std::mem_fn(&thunk64::teardown_call), this)))
+    , d_impl(thunk64_impl::acquire(num_param_registers, register_types,
+                                   callback_ptr))
 { }
 
+thunk64::~thunk64()
+{ thunk64_impl::release(d_impl.release()); }
+
 void * thunk64::func_addr() const
 { return d_impl->func_addr(); }
 
@@ -398,7 +487,10 @@ void * thunk64::func_addr() const
 #include "test64.h"
 
 #include <algorithm>
+#include <cstring>
+#include <vector>
 
+using namespace jsdi;
 using namespace jsdi::abi_amd64;
 using namespace jsdi::abi_amd64::test64;
 
@@ -432,6 +524,27 @@ struct direct_callback : public jsdi::callback
     }
 };
 
+// callback that sums two floating-point arguments and returns the raw bits of
+// the result, just as a Java callback does
+template<typename FloatT>
+struct sum_fp_callback : public jsdi::callback
+{
+    sum_fp_callback()
+        : callback(2 * sizeof(uint64_t), 2 * sizeof(uint64_t), EMPTY_PTR_ARRAY,
+                   0, 0)
+    { }
+    virtual uint64_t call(jsdi::marshall_word_t const * args)
+    {
+        FloatT a, b;
+        std::memcpy(&a, &args[0], sizeof(FloatT));
+        std::memcpy(&b, &args[1], sizeof(FloatT));
+        FloatT const sum(a + b);
+        uint64_t result(0);
+        std::memcpy(&result, &sum, sizeof(FloatT));
+        return result;
+    }
+};
+
 template<typename IntT, typename ... Params>
 struct invoker
 {
@@ -569,6 +682,30 @@ TEST(fp_thorough,
     ); // std::for_each(FP_FUNCTIONS)
 );
 
+TEST(double_return,
+    param_register_types const registers(
+        param_register_type::DOUBLE, param_register_type::DOUBLE,
+        param_register_type::UINT64, param_register_type::UINT64);
+    callback_ptr_t cb(new sum_fp_callback<double>);
+    thunk64 thunk(cb, 2, registers);
+    auto f(reinterpret_cast<double (*)(double, double)>(thunk.func_addr()));
+    double const result(f(1.5, -4.0));
+    thunk.clear();
+    assert_equals(-2.5, result);
+);
+
+TEST(float_return,
+    param_register_types const registers(
+        param_register_type::FLOAT, param_register_type::FLOAT,
+        param_register_type::UINT64, param_register_type::UINT64);
+    callback_ptr_t cb(new sum_fp_callback<float>);
+    thunk64 thunk(cb, 2, registers);
+    auto f(reinterpret_cast<float (*)(float, float)>(thunk.func_addr()));
+    float const result(f(0.25f, 8.0f));
+    thunk.clear();
+    assert_equals(8.25f, result);
+);
+
 TEST(try_catch_chain,
     // This is a regression test for a problem that came up because the thunk
     // code wasn't keeping the stack 16-byte aligned. It manifested itself in
@@ -583,4 +720,75 @@ TEST(try_catch_chain,
     assert_equals(100, result);
 );
 
+TEST(many_thunks,
+    // Enough thunks to need more than one slab of stubs, each of which must
+    // call its own callback.
+    std::vector<std::unique_ptr<thunk64>> thunks;
+    for (int k = 0; k < 1200; ++k)
+    {
+        callback_ptr_t cb(new direct_callback(TestInt32, sizeof(uint64_t),
+                                              DEFAULT_REGISTERS));
+        thunks.emplace_back(new thunk64(cb, 1, DEFAULT_REGISTERS));
+    }
+    for (int k = 0; k < 1200; ++k)
+    {
+        int32_t result = invoker<int32_t, int32_t>::call(
+            TestInvokeCallback_Int32_1, *thunks[k], k);
+        assert_equals(k, result);
+    }
+    for (auto i = thunks.begin(), e = thunks.end(); i != e; ++i)
+        (*i)->clear();
+);
+
+TEST(recycle_impl,
+    // Deleting a thunk gives its stub to the next thunk created, even one with
+    // a different signature.
+    callback_ptr_t cb1(new direct_callback(TestInt32, sizeof(uint64_t),
+                                           DEFAULT_REGISTERS));
+    std::unique_ptr<thunk64> thunk1(new thunk64(cb1, 1, DEFAULT_REGISTERS));
+    void * const func_addr(thunk1->func_addr());
+    thunk1->clear();
+    thunk1.reset();
+    assert_equals(1, cb1.use_count());
+    param_register_types const registers(
+        param_register_type::DOUBLE, param_register_type::DOUBLE,
+        param_register_type::UINT64, param_register_type::UINT64);
+    callback_ptr_t cb2(new sum_fp_callback<double>);
+    thunk64 thunk2(cb2, 2, registers);
+    assert_equals(func_addr, thunk2.func_addr());
+    auto f(reinterpret_cast<double (*)(double, double)>(thunk2.func_addr()));
+    double const result(f(0.5, 0.25));
+    thunk2.clear();
+    assert_equals(0.75, result);
+);
+
+TEST(late_call_to_deleted_thunk,
+    // A native caller may have entered the stub of a thunk which is deleted
+    // before the call reaches the wrapper. While that can still happen, the
+    // implementation must neither be unbound nor handed to a new thunk.
+    callback_ptr_t cb1(new direct_callback(TestInt32, sizeof(uint64_t),
+                                           DEFAULT_REGISTERS));
+    std::unique_ptr<thunk64> thunk1(new thunk64(cb1, 1, DEFAULT_REGISTERS));
+    auto f(reinterpret_cast<int32_t (*)(int32_t)>(thunk1->func_addr()));
+    {
+        epoch_region region;
+        thunk1->clear();
+        thunk1.reset();
+        assert_equals(2, cb1.use_count());
+        callback_ptr_t cb2(new direct_callback(TestInt32, sizeof(uint64_t),
+                                               DEFAULT_REGISTERS));
+        thunk64 thunk2(cb2, 1, DEFAULT_REGISTERS);
+        assert_false(reinterpret_cast<void *>(f) == thunk2.func_addr());
+        assert_equals(0, f(5));
+        thunk2.clear();
+    }
+    // Once the epoch has passed, the next thunk created reclaims the
+    // implementation.
+    callback_ptr_t cb3(new direct_callback(TestInt32, sizeof(uint64_t),
+                                           DEFAULT_REGISTERS));
+    thunk64 thunk3(cb3, 1, DEFAULT_REGISTERS);
+    assert_equals(1, cb1.use_count());
+    thunk3.clear();
+);
+
 #endif // __NOTEST__
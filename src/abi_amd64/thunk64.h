@@ -54,6 +54,15 @@
                 size_t num_param_registers,
                 param_register_types register_types);
 
+        /**
+         * \brief Destroys the thunk, keeping its stub code so that a thunk
+         *        constructed later can reuse it
+         *
+         * Reusing the stub avoids registering the exception unwind data for a
+         * new stub each time a thunk is created.
+         */
+        ~thunk64();
+
         //
         // ANCESTOR CLASS: thunk
         //
@@ -0,0 +1,714 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: thunk_sysv.cpp
+// auth: Victor Schappert
+// date: 20140917
+// desc: Implementation of System V AMD64 ABI thunk
+//==============================================================================
+
+#include "thunk_sysv.h"
+
+#include "callback.h"
+#include "epoch.h"
+#include "log.h"
+#include "sysv_invoke.h"
+#include "thunk_slab.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+// Provided by the GCC runtime (libgcc_s), or by libunwind. The argument is a
+// pointer to a .eh_frame section: a sequence of CIEs and FDEs terminated by a
+// zero length word.
+extern "C" void __register_frame(void *);
+extern "C" void __deregister_frame(void *);
+
+namespace jsdi {
+namespace abi_amd64 {
+
+//==============================================================================
+//                             struct stub_code
+//==============================================================================
+
+namespace {
+
+enum
+{
+    CODE_SIZE_TOTAL                     = 112,
+    CODE_OFFSET_IMPL_DISP               =  88,
+    CODE_OFFSET_AFTER_IMPL_LOAD         =  92,
+    CODE_OFFSET_CALL_DISP               = 101,
+    CODE_OFFSET_AFTER_CALL              = 105,
+    CODE_OFFSET_LEAVE                   = 110,
+    CODE_SLOT_SIZE                      = 112,
+    DATA_SLOT_SIZE                      =  16,
+    CIE_SIZE                            =  24,
+    FDE_SIZE                            =  40,
+    FDE_OFFSET_CIE_POINTER              =   4,
+    FDE_OFFSET_PC_BEGIN                 =   8,
+    FDE_OFFSET_PC_RANGE                 =  16,
+    EH_FRAME_TERMINATOR_SIZE            =   4,
+    REGISTER_BLOCK_WORDS                = SYSV_NUM_INT_PARAM_REGISTERS +
+                                          SYSV_NUM_SSE_PARAM_REGISTERS,
+};
+
+// NOTE: As with the Windows x64 stubs (see thunk64.cpp), the stub code is the
+//       same for every thunk and is written once when its slab is created.
+//       The stub spills all of the parameter registers into a block on its
+//       stack and passes the wrapper a pointer to the block and a pointer to
+//       the stack arguments. The wrapper uses the register types to put the
+//       arguments back in left-to-right order.
+constexpr uint8_t CODE[] =
+{
+    0x55,                                               // push  rbp
+    0x48, 0x89, 0xe5,                                   // mov   rbp, rsp
+    0x48, 0x83, 0xec, 0x70,                             // sub   rsp, 112
+    0x48, 0x89, 0x3c, 0x24,                             // mov   [rsp], rdi
+    0x48, 0x89, 0x74, 0x24, 0x08,                       // mov   [rsp+8], rsi
+    0x48, 0x89, 0x54, 0x24, 0x10,                       // mov   [rsp+16], rdx
+    0x48, 0x89, 0x4c, 0x24, 0x18,                       // mov   [rsp+24], rcx
+    0x4c, 0x89, 0x44, 0x24, 0x20,                       // mov   [rsp+32], r8
+    0x4c, 0x89, 0x4c, 0x24, 0x28,                       // mov   [rsp+40], r9
+    0xf2, 0x0f, 0x11, 0x44, 0x24, 0x30,                 // movsd [rsp+48], xmm0
+    0xf2, 0x0f, 0x11, 0x4c, 0x24, 0x38,                 // movsd [rsp+56], xmm1
+    0xf2, 0x0f, 0x11, 0x54, 0x24, 0x40,                 // movsd [rsp+64], xmm2
+    0xf2, 0x0f, 0x11, 0x5c, 0x24, 0x48,                 // movsd [rsp+72], xmm3
+    0xf2, 0x0f, 0x11, 0x64, 0x24, 0x50,                 // movsd [rsp+80], xmm4
+    0xf2, 0x0f, 0x11, 0x6c, 0x24, 0x58,                 // movsd [rsp+88], xmm5
+    0xf2, 0x0f, 0x11, 0x74, 0x24, 0x60,                 // movsd [rsp+96], xmm6
+    0xf2, 0x0f, 0x11, 0x7c, 0x24, 0x68,                 // movsd [rsp+104], xmm7
+    0x48, 0x8b, 0x3d, 0x55, 0x55, 0x55, 0x55,           // mov   rdi, [rip+0x55555555]
+                                                        //    Placeholder for
+                                                        //    RIP-relative addr.
+                                                        //    of impl. address
+    0x48, 0x89, 0xe6,                                   // mov   rsi, rsp
+    0x48, 0x8d, 0x55, 0x10,                             // lea   rdx, [rbp+16]
+    0xff, 0x15, 0x66, 0x66, 0x66, 0x66,                 // callq [rip+0x66666666]
+                                                        //    Placeholder for
+                                                        //    RIP-relative addr.
+                                                        //    of wrapper addr.
+    0x66, 0x48, 0x0f, 0x6e, 0xc0,                       // movq  xmm0, rax
+    0xc9,                                               // leave
+    0xc3                                                // retq
+};
+// NOTE: The 112 bytes allocated on the stack hold the six general-purpose
+//       registers followed by the eight SSE registers. Together with the
+//       pushed rbp, they keep the stack 16-byte aligned at the call.
+// NOTE: The result is copied into xmm0 for the same reason as in thunk64.cpp.
+static_assert(sizeof(CODE) == CODE_SIZE_TOTAL, "check code");
+static_assert(CODE_SIZE_TOTAL <= CODE_SLOT_SIZE, "check code");
+static_assert(0x55 == CODE[CODE_OFFSET_IMPL_DISP+0], "check code");
+static_assert(0x55 == CODE[CODE_OFFSET_IMPL_DISP+3], "check code");
+static_assert(0x48 == CODE[CODE_OFFSET_AFTER_IMPL_LOAD], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_CALL_DISP+0], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_CALL_DISP+3], "check code");
+static_assert(0x66 == CODE[CODE_OFFSET_AFTER_CALL], "check code");
+static_assert(0xc9 == CODE[CODE_OFFSET_LEAVE], "check code");
+
+constexpr uint8_t NOP = 0x90;
+
+// DWARF call frame information for the stubs, in .eh_frame format. Each slab
+// has one .eh_frame blob containing a single CIE followed by an FDE for every
+// stub in the slab. The CIE pointer and the address and size of the stub in
+// each FDE are filled in when the slab is registered.
+constexpr uint8_t CIE[CIE_SIZE] =
+{
+    0x14, 0x00, 0x00, 0x00,         // length: 20 bytes follow
+    0x00, 0x00, 0x00, 0x00,         // CIE id
+    0x01,                           // version
+    'z', 'R', 0x00,                 // augmentation: pointer encoding follows
+    0x01,                           // code alignment factor: 1
+    0x78,                           // data alignment factor: -8
+    0x10,                           // return address register: rip (16)
+    0x01,                           // augmentation data length
+    0x00,                           // FDE pointer encoding: DW_EH_PE_absptr
+    0x0c, 0x07, 0x08,               // DW_CFA_def_cfa: rsp+8
+    0x90, 0x01,                     // DW_CFA_offset: rip at cfa-8
+    0x00, 0x00                      // DW_CFA_nop (padding)
+};
+
+constexpr uint8_t FDE[FDE_SIZE] =
+{
+    0x24, 0x00, 0x00, 0x00,         // length: 36 bytes follow
+    0x00, 0x00, 0x00, 0x00,         // CIE pointer (placeholder)
+    0x00, 0x00, 0x00, 0x00,         // PC begin: stub address (placeholder)
+    0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,         // PC range: stub size (placeholder)
+    0x00, 0x00, 0x00, 0x00,
+    0x00,                           // augmentation data length
+    0x41,                           // DW_CFA_advance_loc: 1 (after push rbp)
+    0x0e, 0x10,                     // DW_CFA_def_cfa_offset: 16
+    0x86, 0x02,                     // DW_CFA_offset: rbp at cfa-16
+    0x43,                           // DW_CFA_advance_loc: 3 (after mov rbp)
+    0x0d, 0x06,                     // DW_CFA_def_cfa_register: rbp
+    0x02, CODE_SIZE_TOTAL - 1 - 4,  // DW_CFA_advance_loc1: to the ret
+    0x0c, 0x07, 0x08,               // DW_CFA_def_cfa: rsp+8
+    0x00, 0x00                      // DW_CFA_nop (padding)
+};
+static_assert(CODE_OFFSET_LEAVE + 1 == CODE_SIZE_TOTAL - 1, "check eh_frame");
+
+typedef uint64_t (* wrapper_func)(thunk_sysv_impl *, uint64_t const *,
+                                  marshall_word_t const *);
+
+struct stub_data
+{
+    thunk_sysv_impl * d_impl;
+    wrapper_func      d_wrapper_addr;
+};
+static_assert(sizeof(stub_data) <= DATA_SLOT_SIZE, "check data");
+
+inline stub_data * data_of(thunk_slab_allocator::slot const& s)
+{ return reinterpret_cast<stub_data *>(s.data); }
+
+int32_t rip_rel_addr_offset(void * addr_addr, uint8_t * next_instruction)
+{
+    // See thunk64.cpp.
+    ptrdiff_t const offset(static_cast<uint8_t *>(addr_addr) -
+                           next_instruction);
+    assert(static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::min()) <=
+               offset &&
+           offset <= static_cast<ptrdiff_t>(std::numeric_limits<int32_t>::max()));
+    return static_cast<int32_t>(offset);
+}
+
+void write_stub(uint8_t * code, uint8_t * data, wrapper_func wrapper_addr)
+{
+    stub_data * const d(reinterpret_cast<stub_data *>(data));
+    uint8_t * cursor(std::copy(CODE, CODE + CODE_SIZE_TOTAL, code));
+    std::fill(cursor, code + CODE_SLOT_SIZE, NOP);
+    int32_t const impl_offset(rip_rel_addr_offset(
+        &d->d_impl, code + CODE_OFFSET_AFTER_IMPL_LOAD));
+    int32_t const wrapper_offset(rip_rel_addr_offset(
+        &d->d_wrapper_addr, code + CODE_OFFSET_AFTER_CALL));
+    std::memcpy(code + CODE_OFFSET_IMPL_DISP, &impl_offset,
+                sizeof(impl_offset));
+    std::memcpy(code + CODE_OFFSET_CALL_DISP, &wrapper_offset,
+                sizeof(wrapper_offset));
+    d->d_wrapper_addr = wrapper_addr;
+}
+
+// Builds and registers the .eh_frame blob for a slab, so the cost of
+// registering the call frame information is paid once per slab rather than
+// once per thunk. The unwinder sorts the FDEs of a registered blob the first
+// time it searches it.
+void * register_slab(uint8_t * code, size_t num_slots)
+{
+    size_t const size(CIE_SIZE + num_slots * FDE_SIZE +
+                      EH_FRAME_TERMINATOR_SIZE);
+    uint8_t * const eh_frame(new uint8_t[size]);
+    uint8_t * cursor(std::copy(CIE, CIE + CIE_SIZE, eh_frame));
+    for (size_t k = 0; k < num_slots; ++k, cursor += FDE_SIZE)
+    {
+        std::copy(FDE, FDE + FDE_SIZE, cursor);
+        // The CIE pointer is the distance back to the CIE from the field.
+        uint32_t const cie_pointer(static_cast<uint32_t>(
+            cursor + FDE_OFFSET_CIE_POINTER - eh_frame));
+        uint64_t const pc_begin(
+            reinterpret_cast<uint64_t>(code + k * CODE_SLOT_SIZE));
+        uint64_t const pc_range(CODE_SIZE_TOTAL);
+        std::memcpy(cursor + FDE_OFFSET_CIE_POINTER, &cie_pointer,
+                    sizeof(cie_pointer));
+        std::memcpy(cursor + FDE_OFFSET_PC_BEGIN, &pc_begin, sizeof(pc_begin));
+        std::memcpy(cursor + FDE_OFFSET_PC_RANGE, &pc_range, sizeof(pc_range));
+    }
+    std::fill(cursor, cursor + EH_FRAME_TERMINATOR_SIZE, 0);
+    __register_frame(eh_frame);
+    return eh_frame;
+}
+
+void unregister_slab(void * registration)
+{
+    __deregister_frame(registration);
+    delete [] static_cast<uint8_t *>(registration);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                          struct thunk_sysv_impl
+//==============================================================================
+
+struct thunk_sysv_impl
+{
+    //
+    // DATA
+    //
+
+    thunk_slab_allocator::slot  d_slot;
+    std::atomic<bool>           d_bound;
+    param_register_types        d_register_types;
+    std::shared_ptr<callback>   d_callback;
+
+    //
+    // CONSTRUCTORS
+    //
+
+    thunk_sysv_impl(param_register_types, const std::shared_ptr<callback>&);
+
+    ~thunk_sysv_impl();
+
+    //
+    // MUTATORS
+    //
+
+    void bind(param_register_types, const std::shared_ptr<callback>&);
+
+    void unbind();
+
+    //
+    // STATICS
+    //
+
+    static thunk_sysv_impl * acquire(param_register_types,
+                                     const std::shared_ptr<callback>&);
+
+    static void release(thunk_sysv_impl *);
+
+    static void reclaim();
+
+    static uint64_t wrapper(thunk_sysv_impl *, uint64_t const *,
+                            marshall_word_t const *);
+
+    static void write_slot(uint8_t *, uint8_t *);
+
+    //
+    // ACCESSORS
+    //
+
+    void * func_addr();
+};
+
+namespace {
+
+thunk_slab_allocator stub_slabs(CODE_SLOT_SIZE, DATA_SLOT_SIZE,
+                                thunk_sysv_impl::write_slot, register_slab,
+                                unregister_slab);
+
+// See thunk64.cpp. The pool and the retired list own their implementations so
+// that they are freed, before 'stub_slabs', when the process exits.
+struct retired_impl
+{
+    std::unique_ptr<thunk_sysv_impl> d_impl;
+    uint64_t                         d_epoch;
+};
+
+const size_t MAX_POOLED_IMPLS = 1024;
+std::vector<std::unique_ptr<thunk_sysv_impl>> impl_pool;
+std::vector<retired_impl>                      impl_retired;
+std::mutex                                     impl_pool_mutex;
+
+// Number of arguments that can be gathered on the wrapper's stack without
+// allocating.
+const size_t MAX_LOCAL_ARGS = 16;
+
+} // anonymous namespace
+
+thunk_sysv_impl::thunk_sysv_impl(param_register_types register_types,
+                                 const std::shared_ptr<callback>& callback)
+    : d_slot(stub_slabs.allocate())
+    , d_bound(true)
+    , d_register_types(register_types)
+    , d_callback(callback)
+{
+    data_of(d_slot)->d_impl = this;
+}
+
+thunk_sysv_impl::~thunk_sysv_impl()
+{
+    data_of(d_slot)->d_impl = nullptr;
+    stub_slabs.free(d_slot);
+}
+
+void thunk_sysv_impl::bind(param_register_types register_types,
+                           const std::shared_ptr<callback>& callback)
+{
+    assert(! d_callback || !"thunk implementation already bound");
+    d_register_types = register_types;
+    d_callback       = callback;
+    d_bound.store(true);
+}
+
+void thunk_sysv_impl::unbind()
+{
+    assert(! d_bound.load(std::memory_order_relaxed));
+    d_callback.reset();
+}
+
+thunk_sysv_impl * thunk_sysv_impl::acquire(
+    param_register_types register_types,
+    const std::shared_ptr<callback>& callback)
+{
+    reclaim();
+    thunk_sysv_impl * impl(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        if (! impl_pool.empty())
+        {
+            impl = impl_pool.back().release();
+            impl_pool.pop_back();
+        }
+    }
+    if (! impl)
+        return new thunk_sysv_impl(register_types, callback);
+    impl->bind(register_types, callback);
+    return impl;
+}
+
+void thunk_sysv_impl::release(thunk_sysv_impl * impl)
+{
+    assert(impl);
+    impl->d_bound.store(false);
+    retired_impl r = { std::unique_ptr<thunk_sysv_impl>(impl),
+                       epoch::retire() };
+    {
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        impl_retired.push_back(std::move(r));
+    }
+    reclaim();
+}
+
+void thunk_sysv_impl::reclaim()
+{
+    std::vector<std::unique_ptr<thunk_sysv_impl>> safe;
+    {
+        uint64_t const oldest(epoch::oldest_active());
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        auto out(impl_retired.begin());
+        for (auto i = impl_retired.begin(), e = impl_retired.end(); i != e; ++i)
+        {
+            if (epoch::is_safe(i->d_epoch, oldest))
+                safe.push_back(std::move(i->d_impl));
+            else
+                *out++ = std::move(*i);
+        }
+        impl_retired.erase(out, impl_retired.end());
+    }
+    for (auto i = safe.begin(), e = safe.end(); i != e; ++i)
+    {
+        (*i)->unbind();
+        std::lock_guard<std::mutex> lock(impl_pool_mutex);
+        if (impl_pool.size() < MAX_POOLED_IMPLS)
+            impl_pool.push_back(std::move(*i));
+    }
+}
+
+uint64_t thunk_sysv_impl::wrapper(thunk_sysv_impl * impl,
+                                  uint64_t const * regs,
+                                  marshall_word_t const * stack_args)
+{
+    // See thunk64_impl::wrapper().
+    epoch_region region;
+    uint64_t result(0);
+    LOG_TRACE("thunk_sysv_impl::wrapper ( func_addr() => " << impl->func_addr()
+              << ", regs => " << regs << ", stack_args => " << stack_args
+              << " )");
+    if (! impl->d_bound.load())
+    {
+        LOG_ERROR("Thunk at " << impl->func_addr()
+                              << " called after it was deleted");
+        return result;
+    }
+    // Gather the arguments into left-to-right order, assigning them to
+    // registers and stack slots exactly as sysv_invoke does.
+    size_t const num_args(
+        static_cast<size_t>(impl->d_callback->size_direct()) /
+        sizeof(marshall_word_t));
+    marshall_word_t local_args[MAX_LOCAL_ARGS];
+    std::vector<marshall_word_t> heap_args;
+    marshall_word_t * args(local_args);
+    if (MAX_LOCAL_ARGS < num_args)
+    {
+        heap_args.resize(num_args);
+        args = heap_args.data();
+    }
+    uint64_t const * const sse_regs(regs + SYSV_NUM_INT_PARAM_REGISTERS);
+    size_t num_int(0), num_sse(0), num_stack(0);
+    for (size_t k = 0; k < num_args; ++k)
+    {
+        param_register_type const type(
+            k < NUM_PARAM_REGISTERS ? impl->d_register_types[k] : UINT64);
+        if (UINT64 != type)
+            std::memcpy(&args[k], &sse_regs[num_sse++], sizeof(uint64_t));
+        else if (num_int < SYSV_NUM_INT_PARAM_REGISTERS)
+            std::memcpy(&args[k], &regs[num_int++], sizeof(uint64_t));
+        else
+            args[k] = stack_args[num_stack++];
+    }
+    // NOTE: It is [C++] callback's responsibility to ensure that no C++
+    //       exceptions propagate out to this level.
+    try
+    {
+        result = impl->d_callback->invoke(args);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_FATAL("Exception escaped callback: '" << e.what() << '\'');
+        std::abort();
+    }
+    catch (...)
+    {
+        LOG_FATAL("Exception escaped callback");
+        std::abort();
+    }
+    return result;
+}
+
+void thunk_sysv_impl::write_slot(uint8_t * code, uint8_t * data)
+{ write_stub(code, data, wrapper); }
+
+inline void * thunk_sysv_impl::func_addr()
+{ return d_slot.code; }
+
+//==============================================================================
+//                             class thunk_sysv
+//==============================================================================
+
+thunk_sysv::thunk_sysv(const std::shared_ptr<callback>& callback_ptr,
+                       param_register_types register_types)
+    : thunk(callback_ptr)
+    , d_impl(thunk_sysv_impl::acquire(register_types, callback_ptr))
+{ }
+
+thunk_sysv::~thunk_sysv()
+{ thunk_sysv_impl::release(d_impl.release()); }
+
+void * thunk_sysv::func_addr() const
+{ return d_impl->func_addr(); }
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "test_exports.h"
+
+#include "test64.h"
+
+#include <chrono>
+#include <unwind.h>
+
+using namespace jsdi::abi_amd64;
+
+namespace {
+
+static jint const EMPTY_PTR_ARRAY[1] = { };
+
+typedef std::shared_ptr<jsdi::callback> callback_ptr_t;
+
+// callback that invokes a function with its arguments and returns its result
+struct direct_callback : public jsdi::callback
+{
+    void *               d_func_ptr;
+    param_register_types d_register_types;
+    template<typename FuncPtr>
+    direct_callback(FuncPtr func_ptr, size_t size_direct,
+                    param_register_types register_types)
+        : callback(static_cast<jint>(size_direct),
+                   static_cast<jint>(size_direct), EMPTY_PTR_ARRAY, 0, 0)
+        , d_func_ptr(reinterpret_cast<void *>(func_ptr))
+        , d_register_types(register_types)
+    { }
+    virtual uint64_t call(jsdi::marshall_word_t const * args)
+    {
+        return sysv_invoke::fp(static_cast<size_t>(d_size_direct), args,
+                               d_func_ptr, d_register_types);
+    }
+};
+
+// callback that adds up a double, an integer, a float and an integer and
+// returns the raw bits of the double result
+struct mixed_callback : public jsdi::callback
+{
+    mixed_callback()
+        : callback(4 * sizeof(uint64_t), 4 * sizeof(uint64_t),
+                   EMPTY_PTR_ARRAY, 0, 0)
+    { }
+    virtual uint64_t call(jsdi::marshall_word_t const * args)
+    {
+        double a;
+        float c;
+        std::memcpy(&a, &args[0], sizeof(a));
+        std::memcpy(&c, &args[2], sizeof(c));
+        double const sum(a + static_cast<double>(args[1]) + c +
+                         static_cast<double>(args[3]));
+        uint64_t result(0);
+        std::memcpy(&result, &sum, sizeof(sum));
+        return result;
+    }
+};
+
+// callback that walks the stack and records whether the unwinder got past the
+// thunk to a given return address
+struct unwind_callback : public jsdi::callback
+{
+    void * d_target;
+    bool   d_found;
+    unwind_callback()
+        : callback(sizeof(uint64_t), sizeof(uint64_t), EMPTY_PTR_ARRAY, 0, 0)
+        , d_target(nullptr)
+        , d_found(false)
+    { }
+    static _Unwind_Reason_Code trace(_Unwind_Context * context, void * arg)
+    {
+        unwind_callback * const self(static_cast<unwind_callback *>(arg));
+        if (reinterpret_cast<void *>(_Unwind_GetIP(context)) == self->d_target)
+            self->d_found = true;
+        return _URC_NO_REASON;
+    }
+    virtual uint64_t call(jsdi::marshall_word_t const * args)
+    {
+        _Unwind_Backtrace(trace, this);
+        return args[0];
+    }
+};
+
+// Calls 'f' and records, in 'c', the address it will return to.
+__attribute__((noinline))
+uint64_t call_recording_return(uint64_t (* f)(uint64_t), unwind_callback& c)
+{
+    c.d_target = __builtin_return_address(0);
+    uint64_t const result(f(7));
+    __asm__ __volatile__ ("" ::: "memory"); // prevent tail call
+    return result;
+}
+
+} // anonymous namespace
+
+TEST(sysv_thunk_sum_nine_int32s,
+    // Six arguments in registers and three on the stack.
+    callback_ptr_t cb(new direct_callback(
+        TestSumNineInt32s, 9 * sizeof(uint64_t), param_register_types()));
+    thunk_sysv thunk(cb, param_register_types());
+    auto f(reinterpret_cast<int32_t (*)(int32_t, int32_t, int32_t, int32_t,
+                                        int32_t, int32_t, int32_t, int32_t,
+                                        int32_t)>(thunk.func_addr()));
+    int32_t const result(f(1, 2, 3, 4, 5, 6, 7, 8, -9));
+    thunk.clear();
+    assert_equals(27, result);
+);
+
+TEST(sysv_thunk_mixed,
+    param_register_types const registers(
+        param_register_type::DOUBLE, param_register_type::UINT64,
+        param_register_type::FLOAT, param_register_type::UINT64);
+    callback_ptr_t cb(new mixed_callback);
+    thunk_sysv thunk(cb, registers);
+    auto f(reinterpret_cast<double (*)(double, int64_t, float, int64_t)>(
+        thunk.func_addr()));
+    double const result(f(0.5, 10, 0.25f, 100));
+    thunk.clear();
+    assert_equals(110.75, result);
+);
+
+TEST(sysv_thunk_recycle,
+    callback_ptr_t cb(new direct_callback(
+        TestInt32, sizeof(uint64_t), param_register_types()));
+    std::unique_ptr<thunk_sysv> thunk1(
+        new thunk_sysv(cb, param_register_types()));
+    void * const func_addr(thunk1->func_addr());
+    thunk1->clear();
+    thunk1.reset();
+    thunk_sysv thunk2(cb, param_register_types());
+    assert_equals(func_addr, thunk2.func_addr());
+    auto f(reinterpret_cast<int32_t (*)(int32_t)>(thunk2.func_addr()));
+    int32_t const result(f(-5));
+    thunk2.clear();
+    assert_equals(-5, result);
+);
+
+TEST(sysv_thunk_late_call,
+    // A call which reaches the stub after its thunk was deleted, but within
+    // the epoch, finds the implementation released but still not reused.
+    callback_ptr_t cb1(new direct_callback(
+        TestInt32, sizeof(uint64_t), param_register_types()));
+    std::unique_ptr<thunk_sysv> thunk1(
+        new thunk_sysv(cb1, param_register_types()));
+    auto f(reinterpret_cast<int32_t (*)(int32_t)>(thunk1->func_addr()));
+    {
+        jsdi::epoch_region region;
+        thunk1->clear();
+        thunk1.reset();
+        assert_equals(2, cb1.use_count());
+        callback_ptr_t cb2(new direct_callback(
+            TestInt32, sizeof(uint64_t), param_register_types()));
+        thunk_sysv thunk2(cb2, param_register_types());
+        assert_false(reinterpret_cast<void *>(f) == thunk2.func_addr());
+        assert_equals(0, f(-5));
+        thunk2.clear();
+    }
+    callback_ptr_t cb3(new direct_callback(
+        TestInt32, sizeof(uint64_t), param_register_types()));
+    thunk_sysv thunk3(cb3, param_register_types());
+    assert_equals(1, cb1.use_count());
+    thunk3.clear();
+);
+
+TEST(sysv_thunk_unwind,
+    // Without the call frame information, the unwinder would stop at the
+    // thunk and never reach the function that called it.
+    std::shared_ptr<unwind_callback> cb(new unwind_callback);
+    thunk_sysv thunk(cb, param_register_types());
+    uint64_t const result(call_recording_return(
+        reinterpret_cast<uint64_t (*)(uint64_t)>(thunk.func_addr()), *cb));
+    thunk.clear();
+    assert_equals(7, result);
+    assert_true(cb->d_found);
+);
+
+TEST(sysv_thunk_unwind_many,
+    // Every stub in a slab, and in every slab, is covered by its slab's call
+    // frame information.
+    std::shared_ptr<unwind_callback> cb(new unwind_callback);
+    std::vector<std::unique_ptr<thunk_sysv>> thunks;
+    while (thunks.size() <= stub_slabs.slots_per_slab())
+        thunks.emplace_back(new thunk_sysv(cb, param_register_types()));
+    assert_true(1 < stub_slabs.slab_count());
+    bool all_found(true);
+    for (auto i = thunks.begin(), e = thunks.end(); i != e; ++i)
+    {
+        cb->d_found = false;
+        call_recording_return(
+            reinterpret_cast<uint64_t (*)(uint64_t)>((*i)->func_addr()), *cb);
+        all_found = all_found && cb->d_found;
+        (*i)->clear();
+    }
+    assert_true(all_found);
+);
+
+TEST(sysv_thunk_timing,
+    // Measures the round trip through a thunk into a callback which does
+    // nothing but call a native function. Only the results are asserted;
+    // timings are logged.
+    typedef std::chrono::high_resolution_clock clock;
+    constexpr int N = 1000000;
+    callback_ptr_t cb(new direct_callback(
+        TestSumTwoInt32s, 2 * sizeof(uint64_t), param_register_types()));
+    thunk_sysv thunk(cb, param_register_types());
+    auto f(reinterpret_cast<int32_t (*)(int32_t, int32_t)>(thunk.func_addr()));
+    int64_t sum(0);
+    auto t0 = clock::now();
+    for (int k = 0; k < N; ++k)
+        sum += f(k, 1);
+    auto t1 = clock::now();
+    thunk.clear();
+    assert_equals(static_cast<int64_t>(N) * (N + 1) / 2, sum);
+    log_timing("thunk_sysv round trip", t1 - t0, N);
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,91 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_THUNK_SYSV_H___
+#define __INCLUDED_THUNK_SYSV_H___
+
+/**
+ * \file thunk_sysv.h
+ * \author Victor Schappert
+ * \since 20140917
+ * \brief Shim invoked according to the System V AMD64 ABI that wraps a callback
+ *        function
+ */
+
+#include "thunk.h"
+
+#include "register64.h"
+
+namespace jsdi {
+namespace abi_amd64 {
+
+struct thunk_sysv_impl;
+
+/**
+ * \brief Shim invoked via the System V AMD64 ABI that wraps a callback function
+ * \author Victor Schappert
+ * \since 20140917
+ * \see thunk64
+ * \see sysv_invoke
+ *
+ * This is the System V counterpart of \link thunk64\endlink. The thunk
+ * function spills the six general-purpose and eight SSE parameter registers,
+ * and the thunk then gathers them, along with any stack arguments, into a
+ * contiguous block of 8-byte words in left-to-right order. This is the same
+ * block that \link thunk64\endlink passes to callback#invoke(marshall_word_t const *),
+ * so callbacks work unchanged on either ABI. As with
+ * \link sysv_invoke\endlink, the register types only describe the first four
+ * parameters, so any later parameters are treated as param_register_type#UINT64.
+ *
+ * The thunk function has DWARF call frame information registered with
+ * <code>__register_frame()</code>, so C++ exceptions, debuggers and profilers
+ * can unwind through it.
+ */
+class thunk_sysv : public thunk
+{
+        //
+        // DATA
+        //
+
+        std::unique_ptr<thunk_sysv_impl> d_impl;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Constructs a System V ABI thunk
+         * \param callback_ptr Valid pointer to the callback to invoke when
+         *        #func_addr() const is called
+         * \param register_types Register types of the first four parameters
+         */
+        thunk_sysv(const std::shared_ptr<callback>& callback_ptr,
+                   param_register_types register_types);
+
+        /**
+         * \brief Destroys the thunk, keeping its stub code so that a thunk
+         *        constructed later can reuse it
+         */
+        ~thunk_sysv();
+
+        //
+        // ANCESTOR CLASS: thunk
+        //
+
+    public:
+
+        /**
+         * \brief Returns the address of the dynamically-generated System V
+         *        ABI thunk function
+         * \return Thunk function address
+         */
+        void * func_addr() const;
+};
+
+} // namespace abi_amd64
+} // namespace jsdi
+
+#endif // __INCLUDED_THUNK_SYSV_H___
@@ -9,11 +9,13 @@
 // desc: JVM's interface for functionality specific to the x86 __stdcall ABI.
 //==============================================================================
 
+#include "arena.h"
 #include "global_refs.h"
 #include "jni_exception.h"
 #include "jsdi_callback.h"
 #include "log.h"
 #include "marshalling.h"
+#include "message_filter.h"
 #include "seh.h"
 
 #include "stdcall_invoke.h"
@@ -60,6 +62,7 @@ inline jlong call_direct(JNIEnv * env, jlong funcPtr, jint sizeDirect,
 {
     jlong result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect << ", args => " << args);
     // NOTE: I had earlier noted that you could write a critical array version
@@ -98,6 +101,7 @@ inline jlong call_indirect(JNIEnv * env, jlong funcPtr, jint sizeDirect,
 {
     jlong result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect);
     jni_array<jlong> args_(env, args);
@@ -116,6 +120,7 @@ inline jlong call_vi(JNIEnv * env, jlong funcPtr, jint sizeDirect,
 {
     jlong result(0);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect);
     jni_array<jlong> args_(env, args);
@@ -228,6 +233,7 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_NativeCallX86_callVariableIndir
     jintArray ptrArray, jobjectArray viArray, jintArray viInstArray)
 {
     JNI_EXCEPTION_SAFE_CPP_BEGIN
+    arena_scope const scope;
     LOG_TRACE("funcPtr => "    << reinterpret_cast<void *>(funcPtr) << ", " <<
               "sizeDirect => " << sizeDirect);
     jni_array<jlong> args_(env, args);
@@ -255,12 +261,12 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_NativeCallX86_callVariableIndir
 /*
  * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
  * Method:    newThunkX86
- * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[II[J)V
+ * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[IIZ[J)V
  */
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_newThunkX86(
     JNIEnv * env, jclass, jobject callback, jobject boundValue, jint sizeDirect,
     jint sizeTotal, jintArray ptrArray, jint variableIndirectCount,
-    jlongArray outThunkAddrs)
+    jboolean lazyVariableIndirect, jlongArray outThunkAddrs)
 {
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     jni_array_region<jint> ptr_array(env, ptrArray);
@@ -285,7 +291,8 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_newThunkX86(
         callback_ptr.reset(
             new jsdi_callback_vi(env, callback, boundValue, sizeDirect,
                                  sizeTotal, ptr_array.begin(), ptr_array.size(),
-                                 variableIndirectCount));
+                                 variableIndirectCount,
+                                 JNI_FALSE != lazyVariableIndirect));
     }
     stdcall_thunk * thunk(new stdcall_thunk(callback_ptr));
     LOG_DEBUG("Created " << *thunk);
@@ -317,3 +324,58 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_deleteThunkX86
     seh::convert_to_cpp(clear_func);
     JNI_EXCEPTION_SAFE_CPP_END(env);
 }
+
+/*
+ * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
+ * Method:    setMessageFilterX86
+ * Signature: (J[IJZ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_setMessageFilterX86
+  (JNIEnv * env, jclass, jlong thunkObjectAddr, jintArray messages,
+   jlong prevWndProc, jboolean unicode)
+{
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    static_assert(sizeof(stdcall_thunk *) <= sizeof(jlong), "fatal data loss");
+    auto thunk(reinterpret_cast<stdcall_thunk *>(thunkObjectAddr));
+    std::unique_ptr<message_filter> filter;
+    if (messages)
+    {
+        jni_array_region<jint> messages_(env, messages);
+        filter.reset(
+            new message_filter(messages_.data(), messages_.size(),
+                               reinterpret_cast<void *>(prevWndProc),
+                               JNI_FALSE != unicode));
+    }
+    thunk->callback_ptr()->set_filter(std::move(filter));
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+}
+
+/*
+ * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
+ * Method:    messageFilterStatsX86
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_messageFilterStatsX86
+  (JNIEnv * env, jclass, jlong thunkObjectAddr)
+{
+    jlongArray result(nullptr);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    auto thunk(reinterpret_cast<stdcall_thunk *>(thunkObjectAddr));
+    message_filter const * const filter(thunk->callback_ptr()->filter());
+    if (filter)
+    {
+        jlong const values[] =
+        {
+            static_cast<jlong>(filter->filtered_count()),
+            static_cast<jlong>(filter->delivered_count())
+        };
+        jsize const N(static_cast<jsize>(array_length(values)));
+        result = env->NewLongArray(N);
+        JNI_EXCEPTION_CHECK(env);
+        if (! result) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+        env->SetLongArrayRegion(result, 0, N, values);
+        JNI_EXCEPTION_CHECK(env);
+    }
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
@@ -12,10 +12,11 @@
 #include "stdcall_thunk.h"
 
 #include "callback.h"
-#include "heap.h"
 #include "log.h"
+#include "thunk_slab.h"
 
 #include <cassert>
+#include <cstring>
 #include <functional>
 #include <limits>
 #include <stdexcept>
@@ -33,30 +34,44 @@ namespace {
 
 enum
 {
-    CODE_SIZE                = 18,
-    CODE_IMPL_POINTER_OFFSET =  6,
-    CODE_CALL_ADDR_OFFSET    = 11,
-    CODE_RET_OFFSET          = 15,
-    CODE_RET_POP_SIZE_OFFSET = CODE_RET_OFFSET + 1,
+    CODE_SIZE                   = 26,
+    CODE_IMPL_ADDR_OFFSET       =  7,
+    CODE_WRAPPER_ADDR_OFFSET    = 13,
+    CODE_POP_SIZE_ADDR_OFFSET   = 20,
+    CODE_SLOT_SIZE              = 32,
+    DATA_SLOT_SIZE              = 16,
 };
 
+// NOTE: The stub code lives on a read-execute page and is written exactly
+//       once, when its slab is created (see thunk_slab_allocator), so it can't
+//       contain anything specific to a particular thunk. Instead, it loads the
+//       implementation pointer, the wrapper address, and the number of bytes
+//       of arguments to remove from the stack from the stub's data slot. Since
+//       the 'ret' instruction can only take an immediate operand, the stub
+//       returns by popping the return address and jumping to it.
 constexpr unsigned char INSTRUCTIONS[CODE_SIZE] =
 {
     0x8d, 0x44, 0x24, 0x04,          // lea [esp+4], %eax
                                      //   Get pointer to start of arguments
     0x50,                            // push %eax
                                      //   Push pointer to arguments onto stack
-    0x68, 0x55, 0x55, 0x55, 0x55,    // push $0x55555555
-                                     //   Placeholder for pushing impl pointer
-    0xe8, 0x66, 0x66, 0x66, 0x66,    // call $0x66666666
-                                     //   Placeholder for call-relative operand
-                                     //   to call wrapper which itself is a
-                                     //   __stdcall function so it, not us, will
-                                     //   clean up the two arguments we pushed
-                                     //   above.
-    0xc2, 0x77, 0x77,                // ret $0x7777
-                                     //   Pop return value, then remove
-                                     //   args passed by caller from stack
+    0xff, 0x35, 0x55, 0x55, 0x55,    // push ($0x55555555)
+    0x55,                            //   Placeholder for address of impl
+                                     //   pointer in the data slot
+    0xff, 0x15, 0x66, 0x66, 0x66,    // call *($0x66666666)
+    0x66,                            //   Placeholder for address of wrapper
+                                     //   address in the data slot. The wrapper
+                                     //   is itself a __stdcall function so it,
+                                     //   not us, will clean up the two
+                                     //   arguments we pushed above.
+    0x59,                            // pop %ecx
+                                     //   Pop return address
+    0x03, 0x25, 0x77, 0x77, 0x77,    // add ($0x77777777), %esp
+    0x77,                            //   Placeholder for address of pop size
+                                     //   in the data slot. Removes args passed
+                                     //   by caller from stack.
+    0xff, 0xe1,                      // jmp *%ecx
+                                     //   Return to caller
 };
 
 #if !defined(_MSC_VER)
@@ -66,73 +81,47 @@ constexpr unsigned char INSTRUCTIONS[CODE_SIZE] =
 //       of version 18.00.21114 for x86 (November 2013 CTP). These asserts
 //       should be re-enabled as soon as 'constexpr' support is properly
 //       available.
-static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_POINTER_OFFSET+0], "check code");
-static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_POINTER_OFFSET+1], "check code");
-static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_POINTER_OFFSET+2], "check code");
-static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_POINTER_OFFSET+3], "check code");
-static_assert(0x66 == INSTRUCTIONS[CODE_CALL_ADDR_OFFSET+0], "check code");
-static_assert(0x66 == INSTRUCTIONS[CODE_CALL_ADDR_OFFSET+1], "check code");
-static_assert(0x66 == INSTRUCTIONS[CODE_CALL_ADDR_OFFSET+2], "check code");
-static_assert(0x66 == INSTRUCTIONS[CODE_CALL_ADDR_OFFSET+3], "check code");
-static_assert(0x77 == INSTRUCTIONS[CODE_RET_POP_SIZE_OFFSET+0], "check code");
-static_assert(0x77 == INSTRUCTIONS[CODE_RET_POP_SIZE_OFFSET+1], "check code");
+static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_ADDR_OFFSET+0], "check code");
+static_assert(0x55 == INSTRUCTIONS[CODE_IMPL_ADDR_OFFSET+3], "check code");
+static_assert(0x66 == INSTRUCTIONS[CODE_WRAPPER_ADDR_OFFSET+0], "check code");
+static_assert(0x66 == INSTRUCTIONS[CODE_WRAPPER_ADDR_OFFSET+3], "check code");
+static_assert(0x77 == INSTRUCTIONS[CODE_POP_SIZE_ADDR_OFFSET+0], "check code");
+static_assert(0x77 == INSTRUCTIONS[CODE_POP_SIZE_ADDR_OFFSET+3], "check code");
 #endif
 
+constexpr unsigned char NOP = 0x90;
+
 typedef uint64_t (__stdcall * wrapper_func)(stdcall_thunk_impl *,
                                             const marshall_word_t *);
 
-struct stub_code
+struct stub_data
 {
-    unsigned char d_instructions[CODE_SIZE];
-    stub_code(stdcall_thunk_impl *, wrapper_func, int);
+    stdcall_thunk_impl * d_impl;
+    wrapper_func         d_wrapper_addr;
+    uint32_t             d_pop_size;
 };
+static_assert(sizeof(stub_data) <= DATA_SLOT_SIZE, "check data");
+
+inline stub_data * data_of(thunk_slab_allocator::slot const& s)
+{ return reinterpret_cast<stub_data *>(s.data); }
 
-// Compute the operand for the 'call relative' instruction. The operand is an
-// offset which when added to the address of the next instruction gives you the
-// jump address.
-//     See e.g. here: http://stackoverflow.com/q/9438544/1911388
-inline int call_relative_offset(wrapper_func thunk_wrapper, stub_code& code)
+inline void write_address(unsigned char * dest, void * addr)
 {
-    unsigned char * near_jump_addr =
-        reinterpret_cast<unsigned char *>(thunk_wrapper);
-    unsigned char * next_inst_addr = &code.d_instructions[CODE_RET_OFFSET];
-    return near_jump_addr - next_inst_addr;
+    static_assert(4 == sizeof(addr), "check code");
+    std::memcpy(dest, &addr, sizeof(addr));
 }
 
-stub_code::stub_code(stdcall_thunk_impl * impl_addr, wrapper_func thunk_wrapper,
-                     int args_size_bytes)
+void write_stub(uint8_t * code, uint8_t * data, wrapper_func thunk_wrapper)
 {
-    std::memcpy(d_instructions, INSTRUCTIONS, sizeof(INSTRUCTIONS));
-    assert(impl_addr || !"thunk implementation cannot be NULL");
-    assert(
-        0 == args_size_bytes % 4
-            || !"argument size must be a multiple of 4 bytes");
-    static_assert(4 == sizeof(impl_addr), "check code");
-    // Replace the placeholder bytes for the first argument to the wrapper
-    // function with the address of the thunk implementation.
-    std::memcpy(d_instructions + CODE_IMPL_POINTER_OFFSET, &impl_addr,
-                sizeof(impl_addr));
-    // Replace the placeholder bytes for the address of the wrapper function
-    // itself with stdcall_thunk_impl::wrapper.
-    int offset = call_relative_offset(thunk_wrapper, *this);
-    static_assert(4 == sizeof(int), "check code");
-    std::memcpy(d_instructions + CODE_CALL_ADDR_OFFSET, &offset, sizeof(int));
-    // Finally, replace the placeholder bytes for the number of bytes by the
-    // ret instruction with the number of bytes which the thunk containing this
-    // stub code block must pop off of the execution stack in order to
-    // successfully emulate the stdcall function which the caller believes it
-    // invoked when it called the thunk.
-    if (!(0 <= args_size_bytes
-        && args_size_bytes <= std::numeric_limits<uint16_t>::max()))
-    {
-        std::ostringstream() << "Thunk argument size of " << args_size_bytes
-                             << " cannot be represented in a 2-byte unsigned"
-                                " RET instruction operand"
-                             << throw_cpp<std::runtime_error>();
-    }
-    uint16_t ret_pop_size(args_size_bytes);
-    std::memcpy(d_instructions + CODE_RET_POP_SIZE_OFFSET, &ret_pop_size,
-                sizeof(ret_pop_size));
+    stub_data * const d(reinterpret_cast<stub_data *>(data));
+    std::memcpy(code, INSTRUCTIONS, sizeof(INSTRUCTIONS));
+    std::memset(code + CODE_SIZE, NOP, CODE_SLOT_SIZE - CODE_SIZE);
+    // Replace the placeholder bytes with the addresses of the corresponding
+    // fields of the data slot.
+    write_address(code + CODE_IMPL_ADDR_OFFSET, &d->d_impl);
+    write_address(code + CODE_WRAPPER_ADDR_OFFSET, &d->d_wrapper_addr);
+    write_address(code + CODE_POP_SIZE_ADDR_OFFSET, &d->d_pop_size);
+    d->d_wrapper_addr = thunk_wrapper;
 }
 
 } // anonymous namespace
@@ -141,22 +130,16 @@ stub_code::stub_code(stdcall_thunk_impl * impl_addr, wrapper_func thunk_wrapper,
 //                         struct stdcall_thunk_impl
 //==============================================================================
 
-namespace {
-
-heap impl_heap("stdcall_thunk_impl", true);
-
-} // anonymous namespace
-
 struct stdcall_thunk_impl
 {
     //
     // DATA
     //
 
-    stub_code                 d_code;
-    std::function<void()>     d_setup;
-    std::shared_ptr<callback> d_callback;
-    std::function<void()>     d_teardown;
+    thunk_slab_allocator::slot d_slot;
+    std::function<void()>      d_setup;
+    std::shared_ptr<callback>  d_callback;
+    std::function<void()>      d_teardown;
 
     //
     // CONSTRUCTORS
@@ -166,6 +149,8 @@ struct stdcall_thunk_impl
                        const std::shared_ptr<callback>&,
                        const std::function<void()>&);
 
+    ~stdcall_thunk_impl();
+
     //
     // STATIC FUNCTIONS
     //
@@ -173,33 +158,57 @@ struct stdcall_thunk_impl
     static uint64_t __stdcall wrapper(stdcall_thunk_impl *,
                                       const marshall_word_t *);
 
+    static void write_slot(uint8_t *, uint8_t *);
+
     //
     // ACCESSORS
     //
 
     void * func_addr();
+};
 
-    //
-    // OPERATORS
-    //
-
-    void * operator new(size_t);
+namespace {
 
-    void operator delete(void *);
+thunk_slab_allocator stub_slabs(CODE_SLOT_SIZE, DATA_SLOT_SIZE,
+                                stdcall_thunk_impl::write_slot);
 
-    void * operator new[](size_t) = delete;
-    void operator delete[](void *) = delete;
-};
+} // anonymous namespace
 
 stdcall_thunk_impl::stdcall_thunk_impl(
     const std::function<void()>& setup,
     const std::shared_ptr<callback>& callback,
     const std::function<void()>& teardown)
-    : d_code(this, wrapper, callback->size_direct())
+    : d_slot()
     , d_setup(setup)
     , d_callback(callback)
     , d_teardown(teardown)
-{ }
+{
+    // The number of bytes which the stub must pop off of the execution stack
+    // in order to successfully emulate the stdcall function which the caller
+    // believes it invoked when it called the thunk.
+    int const args_size_bytes(callback->size_direct());
+    assert(
+        0 == args_size_bytes % 4
+            || !"argument size must be a multiple of 4 bytes");
+    if (!(0 <= args_size_bytes
+        && args_size_bytes <= std::numeric_limits<uint16_t>::max()))
+    {
+        std::ostringstream() << "Thunk argument size of " << args_size_bytes
+                             << " cannot be represented in a 2-byte unsigned"
+                                " RET instruction operand"
+                             << throw_cpp<std::runtime_error>();
+    }
+    d_slot = stub_slabs.allocate();
+    stub_data * const data(data_of(d_slot));
+    data->d_impl     = this;
+    data->d_pop_size = static_cast<uint32_t>(args_size_bytes);
+}
+
+stdcall_thunk_impl::~stdcall_thunk_impl()
+{
+    data_of(d_slot)->d_impl = nullptr;
+    stub_slabs.free(d_slot);
+}
 
 uint64_t __stdcall stdcall_thunk_impl::wrapper(stdcall_thunk_impl * impl,
                                                const marshall_word_t * args)
@@ -215,7 +224,7 @@ uint64_t __stdcall stdcall_thunk_impl::wrapper(stdcall_thunk_impl * impl,
     try
     {
         // TODO: Put in SEH blocks here (catch, teardown(), rethrow)
-        result = impl->d_callback->call(args);
+        result = impl->d_callback->invoke(args);
     }
     catch (const std::exception& e)
     {
@@ -231,14 +240,11 @@ uint64_t __stdcall stdcall_thunk_impl::wrapper(stdcall_thunk_impl * impl,
     return result;
 }
 
-inline void * stdcall_thunk_impl::func_addr()
-{ return d_code.d_instructions; }
+void stdcall_thunk_impl::write_slot(uint8_t * code, uint8_t * data)
+{ write_stub(code, data, wrapper); }
 
-void * stdcall_thunk_impl::operator new(size_t n)
-{ return impl_heap.alloc(n); }
-
-void stdcall_thunk_impl::operator delete(void * ptr)
-{ impl_heap.free(ptr); }
+inline void * stdcall_thunk_impl::func_addr()
+{ return d_slot.code; }
 
 //==============================================================================
 //                            class stdcall_thunk
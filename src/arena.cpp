@@ -0,0 +1,356 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: arena.cpp
+// auth: Victor Schappert
+// date: 20140914
+// desc: Per-thread bump allocator for memory that only lives as long as a
+//       native call
+//==============================================================================
+
+#include "arena.h"
+
+#include <atomic>
+#include <cassert>
+
+namespace jsdi {
+
+namespace {
+
+// NOTE: The arena itself can't have thread storage duration because it isn't
+//       POD (see JSDI_THREAD_LOCAL), so it is allocated on first use and freed
+//       by DllMain() when the thread exits.
+JSDI_THREAD_LOCAL arena * this_thread_arena;
+
+std::atomic<size_t>   process_high_water(0);
+std::atomic<uint64_t> chunk_allocations(0);
+
+// Chunk data starts after the two-word header, rounded up so that the data is
+// as well aligned as anything the free store returns.
+const size_t CHUNK_HEADER_BYTES = 16;
+
+inline char * align_up(char * ptr, size_t align)
+{
+    uintptr_t const x(reinterpret_cast<uintptr_t>(ptr));
+    return reinterpret_cast<char *>((x + align - 1) & ~(align - 1));
+}
+
+template<typename Chunk>
+inline char * chunk_data(Chunk * c)
+{ return reinterpret_cast<char *>(c) + CHUNK_HEADER_BYTES; }
+
+void update_process_high_water(size_t value)
+{
+    size_t prev(process_high_water.load(std::memory_order_relaxed));
+    while (prev < value &&
+           ! process_high_water.compare_exchange_weak(
+                 prev, value, std::memory_order_relaxed))
+    { }
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                               class arena
+//==============================================================================
+
+void arena::push_chunk(size_t min_capacity)
+{
+    size_t capacity(d_chunk ? 2 * d_chunk->d_capacity : MIN_CHUNK_BYTES);
+    if (capacity < min_capacity) capacity = min_capacity;
+    chunk * c(nullptr);
+    if (d_spare && capacity <= d_spare->d_capacity)
+    {
+        c = d_spare;
+        d_spare = nullptr;
+    }
+    else
+    {
+        if (std::numeric_limits<size_t>::max() - CHUNK_HEADER_BYTES < capacity)
+            throw std::bad_alloc();
+        c = static_cast<chunk *>(::operator new(CHUNK_HEADER_BYTES + capacity));
+        c->d_capacity = capacity;
+        chunk_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (d_chunk)
+        d_used_below += static_cast<size_t>(d_top - chunk_data(d_chunk));
+    c->d_prev = d_chunk;
+    d_chunk   = c;
+    d_top     = chunk_data(c);
+    d_end     = d_top + c->d_capacity;
+}
+
+void arena::retire_chunk(chunk * c)
+{
+    // Only the biggest retired chunk is worth keeping, since the next call
+    // probably needs about as much memory as this one did.
+    if (! d_spare) d_spare = c;
+    else if (d_spare->d_capacity < c->d_capacity)
+    {
+        ::operator delete(d_spare);
+        d_spare = c;
+    }
+    else ::operator delete(c);
+}
+
+bool arena::owns(void const * ptr) const
+{
+    char const * const p(static_cast<char const *>(ptr));
+    for (chunk * c = d_chunk; c; c = c->d_prev)
+    {
+        char const * const begin(chunk_data(c));
+        if (begin <= p && p < begin + c->d_capacity) return true;
+    }
+    return false;
+}
+
+arena::arena()
+    : d_chunk(nullptr)
+    , d_spare(nullptr)
+    , d_top(nullptr)
+    , d_end(nullptr)
+    , d_used_below(0)
+    , d_depth(0)
+    , d_high_water(0)
+{ }
+
+arena::~arena()
+{
+    assert(0 == d_depth || !"arena destroyed while a scope is active");
+    marker const empty = { nullptr, nullptr, 0 };
+    rewind(empty);
+    ::operator delete(d_spare);
+}
+
+size_t arena::bytes_in_use() const
+{
+    return d_chunk
+        ? d_used_below + static_cast<size_t>(d_top - chunk_data(d_chunk))
+        : 0;
+}
+
+void * arena::allocate(size_t size, size_t align)
+{
+    assert(0 < align && 0 == (align & (align - 1)));
+    if (0 == d_depth) return ::operator new(size);
+    char * result(align_up(d_top, align));
+    if (! d_chunk || d_end < result ||
+        static_cast<size_t>(d_end - result) < size)
+    {
+        if (std::numeric_limits<size_t>::max() - align < size)
+            throw std::bad_alloc();
+        push_chunk(size + align - 1);
+        result = align_up(d_top, align);
+    }
+    d_top = result + size;
+    size_t const in_use(bytes_in_use());
+    if (d_high_water < in_use) d_high_water = in_use;
+    return result;
+}
+
+void arena::deallocate(void * ptr, size_t size)
+{
+    if (! ptr) return;
+    else if (! owns(ptr)) ::operator delete(ptr);
+    else if (static_cast<char *>(ptr) + size == d_top)
+        d_top = static_cast<char *>(ptr);
+}
+
+void arena::rewind(marker const& m)
+{
+    while (d_chunk != m.d_chunk)
+    {
+        assert(d_chunk || !"marker is not from this arena");
+        chunk * const c(d_chunk);
+        d_chunk = c->d_prev;
+        retire_chunk(c);
+    }
+    d_top        = m.d_top;
+    d_end        = d_chunk ? chunk_data(d_chunk) + d_chunk->d_capacity
+                           : nullptr;
+    d_used_below = m.d_used_below;
+}
+
+void arena::leave(marker const& m)
+{
+    assert(0 < d_depth || !"not in a scope");
+    rewind(m);
+    if (0 == --d_depth)
+    {
+        assert(! d_chunk);
+        if (d_spare && MAX_RETAINED_BYTES < d_spare->d_capacity)
+        {
+            ::operator delete(d_spare);
+            d_spare = nullptr;
+        }
+        update_process_high_water(d_high_water);
+    }
+}
+
+arena& arena::this_thread()
+{
+    if (! this_thread_arena)
+    {
+        this_thread_arena = new arena;
+#if !defined(_WIN32)
+        call_at_thread_exit(&arena::thread_detach);
+#endif
+    }
+    return *this_thread_arena;
+}
+
+void arena::thread_detach()
+{
+    delete this_thread_arena;
+    this_thread_arena = nullptr;
+}
+
+size_t arena::process_high_water_mark()
+{ return process_high_water.load(std::memory_order_relaxed); }
+
+uint64_t arena::chunk_allocation_count()
+{ return chunk_allocations.load(std::memory_order_relaxed); }
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <thread>
+#include <vector>
+
+using namespace jsdi;
+
+namespace {
+
+template<typename T>
+bool is_aligned(T const * p)
+{ return 0 == reinterpret_cast<uintptr_t>(p) % alignof(T); }
+
+} // anonymous namespace
+
+// Each test runs on a new thread so that it starts with a fresh arena and
+// doesn't disturb the arena of the thread running the tests.
+
+TEST(arena_scope_reset,
+    bool ok(false);
+    std::thread t([&ok]()
+    {
+        arena& a(arena::this_thread());
+        bool good(0 == a.depth() && 0 == a.bytes_in_use());
+        {
+            arena_scope scope;
+            good = good && 1 == a.depth();
+            void * const p(a.allocate(100, 8));
+            void * const q(a.allocate(1, 1));
+            double * const r(static_cast<double *>(a.allocate(8, 8)));
+            good = good && p && q && r && is_aligned(r);
+            good = good && 109 <= a.bytes_in_use() && 100 < a.high_water_mark();
+        }
+        good = good && 0 == a.depth() && 0 == a.bytes_in_use();
+        good = good && 109 <= a.high_water_mark();
+        good = good && a.high_water_mark() <= arena::process_high_water_mark();
+        arena::thread_detach();
+        ok = good;
+    });
+    t.join();
+    assert_true(ok);
+);
+
+TEST(arena_nested_scope,
+    bool ok(false);
+    std::thread t([&ok]()
+    {
+        arena& a(arena::this_thread());
+        bool good(true);
+        {
+            arena_scope outer;
+            char * const p(static_cast<char *>(a.allocate(10, 1)));
+            size_t const outer_in_use(a.bytes_in_use());
+            {
+                arena_scope inner;
+                good = good && 2 == a.depth();
+                a.allocate(3 * arena::MIN_CHUNK_BYTES, 16); // forces new chunk
+                good = good && 3 * arena::MIN_CHUNK_BYTES < a.bytes_in_use();
+            }
+            // Leaving the inner scope only gives back the inner allocations.
+            good = good && 1 == a.depth() && outer_in_use == a.bytes_in_use();
+            char * const q(static_cast<char *>(a.allocate(1, 1)));
+            good = good && p + 10 == q;
+        }
+        arena::thread_detach();
+        ok = good;
+    });
+    t.join();
+    assert_true(ok);
+);
+
+TEST(arena_deallocate,
+    bool ok(false);
+    std::thread t([&ok]()
+    {
+        arena& a(arena::this_thread());
+        // Outside a scope, memory comes from the free store.
+        void * const heap(a.allocate(32, 8));
+        bool good(0 == a.bytes_in_use());
+        {
+            arena_scope scope;
+            void * const p(a.allocate(32, 8));
+            void * const q(a.allocate(64, 8));
+            size_t const in_use(a.bytes_in_use());
+            a.deallocate(p, 32); // not the last allocation, so not reclaimed
+            good = good && in_use == a.bytes_in_use();
+            a.deallocate(q, 64);
+            good = good && in_use - 64 == a.bytes_in_use();
+            a.deallocate(heap, 32); // free store memory goes back to the heap
+        }
+        arena::thread_detach();
+        ok = good;
+    });
+    t.join();
+    assert_true(ok);
+);
+
+TEST(arena_steady_state,
+    // Once a thread has warmed up, repeating the same work in a new outermost
+    // scope doesn't allocate any chunks.
+    bool ok(false);
+    uint64_t allocations(0);
+    std::thread t([&ok, &allocations]()
+    {
+        auto work = []()
+        {
+            arena_scope scope;
+            std::vector<int, arena_allocator<int>> v;
+            for (int k = 0; k < 10000; ++k) v.push_back(k);
+            return 9999 == v.back();
+        };
+        bool good(work() && work());
+        uint64_t const before(arena::chunk_allocation_count());
+        for (int k = 0; k < 10; ++k) good = good && work();
+        allocations = arena::chunk_allocation_count() - before;
+        arena::thread_detach();
+        ok = good;
+    });
+    t.join();
+    assert_true(ok);
+    assert_equals(0, allocations);
+);
+
+TEST(arena_allocator_no_scope,
+    std::vector<double, arena_allocator<double>> v(100, 1.5);
+    assert_equals(100, v.size());
+    assert_true(is_aligned(v.data()));
+    v.resize(1000, 2.5);
+    assert_equals(1.5, v[99]);
+    assert_equals(2.5, v[999]);
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,420 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_ARENA_H___
+#define __INCLUDED_ARENA_H___
+
+/**
+ * \file arena.h
+ * \author Victor Schappert
+ * \since 20140914
+ * \brief Per-thread bump allocator for memory that only lives as long as a
+ *        native call
+ */
+
+#include "util.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace jsdi {
+
+//==============================================================================
+//                               class arena
+//==============================================================================
+
+/**
+ * \brief Bump allocator for the transient memory used while marshalling a
+ *        native call or a callback
+ * \author Victor Schappert
+ * \since 20140914
+ * \see arena_scope
+ * \see arena_allocator
+ *
+ * Each thread has its own arena, returned by #this_thread(), so no locking is
+ * needed. Memory is only handed out by the arena while at least one
+ * \link arena_scope\endlink is active on the thread. The JNI entry points
+ * which marshall a call, and callback#invoke(marshall_word_t const *), each
+ * open a scope, so scopes nest naturally when a native call invokes a callback
+ * which in turn makes another native call. Leaving a nested scope gives back
+ * everything allocated within it, and leaving the outermost scope resets the
+ * arena entirely.
+ *
+ * The arena grows by adding chunks. When it is reset, the largest chunk is
+ * kept for the next call (provided it isn't bigger than #MAX_RETAINED_BYTES),
+ * so once a thread has warmed up, marshalling doesn't touch the heap at all.
+ *
+ * Outside of any scope, #allocate(size_t, size_t) and
+ * #deallocate(void *, size_t) simply use the free store, so containers using
+ * an \link arena_allocator\endlink still work when no scope is active.
+ */
+class arena : private non_copyable
+{
+        //
+        // TYPES
+        //
+
+        struct chunk
+        {
+            chunk * d_prev;
+            size_t  d_capacity;
+        };
+
+    public:
+
+        /**
+         * \brief Position in an arena that it can later be rewound to
+         * \see #mark() const
+         * \see #rewind(const marker&)
+         */
+        struct marker
+        {
+            /** \cond internal */
+            chunk * d_chunk;
+            char *  d_top;
+            size_t  d_used_below;
+            /** \endcond internal */
+        };
+
+        //
+        // DATA
+        //
+
+    private:
+
+        chunk * d_chunk;        // current chunk
+        chunk * d_spare;        // retired chunk kept for reuse
+        char *  d_top;          // next free byte in d_chunk
+        char *  d_end;          // end of d_chunk
+        size_t  d_used_below;   // bytes used in the chunks below d_chunk
+        size_t  d_depth;        // number of active scopes
+        size_t  d_high_water;   // maximum bytes in use
+
+        //
+        // INTERNALS
+        //
+
+        void push_chunk(size_t min_capacity);
+
+        void retire_chunk(chunk * c);
+
+        bool owns(void const * ptr) const;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /** \brief Constructs an empty arena */
+        arena();
+
+        ~arena();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of \link arena_scope\endlink objects
+         *        active on the arena
+         * \return Scope nesting depth
+         */
+        size_t depth() const;
+
+        /**
+         * \brief Returns the number of bytes currently allocated from the
+         *        arena, including alignment padding
+         * \return Bytes in use
+         */
+        size_t bytes_in_use() const;
+
+        /**
+         * \brief Returns the largest value #bytes_in_use() const has had over
+         *        the life of the arena
+         * \return High-water mark, in bytes
+         */
+        size_t high_water_mark() const;
+
+        /**
+         * \brief Returns the current position of the arena
+         * \return Marker which can be passed to #rewind(const marker&)
+         */
+        marker mark() const;
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Smallest capacity of any chunk allocated by an arena
+         */
+        static const size_t MIN_CHUNK_BYTES = 16 * 1024;
+
+        /**
+         * \brief Largest chunk that an arena retains after it is reset
+         */
+        static const size_t MAX_RETAINED_BYTES = 1024 * 1024;
+
+        /**
+         * \brief Allocates memory
+         * \param size Number of bytes required
+         * \param align Required alignment, which must be a power of two
+         * \return Non-<code>null</code> pointer to the memory, whose contents
+         *         are unspecified
+         * \throws std::bad_alloc If there isn't enough memory
+         * \see #deallocate(void *, size_t)
+         *
+         * If no scope is active, the memory is allocated from the free store.
+         */
+        void * allocate(size_t size, size_t align);
+
+        /**
+         * \brief Gives back memory returned by #allocate(size_t, size_t)
+         * \param ptr Pointer returned by #allocate(size_t, size_t)
+         * \param size Size passed to #allocate(size_t, size_t)
+         *
+         * Memory from the arena is only reclaimed immediately if it was the
+         * most recent allocation. Otherwise, it is reclaimed when the
+         * enclosing scope is left.
+         */
+        void deallocate(void * ptr, size_t size);
+
+        /**
+         * \brief Gives back everything allocated since a marker was taken
+         * \param m Marker returned by #mark() const, which must not have been
+         *        invalidated by rewinding to an earlier marker
+         */
+        void rewind(marker const& m);
+
+        /**
+         * \brief Enters a scope
+         * \return Marker to pass to #leave(const marker&)
+         * \see arena_scope
+         */
+        marker enter();
+
+        /**
+         * \brief Leaves a scope entered with #enter()
+         * \param m Marker returned by the matching call to #enter()
+         *
+         * If this is the outermost scope, the arena is reset.
+         */
+        void leave(marker const& m);
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the calling thread's arena, creating it if necessary
+         * \return Reference to the arena
+         */
+        static arena& this_thread();
+
+        /**
+         * \brief Destroys the calling thread's arena, if it has one
+         *
+         * This function is called from <code>DllMain()</code> when a thread
+         * exits.
+         */
+        static void thread_detach();
+
+        /**
+         * \brief Returns the largest high-water mark of any arena when its
+         *        outermost scope was left
+         * \return Process-wide high-water mark, in bytes
+         */
+        static size_t process_high_water_mark();
+
+        /**
+         * \brief Returns the number of chunks that arenas have allocated from
+         *        the free store
+         * \return Number of chunks allocated since the library was loaded
+         *
+         * Once the threads making native calls have warmed up, this number
+         * should stop increasing.
+         */
+        static uint64_t chunk_allocation_count();
+};
+
+inline size_t arena::depth() const
+{ return d_depth; }
+
+inline size_t arena::high_water_mark() const
+{ return d_high_water; }
+
+inline arena::marker arena::mark() const
+{
+    marker const m = { d_chunk, d_top, d_used_below };
+    return m;
+}
+
+inline arena::marker arena::enter()
+{
+    ++d_depth;
+    return mark();
+}
+
+//==============================================================================
+//                            class arena_scope
+//==============================================================================
+
+/**
+ * \brief Activates the calling thread's \link arena\endlink for the lifetime of
+ *        the scope object
+ * \author Victor Schappert
+ * \since 20140914
+ *
+ * Any object allocated from the arena within the scope must be destroyed
+ * before the scope object is. The simplest way to ensure this is to declare
+ * the scope object before anything else in the function that makes the native
+ * call or handles the callback.
+ */
+class arena_scope : private non_copyable
+{
+        //
+        // DATA
+        //
+
+        arena&        d_arena;
+        arena::marker d_mark;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /** \brief Enters a scope on the calling thread's arena */
+        arena_scope();
+
+        ~arena_scope();
+};
+
+inline arena_scope::arena_scope()
+    : d_arena(arena::this_thread())
+    , d_mark(d_arena.enter())
+{ }
+
+inline arena_scope::~arena_scope()
+{ d_arena.leave(d_mark); }
+
+//==============================================================================
+//                           class arena_allocator
+//==============================================================================
+
+/**
+ * \brief Standard library allocator which draws from the calling thread's
+ *        \link arena\endlink
+ * \author Victor Schappert
+ * \since 20140914
+ * \tparam T Type of object to allocate
+ *
+ * Containers using this allocator must not outlive the innermost
+ * \link arena_scope\endlink that was active when they allocated memory, nor be
+ * passed between threads.
+ */
+template<typename T>
+class arena_allocator
+{
+        //
+        // TYPES
+        //
+
+    public:
+
+        /** \cond internal */
+        typedef T              value_type;
+        typedef T *            pointer;
+        typedef T const *      const_pointer;
+        typedef T&             reference;
+        typedef T const&       const_reference;
+        typedef size_t         size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        template<typename U>
+        struct rebind { typedef arena_allocator<U> other; };
+        /** \endcond internal */
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        arena_allocator() { }
+
+        template<typename U>
+        arena_allocator(arena_allocator<U> const&) { }
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Allocates storage for objects
+         * \param n Number of objects
+         * \return Pointer to uninitialized storage
+         * \throws std::bad_alloc If there isn't enough memory
+         */
+        T * allocate(size_t n);
+
+        /**
+         * \brief Gives back storage returned by #allocate(size_t)
+         * \param p Pointer returned by #allocate(size_t)
+         * \param n Number of objects passed to #allocate(size_t)
+         */
+        void deallocate(T * p, size_t n);
+
+        /** \cond internal */
+        size_t max_size() const
+        { return std::numeric_limits<size_t>::max() / sizeof(T); }
+
+        template<typename U, typename ... Args>
+        void construct(U * p, Args&& ... args)
+        { ::new(static_cast<void *>(p)) U(std::forward<Args>(args)...); }
+
+        template<typename U>
+        void destroy(U * p)
+        { p->~U(); }
+        /** \endcond internal */
+};
+
+template<typename T>
+inline T * arena_allocator<T>::allocate(size_t n)
+{
+    if (max_size() < n) throw std::bad_alloc();
+    return static_cast<T *>(
+        arena::this_thread().allocate(n * sizeof(T), alignof(T)));
+}
+
+template<typename T>
+inline void arena_allocator<T>::deallocate(T * p, size_t n)
+{ arena::this_thread().deallocate(p, n * sizeof(T)); }
+
+/** \cond internal */
+template<typename T, typename U>
+inline bool operator==(arena_allocator<T> const&, arena_allocator<U> const&)
+{ return true; }
+
+template<typename T, typename U>
+inline bool operator!=(arena_allocator<T> const&, arena_allocator<U> const&)
+{ return false; }
+/** \endcond internal */
+
+} // namespace jsdi
+
+#endif // __INCLUDED_ARENA_H___
@@ -0,0 +1,213 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: buffer_pool.cpp
+// auth: Victor Schappert
+// date: 20140910
+// desc: Per-thread pool of reusable native buffers
+//==============================================================================
+
+#include "buffer_pool.h"
+
+#include <atomic>
+#include <cassert>
+
+namespace jsdi {
+
+namespace {
+
+// NOTE: The pool itself can't have thread storage duration because it isn't
+//       POD (see JSDI_THREAD_LOCAL), so it is allocated on first use and freed
+//       by DllMain() when the thread exits.
+JSDI_THREAD_LOCAL buffer_pool * this_thread_pool;
+
+std::atomic<size_t> buffer_bytes(0);
+
+void delete_buffer(char * data, size_t capacity)
+{
+    delete[] data;
+    buffer_bytes.fetch_sub(capacity, std::memory_order_relaxed);
+}
+
+size_t round_capacity(size_t size)
+{
+    size_t capacity(buffer_pool::MIN_CAPACITY);
+    while (capacity < size)
+    {
+        size_t const next(capacity << 1);
+        if (next < capacity) return size; // overflow
+        capacity = next;
+    }
+    return capacity;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                            class buffer_pool
+//==============================================================================
+
+buffer_pool::buffer_pool()
+    : d_free_bytes(0)
+{ }
+
+buffer_pool::~buffer_pool()
+{
+    for (auto i = d_free.begin(), e = d_free.end(); i != e; ++i)
+        delete_buffer(i->d_data, i->d_capacity);
+}
+
+char * buffer_pool::acquire(size_t size, size_t& capacity)
+{
+    // Best fit. The free list is short, so a linear search is fine.
+    auto const e(d_free.end());
+    auto best(e);
+    for (auto i = d_free.begin(); i != e; ++i)
+    {
+        if (size <= i->d_capacity &&
+            (e == best || i->d_capacity < best->d_capacity))
+            best = i;
+    }
+    if (e != best)
+    {
+        char * const result(best->d_data);
+        capacity = best->d_capacity;
+        d_free_bytes -= capacity;
+        *best = d_free.back();
+        d_free.pop_back();
+        return result;
+    }
+    capacity = round_capacity(size);
+    char * const result(new char[capacity]);
+    buffer_bytes.fetch_add(capacity, std::memory_order_relaxed);
+    return result;
+}
+
+void buffer_pool::release(char * data, size_t capacity)
+{
+    assert(data || !"can't release a null buffer");
+    if (MAX_POOLED_BYTES < capacity ||
+        MAX_POOLED_BYTES - capacity < d_free_bytes)
+    {
+        delete_buffer(data, capacity);
+        return;
+    }
+    buffer const b = { data, capacity };
+    d_free.push_back(b);
+    d_free_bytes += capacity;
+}
+
+buffer_pool& buffer_pool::this_thread()
+{
+    if (! this_thread_pool)
+    {
+        this_thread_pool = new buffer_pool;
+#if !defined(_WIN32)
+        call_at_thread_exit(&buffer_pool::thread_detach);
+#endif
+    }
+    return *this_thread_pool;
+}
+
+void buffer_pool::thread_detach()
+{
+    delete this_thread_pool;
+    this_thread_pool = nullptr;
+}
+
+size_t buffer_pool::process_buffer_bytes()
+{ return buffer_bytes.load(std::memory_order_relaxed); }
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+using namespace jsdi;
+
+namespace {
+
+// Copies of the static members, so that assert_equals() doesn't need their
+// addresses.
+size_t const MIN_CAPACITY(buffer_pool::MIN_CAPACITY);
+size_t const MAX_POOLED_BYTES(buffer_pool::MAX_POOLED_BYTES);
+
+} // anonymous namespace
+
+TEST(buffer_pool_reuse,
+    buffer_pool pool;
+    size_t cap1(0), cap2(0), cap3(0);
+    char * const a(pool.acquire(0, cap1));
+    assert_true(nullptr != a);
+    assert_equals(MIN_CAPACITY, cap1);
+    char * const b(pool.acquire(1000, cap2));
+    assert_equals(1024, cap2);
+    pool.release(a, cap1);
+    pool.release(b, cap2);
+    assert_equals(cap1 + cap2, pool.free_bytes());
+    // Best fit: a request for 100 bytes should get the 1024-byte buffer and a
+    // request for 10 bytes the 64-byte one.
+    assert_true(b == pool.acquire(100, cap3));
+    assert_equals(1024, cap3);
+    assert_true(a == pool.acquire(10, cap3));
+    assert_equals(MIN_CAPACITY, cap3);
+    assert_equals(0, pool.free_bytes());
+    pool.release(a, cap1);
+    pool.release(b, cap2);
+);
+
+TEST(buffer_pool_limit,
+    buffer_pool pool;
+    size_t cap1(0), cap2(0), cap3(0);
+    char * const big(pool.acquire(MAX_POOLED_BYTES + 1, cap1));
+    char * const half1(pool.acquire(MAX_POOLED_BYTES / 2, cap2));
+    char * const half2(pool.acquire(MAX_POOLED_BYTES / 2, cap3));
+    pool.release(big, cap1); // too big to retain
+    assert_equals(0, pool.free_bytes());
+    pool.release(half1, cap2);
+    pool.release(half2, cap3);
+    assert_equals(MAX_POOLED_BYTES, pool.free_bytes());
+    char * const small(pool.acquire(1, cap1));
+    assert_equals(MAX_POOLED_BYTES / 2, cap1);
+    pool.release(small, cap1);
+    char * const extra(pool.acquire(1, cap1)); // reuses a half again
+    char * const more(pool.acquire(1, cap2));
+    char * const fresh(pool.acquire(1, cap3));
+    assert_equals(MIN_CAPACITY, cap3);
+    pool.release(fresh, cap3); // pool is empty so this is retained
+    pool.release(extra, cap1);
+    pool.release(more, cap2);  // would exceed the limit, so freed
+    assert_equals(MAX_POOLED_BYTES / 2 +
+                  MIN_CAPACITY, pool.free_bytes());
+);
+
+TEST(buffer_pool_this_thread,
+    buffer_pool& pool(buffer_pool::this_thread());
+    assert_true(&pool == &buffer_pool::this_thread());
+    size_t capacity(0);
+    char * const a(pool.acquire(32, capacity));
+    pool.release(a, capacity);
+    assert_true(capacity <= pool.free_bytes());
+);
+
+TEST(buffer_pool_process_bytes,
+    size_t const before(buffer_pool::process_buffer_bytes());
+    {
+        buffer_pool pool;
+        size_t capacity(0);
+        char * const a(pool.acquire(100, capacity));
+        assert_equals(before + capacity, buffer_pool::process_buffer_bytes());
+        pool.release(a, capacity); // retained, so still counted
+        assert_equals(before + capacity, buffer_pool::process_buffer_bytes());
+    }
+    assert_equals(before, buffer_pool::process_buffer_bytes());
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,146 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_BUFFER_POOL_H___
+#define __INCLUDED_BUFFER_POOL_H___
+
+/**
+ * \file buffer_pool.h
+ * \author Victor Schappert
+ * \since 20140910
+ * \brief Per-thread pool of reusable native buffers
+ */
+
+#include "util.h"
+
+#include <vector>
+
+namespace jsdi {
+
+//==============================================================================
+//                            class buffer_pool
+//==============================================================================
+
+/**
+ * \brief Pool of heap buffers that are reused instead of being freed
+ * \author Victor Schappert
+ * \since 20140910
+ * \see marshalling_vi_container
+ *
+ * Each thread has its own pool, returned by #this_thread(), so no locking is
+ * needed. Buffers may be acquired in any order and any number may be
+ * outstanding at once, which allows a native call made from within a callback
+ * to use the pool while the outer call still holds its buffers.
+ *
+ * Buffer capacities are rounded up to a power of two so that a buffer released
+ * by one call can usually be reused by the next call of similar size. At most
+ * #MAX_POOLED_BYTES bytes of free buffers are retained by a pool; buffers
+ * released beyond that are freed.
+ */
+class buffer_pool : private non_copyable
+{
+        //
+        // TYPES
+        //
+
+        struct buffer
+        {
+            char * d_data;
+            size_t d_capacity;
+        };
+
+        //
+        // DATA
+        //
+
+        std::vector<buffer> d_free;
+        size_t              d_free_bytes;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /** \brief Constructs an empty pool */
+        buffer_pool();
+
+        ~buffer_pool();
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Smallest capacity of any buffer allocated by a pool
+         */
+        static const size_t MIN_CAPACITY = 64;
+
+        /**
+         * \brief Maximum total capacity of the free buffers retained by a pool
+         */
+        static const size_t MAX_POOLED_BYTES = 1024 * 1024;
+
+        /**
+         * \brief Returns a buffer of at least the requested size
+         * \param size Minimum number of bytes required
+         * \param capacity Receives the actual capacity of the buffer, which
+         *        must be passed to #release(char *, size_t)
+         * \return Non-<code>null</code> pointer to the buffer, whose contents
+         *         are unspecified
+         * \throws std::bad_alloc If a new buffer has to be allocated and there
+         *         isn't enough memory
+         */
+        char * acquire(size_t size, size_t& capacity);
+
+        /**
+         * \brief Returns a buffer to the pool
+         * \param data Buffer returned by #acquire(size_t, size_t&)
+         * \param capacity Capacity returned by #acquire(size_t, size_t&)
+         */
+        void release(char * data, size_t capacity);
+
+        /**
+         * \brief Returns the total capacity of the free buffers in the pool
+         * \return Number of bytes retained
+         */
+        size_t free_bytes() const;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the calling thread's pool, creating it if necessary
+         * \return Reference to the pool
+         */
+        static buffer_pool& this_thread();
+
+        /**
+         * \brief Destroys the calling thread's pool, if it has one
+         *
+         * This function is called from <code>DllMain()</code> when a thread
+         * exits.
+         */
+        static void thread_detach();
+
+        /**
+         * \brief Returns the total capacity of the buffers which all pools
+         *        have allocated and not yet freed
+         * \return Number of bytes in buffers, whether they are in use or
+         *         waiting in a pool to be reused
+         */
+        static size_t process_buffer_bytes();
+};
+
+inline size_t buffer_pool::free_bytes() const
+{ return d_free_bytes; }
+
+} // namespace jsdi
+
+#endif // __INCLUDED_BUFFER_POOL_H___
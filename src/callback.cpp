@@ -11,6 +11,9 @@
 
 #include "callback.h"
 
+#include <sstream>
+#include <stdexcept>
+
 namespace jsdi {
 
 callback::callback(jint size_direct, jint size_total, jint const * ptr_array,
@@ -20,6 +23,7 @@ callback::callback(jint size_direct, jint size_total, jint const * ptr_array,
     , d_size_total_bytes(size_total)
     , d_size_total_words(marshalling_util::num_whole_words_exact(size_total))
     , d_vi_count(vi_count)
+    , d_filter(nullptr)
 {
     assert(0 < size_direct || !"direct size must be positive");
     assert(size_direct <= size_total || !"direct size can't exceed total size");
@@ -27,4 +31,44 @@ callback::callback(jint size_direct, jint size_total, jint const * ptr_array,
     assert(0 <= vi_count || !"variable indirect count cannot be negative");
 }
 
+size_t callback::retired_filter_count() const
+{
+    std::lock_guard<std::mutex> lock(d_filters_mutex);
+    return d_retired_filters.size();
+}
+
+void callback::set_filter(std::unique_ptr<message_filter>&& filter)
+{
+    // The filter reads the window procedure arguments straight out of the
+    // callback's direct arguments, so they must be exactly that size.
+    if (filter && message_filter::ARGS_SIZE != d_size_direct)
+    {
+        std::ostringstream() << "can't filter messages for a callback with "
+                                "sizeDirect => " << d_size_direct
+                             << throw_cpp<std::invalid_argument>();
+    }
+    std::lock_guard<std::mutex> lock(d_filters_mutex);
+    d_filter.store(filter.get(), std::memory_order_release);
+    if (d_current_filter)
+    {
+        // The old filter is now unreachable for new invocations, so it can be
+        // deleted once every invocation already in progress has finished.
+        retired_filter r;
+        r.d_filter = std::move(d_current_filter);
+        r.d_epoch = epoch::retire();
+        d_retired_filters.push_back(std::move(r));
+    }
+    d_current_filter = std::move(filter);
+    uint64_t const oldest(epoch::oldest_active());
+    auto out(d_retired_filters.begin());
+    for (auto i = d_retired_filters.begin(), e = d_retired_filters.end();
+         i != e; ++i)
+    {
+        if (epoch::is_safe(i->d_epoch, oldest)) continue;
+        if (out != i) *out = std::move(*i);
+        ++out;
+    }
+    d_retired_filters.erase(out, d_retired_filters.end());
+}
+
 } // namespace jsdi
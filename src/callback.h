@@ -12,10 +12,15 @@
  * \brief Generic interface for a callback function
  */
 
+#include "arena.h"
+#include "epoch.h"
 #include "marshalling.h"
+#include "message_filter.h"
 
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <cassert>
 
 namespace jsdi {
@@ -30,7 +35,15 @@ namespace jsdi {
  * \since 20130804
  *
  * Specific implementations of this class should override
- * #call(const marshall_word_t *).
+ * #call(const marshall_word_t *). Thunks invoke a callback through
+ * #invoke(marshall_word_t const *), which gives any attached
+ * \link message_filter\endlink the chance to handle the invocation without
+ * calling #call(const marshall_word_t *) at all, and which opens an
+ * \link arena_scope\endlink for the transient memory the callback uses.
+ *
+ * An invocation uses the filter inside an \link epoch\endlink critical
+ * region, so a filter replaced by #set_filter(std::unique_ptr<message_filter>&&)
+ * is retired and deleted as soon as no invocation can still be using it.
  */
 class callback
 {
@@ -48,6 +61,19 @@ class callback
         jint              d_vi_count;
         /** \endcond internal */
 
+    private:
+
+        struct retired_filter
+        {
+            std::unique_ptr<message_filter> d_filter;
+            uint64_t                        d_epoch;
+        };
+
+        std::atomic<message_filter const *> d_filter;
+        std::unique_ptr<message_filter>     d_current_filter;
+        std::vector<retired_filter>         d_retired_filters;
+        mutable std::mutex                  d_filters_mutex;
+
         //
         // CONSTRUCTORS
         //
@@ -88,12 +114,56 @@ class callback
          */
         jint size_direct() const;
 
+        /**
+         * \brief Returns the message filter attached to the callback
+         * \return Filter, or <code>nullptr</code> if no filter is attached
+         * \see #set_filter(std::unique_ptr<message_filter>&&)
+         */
+        message_filter const * filter() const;
+
+        /**
+         * \brief Returns the number of replaced filters which may still be in
+         *        use and so haven't been deleted yet
+         * \return Number of retired filters
+         * \see #set_filter(std::unique_ptr<message_filter>&&)
+         */
+        size_t retired_filter_count() const;
+
         //
         // MUTATORS
         //
 
     public:
 
+        /**
+         * \brief Attaches a message filter to the callback, replacing any
+         *        existing filter
+         * \param filter Filter to attach, or <code>nullptr</code> to remove
+         *        the existing filter
+         * \throws std::invalid_argument If <code>filter</code> isn't
+         *         <code>nullptr</code> and the callback's direct arguments
+         *         aren't \link message_filter::ARGS_SIZE\endlink bytes
+         * \see #invoke(marshall_word_t const *)
+         *
+         * This function may be called while the callback is being invoked on
+         * another thread. Because an invocation may still be using the filter
+         * being replaced, that filter is retired in the current
+         * \link epoch\endlink rather than deleted. Each call deletes the
+         * retired filters which no invocation can still be using.
+         */
+        void set_filter(std::unique_ptr<message_filter>&& filter);
+
+        /**
+         * \brief Invokes the callback on behalf of a thunk
+         * \param args As for #call(marshall_word_t const *)
+         * \return Return value of the callback function
+         *
+         * If a \link message_filter\endlink is attached and handles the
+         * invocation, its result is returned and
+         * #call(marshall_word_t const *) isn't called.
+         */
+        uint64_t invoke(marshall_word_t const * args);
+
         /**
          * \brief Unmarshalls the parameters, does whatever work is expected,
          * and returns the callback return value
@@ -106,6 +176,21 @@ class callback
 
 inline jint callback::size_direct() const { return d_size_direct; }
 
+inline message_filter const * callback::filter() const
+{ return d_filter.load(std::memory_order_acquire); }
+
+inline uint64_t callback::invoke(marshall_word_t const * args)
+{
+    {
+        epoch_region const region; // Keeps a replaced filter from being deleted
+        message_filter const * const f(filter());
+        uint64_t result(0);
+        if (f && f->handle(args, result)) return result;
+    }
+    arena_scope const scope;
+    return call(args);
+}
+
 } // namespace jsdi
 
 #endif // __INCLUDED_CALLBACK_H___
@@ -0,0 +1,403 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: char_widen.cpp
+// auth: Victor Schappert
+// date: 20140907
+// desc: Scalar, SSE2, and AVX2 string scanning and widening with run-time
+//       selection of the implementation
+//==============================================================================
+
+#include "char_widen.h"
+
+#include <cassert>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif // if defined(_MSC_VER)
+#include <immintrin.h>
+
+// GCC only lets a function use instruction set extensions which are enabled
+// either on the command line or by a target attribute on the function itself.
+// Visual C++ allows any intrinsic in any function.
+#if defined(_MSC_VER)
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif // if defined(_MSC_VER)
+
+// The vector kernels may read past the terminating zero up to the end of the
+// vector containing it. Such reads stay within the string's page and so can't
+// fault, but AddressSanitizer can't tell them from overflows.
+#if defined(_MSC_VER)
+#define NO_SANITIZE_ADDRESS
+#else
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif // if defined(_MSC_VER)
+
+namespace jsdi {
+
+namespace {
+
+// Smallest page size on x86 and x64. A vector load which does not cross a
+// multiple of this size cannot touch a page the string does not occupy.
+const uintptr_t PAGE_SIZE = 4096;
+
+inline uint32_t count_trailing_zeros(uint32_t x)
+{
+    assert(0 != x);
+#if defined(_MSC_VER)
+    unsigned long result;
+    _BitScanForward(&result, x);
+    return static_cast<uint32_t>(result);
+#else
+    return static_cast<uint32_t>(__builtin_ctz(x));
+#endif // if defined(_MSC_VER)
+}
+
+inline bool fits_in_page(char const * p, uintptr_t vector_size)
+{ return (reinterpret_cast<uintptr_t>(p) & (PAGE_SIZE - 1)) <=
+         PAGE_SIZE - vector_size; }
+
+//
+// SCALAR
+//
+
+size_t ascii_prefix_scalar(char const * sz)
+{
+    char const * i(sz);
+    while (0 < static_cast<signed char>(*i)) ++i;
+    return static_cast<size_t>(i - sz);
+}
+
+size_t widen_scalar(char const * sz, uint16_t * dest, size_t capacity)
+{
+    size_t n(0);
+    for (; n < capacity && sz[n]; ++n)
+        dest[n] = static_cast<unsigned char>(sz[n]);
+    return n;
+}
+
+//
+// SSE2
+//
+
+TARGET_SSE2 NO_SANITIZE_ADDRESS size_t ascii_prefix_sse2(char const * sz)
+{
+    // Aligned loads can't cross a page boundary. The scan stops at any byte
+    // that is zero or has its high bit set. Bits for bytes in the first vector
+    // that precede the start of the string are shifted out.
+    uintptr_t const misalign(reinterpret_cast<uintptr_t>(sz) & 15);
+    __m128i const * p(reinterpret_cast<__m128i const *>(sz - misalign));
+    __m128i const zero(_mm_setzero_si128());
+    __m128i v(_mm_load_si128(p));
+    uint32_t stop(static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) | _mm_movemask_epi8(v)));
+    stop >>= misalign;
+    if (stop) return count_trailing_zeros(stop);
+    size_t result(16 - misalign);
+    for (;; result += 16)
+    {
+        v = _mm_load_si128(++p);
+        stop = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) | _mm_movemask_epi8(v));
+        if (stop) return result + count_trailing_zeros(stop);
+    }
+}
+
+TARGET_SSE2 NO_SANITIZE_ADDRESS size_t widen_sse2(char const * sz,
+                                                  uint16_t * dest,
+                                                  size_t capacity)
+{
+    // Each iteration widens 16 characters if there is room for them in the
+    // destination and the load stays within a page. Otherwise it widens one.
+    __m128i const zero(_mm_setzero_si128());
+    size_t n(0);
+    while (n < capacity)
+    {
+        char const * const p(sz + n);
+        if (16 <= capacity - n && fits_in_page(p, 16))
+        {
+            __m128i const v(
+                _mm_loadu_si128(reinterpret_cast<__m128i const *>(p)));
+            __m128i * const o(reinterpret_cast<__m128i *>(dest + n));
+            _mm_storeu_si128(o + 0, _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128(o + 1, _mm_unpackhi_epi8(v, zero));
+            uint32_t const nul(static_cast<uint32_t>(
+                _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))));
+            if (nul) return n + count_trailing_zeros(nul);
+            n += 16;
+        }
+        else if (*p)
+            dest[n++] = static_cast<unsigned char>(*p);
+        else
+            break;
+    }
+    return n;
+}
+
+//
+// AVX2
+//
+
+TARGET_AVX2 NO_SANITIZE_ADDRESS size_t ascii_prefix_avx2(char const * sz)
+{
+    // See ascii_prefix_sse2()
+    uintptr_t const misalign(reinterpret_cast<uintptr_t>(sz) & 31);
+    __m256i const * p(reinterpret_cast<__m256i const *>(sz - misalign));
+    __m256i const zero(_mm256_setzero_si256());
+    __m256i v(_mm256_load_si256(p));
+    uint32_t stop(static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, zero), v))));
+    stop >>= misalign;
+    if (stop) return count_trailing_zeros(stop);
+    size_t result(32 - misalign);
+    for (;; result += 32)
+    {
+        v = _mm256_load_si256(++p);
+        stop = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), v)));
+        if (stop) return result + count_trailing_zeros(stop);
+    }
+}
+
+TARGET_AVX2 NO_SANITIZE_ADDRESS size_t widen_avx2(char const * sz,
+                                                  uint16_t * dest,
+                                                  size_t capacity)
+{
+    // See widen_sse2()
+    __m256i const zero(_mm256_setzero_si256());
+    size_t n(0);
+    while (n < capacity)
+    {
+        char const * const p(sz + n);
+        if (32 <= capacity - n && fits_in_page(p, 32))
+        {
+            __m256i const v(
+                _mm256_loadu_si256(reinterpret_cast<__m256i const *>(p)));
+            __m256i * const o(reinterpret_cast<__m256i *>(dest + n));
+            _mm256_storeu_si256(
+                o + 0, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256(
+                o + 1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+            uint32_t const nul(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero))));
+            if (nul) return n + count_trailing_zeros(nul);
+            n += 32;
+        }
+        else if (*p)
+            dest[n++] = static_cast<unsigned char>(*p);
+        else
+            break;
+    }
+    return n;
+}
+
+//
+// DISPATCH
+//
+
+struct kernels
+{
+    size_t (* ascii_prefix)(char const *);
+    size_t (* widen)(char const *, uint16_t *, size_t);
+};
+
+kernels const KERNELS[] =
+{
+    { ascii_prefix_scalar, widen_scalar },  // char_widen::SCALAR
+    { ascii_prefix_sse2,   widen_sse2   },  // char_widen::SSE2
+    { ascii_prefix_avx2,   widen_avx2   },  // char_widen::AVX2
+};
+
+void cpuid(uint32_t leaf, uint32_t (& regs)[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, static_cast<int>(leaf), 0);
+    for (int k = 0; k < 4; ++k) regs[k] = static_cast<uint32_t>(r[k]);
+#else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif // if defined(_MSC_VER)
+}
+
+uint64_t xgetbv0()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return static_cast<uint64_t>(edx) << 32 | eax;
+#endif // if defined(_MSC_VER)
+}
+
+char_widen::impl_type best_supported()
+{
+    enum { EAX, EBX, ECX, EDX };
+    uint32_t regs[4];
+    cpuid(0, regs);
+    uint32_t const max_leaf(regs[EAX]);
+    if (max_leaf < 1) return char_widen::SCALAR;
+    cpuid(1, regs);
+    if (! (regs[EDX] & 1u << 26)) return char_widen::SCALAR;
+    // AVX2 requires the processor to support it and the operating system to
+    // save the upper halves of the YMM registers on a context switch.
+    bool const osxsave_and_avx((regs[ECX] & 3u << 27) == 3u << 27);
+    if (max_leaf < 7 || ! osxsave_and_avx || 6 != (xgetbv0() & 6))
+        return char_widen::SSE2;
+    cpuid(7, regs);
+    return regs[EBX] & 1u << 5 ? char_widen::AVX2 : char_widen::SSE2;
+}
+
+char_widen::impl_type& selected_impl()
+{
+    static char_widen::impl_type impl(best_supported());
+    return impl;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                            struct char_widen
+//==============================================================================
+
+char_widen::impl_type char_widen::impl()
+{ return selected_impl(); }
+
+size_t char_widen::ascii_prefix(char const * sz)
+{
+    assert(sz || !"string cannot be NULL");
+    return KERNELS[selected_impl()].ascii_prefix(sz);
+}
+
+size_t char_widen::widen(char const * sz, uint16_t * dest, size_t capacity)
+{
+    assert(sz || !"string cannot be NULL");
+    assert(dest || 0 == capacity);
+    return KERNELS[selected_impl()].widen(sz, dest, capacity);
+}
+
+bool char_widen::is_supported(impl_type impl)
+{
+    static impl_type const best(best_supported());
+    return impl <= best;
+}
+
+char_widen::impl_type char_widen::set_impl(impl_type impl)
+{
+    assert(is_supported(impl));
+    impl_type const result(selected_impl());
+    selected_impl() = impl;
+    return result;
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace jsdi;
+
+namespace {
+
+char_widen::impl_type const ALL_IMPLS[] =
+{ char_widen::SCALAR, char_widen::SSE2, char_widen::AVX2 };
+
+// Runs 'f' once with each implementation the processor supports.
+template<typename Func>
+void for_each_impl(Func f)
+{
+    for (char_widen::impl_type impl : ALL_IMPLS)
+    {
+        if (! char_widen::is_supported(impl)) continue;
+        char_widen::impl_type const prev(char_widen::set_impl(impl));
+        f();
+        char_widen::set_impl(prev);
+    }
+}
+
+} // anonymous namespace
+
+TEST(char_widen_ascii_prefix,
+    for_each_impl([this]() {
+        // Place the string at every alignment, and the stopping character at
+        // every position, with junk before the string and after the stop.
+        std::vector<char> buf(160, '\x80');
+        for (size_t start = 0; start < 32; ++start)
+        {
+            for (size_t len = 0; len < 96; ++len)
+            {
+                char * const sz(&buf[start]);
+                for (size_t k = 0; k < len; ++k)
+                    sz[k] = static_cast<char>('a' + k % 26);
+                sz[len] = '\0';
+                assert_equals(len, char_widen::ascii_prefix(sz));
+                sz[len] = '\xe9';
+                assert_equals(len, char_widen::ascii_prefix(sz));
+                std::fill(buf.begin(), buf.end(), '\x80');
+            }
+        }
+    });
+);
+
+TEST(char_widen_widen,
+    for_each_impl([this]() {
+        std::vector<char> buf(160, 'x');
+        std::vector<uint16_t> wide(128);
+        for (size_t start = 0; start < 32; ++start)
+        {
+            for (size_t len = 0; len < 96; ++len)
+            {
+                char * const sz(&buf[start]);
+                for (size_t k = 0; k < len; ++k)
+                    sz[k] = static_cast<char>(0x70 + k);
+                sz[len] = '\0';
+                assert_equals(len, char_widen::widen(sz, wide.data(),
+                                                     wide.size()));
+                for (size_t k = 0; k < len; ++k)
+                    assert_equals(0x70 + k, wide[k]);
+                // Capacity smaller than the string
+                size_t const cap(len / 2);
+                std::fill(wide.begin(), wide.end(), 0xffff);
+                assert_equals(cap, char_widen::widen(sz, wide.data(), cap));
+                for (size_t k = 0; k < cap; ++k)
+                    assert_equals(0x70 + k, wide[k]);
+                assert_equals(0xffff, wide[cap]);
+                std::fill(buf.begin(), buf.end(), 'x');
+            }
+        }
+    });
+);
+
+TEST(char_widen_high_bytes,
+    // Bytes with the high bit set must be widened as unsigned values.
+    for_each_impl([this]() {
+        std::string str;
+        for (int k = 1; k < 256; ++k) str.push_back(static_cast<char>(k));
+        std::vector<uint16_t> wide(str.size() + 1);
+        assert_equals(str.size(),
+                      char_widen::widen(str.c_str(), wide.data(),
+                                        wide.size()));
+        for (size_t k = 0; k < str.size(); ++k)
+            assert_equals(k + 1, wide[k]);
+        assert_equals(127, char_widen::ascii_prefix(str.c_str()));
+    });
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,116 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_CHAR_WIDEN_H___
+#define __INCLUDED_CHAR_WIDEN_H___
+
+/**
+ * \file char_widen.h
+ * \author Victor Schappert
+ * \since 20140907
+ * \brief Vectorized scanning and widening of zero-terminated 8-bit strings
+ */
+
+#include "util.h"
+
+#include <cstdint>
+
+namespace jsdi {
+
+//==============================================================================
+//                            struct char_widen
+//==============================================================================
+
+/**
+ * \brief Scans and widens zero-terminated strings of 8-bit characters
+ * \author Victor Schappert
+ * \since 20140907
+ * \see make_jstring(JNIEnv *, char const *)
+ *
+ * Each operation has a scalar, an SSE2, and an AVX2 implementation. The best
+ * implementation the processor supports is chosen the first time any operation
+ * is used.
+ *
+ * The vectorized implementations look for the zero terminator a whole vector
+ * at a time, so they may read, but never use, a few bytes before the start of
+ * the string or after its zero terminator. They never load a vector that
+ * crosses a page boundary, so they cannot fault on a page that the string
+ * itself does not occupy.
+ */
+struct char_widen : private non_instantiable
+{
+        /**
+         * \brief Enumerates the available implementations
+         * \see #impl()
+         */
+        enum impl_type
+        {
+            /** \brief One character at a time */
+            SCALAR,
+            /** \brief 16 characters at a time */
+            SSE2,
+            /** \brief 32 characters at a time */
+            AVX2
+        };
+
+        /**
+         * \brief Returns the implementation in use on this processor
+         * \return Implementation chosen
+         */
+        static impl_type impl();
+
+        /**
+         * \brief Returns the length of the prefix of a string consisting only
+         *        of 7-bit ASCII characters
+         * \param sz Non-<code>null</code> pointer to a zero-terminated string
+         * \return Index of the first character in <code>sz</code> that is
+         *         either the zero terminator or has its high bit set
+         *
+         * If <code>sz[ascii_prefix(sz)]</code> is zero, the whole string is
+         * ASCII.
+         */
+        static size_t ascii_prefix(char const * sz);
+
+        /**
+         * \brief Widens the characters of a string into 16-bit characters
+         * \param sz Non-<code>null</code> pointer to a zero-terminated string
+         * \param dest Buffer to receive the widened characters, which is not
+         *        zero-terminated
+         * \param capacity Number of characters <code>dest</code> can hold
+         * \return Number of characters widened, which is the length of
+         *         <code>sz</code> if it is less than or equal to
+         *         <code>capacity</code>, and <code>capacity</code> otherwise
+         *
+         * Since widening stops at the first zero byte <em>or</em> after
+         * <code>capacity</code> characters, this function can also widen a
+         * range of known length that contains no zero bytes. The elements of
+         * <code>dest</code> after the returned count, up to
+         * <code>capacity</code>, may be overwritten.
+         */
+        static size_t widen(char const * sz, uint16_t * dest, size_t capacity);
+
+        /**
+         * \brief Indicates whether this processor supports an implementation
+         * \param impl Implementation to test
+         * \return Whether <code>impl</code> can be used on this processor
+         * \see #set_impl(impl_type)
+         */
+        static bool is_supported(impl_type impl);
+
+        /**
+         * \brief Selects the implementation to use
+         * \param impl Implementation to use, which must be supported by the
+         *        processor
+         * \return The previously selected implementation
+         * \see #is_supported(impl_type)
+         *
+         * This function is not thread-safe. It is intended only to allow the
+         * tests to exercise every implementation.
+         */
+        static impl_type set_impl(impl_type impl);
+};
+
+} // namespace jsdi
+
+#endif // __INCLUDED_CHAR_WIDEN_H___
@@ -0,0 +1,395 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: code_page.cpp
+// auth: Victor Schappert
+// date: 20140908
+// desc: Conversion tables for the single-byte Windows ANSI code pages
+//==============================================================================
+
+#include "code_page.h"
+
+#include "char_widen.h"
+
+#include <cassert>
+
+namespace jsdi {
+
+namespace {
+
+// Mapping of the bytes 0x80..0xff to UTF-16 for each supported code page,
+// generated from the Unicode Consortium's mapping files. Undefined bytes map to
+// the code point with the same value.
+
+uint16_t const CP874_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x0082, 0x0083, 0x0084, 0x2026, 0x0086, 0x0087,  // 0x80
+    0x0088, 0x0089, 0x008a, 0x008b, 0x008c, 0x008d, 0x008e, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0098, 0x0099, 0x009a, 0x009b, 0x009c, 0x009d, 0x009e, 0x009f,  // 0x98
+    0x00a0, 0x0e01, 0x0e02, 0x0e03, 0x0e04, 0x0e05, 0x0e06, 0x0e07,  // 0xa0
+    0x0e08, 0x0e09, 0x0e0a, 0x0e0b, 0x0e0c, 0x0e0d, 0x0e0e, 0x0e0f,  // 0xa8
+    0x0e10, 0x0e11, 0x0e12, 0x0e13, 0x0e14, 0x0e15, 0x0e16, 0x0e17,  // 0xb0
+    0x0e18, 0x0e19, 0x0e1a, 0x0e1b, 0x0e1c, 0x0e1d, 0x0e1e, 0x0e1f,  // 0xb8
+    0x0e20, 0x0e21, 0x0e22, 0x0e23, 0x0e24, 0x0e25, 0x0e26, 0x0e27,  // 0xc0
+    0x0e28, 0x0e29, 0x0e2a, 0x0e2b, 0x0e2c, 0x0e2d, 0x0e2e, 0x0e2f,  // 0xc8
+    0x0e30, 0x0e31, 0x0e32, 0x0e33, 0x0e34, 0x0e35, 0x0e36, 0x0e37,  // 0xd0
+    0x0e38, 0x0e39, 0x0e3a, 0x00db, 0x00dc, 0x00dd, 0x00de, 0x0e3f,  // 0xd8
+    0x0e40, 0x0e41, 0x0e42, 0x0e43, 0x0e44, 0x0e45, 0x0e46, 0x0e47,  // 0xe0
+    0x0e48, 0x0e49, 0x0e4a, 0x0e4b, 0x0e4c, 0x0e4d, 0x0e4e, 0x0e4f,  // 0xe8
+    0x0e50, 0x0e51, 0x0e52, 0x0e53, 0x0e54, 0x0e55, 0x0e56, 0x0e57,  // 0xf0
+    0x0e58, 0x0e59, 0x0e5a, 0x0e5b, 0x00fc, 0x00fd, 0x00fe, 0x00ff,  // 0xf8
+};
+
+uint16_t const CP1250_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0083, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x0088, 0x2030, 0x0160, 0x2039, 0x015a, 0x0164, 0x017d, 0x0179,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0098, 0x2122, 0x0161, 0x203a, 0x015b, 0x0165, 0x017e, 0x017a,  // 0x98
+    0x00a0, 0x02c7, 0x02d8, 0x0141, 0x00a4, 0x0104, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x015e, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x017b,  // 0xa8
+    0x00b0, 0x00b1, 0x02db, 0x0142, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x0105, 0x015f, 0x00bb, 0x013d, 0x02dd, 0x013e, 0x017c,  // 0xb8
+    0x0154, 0x00c1, 0x00c2, 0x0102, 0x00c4, 0x0139, 0x0106, 0x00c7,  // 0xc0
+    0x010c, 0x00c9, 0x0118, 0x00cb, 0x011a, 0x00cd, 0x00ce, 0x010e,  // 0xc8
+    0x0110, 0x0143, 0x0147, 0x00d3, 0x00d4, 0x0150, 0x00d6, 0x00d7,  // 0xd0
+    0x0158, 0x016e, 0x00da, 0x0170, 0x00dc, 0x00dd, 0x0162, 0x00df,  // 0xd8
+    0x0155, 0x00e1, 0x00e2, 0x0103, 0x00e4, 0x013a, 0x0107, 0x00e7,  // 0xe0
+    0x010d, 0x00e9, 0x0119, 0x00eb, 0x011b, 0x00ed, 0x00ee, 0x010f,  // 0xe8
+    0x0111, 0x0144, 0x0148, 0x00f3, 0x00f4, 0x0151, 0x00f6, 0x00f7,  // 0xf0
+    0x0159, 0x016f, 0x00fa, 0x0171, 0x00fc, 0x00fd, 0x0163, 0x02d9,  // 0xf8
+};
+
+uint16_t const CP1251_HIGH[128] =
+{
+    0x0402, 0x0403, 0x201a, 0x0453, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x20ac, 0x2030, 0x0409, 0x2039, 0x040a, 0x040c, 0x040b, 0x040f,  // 0x88
+    0x0452, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0098, 0x2122, 0x0459, 0x203a, 0x045a, 0x045c, 0x045b, 0x045f,  // 0x98
+    0x00a0, 0x040e, 0x045e, 0x0408, 0x00a4, 0x0490, 0x00a6, 0x00a7,  // 0xa0
+    0x0401, 0x00a9, 0x0404, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x0407,  // 0xa8
+    0x00b0, 0x00b1, 0x0406, 0x0456, 0x0491, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x0451, 0x2116, 0x0454, 0x00bb, 0x0458, 0x0405, 0x0455, 0x0457,  // 0xb8
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,  // 0xc0
+    0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,  // 0xc8
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,  // 0xd0
+    0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,  // 0xd8
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,  // 0xe0
+    0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,  // 0xe8
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,  // 0xf0
+    0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,  // 0xf8
+};
+
+uint16_t const CP1252_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178,  // 0x98
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf,  // 0xb8
+    0x00c0, 0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7,  // 0xc0
+    0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd, 0x00ce, 0x00cf,  // 0xc8
+    0x00d0, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7,  // 0xd0
+    0x00d8, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df,  // 0xd8
+    0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,  // 0xe0
+    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef,  // 0xe8
+    0x00f0, 0x00f1, 0x00f2, 0x00f3, 0x00f4, 0x00f5, 0x00f6, 0x00f7,  // 0xf0
+    0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x00fd, 0x00fe, 0x00ff,  // 0xf8
+};
+
+uint16_t const CP1253_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x0088, 0x2030, 0x008a, 0x2039, 0x008c, 0x008d, 0x008e, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0098, 0x2122, 0x009a, 0x203a, 0x009c, 0x009d, 0x009e, 0x009f,  // 0x98
+    0x00a0, 0x0385, 0x0386, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x2015,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x0384, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x0388, 0x0389, 0x038a, 0x00bb, 0x038c, 0x00bd, 0x038e, 0x038f,  // 0xb8
+    0x0390, 0x0391, 0x0392, 0x0393, 0x0394, 0x0395, 0x0396, 0x0397,  // 0xc0
+    0x0398, 0x0399, 0x039a, 0x039b, 0x039c, 0x039d, 0x039e, 0x039f,  // 0xc8
+    0x03a0, 0x03a1, 0x00d2, 0x03a3, 0x03a4, 0x03a5, 0x03a6, 0x03a7,  // 0xd0
+    0x03a8, 0x03a9, 0x03aa, 0x03ab, 0x03ac, 0x03ad, 0x03ae, 0x03af,  // 0xd8
+    0x03b0, 0x03b1, 0x03b2, 0x03b3, 0x03b4, 0x03b5, 0x03b6, 0x03b7,  // 0xe0
+    0x03b8, 0x03b9, 0x03ba, 0x03bb, 0x03bc, 0x03bd, 0x03be, 0x03bf,  // 0xe8
+    0x03c0, 0x03c1, 0x03c2, 0x03c3, 0x03c4, 0x03c5, 0x03c6, 0x03c7,  // 0xf0
+    0x03c8, 0x03c9, 0x03ca, 0x03cb, 0x03cc, 0x03cd, 0x03ce, 0x00ff,  // 0xf8
+};
+
+uint16_t const CP1254_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x008e, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x009e, 0x0178,  // 0x98
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf,  // 0xb8
+    0x00c0, 0x00c1, 0x00c2, 0x00c3, 0x00c4, 0x00c5, 0x00c6, 0x00c7,  // 0xc0
+    0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x00cc, 0x00cd, 0x00ce, 0x00cf,  // 0xc8
+    0x011e, 0x00d1, 0x00d2, 0x00d3, 0x00d4, 0x00d5, 0x00d6, 0x00d7,  // 0xd0
+    0x00d8, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x0130, 0x015e, 0x00df,  // 0xd8
+    0x00e0, 0x00e1, 0x00e2, 0x00e3, 0x00e4, 0x00e5, 0x00e6, 0x00e7,  // 0xe0
+    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x00ec, 0x00ed, 0x00ee, 0x00ef,  // 0xe8
+    0x011f, 0x00f1, 0x00f2, 0x00f3, 0x00f4, 0x00f5, 0x00f6, 0x00f7,  // 0xf0
+    0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x0131, 0x015f, 0x00ff,  // 0xf8
+};
+
+uint16_t const CP1255_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x02c6, 0x2030, 0x008a, 0x2039, 0x008c, 0x008d, 0x008e, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x02dc, 0x2122, 0x009a, 0x203a, 0x009c, 0x009d, 0x009e, 0x009f,  // 0x98
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x20aa, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x00d7, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x00b9, 0x00f7, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf,  // 0xb8
+    0x05b0, 0x05b1, 0x05b2, 0x05b3, 0x05b4, 0x05b5, 0x05b6, 0x05b7,  // 0xc0
+    0x05b8, 0x05b9, 0x00ca, 0x05bb, 0x05bc, 0x05bd, 0x05be, 0x05bf,  // 0xc8
+    0x05c0, 0x05c1, 0x05c2, 0x05c3, 0x05f0, 0x05f1, 0x05f2, 0x05f3,  // 0xd0
+    0x05f4, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x00dd, 0x00de, 0x00df,  // 0xd8
+    0x05d0, 0x05d1, 0x05d2, 0x05d3, 0x05d4, 0x05d5, 0x05d6, 0x05d7,  // 0xe0
+    0x05d8, 0x05d9, 0x05da, 0x05db, 0x05dc, 0x05dd, 0x05de, 0x05df,  // 0xe8
+    0x05e0, 0x05e1, 0x05e2, 0x05e3, 0x05e4, 0x05e5, 0x05e6, 0x05e7,  // 0xf0
+    0x05e8, 0x05e9, 0x05ea, 0x00fb, 0x00fc, 0x200e, 0x200f, 0x00ff,  // 0xf8
+};
+
+uint16_t const CP1256_HIGH[128] =
+{
+    0x20ac, 0x067e, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x02c6, 0x2030, 0x0679, 0x2039, 0x0152, 0x0686, 0x0698, 0x0688,  // 0x88
+    0x06af, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x06a9, 0x2122, 0x0691, 0x203a, 0x0153, 0x200c, 0x200d, 0x06ba,  // 0x98
+    0x00a0, 0x060c, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x06be, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x00b9, 0x061b, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x061f,  // 0xb8
+    0x06c1, 0x0621, 0x0622, 0x0623, 0x0624, 0x0625, 0x0626, 0x0627,  // 0xc0
+    0x0628, 0x0629, 0x062a, 0x062b, 0x062c, 0x062d, 0x062e, 0x062f,  // 0xc8
+    0x0630, 0x0631, 0x0632, 0x0633, 0x0634, 0x0635, 0x0636, 0x00d7,  // 0xd0
+    0x0637, 0x0638, 0x0639, 0x063a, 0x0640, 0x0641, 0x0642, 0x0643,  // 0xd8
+    0x00e0, 0x0644, 0x00e2, 0x0645, 0x0646, 0x0647, 0x0648, 0x00e7,  // 0xe0
+    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x0649, 0x064a, 0x00ee, 0x00ef,  // 0xe8
+    0x064b, 0x064c, 0x064d, 0x064e, 0x00f4, 0x064f, 0x0650, 0x00f7,  // 0xf0
+    0x0651, 0x00f9, 0x0652, 0x00fb, 0x00fc, 0x200e, 0x200f, 0x06d2,  // 0xf8
+};
+
+uint16_t const CP1257_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0083, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x0088, 0x2030, 0x008a, 0x2039, 0x008c, 0x00a8, 0x02c7, 0x00b8,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0098, 0x2122, 0x009a, 0x203a, 0x009c, 0x00af, 0x02db, 0x009f,  // 0x98
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00d8, 0x00a9, 0x0156, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00c6,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00f8, 0x00b9, 0x0157, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00e6,  // 0xb8
+    0x0104, 0x012e, 0x0100, 0x0106, 0x00c4, 0x00c5, 0x0118, 0x0112,  // 0xc0
+    0x010c, 0x00c9, 0x0179, 0x0116, 0x0122, 0x0136, 0x012a, 0x013b,  // 0xc8
+    0x0160, 0x0143, 0x0145, 0x00d3, 0x014c, 0x00d5, 0x00d6, 0x00d7,  // 0xd0
+    0x0172, 0x0141, 0x015a, 0x016a, 0x00dc, 0x017b, 0x017d, 0x00df,  // 0xd8
+    0x0105, 0x012f, 0x0101, 0x0107, 0x00e4, 0x00e5, 0x0119, 0x0113,  // 0xe0
+    0x010d, 0x00e9, 0x017a, 0x0117, 0x0123, 0x0137, 0x012b, 0x013c,  // 0xe8
+    0x0161, 0x0144, 0x0146, 0x00f3, 0x014d, 0x00f5, 0x00f6, 0x00f7,  // 0xf0
+    0x0173, 0x0142, 0x015b, 0x016b, 0x00fc, 0x017c, 0x017e, 0x02d9,  // 0xf8
+};
+
+uint16_t const CP1258_HIGH[128] =
+{
+    0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x02c6, 0x2030, 0x008a, 0x2039, 0x0152, 0x008d, 0x008e, 0x008f,  // 0x88
+    0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x02dc, 0x2122, 0x009a, 0x203a, 0x0153, 0x009d, 0x009e, 0x0178,  // 0x98
+    0x00a0, 0x00a1, 0x00a2, 0x00a3, 0x00a4, 0x00a5, 0x00a6, 0x00a7,  // 0xa0
+    0x00a8, 0x00a9, 0x00aa, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x00af,  // 0xa8
+    0x00b0, 0x00b1, 0x00b2, 0x00b3, 0x00b4, 0x00b5, 0x00b6, 0x00b7,  // 0xb0
+    0x00b8, 0x00b9, 0x00ba, 0x00bb, 0x00bc, 0x00bd, 0x00be, 0x00bf,  // 0xb8
+    0x00c0, 0x00c1, 0x00c2, 0x0102, 0x00c4, 0x00c5, 0x00c6, 0x00c7,  // 0xc0
+    0x00c8, 0x00c9, 0x00ca, 0x00cb, 0x0300, 0x00cd, 0x00ce, 0x00cf,  // 0xc8
+    0x0110, 0x00d1, 0x0309, 0x00d3, 0x00d4, 0x01a0, 0x00d6, 0x00d7,  // 0xd0
+    0x00d8, 0x00d9, 0x00da, 0x00db, 0x00dc, 0x01af, 0x0303, 0x00df,  // 0xd8
+    0x00e0, 0x00e1, 0x00e2, 0x0103, 0x00e4, 0x00e5, 0x00e6, 0x00e7,  // 0xe0
+    0x00e8, 0x00e9, 0x00ea, 0x00eb, 0x0301, 0x00ed, 0x00ee, 0x00ef,  // 0xe8
+    0x0111, 0x00f1, 0x0323, 0x00f3, 0x00f4, 0x01a1, 0x00f6, 0x00f7,  // 0xf0
+    0x00f8, 0x00f9, 0x00fa, 0x00fb, 0x00fc, 0x01b0, 0x20ab, 0x00ff,  // 0xf8
+};
+
+} // anonymous namespace
+
+//==============================================================================
+//                             class code_page
+//==============================================================================
+
+code_page const code_page::PAGES[] =
+{
+    {  874,  CP874_HIGH },  // Thai
+    { 1250, CP1250_HIGH },  // Central European
+    { 1251, CP1251_HIGH },  // Cyrillic
+    { 1252, CP1252_HIGH },  // Western European
+    { 1253, CP1253_HIGH },  // Greek
+    { 1254, CP1254_HIGH },  // Turkish
+    { 1255, CP1255_HIGH },  // Hebrew
+    { 1256, CP1256_HIGH },  // Arabic
+    { 1257, CP1257_HIGH },  // Baltic
+    { 1258, CP1258_HIGH },  // Vietnamese
+};
+
+size_t code_page::widen(char const * sz, uint16_t * dest,
+                        size_t capacity) const
+{
+    // Widen everything as if it were Latin-1, then go back and look up the
+    // characters above 0x7f, skipping over the ASCII runs between them.
+    size_t const n(char_widen::widen(sz, dest, capacity));
+    size_t k(char_widen::ascii_prefix(sz));
+    while (k < n)
+    {
+        dest[k] = d_high[static_cast<unsigned char>(sz[k]) - 0x80];
+        ++k;
+        k += char_widen::ascii_prefix(sz + k);
+    }
+    return n;
+}
+
+code_page const * code_page::find(unsigned id)
+{
+    for (code_page const& page : PAGES)
+        if (id == page.d_id) return &page;
+    return nullptr;
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace jsdi;
+
+namespace {
+
+// Reference mappings taken from the Unicode Consortium's mapping files
+// (MAPPINGS/VENDORS/MICSFT/WINDOWS/CP*.TXT), independently of the tables.
+struct reference_mapping
+{
+    unsigned      code_page;
+    unsigned char byte;
+    uint16_t      utf16;
+};
+
+reference_mapping const REFERENCE[] =
+{
+    {  874, 0x80, 0x20ac }, {  874, 0xa1, 0x0e01 }, {  874, 0xdf, 0x0e3f },
+    {  874, 0xfb, 0x0e5b },
+    { 1250, 0x8a, 0x0160 }, { 1250, 0xa5, 0x0104 }, { 1250, 0xe8, 0x010d },
+    { 1250, 0xff, 0x02d9 },
+    { 1251, 0x80, 0x0402 }, { 1251, 0xa8, 0x0401 }, { 1251, 0xc0, 0x0410 },
+    { 1251, 0xff, 0x044f },
+    { 1252, 0x80, 0x20ac }, { 1252, 0x85, 0x2026 }, { 1252, 0x99, 0x2122 },
+    { 1252, 0x9f, 0x0178 }, { 1252, 0xe9, 0x00e9 }, { 1252, 0x81, 0x0081 },
+    { 1253, 0xa2, 0x0386 }, { 1253, 0xc1, 0x0391 }, { 1253, 0xf9, 0x03c9 },
+    { 1254, 0xd0, 0x011e }, { 1254, 0xdd, 0x0130 }, { 1254, 0xfe, 0x015f },
+    { 1255, 0xa4, 0x20aa }, { 1255, 0xe0, 0x05d0 }, { 1255, 0xfa, 0x05ea },
+    { 1256, 0x81, 0x067e }, { 1256, 0xc7, 0x0627 }, { 1256, 0xff, 0x06d2 },
+    { 1257, 0xa8, 0x00d8 }, { 1257, 0xc0, 0x0104 }, { 1257, 0xfd, 0x017c },
+    { 1258, 0xc3, 0x0102 }, { 1258, 0xd2, 0x0309 }, { 1258, 0xfe, 0x20ab },
+};
+
+std::vector<uint16_t> widen_all(code_page const& page, char const * sz,
+                                size_t capacity)
+{
+    std::vector<uint16_t> result(capacity);
+    result.resize(page.widen(sz, result.data(), capacity));
+    return result;
+}
+
+} // anonymous namespace
+
+TEST(code_page_find,
+    unsigned const SUPPORTED[] =
+    { 874, 1250, 1251, 1252, 1253, 1254, 1255, 1256, 1257, 1258 };
+    for (unsigned id : SUPPORTED)
+    {
+        code_page const * page(code_page::find(id));
+        assert_true(page);
+        assert_equals(id, page->id());
+    }
+    assert_false(code_page::find(0));
+    assert_false(code_page::find(932));
+    assert_false(code_page::find(65001));
+);
+
+TEST(code_page_reference,
+    for (reference_mapping const& ref : REFERENCE)
+    {
+        code_page const * page(code_page::find(ref.code_page));
+        assert_true(page);
+        assert_equals(ref.utf16, page->to_utf16(ref.byte));
+    }
+    // Every code page is ASCII-compatible
+    for (unsigned id = 0; id < 65536; ++id)
+    {
+        code_page const * page(code_page::find(id));
+        if (! page) continue;
+        for (unsigned c = 0; c < 0x80; ++c)
+            assert_equals(c, page->to_utf16(static_cast<unsigned char>(c)));
+    }
+);
+
+TEST(code_page_widen,
+    code_page const& cp1252(*code_page::find(1252));
+    code_page const& cp1251(*code_page::find(1251));
+    assert_true(widen_all(cp1252, "", 8).empty());
+    {
+        // "caf\xe9 \x80 5" => "caf" LATIN SMALL E WITH ACUTE " " EURO " 5"
+        std::vector<uint16_t> const expected =
+        { 'c', 'a', 'f', 0x00e9, ' ', 0x20ac, ' ', '5' };
+        assert_true(expected == widen_all(cp1252, "caf\xe9 \x80 5", 64));
+    }
+    {
+        // "\xcf\xf0\xe8\xe2\xe5\xf2" => Cyrillic "Privet"
+        std::vector<uint16_t> const expected =
+        { 0x041f, 0x0440, 0x0438, 0x0432, 0x0435, 0x0442 };
+        assert_true(expected ==
+                    widen_all(cp1251, "\xcf\xf0\xe8\xe2\xe5\xf2", 64));
+    }
+    {
+        // Long string with high characters scattered through long ASCII
+        // runs, converted both with plenty of room and truncated
+        std::string str;
+        for (int k = 0; k < 300; ++k)
+        {
+            str.push_back(
+                0 == k % 37 ? '\x80' : static_cast<char>('a' + k % 26));
+        }
+        for (size_t capacity : { str.size() + 1, size_t(100), size_t(37) })
+        {
+            std::vector<uint16_t> const wide(
+                widen_all(cp1252, str.c_str(), capacity));
+            assert_equals(std::min(capacity, str.size()), wide.size());
+            for (size_t k = 0; k < wide.size(); ++k)
+            {
+                unsigned char const c(static_cast<unsigned char>(str[k]));
+                assert_equals(cp1252.to_utf16(c), wide[k]);
+            }
+        }
+    }
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,125 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_CODE_PAGE_H___
+#define __INCLUDED_CODE_PAGE_H___
+
+/**
+ * \file code_page.h
+ * \author Victor Schappert
+ * \since 20140908
+ * \brief Table-driven conversion of single-byte ANSI code pages to UTF-16
+ */
+
+#include "util.h"
+
+#include <cstdint>
+
+namespace jsdi {
+
+//==============================================================================
+//                             class code_page
+//==============================================================================
+
+/**
+ * \brief Converts strings in a single-byte Windows ANSI code page to UTF-16
+ * \author Victor Schappert
+ * \since 20140908
+ * \see char_widen
+ *
+ * Every supported code page agrees with ASCII on the bytes
+ * <code>0x00..0x7f</code>, so a code page is described entirely by a
+ * precomputed table giving the UTF-16 code unit for each of the bytes
+ * <code>0x80..0xff</code>. The tables were generated from the Unicode
+ * Consortium's mapping files. A byte which the code page leaves undefined maps
+ * to the code point with the same value, which is what Windows does for the
+ * undefined bytes in code page 1252.
+ *
+ * The double-byte code pages (932, 936, 949, and 950) are not supported, and
+ * #find(unsigned) returns <code>nullptr</code> for them.
+ */
+class code_page : private non_copyable
+{
+        //
+        // DATA
+        //
+
+        unsigned         d_id;
+        uint16_t const * d_high;
+
+        //
+        // CONSTRUCTORS
+        //
+
+        code_page(unsigned id, uint16_t const * high);
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the Windows code page identifier
+         * \return Code page identifier, <em>eg</em> 1252
+         */
+        unsigned id() const;
+
+        /**
+         * \brief Converts a single character to UTF-16
+         * \param c Character to convert
+         * \return UTF-16 code unit corresponding to <code>c</code>
+         */
+        uint16_t to_utf16(unsigned char c) const;
+
+        /**
+         * \brief Converts the characters of a string into UTF-16
+         * \param sz Non-<code>null</code> pointer to a zero-terminated string
+         * \param dest Buffer to receive the converted characters, which is not
+         *        zero-terminated
+         * \param capacity Number of characters <code>dest</code> can hold
+         * \return Number of characters converted
+         * \see char_widen::widen(char const *, uint16_t *, size_t)
+         *
+         * This function has the same contract as
+         * \link char_widen::widen(char const *, uint16_t *, size_t)\endlink.
+         * Runs of ASCII characters are widened by the vectorized kernels in
+         * \link char_widen\endlink and only the remaining characters are
+         * looked up in the table.
+         */
+        size_t widen(char const * sz, uint16_t * dest, size_t capacity) const;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the table for a code page
+         * \param id Windows code page identifier
+         * \return Pointer to the code page, or <code>nullptr</code> if
+         *         <code>id</code> is not a supported single-byte code page
+         */
+        static code_page const * find(unsigned id);
+
+    private:
+
+        static code_page const PAGES[];
+};
+
+inline code_page::code_page(unsigned id, uint16_t const * high)
+    : d_id(id)
+    , d_high(high)
+{ }
+
+inline unsigned code_page::id() const
+{ return d_id; }
+
+inline uint16_t code_page::to_utf16(unsigned char c) const
+{ return c < 0x80 ? c : d_high[c - 0x80]; }
+
+} // namespace jsdi
+
+#endif // __INCLUDED_CODE_PAGE_H___
@@ -11,6 +11,7 @@
 
 #include "com.h"
 
+#include "arena.h"
 #include "com_util.h"
 #include "global_refs.h"
 #include "jni_exception.h"
@@ -690,9 +691,10 @@ jobject com::call_method(IDispatch * idisp, DISPID dispid, JNIEnv * env,
     ASSERT_IDISPATCH(idisp);
     const jsize num_args(env->GetArrayLength(args));
     DISPPARAMS com_args = { nullptr, nullptr, static_cast<UINT>(num_args), 0 };
-    std::vector<VARIANT> var_args(com_args.cArgs);
-    std::vector<VARIANT>::reverse_iterator i = var_args.rbegin(),
-                                           e = var_args.rend();
+    typedef std::vector<VARIANT, arena_allocator<VARIANT>> variant_vector;
+    variant_vector var_args(com_args.cArgs);
+    variant_vector::reverse_iterator i = var_args.rbegin(),
+                                     e = var_args.rend();
     try
     {
         for (jsize arg_index = 0; i != e; ++i, ++arg_index)
@@ -707,7 +709,7 @@ jobject com::call_method(IDispatch * idisp, DISPID dispid, JNIEnv * env,
         // If an exception gets thrown while converting the jSuneido Java types
         // to COM types, we need to clear all the variants which were
         // initialized before rethrowing.
-        std::vector<VARIANT>::reverse_iterator j = var_args.rbegin();
+        variant_vector::reverse_iterator j = var_args.rbegin();
         for (; j != i; ++j) VariantClear(&*j);
         throw;
     }
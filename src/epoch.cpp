@@ -0,0 +1,219 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: epoch.cpp
+// auth: Victor Schappert
+// date: 20140916
+// desc: Epoch-based reclamation for objects that threads may be using without
+//       holding a lock
+//==============================================================================
+
+#include "epoch.h"
+
+#include <atomic>
+#include <cassert>
+
+namespace jsdi {
+
+namespace {
+
+const size_t CACHE_LINE_BYTES = 64;
+
+// Each record is padded on both sides so that a thread entering and leaving
+// critical regions never writes a cache line that another thread is using.
+struct record
+{
+    char                  d_pad_front[CACHE_LINE_BYTES];
+    std::atomic<uint64_t> d_epoch;  // 0 if not in a critical region
+    size_t                d_depth;  // only used by the owning thread
+    std::atomic<bool>     d_in_use;
+    record *              d_next;   // never changes once record is published
+    char                  d_pad_back[CACHE_LINE_BYTES];
+};
+
+std::atomic<record *> records(nullptr);
+std::atomic<uint64_t> global_epoch(1);
+
+// NOTE: The record itself can't have thread storage duration because it isn't
+//       POD (see JSDI_THREAD_LOCAL), so it is taken from the global list on
+//       first use and given back by DllMain() when the thread exits.
+JSDI_THREAD_LOCAL record * this_thread_record;
+
+record * acquire_record()
+{
+    // Reuse a record given back by a thread that has exited, if possible.
+    for (record * r = records.load(std::memory_order_acquire); r; r = r->d_next)
+    {
+        bool in_use(false);
+        if (! r->d_in_use.load(std::memory_order_relaxed) &&
+            r->d_in_use.compare_exchange_strong(in_use, true,
+                                                std::memory_order_acquire))
+        {
+            assert(0 == r->d_depth);
+            return r;
+        }
+    }
+    record * const r(new record);
+    r->d_epoch.store(0, std::memory_order_relaxed);
+    r->d_depth = 0;
+    r->d_in_use.store(true, std::memory_order_relaxed);
+    r->d_next = records.load(std::memory_order_relaxed);
+    while (! records.compare_exchange_weak(r->d_next, r,
+                                           std::memory_order_release,
+                                           std::memory_order_relaxed))
+    { }
+    return r;
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                               class epoch
+//==============================================================================
+
+void epoch::enter()
+{
+    record * r(this_thread_record);
+    if (! r)
+    {
+        r = this_thread_record = acquire_record();
+#if !defined(_WIN32)
+        call_at_thread_exit(&epoch::thread_detach);
+#endif
+    }
+    if (0 == r->d_depth++)
+    {
+        // The store must be visible to oldest_active() before this thread
+        // looks at anything which could be retired, hence sequential
+        // consistency. It is the only store, and it is to this thread's own
+        // record.
+        r->d_epoch.store(global_epoch.load(std::memory_order_acquire),
+                         std::memory_order_seq_cst);
+    }
+}
+
+void epoch::leave()
+{
+    record * const r(this_thread_record);
+    assert((r && 0 < r->d_depth) || !"not in a critical region");
+    if (0 == --r->d_depth)
+        r->d_epoch.store(0, std::memory_order_release);
+}
+
+size_t epoch::depth()
+{
+    record const * const r(this_thread_record);
+    return r ? r->d_depth : 0;
+}
+
+uint64_t epoch::retire()
+{ return global_epoch.fetch_add(1, std::memory_order_seq_cst); }
+
+uint64_t epoch::oldest_active()
+{
+    uint64_t result(global_epoch.load(std::memory_order_seq_cst));
+    for (record * r = records.load(std::memory_order_acquire); r; r = r->d_next)
+    {
+        uint64_t const e(r->d_epoch.load(std::memory_order_seq_cst));
+        if (0 != e && e < result) result = e;
+    }
+    return result;
+}
+
+void epoch::thread_detach()
+{
+    record * const r(this_thread_record);
+    if (! r) return;
+    assert(0 == r->d_depth || !"thread exiting in a critical region");
+    r->d_epoch.store(0, std::memory_order_relaxed);
+    r->d_in_use.store(false, std::memory_order_release);
+    this_thread_record = nullptr;
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace jsdi;
+
+TEST(epoch_nesting,
+    bool ok(false);
+    std::thread t([&ok]()
+    {
+        bool good(0 == epoch::depth());
+        uint64_t const before(epoch::retire());
+        good = good && epoch::is_safe(before);
+        {
+            epoch_region outer;
+            uint64_t const during(epoch::retire());
+            {
+                epoch_region inner;
+                good = good && 2 == epoch::depth();
+            }
+            // Still in the outer region, so neither object is safe yet.
+            good = good && 1 == epoch::depth() && ! epoch::is_safe(during);
+        }
+        good = good && 0 == epoch::depth() && epoch::is_safe(before);
+        epoch::thread_detach();
+        ok = good;
+    });
+    t.join();
+    assert_true(ok);
+);
+
+TEST(epoch_other_thread,
+    // An object retired while another thread is in a critical region is only
+    // safe once that thread leaves the region, but a thread entering a region
+    // after the object was retired doesn't hold it up.
+    std::mutex m;
+    std::condition_variable cv;
+    int step(0);
+    auto wait_for = [&](int s)
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&]() { return s <= step; });
+    };
+    auto advance = [&](int s)
+    {
+        { std::lock_guard<std::mutex> lock(m); step = s; }
+        cv.notify_all();
+    };
+    std::thread t([&]()
+    {
+        {
+            epoch_region region;
+            advance(1);
+            wait_for(2);
+        }
+        advance(3);
+        epoch::thread_detach();
+    });
+    wait_for(1);
+    uint64_t const retired(epoch::retire());
+    bool const safe_in_region(epoch::is_safe(retired));
+    advance(2);
+    wait_for(3);
+    t.join();
+    bool safe_late_region(false);
+    {
+        epoch_region region;
+        safe_late_region = epoch::is_safe(retired);
+    }
+    assert_false(safe_in_region);
+    assert_true(safe_late_region);
+    epoch::thread_detach();
+);
+
+#endif // __NOTEST__
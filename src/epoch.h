@@ -0,0 +1,177 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_EPOCH_H___
+#define __INCLUDED_EPOCH_H___
+
+/**
+ * \file epoch.h
+ * \author Victor Schappert
+ * \since 20140916
+ * \brief Epoch-based reclamation for objects that threads may be using without
+ *        holding a lock
+ */
+
+#include "util.h"
+
+#include <cstdint>
+
+namespace jsdi {
+
+//==============================================================================
+//                               class epoch
+//==============================================================================
+
+/**
+ * \brief Tracks which threads may still be using an object that has been
+ *        retired, so that it can be deleted as soon as none are
+ * \author Victor Schappert
+ * \since 20140916
+ * \see thunk_clearing_list
+ *
+ * There is a global epoch counter, and each thread which uses epochs has a
+ * record containing the epoch that was current when it entered its outermost
+ * critical region, or zero if it isn't in one. A thread enters a critical
+ * region with #enter() and leaves it with #leave(). Regions nest, and only the
+ * outermost #enter() and #leave() write the record. Neither function touches
+ * any memory shared with other threads except the calling thread's own record,
+ * which no other thread writes, so the fast path involves no atomic
+ * read-modify-write on shared data and no contended cache line.
+ *
+ * An object is retired by first making it unreachable for new critical regions
+ * and then calling #retire(), which advances the global epoch and returns the
+ * retirement epoch to store with the object. The object may be deleted once
+ * #is_safe(uint64_t) returns <code>true</code> for its retirement epoch, which
+ * is the case as soon as every thread that was in a critical region when it
+ * was retired has left that region. Threads which enter a critical region
+ * after the object was retired don't delay its deletion.
+ *
+ * Per-thread records are never freed, but a record released by
+ * #thread_detach() is reused by the next thread that needs one, so the number
+ * of records is bounded by the largest number of threads that have used
+ * epochs at the same time.
+ */
+class epoch : private non_copyable
+{
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        epoch() = delete;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Enters a critical region on the calling thread
+         * \see #leave()
+         * \see epoch_region
+         */
+        static void enter();
+
+        /**
+         * \brief Leaves a critical region entered with #enter()
+         */
+        static void leave();
+
+        /**
+         * \brief Returns the number of critical regions the calling thread is
+         *        in
+         * \return Critical region nesting depth
+         */
+        static size_t depth();
+
+        /**
+         * \brief Advances the global epoch
+         * \return Retirement epoch of an object which has just been made
+         *         unreachable
+         * \see #is_safe(uint64_t)
+         */
+        static uint64_t retire();
+
+        /**
+         * \brief Returns the epoch of the oldest critical region any thread is
+         *        in
+         * \return Oldest active epoch, or the current global epoch if no
+         *         thread is in a critical region
+         *
+         * This scans the records of all threads, so it is best called once
+         * for a batch of retired objects.
+         */
+        static uint64_t oldest_active();
+
+        /**
+         * \brief Indicates whether an object retired in a given epoch can be
+         *        deleted
+         * \param retire_epoch Value returned by #retire() when the object was
+         *        retired
+         * \param oldest Value returned by #oldest_active() after the object
+         *        was retired
+         * \return Whether no thread can still be using the object
+         */
+        static bool is_safe(uint64_t retire_epoch, uint64_t oldest);
+
+        /**
+         * \brief Indicates whether an object retired in a given epoch can be
+         *        deleted
+         * \param retire_epoch Value returned by #retire() when the object was
+         *        retired
+         * \return Whether no thread can still be using the object
+         */
+        static bool is_safe(uint64_t retire_epoch);
+
+        /**
+         * \brief Releases the calling thread's record, if it has one, for
+         *        reuse by another thread
+         *
+         * This function is called from <code>DllMain()</code> when a thread
+         * exits. The thread must not be in a critical region.
+         */
+        static void thread_detach();
+};
+
+inline bool epoch::is_safe(uint64_t retire_epoch, uint64_t oldest)
+{ return retire_epoch < oldest; }
+
+inline bool epoch::is_safe(uint64_t retire_epoch)
+{ return is_safe(retire_epoch, oldest_active()); }
+
+//==============================================================================
+//                            class epoch_region
+//==============================================================================
+
+/**
+ * \brief Keeps the calling thread in an \link epoch\endlink critical region
+ *        for the lifetime of the region object
+ * \author Victor Schappert
+ * \since 20140916
+ */
+class epoch_region : private non_copyable
+{
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /** \brief Enters a critical region on the calling thread */
+        epoch_region();
+
+        ~epoch_region();
+};
+
+inline epoch_region::epoch_region()
+{ epoch::enter(); }
+
+inline epoch_region::~epoch_region()
+{ epoch::leave(); }
+
+} // namespace jsdi
+
+#endif // __INCLUDED_EPOCH_H___
@@ -31,6 +31,46 @@ JNIEXPORT jstring JNICALL Java_suneido_jsdi_JSDI_when
 JNIEXPORT jobject JNICALL Java_suneido_jsdi_JSDI_logThreshold
   (JNIEnv *, jclass, jobject);
 
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    setStringCacheCapacity
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_JSDI_setStringCacheCapacity
+  (JNIEnv *, jclass, jint);
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    flushStringCache
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_JSDI_flushStringCache
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    stringCacheStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_JSDI_stringCacheStats
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    memoryStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_JSDI_memoryStats
+  (JNIEnv *, jclass);
+
+/*
+ * Class:     suneido_jsdi_JSDI
+ * Method:    getVariableIndirect
+ * Signature: (JII)Ljava/lang/Object;
+ */
+JNIEXPORT jobject JNICALL Java_suneido_jsdi_JSDI_getVariableIndirect
+  (JNIEnv *, jclass, jlong, jint, jint);
+
 #ifdef __cplusplus
 }
 #endif
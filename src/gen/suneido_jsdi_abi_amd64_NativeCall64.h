@@ -11,6 +11,8 @@ extern "C" {
 #define suneido_jsdi_abi_amd64_NativeCall64_MAX_LONGMARSHALL_PARAMS 4L
 #undef suneido_jsdi_abi_amd64_NativeCall64_MAX_NUMPARAMS_VALUE
 #define suneido_jsdi_abi_amd64_NativeCall64_MAX_NUMPARAMS_VALUE 5L
+#undef suneido_jsdi_abi_amd64_NativeCall64_MAX_FAST_CALL_PARAMS
+#define suneido_jsdi_abi_amd64_NativeCall64_MAX_FAST_CALL_PARAMS 8L
 /*
  * Class:     suneido_jsdi_abi_amd64_NativeCall64
  * Method:    callJ0
@@ -51,6 +53,78 @@ JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callJ3
 JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callJ4
   (JNIEnv *, jclass, jlong, jlong, jlong, jlong, jlong);
 
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast0
+ * Signature: (JII)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast0
+  (JNIEnv *, jclass, jlong, jint, jint);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast1
+ * Signature: (JIIJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast1
+  (JNIEnv *, jclass, jlong, jint, jint, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast2
+ * Signature: (JIIJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast2
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast3
+ * Signature: (JIIJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast3
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast4
+ * Signature: (JIIJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast4
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast5
+ * Signature: (JIIJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast5
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast6
+ * Signature: (JIIJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast6
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong, jlong, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast7
+ * Signature: (JIIJJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast7
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong, jlong, jlong, jlong, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callFast8
+ * Signature: (JIIJJJJJJJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callFast8
+  (JNIEnv *, jclass, jlong, jint, jint, jlong, jlong, jlong, jlong, jlong, jlong, jlong, jlong);
+
 /*
  * Class:     suneido_jsdi_abi_amd64_NativeCall64
  * Method:    callDirectNoFpReturnInt64
@@ -147,6 +221,182 @@ JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableInd
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectReturnVariableIndirect
   (JNIEnv *, jclass, jlong, jint, jlongArray, jint, jintArray, jobjectArray, jintArray);
 
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferNoFpReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferNoFpReturnInt64
+  (JNIEnv *, jclass, jlong, jint, jobject, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnInt64
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnFloat
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnFloat
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectBufferReturnDouble
+ * Signature: (JILjava/nio/ByteBuffer;I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectBufferReturnDouble
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnInt64
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnInt64
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray, jobjectArray, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnFloat
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnFloat
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray, jobjectArray, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnDouble
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnDouble
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray, jobjectArray, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectBufferReturnVariableIndirect
+ * Signature: (JILjava/nio/ByteBuffer;I[I[Ljava/lang/Object;[I)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectBufferReturnVariableIndirect
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jintArray, jobjectArray, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    newMarshallPlan
+ * Signature: (II[I[I)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_newMarshallPlan
+  (JNIEnv *, jclass, jint, jint, jintArray, jintArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    deleteMarshallPlan
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_deleteMarshallPlan
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnInt64
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnInt64
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnFloat
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnFloat
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callIndirectPlanReturnDouble
+ * Signature: (JJ[JI)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callIndirectPlanReturnDouble
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnInt64
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnInt64
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint, jobjectArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnFloat
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnFloat
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint, jobjectArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnDouble
+ * Signature: (JJ[JI[Ljava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnDouble
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint, jobjectArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callVariableIndirectPlanReturnVariableIndirect
+ * Signature: (JJ[JI[Ljava/lang/Object;)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callVariableIndirectPlanReturnVariableIndirect
+  (JNIEnv *, jclass, jlong, jlong, jlongArray, jint, jobjectArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    compileStub
+ * Signature: (III)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_compileStub
+  (JNIEnv *, jclass, jint, jint, jint);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnInt64
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnInt64
+  (JNIEnv *, jclass, jlong, jlong, jlongArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnFloat
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnFloat
+  (JNIEnv *, jclass, jlong, jlong, jlongArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callStubReturnDouble
+ * Signature: (JJ[J)J
+ */
+JNIEXPORT jlong JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callStubReturnDouble
+  (JNIEnv *, jclass, jlong, jlong, jlongArray);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_NativeCall64
+ * Method:    callBatch
+ * Signature: ([J[J)I
+ */
+JNIEXPORT jint JNICALL Java_suneido_jsdi_abi_amd64_NativeCall64_callBatch
+  (JNIEnv *, jclass, jlongArray, jlongArray);
+
 #ifdef __cplusplus
 }
 #endif
@@ -14,10 +14,10 @@ extern "C" {
 /*
  * Class:     suneido_jsdi_abi_amd64_ThunkManager64
  * Method:    newThunk64
- * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[IIIIZ[J)V
+ * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[IIZIIZ[J)V
  */
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_newThunk64
-  (JNIEnv *, jclass, jobject, jobject, jint, jint, jintArray, jint, jint, jint, jboolean, jlongArray);
+  (JNIEnv *, jclass, jobject, jobject, jint, jint, jintArray, jint, jboolean, jint, jint, jboolean, jlongArray);
 
 /*
  * Class:     suneido_jsdi_abi_amd64_ThunkManager64
@@ -27,6 +27,22 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_newThunk64
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_deleteThunk64
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     suneido_jsdi_abi_amd64_ThunkManager64
+ * Method:    setMessageFilter64
+ * Signature: (J[IJZ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_setMessageFilter64
+  (JNIEnv *, jclass, jlong, jintArray, jlong, jboolean);
+
+/*
+ * Class:     suneido_jsdi_abi_amd64_ThunkManager64
+ * Method:    messageFilterStats64
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_abi_amd64_ThunkManager64_messageFilterStats64
+  (JNIEnv *, jclass, jlong);
+
 #ifdef __cplusplus
 }
 #endif
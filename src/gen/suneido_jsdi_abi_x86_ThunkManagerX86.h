@@ -14,10 +14,10 @@ extern "C" {
 /*
  * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
  * Method:    newThunkX86
- * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[II[J)V
+ * Signature: (Lsuneido/jsdi/type/Callback;Lsuneido/SuValue;II[IIZ[J)V
  */
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_newThunkX86
-  (JNIEnv *, jclass, jobject, jobject, jint, jint, jintArray, jint, jlongArray);
+  (JNIEnv *, jclass, jobject, jobject, jint, jint, jintArray, jint, jboolean, jlongArray);
 
 /*
  * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
@@ -27,6 +27,22 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_newThunkX86
 JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_deleteThunkX86
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
+ * Method:    setMessageFilterX86
+ * Signature: (J[IJZ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_setMessageFilterX86
+  (JNIEnv *, jclass, jlong, jintArray, jlong, jboolean);
+
+/*
+ * Class:     suneido_jsdi_abi_x86_ThunkManagerX86
+ * Method:    messageFilterStatsX86
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_suneido_jsdi_abi_x86_ThunkManagerX86_messageFilterStatsX86
+  (JNIEnv *, jclass, jlong);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,22 @@ JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutIndirect
 JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutVariableIndirect
   (JNIEnv *, jclass, jlong, jlongArray, jint, jintArray, jobjectArray, jintArray);
 
+/*
+ * Class:     suneido_jsdi_type_Structure
+ * Method:    copyOutIndirectPlan
+ * Signature: (J[JJ)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutIndirectPlan
+  (JNIEnv *, jclass, jlong, jlongArray, jlong);
+
+/*
+ * Class:     suneido_jsdi_type_Structure
+ * Method:    copyOutVariableIndirectPlan
+ * Signature: (J[JJ[Ljava/lang/Object;)V
+ */
+JNIEXPORT void JNICALL Java_suneido_jsdi_type_Structure_copyOutVariableIndirectPlan
+  (JNIEnv *, jclass, jlong, jlongArray, jlong, jobjectArray);
+
 #ifdef __cplusplus
 }
 #endif
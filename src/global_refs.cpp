@@ -177,11 +177,16 @@ void global_refs::init(JNIEnv * env)
     g->suneido_jsdi_type_Callback_ = get_global_class_ref(env, "suneido/jsdi/type/Callback");
     g->suneido_jsdi_type_Callback__m_invoke_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke", "(Lsuneido/SuValue;[J)J");
     g->suneido_jsdi_type_Callback__m_invokeVariableIndirect_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invokeVariableIndirect", "(Lsuneido/SuValue;[J[Ljava/lang/Object;)J");
+    g->suneido_jsdi_type_Callback__m_invokeVariableIndirectLazy_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invokeVariableIndirectLazy", "(Lsuneido/SuValue;[JJ)J");
     g->suneido_jsdi_type_Callback__m_invoke0_ = get_static_method_id(env, g->suneido_jsdi_type_Callback_, "invoke0", "(Lsuneido/SuValue;)J");
     g->suneido_jsdi_type_Callback__m_invoke1_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke1", "(Lsuneido/SuValue;J)J");
     g->suneido_jsdi_type_Callback__m_invoke2_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke2", "(Lsuneido/SuValue;JJ)J");
     g->suneido_jsdi_type_Callback__m_invoke3_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke3", "(Lsuneido/SuValue;JJJ)J");
     g->suneido_jsdi_type_Callback__m_invoke4_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke4", "(Lsuneido/SuValue;JJJJ)J");
+    g->suneido_jsdi_type_Callback__m_invoke5_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke5", "(Lsuneido/SuValue;JJJJJ)J");
+    g->suneido_jsdi_type_Callback__m_invoke6_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke6", "(Lsuneido/SuValue;JJJJJJ)J");
+    g->suneido_jsdi_type_Callback__m_invoke7_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke7", "(Lsuneido/SuValue;JJJJJJJ)J");
+    g->suneido_jsdi_type_Callback__m_invoke8_ = get_method_id(env, g->suneido_jsdi_type_Callback_, "invoke8", "(Lsuneido/SuValue;JJJJJJJJ)J");
     g->suneido_jsdi_com_COMobject_ = get_global_class_ref(env, "suneido/jsdi/com/COMobject");
     g->suneido_jsdi_com_COMobject__init_ = get_method_id(env, g->suneido_jsdi_com_COMobject_, "<init>", "(Ljava/lang/String;JZ)V");
     g->suneido_jsdi_com_COMobject__m_isDispatch_ = get_method_id(env, g->suneido_jsdi_com_COMobject_, "isDispatch", "()Z");
@@ -387,6 +387,18 @@ struct global_refs
          *
          * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
          */
+    private:
+        jmethodID suneido_jsdi_type_Callback__m_invokeVariableIndirectLazy_;
+    public:
+        jmethodID suneido_jsdi_type_Callback__m_invokeVariableIndirectLazy() const
+        { return suneido_jsdi_type_Callback__m_invokeVariableIndirectLazy_; }
+        /**<
+         * \brief Returns a global reference to the instance method <code>public final long suneido.jsdi.type.Callback.invokeVariableIndirectLazy(suneido.SuValue,long[],long)</code>.
+         * \return <code>public final long suneido.jsdi.type.Callback.invokeVariableIndirectLazy(suneido.SuValue,long[],long)</code>
+         * \see jclass suneido_jsdi_type_Callback() const
+         *
+         * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
+         */
     private:
         jmethodID suneido_jsdi_type_Callback__m_invoke0_;
     public:
@@ -447,6 +459,54 @@ struct global_refs
          *
          * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
          */
+    private:
+        jmethodID suneido_jsdi_type_Callback__m_invoke5_;
+    public:
+        jmethodID suneido_jsdi_type_Callback__m_invoke5() const
+        { return suneido_jsdi_type_Callback__m_invoke5_; }
+        /**<
+         * \brief Returns a global reference to the instance method <code>public final long suneido.jsdi.type.Callback.invoke5(suneido.SuValue,long,long,long,long,long)</code>.
+         * \return <code>public final long suneido.jsdi.type.Callback.invoke5(suneido.SuValue,long,long,long,long,long)</code>
+         * \see jclass suneido_jsdi_type_Callback() const
+         *
+         * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
+         */
+    private:
+        jmethodID suneido_jsdi_type_Callback__m_invoke6_;
+    public:
+        jmethodID suneido_jsdi_type_Callback__m_invoke6() const
+        { return suneido_jsdi_type_Callback__m_invoke6_; }
+        /**<
+         * \brief Returns a global reference to the instance method <code>public final long suneido.jsdi.type.Callback.invoke6(suneido.SuValue,long,long,long,long,long,long)</code>.
+         * \return <code>public final long suneido.jsdi.type.Callback.invoke6(suneido.SuValue,long,long,long,long,long,long)</code>
+         * \see jclass suneido_jsdi_type_Callback() const
+         *
+         * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
+         */
+    private:
+        jmethodID suneido_jsdi_type_Callback__m_invoke7_;
+    public:
+        jmethodID suneido_jsdi_type_Callback__m_invoke7() const
+        { return suneido_jsdi_type_Callback__m_invoke7_; }
+        /**<
+         * \brief Returns a global reference to the instance method <code>public final long suneido.jsdi.type.Callback.invoke7(suneido.SuValue,long,long,long,long,long,long,long)</code>.
+         * \return <code>public final long suneido.jsdi.type.Callback.invoke7(suneido.SuValue,long,long,long,long,long,long,long)</code>
+         * \see jclass suneido_jsdi_type_Callback() const
+         *
+         * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
+         */
+    private:
+        jmethodID suneido_jsdi_type_Callback__m_invoke8_;
+    public:
+        jmethodID suneido_jsdi_type_Callback__m_invoke8() const
+        { return suneido_jsdi_type_Callback__m_invoke8_; }
+        /**<
+         * \brief Returns a global reference to the instance method <code>public final long suneido.jsdi.type.Callback.invoke8(suneido.SuValue,long,long,long,long,long,long,long,long)</code>.
+         * \return <code>public final long suneido.jsdi.type.Callback.invoke8(suneido.SuValue,long,long,long,long,long,long,long,long)</code>
+         * \see jclass suneido_jsdi_type_Callback() const
+         *
+         * Auto-generated by <code>suneido.jsdi.tools.GenerateGlobalReferences</code>.
+         */
     private:
         jclass suneido_jsdi_com_COMobject_;
     public:
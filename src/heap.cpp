@@ -6,14 +6,22 @@
 // file: heap.cpp
 // auth: Victor Schappert
 // date: 20130802
-// desc: Implements C++ wrapper for a Win32 heap
+// desc: Implements a private heap, optionally of executable memory
 //==============================================================================
 
 #include "heap.h"
 
+#if defined(_WIN32)
 #include "jsdi_windows.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <mutex>
+#endif
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <memory>
 
 namespace jsdi {
@@ -24,6 +32,120 @@ namespace jsdi {
 
 namespace {
 
+// Each heap has its own counters, which are only ever updated with relaxed
+// atomics, so a snapshot taken while other threads are allocating may be
+// slightly out of step, but reading them never holds up a thread that is
+// allocating. The totals for all heaps are added up when they are asked for,
+// rather than having every allocation update counters shared by every heap.
+struct heap_counters
+{
+    std::atomic<size_t>   d_live_bytes;
+    std::atomic<size_t>   d_live_blocks;
+    std::atomic<size_t>   d_peak_bytes;
+    std::atomic<uint64_t> d_allocations;
+    heap_counters *       d_prev;  // registry links, guarded by registry_lock
+    heap_counters *       d_next;
+};
+
+// The registry is zero-initialized before any dynamic initialization, so heaps
+// which are constructed during static initialization are registered properly.
+std::atomic_flag registry_lock = ATOMIC_FLAG_INIT;
+heap_counters *  registry;
+size_t           registry_size;
+uint64_t         destroyed_heap_allocations;
+
+class registry_guard : private non_copyable
+{
+    public:
+        registry_guard()
+        {
+            while (registry_lock.test_and_set(std::memory_order_acquire))
+            { }
+        }
+        ~registry_guard()
+        { registry_lock.clear(std::memory_order_release); }
+};
+
+void register_heap(heap_counters& c)
+{
+    c.d_live_bytes.store(0, std::memory_order_relaxed);
+    c.d_live_blocks.store(0, std::memory_order_relaxed);
+    c.d_peak_bytes.store(0, std::memory_order_relaxed);
+    c.d_allocations.store(0, std::memory_order_relaxed);
+    registry_guard guard;
+    c.d_prev = nullptr;
+    c.d_next = registry;
+    if (registry) registry->d_prev = &c;
+    registry = &c;
+    ++registry_size;
+}
+
+void unregister_heap(heap_counters& c)
+{
+    registry_guard guard;
+    if (c.d_prev) c.d_prev->d_next = c.d_next;
+    else registry = c.d_next;
+    if (c.d_next) c.d_next->d_prev = c.d_prev;
+    --registry_size;
+    destroyed_heap_allocations +=
+        c.d_allocations.load(std::memory_order_relaxed);
+}
+
+#if defined(_WIN32)
+// A Win32 heap has its own lock, which isn't held while the counters are
+// updated, so they need atomic read-modify-writes.
+template<typename T>
+inline void add_relaxed(std::atomic<T>& a, T delta)
+{ a.fetch_add(delta, std::memory_order_relaxed); }
+#else
+// The counters are only updated while the heap's mutex is held, so an atomic
+// load and store does the job of a read-modify-write at a fraction of the cost.
+template<typename T>
+inline void add_relaxed(std::atomic<T>& a, T delta)
+{
+    a.store(a.load(std::memory_order_relaxed) + delta,
+            std::memory_order_relaxed);
+}
+#endif
+
+void add_block(heap_counters& c, size_t bytes)
+{
+    add_relaxed(c.d_live_bytes, bytes);
+    add_relaxed(c.d_live_blocks, size_t(1));
+    add_relaxed(c.d_allocations, uint64_t(1));
+    size_t const live(c.d_live_bytes.load(std::memory_order_relaxed));
+    size_t peak(c.d_peak_bytes.load(std::memory_order_relaxed));
+    while (peak < live &&
+           ! c.d_peak_bytes.compare_exchange_weak(
+                 peak, live, std::memory_order_relaxed))
+    { }
+}
+
+void remove_block(heap_counters& c, size_t bytes)
+{
+    // Unsigned arithmetic wraps, so adding the negation subtracts.
+    add_relaxed(c.d_live_bytes, 0 - bytes);
+    add_relaxed(c.d_live_blocks, 0 - size_t(1));
+}
+
+heap::stats_type snapshot(heap_counters const& c)
+{
+    heap::stats_type const result =
+    {
+        c.d_live_bytes.load(std::memory_order_relaxed),
+        c.d_live_blocks.load(std::memory_order_relaxed),
+        c.d_peak_bytes.load(std::memory_order_relaxed),
+        c.d_allocations.load(std::memory_order_relaxed)
+    };
+    return result;
+}
+
+} // anonymous namespace
+
+#if defined(_WIN32)
+
+namespace {
+
 // For some reason, this flag isn't defined in many versions of windows.h
 #ifndef HEAP_CREATE_ENABLE_EXECUTE
 enum { HEAP_CREATE_ENABLE_EXECUTE = 0x00040000 };
@@ -40,11 +162,13 @@ inline DWORD flags(bool is_executable)
 
 struct heap_impl
 {
-    HANDLE      d_hheap;
-    std::string d_name;
+    HANDLE        d_hheap;
+    std::string   d_name;
+    heap_counters d_counters;
 };
 
-heap::heap(const char * name, bool is_executable) : d_impl(nullptr)
+heap::heap(const char * name, bool is_executable, bool)
+    : d_impl(nullptr)
 {
     assert(name || !"heap name cannot be null");
     std::unique_ptr<heap_impl> tmp(new heap_impl);
@@ -55,12 +179,14 @@ heap::heap(const char * name, bool is_executable) : d_impl(nullptr)
     );
     if (! tmp->d_hheap) throw std::bad_alloc();
     tmp->d_name.assign(name);
+    register_heap(tmp->d_counters);
     d_impl = tmp.release();
 }
 
 heap::~heap()
 {
     assert(d_impl && d_impl->d_hheap);
+    unregister_heap(d_impl->d_counters);
 #ifndef NDEBUG
     BOOL success =
 #endif
@@ -77,12 +203,15 @@ void * heap::alloc(size_t n)
     assert(d_impl && d_impl->d_hheap);
     void * ptr = HeapAlloc(d_impl->d_hheap, 0, n);
     if (! ptr) throw std::bad_alloc();
+    add_block(d_impl->d_counters, n);
     return ptr;
 }
 
 void heap::free(void * ptr) noexcept
 {
     assert(d_impl && d_impl->d_hheap);
+    if (! ptr) return;
+    remove_block(d_impl->d_counters, HeapSize(d_impl->d_hheap, 0, ptr));
 #ifndef NDEBUG
     BOOL success =
 #endif
@@ -90,6 +219,286 @@ void heap::free(void * ptr) noexcept
     assert(success || !"failed to free heap memory");
 }
 
+#else // !defined(_WIN32)
+
+namespace {
+
+// Blocks up to 128 bytes are rounded up to a multiple of 16. Above that, each
+// doubling of the block size is split into four evenly-spaced size classes, so
+// no more than a fifth of a block is wasted.
+constexpr size_t SIZE_CLASS_BYTES[] =
+{
+      16,   32,   48,   64,   80,   96,  112,  128,
+     160,  192,  224,  256,  320,  384,  448,  512,
+     640,  768,  896, 1024, 1280, 1536, 1792, 2048
+};
+
+enum
+{
+    NUM_SIZE_CLASSES = sizeof(SIZE_CLASS_BYTES) / sizeof(SIZE_CLASS_BYTES[0]),
+    LARGE_BLOCK      = NUM_SIZE_CLASSES,
+    ALIGNMENT        = 16,
+};
+
+static_assert(heap::MAX_SIZE_CLASS_BYTES ==
+                  SIZE_CLASS_BYTES[NUM_SIZE_CLASSES - 1],
+              "check size classes");
+
+const size_t CHUNK_BYTES      = 64 * 1024;
+const size_t HUGE_CHUNK_BYTES = 2 * 1024 * 1024;
+
+inline size_t size_class(size_t n)
+{
+    assert(n <= heap::MAX_SIZE_CLASS_BYTES);
+    if (n <= 128) return 0 < n ? (n - 1) / 16 : 0;
+    size_t const m(n - 1);
+    size_t const log2(63 - __builtin_clzll(m)); // 7 <= log2 <= 10
+    size_t const result(8 + (log2 - 7) * 4 + (m >> (log2 - 2)) - 4);
+    assert(n <= SIZE_CLASS_BYTES[result] &&
+           SIZE_CLASS_BYTES[result - 1] < n);
+    return result;
+}
+
+inline size_t round_up(size_t n, size_t multiple)
+{ return (n + multiple - 1) / multiple * multiple; }
+
+// Every chunk, and every mapping for a large block, is aligned to the heap's
+// chunk size and starts with a header giving the size class of its blocks. So
+// the header of any block can be found by rounding its address down.
+struct chunk_header
+{
+    size_t         d_size_class;
+    chunk_header * d_next;
+};
+
+struct large_header
+{
+    size_t         d_size_class; // always LARGE_BLOCK
+    size_t         d_map_bytes;
+    large_header * d_prev;
+    large_header * d_next;
+};
+
+struct free_block
+{
+    free_block * d_next;
+};
+
+static_assert(0 == sizeof(chunk_header) % ALIGNMENT, "check alignment");
+static_assert(0 == sizeof(large_header) % ALIGNMENT, "check alignment");
+
+size_t page_size()
+{ return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+// Maps 'bytes' bytes at an address which is a multiple of 'alignment'.
+void * map_aligned(size_t bytes, size_t alignment, int prot, bool huge)
+{
+    size_t const padded(bytes + alignment);
+    void * const raw(mmap(nullptr, padded, prot, MAP_PRIVATE | MAP_ANONYMOUS,
+                          -1, 0));
+    if (MAP_FAILED == raw) throw std::bad_alloc();
+    uintptr_t const begin(reinterpret_cast<uintptr_t>(raw));
+    uintptr_t const aligned(round_up(begin, alignment));
+    if (begin < aligned)
+        munmap(raw, aligned - begin);
+    if (aligned + bytes < begin + padded)
+        munmap(reinterpret_cast<void *>(aligned + bytes),
+               begin + padded - aligned - bytes);
+#if defined(MADV_HUGEPAGE)
+    // Transparent huge pages need no reserved pool, unlike MAP_HUGETLB. If
+    // the kernel doesn't support them, the chunk simply stays in normal pages.
+    if (huge) madvise(reinterpret_cast<void *>(aligned), bytes, MADV_HUGEPAGE);
+#else
+    (void)huge;
+#endif
+    return reinterpret_cast<void *>(aligned);
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                                class heap
+//==============================================================================
+
+struct heap_impl
+{
+    std::string    d_name;
+    int            d_prot;
+    bool           d_use_huge_pages;
+    size_t         d_chunk_bytes;
+    std::mutex     d_mutex;
+    free_block *   d_free[NUM_SIZE_CLASSES];
+    uint8_t *      d_bump[NUM_SIZE_CLASSES];     // uncarved part of newest
+    uint8_t *      d_bump_end[NUM_SIZE_CLASSES]; // chunk for each size class
+    chunk_header * d_chunks;
+    large_header * d_large_blocks;
+    heap_counters  d_counters;
+
+    void * alloc_small(size_t);
+    void * alloc_large(size_t);
+    void free_large(large_header *);
+};
+
+void * heap_impl::alloc_small(size_t size_class)
+{
+    free_block * const block(d_free[size_class]);
+    if (block)
+    {
+        d_free[size_class] = block->d_next;
+        return block;
+    }
+    size_t const bytes(SIZE_CLASS_BYTES[size_class]);
+    if (d_bump_end[size_class] - d_bump[size_class] <
+        static_cast<ptrdiff_t>(bytes))
+    {
+        chunk_header * const chunk(static_cast<chunk_header *>(map_aligned(
+            d_chunk_bytes, d_chunk_bytes, d_prot, d_use_huge_pages)));
+        chunk->d_size_class  = size_class;
+        chunk->d_next        = d_chunks;
+        d_chunks             = chunk;
+        d_bump[size_class]     = reinterpret_cast<uint8_t *>(chunk + 1);
+        d_bump_end[size_class] = reinterpret_cast<uint8_t *>(chunk) +
+                                 d_chunk_bytes;
+    }
+    void * const result(d_bump[size_class]);
+    d_bump[size_class] += bytes;
+    return result;
+}
+
+void * heap_impl::alloc_large(size_t n)
+{
+    size_t const map_bytes(round_up(sizeof(large_header) + n, page_size()));
+    large_header * const block(static_cast<large_header *>(map_aligned(
+        map_bytes, d_chunk_bytes, d_prot, d_use_huge_pages)));
+    block->d_size_class = LARGE_BLOCK;
+    block->d_map_bytes  = map_bytes;
+    block->d_prev       = nullptr;
+    block->d_next       = d_large_blocks;
+    if (d_large_blocks) d_large_blocks->d_prev = block;
+    d_large_blocks = block;
+    return block + 1;
+}
+
+void heap_impl::free_large(large_header * block)
+{
+    if (block->d_prev) block->d_prev->d_next = block->d_next;
+    else d_large_blocks = block->d_next;
+    if (block->d_next) block->d_next->d_prev = block->d_prev;
+    munmap(block, block->d_map_bytes);
+}
+
+heap::heap(const char * name, bool is_executable, bool use_huge_pages)
+    : d_impl(nullptr)
+{
+    assert(name || !"heap name cannot be null");
+    std::unique_ptr<heap_impl> tmp(new heap_impl);
+    tmp->d_name.assign(name);
+    tmp->d_prot = PROT_READ | PROT_WRITE | (is_executable ? PROT_EXEC : 0);
+    tmp->d_use_huge_pages = use_huge_pages;
+    tmp->d_chunk_bytes = use_huge_pages ? HUGE_CHUNK_BYTES : CHUNK_BYTES;
+    for (size_t k = 0; k < NUM_SIZE_CLASSES; ++k)
+    {
+        tmp->d_free[k]     = nullptr;
+        tmp->d_bump[k]     = nullptr;
+        tmp->d_bump_end[k] = nullptr;
+    }
+    tmp->d_chunks       = nullptr;
+    tmp->d_large_blocks = nullptr;
+    register_heap(tmp->d_counters);
+    d_impl = tmp.release();
+}
+
+heap::~heap()
+{
+    assert(d_impl);
+    unregister_heap(d_impl->d_counters);
+    // Like HeapDestroy(), this frees every block, whether or not it was freed.
+    while (d_impl->d_large_blocks)
+        d_impl->free_large(d_impl->d_large_blocks);
+    for (chunk_header * chunk = d_impl->d_chunks; chunk; )
+    {
+        chunk_header * const next(chunk->d_next);
+        munmap(chunk, d_impl->d_chunk_bytes);
+        chunk = next;
+    }
+    delete d_impl;
+}
+
+const std::string& heap::name() const
+{ return d_impl->d_name; }
+
+void * heap::alloc(size_t n)
+{
+    assert(d_impl);
+    std::lock_guard<std::mutex> lock(d_impl->d_mutex);
+    if (n <= MAX_SIZE_CLASS_BYTES)
+    {
+        size_t const c(size_class(n));
+        void * const result(d_impl->alloc_small(c));
+        add_block(d_impl->d_counters, SIZE_CLASS_BYTES[c]);
+        return result;
+    }
+    else
+    {
+        void * const result(d_impl->alloc_large(n));
+        add_block(d_impl->d_counters,
+                  static_cast<large_header *>(result)[-1].d_map_bytes -
+                      sizeof(large_header));
+        return result;
+    }
+}
+
+void heap::free(void * ptr) noexcept
+{
+    assert(d_impl);
+    if (! ptr) return;
+    uintptr_t const chunk_mask(~(d_impl->d_chunk_bytes - 1));
+    size_t * const header(reinterpret_cast<size_t *>(
+        reinterpret_cast<uintptr_t>(ptr) & chunk_mask));
+    std::lock_guard<std::mutex> lock(d_impl->d_mutex);
+    if (LARGE_BLOCK == *header)
+    {
+        large_header * const block(reinterpret_cast<large_header *>(header));
+        remove_block(d_impl->d_counters,
+                     block->d_map_bytes - sizeof(large_header));
+        d_impl->free_large(block);
+    }
+    else
+    {
+        assert(*header < NUM_SIZE_CLASSES || !"not a block from this heap");
+        remove_block(d_impl->d_counters, SIZE_CLASS_BYTES[*header]);
+        free_block * const block(static_cast<free_block *>(ptr));
+        block->d_next = d_impl->d_free[*header];
+        d_impl->d_free[*header] = block;
+    }
+}
+
+#endif // !defined(_WIN32)
+
+heap::stats_type heap::stats() const
+{ return snapshot(d_impl->d_counters); }
+
+size_t heap::count()
+{
+    registry_guard guard;
+    return registry_size;
+}
+
+heap::stats_type heap::total_stats()
+{
+    registry_guard guard;
+    stats_type result = { 0, 0, 0, destroyed_heap_allocations };
+    for (heap_counters const * c = registry; c; c = c->d_next)
+    {
+        stats_type const s(snapshot(*c));
+        result.live_bytes  += s.live_bytes;
+        result.live_blocks += s.live_blocks;
+        result.peak_bytes  += s.peak_bytes;
+        result.allocations += s.allocations;
+    }
+    return result;
+}
+
 } // namespace jsdi
 
 //==============================================================================
@@ -100,7 +509,11 @@ void heap::free(void * ptr) noexcept
 
 #include "test.h"
 
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
+#include <sstream>
+#include <vector>
 
 using namespace jsdi;
 
@@ -140,6 +553,81 @@ TEST(heap_basic,
     h.free(str);
 );
 
+TEST(heap_sizes,
+    // Every block is aligned, writeable all the way to its end and distinct
+    // from every other block, whether it comes from a size class or is mapped
+    // individually.
+    for (int use_huge_pages = 0; use_huge_pages < 2; ++use_huge_pages)
+    {
+        heap h("sizes", false, 0 != use_huge_pages);
+        std::vector<std::pair<unsigned char *, size_t>> blocks;
+        for (size_t n = 0; n <= 3 * heap::MAX_SIZE_CLASS_BYTES; n += 7)
+        {
+            unsigned char * const p(static_cast<unsigned char *>(h.alloc(n)));
+            assert_true(p);
+            assert_equals(0, reinterpret_cast<uintptr_t>(p) %
+                                 (2 * sizeof(void *)));
+            std::memset(p, static_cast<int>(n & 0xff), n);
+            blocks.push_back(std::make_pair(p, n));
+        }
+        bool intact(true);
+        for (auto i = blocks.begin(), e = blocks.end(); i != e; ++i)
+        {
+            for (size_t k = 0; k < i->second; ++k)
+                intact = intact && (i->second & 0xff) == i->first[k];
+            h.free(i->first);
+        }
+        assert_true(intact);
+        h.free(nullptr);
+    }
+);
+
+#if !defined(_WIN32)
+
+TEST(heap_reuse,
+    heap h("reuse", false);
+    void * const a(h.alloc(40));
+    void * const b(h.alloc(48));
+    h.free(a);
+    // Blocks of the same size class are reused, most recently freed first.
+    assert_true(a == h.alloc(33));
+    h.free(b);
+    // Blocks left allocated are freed with the heap.
+    h.alloc(heap::MAX_SIZE_CLASS_BYTES + 1);
+);
+
+#endif // #if !defined(_WIN32)
+
+TEST(heap_stats,
+    size_t const heaps_before(heap::count());
+    heap::stats_type const total_before(heap::total_stats());
+    {
+        heap h("stats", false);
+        assert_equals(heaps_before + 1, heap::count());
+        void * const a(h.alloc(100));
+        void * const b(h.alloc(3 * heap::MAX_SIZE_CLASS_BYTES));
+        heap::stats_type const s(h.stats());
+        assert_equals(2, s.live_blocks);
+        assert_true(100 + 3 * heap::MAX_SIZE_CLASS_BYTES <= s.live_bytes);
+        assert_equals(s.live_bytes, s.peak_bytes);
+        assert_equals(2, s.allocations);
+        h.free(a);
+        h.free(b);
+        heap::stats_type const t(h.stats());
+        assert_equals(0, t.live_blocks);
+        assert_equals(0, t.live_bytes);
+        assert_equals(s.peak_bytes, t.peak_bytes);
+        assert_equals(2, t.allocations);
+        // Blocks left allocated when a heap is destroyed stop counting.
+        h.alloc(16);
+    }
+    heap::stats_type const total_after(heap::total_stats());
+    assert_equals(heaps_before, heap::count());
+    assert_equals(total_before.live_blocks, total_after.live_blocks);
+    assert_equals(total_before.live_bytes, total_after.live_bytes);
+    assert_equals(total_before.allocations + 3, total_after.allocations);
+);
+
 #if defined(_M_IX86)
 
 TEST(heap_exec_x86,
@@ -158,4 +646,69 @@ TEST(heap_exec_x86,
 
 #endif // #if defined(_M_IX86)
 
+#if defined(_M_AMD64) || defined(__x86_64__)
+
+TEST(heap_exec_amd64,
+    constexpr unsigned char CODE[] =
+    {
+        0xb8, 0x1b, 0x00, 0x00, 0x00, // mov eax, 27
+        0xc3                          // retq
+    };
+    heap h("exeheap", true);
+    void * code = h.alloc(sizeof(CODE));
+    std::memcpy(code, CODE, sizeof(CODE));
+    int (* f)() = reinterpret_cast<int (*)()>(code);
+    assert_equals(27, f());
+    h.free(code);
+);
+
+#endif // #if defined(_M_AMD64) || defined(__x86_64__)
+
+TEST(heap_timing,
+    // Compares the heap against the system allocator for blocks the size of
+    // thunks, allocating a batch and then freeing it, over and over. Only the
+    // results are asserted; timings are logged.
+    typedef std::chrono::high_resolution_clock clock;
+    constexpr int ROUNDS = 1000;
+    constexpr int BATCH = 256;
+    constexpr size_t SIZES[] = { 16, 32, 48, 96, 112 };
+    constexpr size_t NUM_SIZES = sizeof(SIZES) / sizeof(SIZES[0]);
+    void * blocks[BATCH];
+    heap h("timing", false);
+    size_t sum_heap(0), sum_malloc(0);
+    auto t0 = clock::now();
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (int k = 0; k < BATCH; ++k)
+        {
+            blocks[k] = h.alloc(SIZES[k % NUM_SIZES]);
+            *static_cast<unsigned char *>(blocks[k]) = 1;
+        }
+        for (int k = 0; k < BATCH; ++k)
+        {
+            sum_heap += *static_cast<unsigned char *>(blocks[k]);
+            h.free(blocks[k]);
+        }
+    }
+    auto t1 = clock::now();
+    for (int r = 0; r < ROUNDS; ++r)
+    {
+        for (int k = 0; k < BATCH; ++k)
+        {
+            blocks[k] = std::malloc(SIZES[k % NUM_SIZES]);
+            *static_cast<unsigned char *>(blocks[k]) = 1;
+        }
+        for (int k = 0; k < BATCH; ++k)
+        {
+            sum_malloc += *static_cast<unsigned char *>(blocks[k]);
+            std::free(blocks[k]);
+        }
+    }
+    auto t2 = clock::now();
+    assert_equals(static_cast<size_t>(ROUNDS * BATCH), sum_heap);
+    assert_equals(sum_heap, sum_malloc);
+    log_timing("heap alloc/free", t1 - t0, ROUNDS * BATCH);
+    log_timing("malloc/free", t2 - t1, ROUNDS * BATCH);
+);
+
 #endif // #ifndef __NOTEST__
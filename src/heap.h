@@ -9,23 +9,36 @@
  * \file heap.h
  * \author Victor Schappert
  * \since 20130802
- * \brief Wraps Win32 heap object in C++ code
+ * \brief Private heap, optionally of executable memory
  */
 
 #include "util.h"
 
+#include <cstdint>
+
 namespace jsdi {
 
 struct heap_impl;
 
 /**
- * \brief Wraps a Windows heap
+ * \brief Private heap, optionally of executable memory
  * \author Victor Schappert
  * \since 20130802
  *
  * This is basically a copy of Andrew's cSuneido Heap class. It is necessary
  * for allocating executable stubs on the heap in order to implement callbacks
  * (because the default process heap should not be executable).
+ *
+ * The backend depends on the platform. On Windows, the heap wraps a Win32 heap
+ * object. Elsewhere, it is an arena of memory mapped with
+ * <code>mmap()</code>. Blocks of up to #MAX_SIZE_CLASS_BYTES bytes are rounded
+ * up to one of a small number of size classes. Each size class is carved out
+ * of its own chunks of memory and has its own free list, so allocating and
+ * freeing a small block takes constant time and never fragments the heap.
+ * Larger blocks are mapped individually. Memory in chunks is only returned to
+ * the operating system when the heap is destroyed.
+ *
+ * All member functions are thread-safe.
  */
 class heap : private non_copyable
 {
@@ -41,14 +54,27 @@ class heap : private non_copyable
 
     public:
 
+        /**
+         * \brief Largest block size, in bytes, which is rounded up to a size
+         *        class rather than being mapped individually
+         *
+         * Has no effect on Windows.
+         */
+        static const size_t MAX_SIZE_CLASS_BYTES = 2048;
+
         /**
          * \brief Constructs a heap
          * \param name Non-NULL zero-terminated name for the heap
          * \param is_executable Set <code>true</code> to allow blocks allocated
          * from this heap to be executable, <code>false</code> otherwise
-         * \throw std::bad_alloc If a Windows heap cannot be created
+         * \param use_huge_pages Set <code>true</code> to ask the operating
+         * system to back the heap with huge pages where it can. This is only a
+         * hint: it is ignored on Windows, and elsewhere the heap falls back to
+         * normal pages if huge pages aren't available.
+         * \throw std::bad_alloc If the heap cannot be created
          */
-        heap(const char * name, bool is_executable);
+        heap(const char * name, bool is_executable,
+             bool use_huge_pages = false);
 
         ~heap();
 
@@ -64,6 +90,34 @@ class heap : private non_copyable
          */
         const std::string& name() const;
 
+        /**
+         * \brief Heap statistics
+         * \see #stats() const
+         * \see #total_stats()
+         */
+        struct stats_type
+        {
+            /** \brief Number of bytes in blocks which haven't been freed */
+            size_t   live_bytes;
+            /** \brief Number of blocks which haven't been freed */
+            size_t   live_blocks;
+            /** \brief Largest value #live_bytes has had */
+            size_t   peak_bytes;
+            /** \brief Number of blocks ever allocated, from which a caller
+             *         sampling the statistics can work out the allocation
+             *         rate */
+            uint64_t allocations;
+        };
+
+        /**
+         * \brief Returns a snapshot of the statistics for this heap
+         * \return Statistics
+         *
+         * The number of bytes in a block is the number of bytes the heap set
+         * aside for it, which may be more than the number requested.
+         */
+        stats_type stats() const;
+
         //
         // MUTATORS
         //
@@ -79,9 +133,32 @@ class heap : private non_copyable
 
         /**
          * \brief Frees a block previously allocated using #alloc(size_t)
-         * \param ptr Pointer to the block of memory to free
+         * \param ptr Pointer to the block of memory to free, or
+         *        <code>null</code> to do nothing
          */
         void free(void * ptr) noexcept;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of heaps which haven't been destroyed
+         * \return Heap count
+         */
+        static size_t count();
+
+        /**
+         * \brief Returns a snapshot of the statistics for all heaps together
+         * \return Statistics for the heaps which haven't been destroyed, except
+         *         that stats_type#allocations also counts the blocks allocated
+         *         by heaps which have been. stats_type#peak_bytes is the sum of
+         *         each heap's peak, so it is an upper bound on the peak of the
+         *         heaps together.
+         */
+        static stats_type total_stats();
 };
 
 } // namespace jsdi
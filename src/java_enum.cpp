@@ -45,7 +45,7 @@ suneido_jsdi_marshall_VariableIndirectInstruction jni_enum_to_cpp(JNIEnv * env,
 template <>
 suneido_jsdi_marshall_VariableIndirectInstruction ordinal_enum_to_cpp(int e)
 {
-    if (! (0 <= e && e < 3))
+    if (! (0 <= e && e < 5))
     {
         throw_out_of_range(
             __FUNCTION__,
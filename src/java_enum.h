@@ -78,6 +78,8 @@ enum suneido_jsdi_marshall_VariableIndirectInstruction
     NO_ACTION,
     RETURN_JAVA_STRING,
     RETURN_RESOURCE,
+    RETURN_JAVA_STRING_ANSI,
+    RETURN_JAVA_STRING_UTF16,
 };
 
 /** \cond internal */
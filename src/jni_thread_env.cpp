@@ -0,0 +1,232 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: jni_thread_env.cpp
+// auth: Victor Schappert
+// date: 20140911
+// desc: Per-thread cache of the JNI environment for threads entering the JVM
+//       from native code
+//==============================================================================
+
+#include "jni_thread_env.h"
+
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#endif // defined(_WIN32)
+
+#include <atomic>
+#include <cassert>
+
+namespace jsdi {
+
+namespace {
+
+// The environment and JVM are non-NULL iff jni_thread_env::get() attached
+// this thread.
+JSDI_THREAD_LOCAL JNIEnv * this_thread_attached_env;
+JSDI_THREAD_LOCAL JavaVM * this_thread_attached_jvm;
+
+std::atomic<uint64_t> attached_threads(0);
+
+#if defined(_WIN32)
+
+// An attached thread can't be detached from DllMain(), which runs with the
+// loader lock held: DetachCurrentThread() takes JVM locks which another thread
+// may hold while it waits for the loader lock. Instead, each attached thread
+// sets a fiber local storage value, and the callback for that value detaches
+// the thread. Windows calls the callback when the thread exits, before the
+// DLL_THREAD_DETACH notifications and without holding the loader lock.
+
+void WINAPI detach_at_thread_exit(void *)
+{ jni_thread_env::thread_detach(); }
+
+DWORD alloc_detach_fls_index()
+{
+    // The callback must stay mapped as long as any attached thread can exit,
+    // so the module is pinned before the callback is registered. The index is
+    // never freed, because FlsFree() would run the callback for every thread
+    // on the calling thread.
+    HMODULE module(nullptr);
+    GetModuleHandleEx(
+        GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+        reinterpret_cast<LPCTSTR>(&detach_at_thread_exit), &module);
+    return FlsAlloc(detach_at_thread_exit);
+}
+
+DWORD detach_fls_index()
+{
+    static DWORD const index(alloc_detach_fls_index());
+    return index;
+}
+
+#endif // defined(_WIN32)
+
+} // anonymous namespace
+
+//==============================================================================
+//                          struct jni_thread_env
+//==============================================================================
+
+JNIEnv * jni_thread_env::get(JavaVM * jni_jvm)
+{
+    assert(jni_jvm || !"JVM cannot be NULL");
+    if (this_thread_attached_env)
+    {
+        assert(jni_jvm == this_thread_attached_jvm);
+        return this_thread_attached_env;
+    }
+    JNIEnv * env(nullptr);
+    jint const status(
+        jni_jvm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6));
+    if (JNI_OK == status) return env;
+    else if (JNI_EDETACHED != status) return nullptr;
+    JavaVMAttachArgs attach_args;
+    attach_args.version = JNI_VERSION_1_6;
+    attach_args.name    = nullptr;
+    attach_args.group   = nullptr;
+    if (JNI_OK != jni_jvm->AttachCurrentThread(reinterpret_cast<void **>(&env),
+                                               &attach_args))
+        return nullptr;
+    this_thread_attached_env = env;
+    this_thread_attached_jvm = jni_jvm;
+    attached_threads.fetch_add(1, std::memory_order_relaxed);
+#if defined(_WIN32)
+    DWORD const index(detach_fls_index());
+    if (FLS_OUT_OF_INDEXES != index) FlsSetValue(index, jni_jvm);
+#else
+    call_at_thread_exit(&jni_thread_env::thread_detach);
+#endif // defined(_WIN32)
+    return env;
+}
+
+void jni_thread_env::thread_detach()
+{
+    if (! this_thread_attached_env) return;
+    JavaVM * const jni_jvm(this_thread_attached_jvm);
+    this_thread_attached_env = nullptr;
+    this_thread_attached_jvm = nullptr;
+    jni_jvm->DetachCurrentThread();
+}
+
+uint64_t jni_thread_env::attached_count()
+{ return attached_threads.load(std::memory_order_relaxed); }
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <thread>
+
+using namespace jsdi;
+
+namespace {
+
+// Stand-in for the JVM's invocation interface which records calls.
+struct fake_jvm
+{
+    static int      get_env_calls;
+    static int      attach_calls;
+    static int      detach_calls;
+    static bool     attached;
+    static JNIEnv * const ENV;
+
+    static jint JNICALL GetEnv(JavaVM *, void ** penv, jint)
+    {
+        ++get_env_calls;
+        *penv = attached ? ENV : nullptr;
+        return attached ? JNI_OK : JNI_EDETACHED;
+    }
+
+    static jint JNICALL AttachCurrentThread(JavaVM *, void ** penv, void *)
+    {
+        ++attach_calls;
+        attached = true;
+        *penv = ENV;
+        return JNI_OK;
+    }
+
+    static jint JNICALL DetachCurrentThread(JavaVM *)
+    {
+        ++detach_calls;
+        attached = false;
+        return JNI_OK;
+    }
+
+    static void reset(bool attached_)
+    {
+        get_env_calls = attach_calls = detach_calls = 0;
+        attached = attached_;
+    }
+
+    static JavaVM * instance()
+    {
+        static JNIInvokeInterface_ functions;
+        static JavaVM jvm;
+        functions.GetEnv = GetEnv;
+        functions.AttachCurrentThread = AttachCurrentThread;
+        functions.DetachCurrentThread = DetachCurrentThread;
+        jvm.functions = &functions;
+        return &jvm;
+    }
+};
+
+int fake_jvm::get_env_calls;
+int fake_jvm::attach_calls;
+int fake_jvm::detach_calls;
+bool fake_jvm::attached;
+JNIEnv * const fake_jvm::ENV(reinterpret_cast<JNIEnv *>(0x1234));
+
+} // anonymous namespace
+
+TEST(jni_thread_env_native_thread,
+    // Run on a new thread so that this thread's state isn't touched.
+    fake_jvm::reset(false);
+    uint64_t const count_before(jni_thread_env::attached_count());
+    int wrong_env(0), detach_calls_after_first(0);
+    std::thread t([&wrong_env, &detach_calls_after_first]()
+    {
+        JavaVM * const jvm(fake_jvm::instance());
+        for (int k = 0; k < 100; ++k)
+            if (fake_jvm::ENV != jni_thread_env::get(jvm)) ++wrong_env;
+        jni_thread_env::thread_detach();
+        detach_calls_after_first = fake_jvm::detach_calls;
+        jni_thread_env::thread_detach(); // no-op
+    });
+    t.join();
+    assert_equals(0, wrong_env);
+    assert_equals(1, fake_jvm::get_env_calls);
+    assert_equals(1, fake_jvm::attach_calls);
+    assert_equals(1, detach_calls_after_first);
+    assert_equals(1, fake_jvm::detach_calls);
+    assert_equals(count_before + 1, jni_thread_env::attached_count());
+);
+
+TEST(jni_thread_env_attached_thread,
+    // A thread that is already attached is never attached or detached again.
+    fake_jvm::reset(true);
+    uint64_t const count_before(jni_thread_env::attached_count());
+    int wrong_env(0);
+    std::thread t([&wrong_env]()
+    {
+        JavaVM * const jvm(fake_jvm::instance());
+        for (int k = 0; k < 10; ++k)
+            if (fake_jvm::ENV != jni_thread_env::get(jvm)) ++wrong_env;
+        jni_thread_env::thread_detach();
+    });
+    t.join();
+    assert_equals(0, wrong_env);
+    assert_equals(10, fake_jvm::get_env_calls);
+    assert_equals(0, fake_jvm::attach_calls);
+    assert_equals(0, fake_jvm::detach_calls);
+    assert_equals(count_before, jni_thread_env::attached_count());
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,80 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_JNI_THREAD_ENV_H___
+#define __INCLUDED_JNI_THREAD_ENV_H___
+
+/**
+ * \file jni_thread_env.h
+ * \author Victor Schappert
+ * \since 20140911
+ * \brief Per-thread cache of the JNI environment for threads entering the JVM
+ *        from native code
+ */
+
+#include "util.h"
+
+#include <jni.h>
+
+#include <cstdint>
+
+namespace jsdi {
+
+//==============================================================================
+//                          struct jni_thread_env
+//==============================================================================
+
+/**
+ * \brief Obtains the JNI environment for the calling thread, attaching the
+ *        thread to the JVM only if it isn't already attached
+ * \author Victor Schappert
+ * \since 20140911
+ * \see jsdi_callback_base
+ *
+ * Code that can be entered on an arbitrary thread, such as a callback or a COM
+ * handler, needs a <code>JNIEnv</code> before it can call into Java. A thread
+ * created by the JVM, or already attached by someone else, is found cheaply
+ * with <code>GetEnv()</code>. A purely native thread is attached the first
+ * time it needs an environment, and that environment is then cached for the
+ * life of the thread.
+ *
+ * A thread attached by this class is detached by #thread_detach() when it
+ * exits. On Windows, this happens in a fiber local storage callback rather
+ * than in <code>DllMain()</code>, because detaching a thread while holding
+ * the loader lock can deadlock the JVM. An environment obtained from
+ * <code>GetEnv()</code> is never cached, because whoever attached the thread
+ * may detach it again.
+ */
+struct jni_thread_env : private non_instantiable
+{
+        /**
+         * \brief Returns the JNI environment for the calling thread
+         * \param jni_jvm Non-<code>null</code> pointer to the JVM
+         * \return JNI environment, or <code>nullptr</code> if the thread
+         *         isn't attached and attaching it failed
+         */
+        static JNIEnv * get(JavaVM * jni_jvm);
+
+        /**
+         * \brief Detaches the calling thread from the JVM if it was attached
+         *        by #get(JavaVM *)
+         *
+         * This function is called automatically when a thread attached by
+         * #get(JavaVM *) exits. It does nothing if #get(JavaVM *) never
+         * attached the calling thread.
+         */
+        static void thread_detach();
+
+        /**
+         * \brief Returns the number of native threads that #get(JavaVM *) has
+         *        attached to the JVM
+         * \return Number of threads attached since the library was loaded,
+         *         including threads which have since exited
+         */
+        static uint64_t attached_count();
+};
+
+} // namespace jsdi
+
+#endif // __INCLUDED_JNI_THREAD_ENV_H___
@@ -11,7 +11,12 @@
 
 #include "jni_util.h"
 
+#include "char_widen.h"
+#include "jsdi_windows.h"
+
+#include <algorithm>
 #include <cstring>
+#include <stdexcept>
 
 namespace jsdi {
 
@@ -104,33 +109,208 @@ jni_utf16_ostream& operator<<(jni_utf16_ostream& o, jstring jstr)
 //                         string utility functions
 //==============================================================================
 
+namespace {
+
+// Strings containing non-ASCII characters up to this length are widened on the
+// stack.
+const size_t MAKE_JSTRING_STACK_CHARS = 256;
+
+static_assert(sizeof(jchar) == sizeof(uint16_t), "jchar must be 16 bits");
+
+inline size_t widen_into(char const * sz, jchar * dest, size_t capacity)
+{ return char_widen::widen(sz, reinterpret_cast<uint16_t *>(dest), capacity); }
+
+inline jstring new_string(JNIEnv * env, jchar const * jchars, size_t jlen)
+{
+    jstring result = env->NewString(jchars, static_cast<jsize>(jlen));
+    // According to the NewString docs, it can either:
+    //   -- return NULL (if the string "cannot be constructed"); or
+    //   -- throw OutOfMemoryError if JVM runs out of memory
+    JNI_EXCEPTION_CHECK(env);
+    if (! result) throw jni_bad_alloc("NewString", __FUNCTION__);
+    return result;
+}
+
+// 'Widen' must have the same contract as char_widen::widen().
+template<typename Widen>
+jstring make_jstring_widened(JNIEnv * env, char const * sz, Widen widen)
+{
+    assert(env || !"environment cannot be NULL");
+    assert(sz || !"string cannot be null");
+    // A string of 7-bit ASCII characters is already valid modified UTF-8, so
+    // the JVM can read it directly and there is no need to widen it.
+    size_t const ascii_len(char_widen::ascii_prefix(sz));
+    if (! sz[ascii_len])
+    {
+        jstring result = env->NewStringUTF(sz);
+        JNI_EXCEPTION_CHECK(env);
+        if (! result) throw jni_bad_alloc("NewStringUTF", __FUNCTION__);
+        return result;
+    }
+    // Widen in one pass into the stack buffer. Only if the string turns out
+    // not to fit is its length determined so it can be widened onto the heap.
+    jchar stack_buf[MAKE_JSTRING_STACK_CHARS];
+    size_t jlen(widen(sz, stack_buf, MAKE_JSTRING_STACK_CHARS));
+    if (MAKE_JSTRING_STACK_CHARS == jlen && sz[jlen])
+    {
+        jlen += std::strlen(sz + jlen);
+        std::vector<jchar, arena_allocator<jchar>> heap_buf(jlen);
+        std::copy(stack_buf, stack_buf + MAKE_JSTRING_STACK_CHARS,
+                  heap_buf.begin());
+        widen(sz + MAKE_JSTRING_STACK_CHARS,
+              heap_buf.data() + MAKE_JSTRING_STACK_CHARS,
+              jlen - MAKE_JSTRING_STACK_CHARS);
+        return new_string(env, heap_buf.data(), jlen);
+    }
+    return new_string(env, stack_buf, jlen);
+}
+
+} // anonymous namespace
+
 std::vector<jchar> widen(char const * sz)
 {
     assert(sz || !"sz cannot be NULL");
     size_t N = std::strlen(sz);
     std::vector<jchar> wide(N);
-    const char * end(sz + N);
-    std::vector<jchar>::iterator o(wide.begin());
-    for (; sz != end; ++sz, ++o)
-    {
-        *o = static_cast<jchar>(static_cast<unsigned char>(*sz));
-    }
+    if (0 < N) widen_into(sz, wide.data(), N);
     return wide;
 }
 
 jstring make_jstring(JNIEnv * env, char const * sz)
+{ return make_jstring_widened(env, sz, widen_into); }
+
+jstring make_jstring(JNIEnv * env, char const * sz, code_page const& cp)
+{
+    return make_jstring_widened(
+        env, sz,
+        [&cp](char const * str, jchar * dest, size_t capacity)
+        { return cp.widen(str, reinterpret_cast<uint16_t *>(dest), capacity); }
+    );
+}
+
+jstring make_jstring_ansi(JNIEnv * env, char const * sz)
 {
+    static code_page const * const ACP(code_page::find(GetACP()));
+    if (ACP) return make_jstring(env, sz, *ACP);
+    // The ANSI code page is a double-byte code page, so let Windows convert it.
     assert(env || !"environment cannot be NULL");
     assert(sz || !"string cannot be null");
-    std::vector<jchar> const jchars(widen(sz));
-    jsize const jlen(static_cast<jsize>(jchars.size()));
-    jstring result = env->NewString(jchars.data(), jlen);
-    // According to the NewString docs, it can either:
-    //   -- return NULL (if the string "cannot be constructed"); or
-    //   -- throw OutOfMemoryError if JVM runs out of memory
-    JNI_EXCEPTION_CHECK(env);
-    if (! result) throw jni_bad_alloc("NewString", __FUNCTION__);
-    return result;
+    int const size(MultiByteToWideChar(CP_ACP, 0, sz, -1, nullptr, 0));
+    if (size < 1) throw std::runtime_error("MultiByteToWideChar failed");
+    std::vector<jchar, arena_allocator<jchar>> wide(static_cast<size_t>(size));
+    static_assert(sizeof(jchar) == sizeof(WCHAR), "jchar must be a WCHAR");
+    MultiByteToWideChar(CP_ACP, 0, sz, -1,
+                        reinterpret_cast<WCHAR *>(wide.data()), size);
+    return new_string(env, wide.data(), static_cast<size_t>(size - 1));
+}
+
+jstring make_jstring_utf16(JNIEnv * env, jchar const * sz)
+{
+    assert(env || !"environment cannot be NULL");
+    assert(sz || !"string cannot be null");
+    jchar const * end(sz);
+    while (*end) ++end;
+    return new_string(env, sz, static_cast<size_t>(end - sz));
 }
 
 } // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+using namespace jsdi;
+
+namespace {
+
+jlongArray make_long_array(JNIEnv * env, jsize size)
+{
+    jlongArray array = env->NewLongArray(size);
+    std::vector<jlong> values(static_cast<size_t>(size));
+    for (jsize k = 0; k < size; ++k) values[k] = 1000 + k;
+    env->SetLongArrayRegion(array, 0, size, values.data());
+    return array;
+}
+
+template<typename Region>
+bool is_inside(Region const& region)
+{
+    auto const p = reinterpret_cast<char const *>(region.data());
+    auto const r = reinterpret_cast<char const *>(&region);
+    return r <= p && p < r + sizeof(Region);
+}
+
+template<typename Region>
+bool has_values(Region const& region, jsize size)
+{
+    if (size != region.size()) return false;
+    for (jsize k = 0; k < size; ++k)
+        if (1000 + k != region[k]) return false;
+    return true;
+}
+
+} // anonymous namespace
+
+TEST(jni_array_region_inline,
+    test_java_vm vm;
+    JNIEnv * const env(vm.env_of_creating_thread());
+    typedef jni_array_region<jlong> region_type;
+    jsize const SIZES[] = { 0, 1, 16, region_type::INLINE_CAPACITY };
+    for (jsize size : SIZES)
+    {
+        jlongArray array = make_long_array(env, size);
+        region_type const region(env, array);
+        assert_true(is_inside(region));
+        assert_true(has_values(region, size));
+        env->DeleteLocalRef(array);
+    }
+);
+
+TEST(jni_array_region_allocated,
+    test_java_vm vm;
+    JNIEnv * const env(vm.env_of_creating_thread());
+    typedef jni_array_region<jlong> region_type;
+    jsize const SIZE(region_type::INLINE_CAPACITY + 1);
+    arena_scope const scope;
+    jlongArray array = make_long_array(env, SIZE);
+    region_type const whole(env, array);
+    assert_false(is_inside(whole));
+    assert_true(has_values(whole, SIZE));
+    region_type const part(env, array, SIZE - 1);
+    assert_true(is_inside(part));
+    assert_true(has_values(part, SIZE - 1));
+    env->DeleteLocalRef(array);
+);
+
+TEST(jni_array_region_caller_storage,
+    test_java_vm vm;
+    JNIEnv * const env(vm.env_of_creating_thread());
+    typedef jni_array_region<jlong> region_type;
+    jsize const CAPACITY(2 * region_type::INLINE_CAPACITY);
+    jlong storage[CAPACITY];
+    arena_scope const scope;
+    jlongArray array = make_long_array(env, CAPACITY + 1);
+    { // Fits in the caller's storage
+        region_type const region(env, array, CAPACITY, storage, CAPACITY);
+        assert_true(storage == region.data());
+        assert_true(has_values(region, CAPACITY));
+    }
+    { // Too big for the caller's storage
+        region_type const region(env, array, CAPACITY + 1, storage, CAPACITY);
+        assert_true(storage != region.data());
+        assert_false(is_inside(region));
+        assert_true(has_values(region, CAPACITY + 1));
+    }
+    { // Too big for the caller's storage but not for the inline buffer
+        region_type const region(env, array, 3, storage, 2);
+        assert_true(is_inside(region));
+        assert_true(has_values(region, 3));
+    }
+    env->DeleteLocalRef(array);
+);
+
+#endif // __NOTEST__
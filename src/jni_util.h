@@ -12,6 +12,8 @@
  * \brief Utility functions to simplify working with JNI.
  */
 
+#include "arena.h"
+#include "code_page.h"
 #include "util.h"
 #include "utf16_util.h"
 #include "jni_exception.h"
@@ -137,6 +139,8 @@ inline void jni_array_get_region<jboolean>(JNIEnv * env, jbooleanArray array,
  * \since 20130628
  * \tparam JNIType The JNI data type on which to specialize the array region
  *         &mdash; \em eg <code>jbyte</code>.
+ * \tparam Allocator Allocator for the copy of the array data. By default, the
+ *         data is drawn from the calling thread's \link arena\endlink.
  * \see jni_array
  * \see jni_utf8_string_region
  * \see jni_utf16_string_region
@@ -145,8 +149,16 @@ inline void jni_array_get_region<jboolean>(JNIEnv * env, jbooleanArray array,
  * <code>Get&lt;Type&gt;ArrayRegion(...)</code> function and deallocated on
  * destruction. This is a one-way data structure in the sense that it is not
  * possible to send its contents back to the JVM.
+ *
+ * Most regions are small, such as the pointer and variable indirect
+ * instruction arrays of a typical call, so a region of up to #INLINE_CAPACITY
+ * elements is copied into a buffer inside the region object itself and the
+ * allocator is only used for larger regions. A caller which knows more about
+ * the sizes it deals with can also supply its own storage.
  */
-template<typename JNIType>
+template<typename JNIType,
+         typename Allocator =
+             arena_allocator<typename jni_traits<JNIType>::value_type>>
 class jni_array_region: private non_copyable
 {
         //
@@ -179,6 +191,14 @@ class jni_array_region: private non_copyable
         typedef typename jni_traits<JNIType>::const_reference const_reference;
         /** \brief Random-access iterator to a #const_value_type. */
         typedef typename jni_traits<JNIType>::const_pointer const_iterator;
+        /** \brief Type of the allocator for the region's array. */
+        typedef Allocator allocator_type;
+
+        /**
+         * \brief Maximum number of elements the region can hold without
+         *        using the allocator.
+         */
+        static const size_type INLINE_CAPACITY = 32;
 
         //
         // DATA
@@ -186,8 +206,18 @@ class jni_array_region: private non_copyable
 
     private:
 
+        allocator_type d_allocator;
         size_type d_size;
         pointer d_array;
+        bool d_is_allocated;
+        value_type d_inline[INLINE_CAPACITY];
+
+        //
+        // INTERNALS
+        //
+
+        void init(JNIEnv * env, array_type array, pointer storage,
+                  size_type capacity);
 
         //
         // CONSTRUCTORS
@@ -218,6 +248,28 @@ class jni_array_region: private non_copyable
          */
         jni_array_region(JNIEnv * env, array_type array, size_type size);
 
+        /**
+         * \brief Constructor for region containing all of the elements of the
+         *        Java array from index 0 up to a certain size, which copies
+         *        them into storage provided by the caller if it is big enough.
+         * \param env JNI environment
+         * \param array Reference to a JNI primitive array of the correct type
+         *              (\em eg <code>jbyteArray</code>)
+         * \param size Desired size of the region; this must be known in advance
+         *             to be less than or equal to the array's length, because
+         *             this constructor does not check the length of the array
+         * \param storage Pointer to at least <code>capacity</code> elements,
+         *                which must outlive the region
+         * \param capacity Number of elements at <code>storage</code>
+         * \see #jni_array_region(JNIEnv *, array_type, size_type)
+         *
+         * If <code>size</code> is no more than <code>capacity</code>, the
+         * region's data is <code>storage</code>. Otherwise this constructor
+         * behaves like #jni_array_region(JNIEnv *, array_type, size_type).
+         */
+        jni_array_region(JNIEnv * env, array_type array, size_type size,
+                         pointer storage, size_type capacity);
+
         ~jni_array_region();
 
         //
@@ -314,94 +366,120 @@ class jni_array_region: private non_copyable
         const_iterator end() const;
 };
 
-template <typename JNIType>
-inline jni_array_region<JNIType>::jni_array_region(JNIEnv * env,
-                                                   array_type array)
-    : d_size(env->GetArrayLength(array))
-    , d_array(new value_type[d_size])
+template <typename JNIType, typename Allocator>
+inline void jni_array_region<JNIType, Allocator>::init(
+    JNIEnv * env, array_type array, pointer storage, size_type capacity)
 {
     assert(env || !"JNI environment cannot be NULL");
     assert(array || !"JNI array cannot be NULL");
+    assert(0 <= d_size || !"region size cannot be negative");
+    if (d_size <= capacity)
+        d_array = storage;
+    else if (d_size <= INLINE_CAPACITY)
+        d_array = d_inline;
+    else
+    {
+        d_array = d_allocator.allocate(static_cast<size_t>(d_size));
+        d_is_allocated = true;
+    }
     jni_array_get_region<JNIType>(env, array, 0, d_size, d_array);
     JNI_EXCEPTION_CHECK(env);
 }
 
-template <typename JNIType>
-inline jni_array_region<JNIType>::jni_array_region(JNIEnv * env,
-                                                   array_type array,
-                                                   size_type size)
+template <typename JNIType, typename Allocator>
+inline jni_array_region<JNIType, Allocator>::jni_array_region(
+    JNIEnv * env, array_type array)
+    : d_size(env->GetArrayLength(array))
+    , d_array(nullptr)
+    , d_is_allocated(false)
+{ init(env, array, d_inline, INLINE_CAPACITY); }
+
+template <typename JNIType, typename Allocator>
+inline jni_array_region<JNIType, Allocator>::jni_array_region(
+    JNIEnv * env, array_type array, size_type size)
+    : d_size(size)
+    , d_array(nullptr)
+    , d_is_allocated(false)
+{ init(env, array, d_inline, INLINE_CAPACITY); }
+
+template <typename JNIType, typename Allocator>
+inline jni_array_region<JNIType, Allocator>::jni_array_region(
+    JNIEnv * env, array_type array, size_type size, pointer storage,
+    size_type capacity)
     : d_size(size)
-    , d_array(new value_type[d_size])
+    , d_array(nullptr)
+    , d_is_allocated(false)
 {
-    assert(env || !"JNI environment cannot be NULL");
-    assert(array || !"JNI array cannot be NULL");
-    jni_array_get_region<JNIType>(env, array, 0, d_size, d_array);
-    JNI_EXCEPTION_CHECK(env);
+    assert((storage || 0 == capacity) || !"storage cannot be NULL");
+    init(env, array, storage, capacity);
 }
 
-template<typename JNIType>
-inline jni_array_region<JNIType>::~jni_array_region()
+template<typename JNIType, typename Allocator>
+inline jni_array_region<JNIType, Allocator>::~jni_array_region()
 {
-    delete[] d_array;
+    if (d_is_allocated)
+        d_allocator.deallocate(d_array, static_cast<size_t>(d_size));
 }
 
-template <typename JNIType>
-inline typename jni_array_region<JNIType>::size_type jni_array_region<JNIType>::size() const
+template <typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::size_type
+    jni_array_region<JNIType, Allocator>::size() const
 {
     return d_size;
 }
 
-template <typename JNIType>
-inline typename jni_array_region<JNIType>::pointer jni_array_region<JNIType>::data()
+template <typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::pointer
+    jni_array_region<JNIType, Allocator>::data()
 {
     return d_array;
 }
 
-template <typename JNIType>
-inline typename jni_array_region<JNIType>::const_pointer jni_array_region<
-    JNIType>::data() const
+template <typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_pointer
+    jni_array_region<JNIType, Allocator>::data() const
 {
     return d_array;
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::reference jni_array_region<
-    JNIType>::operator[](size_type n)
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::reference
+    jni_array_region<JNIType, Allocator>::operator[](size_type n)
 {
     return d_array[n];
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::const_reference jni_array_region<
-    JNIType>::operator[](size_type n) const
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_reference
+    jni_array_region<JNIType, Allocator>::operator[](size_type n) const
 {
     return d_array[n];
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::const_iterator jni_array_region<
-    JNIType>::cbegin() const
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_iterator
+    jni_array_region<JNIType, Allocator>::cbegin() const
 {
     return d_array;
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::const_iterator jni_array_region<
-    JNIType>::cend() const
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_iterator
+    jni_array_region<JNIType, Allocator>::cend() const
 {
     return d_array + d_size;
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::const_iterator jni_array_region<
-    JNIType>::begin() const
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_iterator
+    jni_array_region<JNIType, Allocator>::begin() const
 {
     return cbegin();
 }
 
-template<typename JNIType>
-inline typename jni_array_region<JNIType>::const_iterator jni_array_region<
-    JNIType>::end() const
+template<typename JNIType, typename Allocator>
+inline typename jni_array_region<JNIType, Allocator>::const_iterator
+    jni_array_region<JNIType, Allocator>::end() const
 {
     return cend();
 }
@@ -927,6 +1005,132 @@ inline typename jni_critical_array<JNIType>::const_pointer jni_critical_array<
     JNIType>::data() const
 { return d_array; }
 
+//==============================================================================
+//                         class jni_direct_buffer
+//==============================================================================
+
+/**
+ * \brief Typed view of the memory backing a direct
+ *        <code>java.nio.Buffer</code>
+ * \author Victor Schappert
+ * \since 20140906
+ * \tparam JNIType The JNI data type on which to specialize the view &mdash;
+ *         \em eg <code>jlong</code>.
+ * \see jni_array
+ *
+ * This class provides the same basic interface as jni_array, but because the
+ * memory backing a direct buffer lives outside the Java heap, it is accessed
+ * in place: there is nothing to copy in on construction or to release on
+ * destruction. Changes made through the view are immediately visible to the
+ * Java side.
+ */
+template<typename JNIType>
+class jni_direct_buffer : private non_copyable
+{
+        //
+        // TYPES
+        //
+
+    public:
+
+        /** \brief Type of the underlying Java object. */
+        typedef jobject array_type;
+        /** \brief An signed integral type. */
+        typedef jsize size_type;
+        /** \brief Type of the buffer elements (a JNI primitive type, such as
+         *         <code>jlong</code>).
+         */
+        typedef typename jni_traits<JNIType>::value_type value_type;
+        /** \brief Type of a pointer a buffer element. */
+        typedef typename jni_traits<JNIType>::pointer pointer;
+        /** \brief Type of a pointer to a <code>const</code> buffer element. */
+        typedef typename jni_traits<JNIType>::const_pointer const_pointer;
+
+        //
+        // DATA
+        //
+
+    private:
+
+        pointer    d_array;
+        size_type  d_size;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Constructs a view of the memory backing a direct buffer
+         * \param env JNI environment
+         * \param buffer Reference to a direct <code>java.nio.Buffer</code>
+         * \throws jni_exception If <code>buffer</code> is not a direct buffer,
+         *         or if its address is not suitably aligned for
+         *         <code>JNIType</code>
+         *
+         * The size of the view is the buffer's capacity in bytes divided by
+         * <code>sizeof(JNIType)</code>. Any trailing partial element is not
+         * part of the view.
+         */
+        jni_direct_buffer(JNIEnv * env, array_type buffer);
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of elements in the view.
+         * \return Number of elements in the view
+         */
+        size_type size() const;
+
+        /**
+         * \brief Returns a pointer to the buffer storage.
+         * \return Pointer to buffer storage
+         * \see #data() const
+         */
+        pointer data();
+
+        /**
+         * \brief Returns a pointer to the buffer storage.
+         * \return Pointer to buffer storage
+         * \see #data()
+         */
+        const_pointer data() const;
+};
+
+template <typename JNIType>
+inline jni_direct_buffer<JNIType>::jni_direct_buffer(JNIEnv * env,
+                                                     array_type buffer)
+    : d_array(static_cast<pointer>(env->GetDirectBufferAddress(buffer)))
+{
+    assert(env || !"JNI environment cannot be NULL");
+    jlong const capacity(env->GetDirectBufferCapacity(buffer));
+    if (! d_array || capacity < 0)
+        throw jni_exception("not a direct buffer", false);
+    if (0 != reinterpret_cast<uintptr_t>(d_array) % sizeof(value_type))
+        throw jni_exception("misaligned direct buffer", false);
+    d_size = static_cast<size_type>(capacity / sizeof(value_type));
+}
+
+template <typename JNIType>
+inline typename jni_direct_buffer<JNIType>::size_type jni_direct_buffer<
+    JNIType>::size() const
+{ return d_size; }
+
+template <typename JNIType>
+inline typename jni_direct_buffer<JNIType>::pointer jni_direct_buffer<
+    JNIType>::data()
+{ return d_array; }
+
+template <typename JNIType>
+inline typename jni_direct_buffer<JNIType>::const_pointer jni_direct_buffer<
+    JNIType>::data() const
+{ return d_array; }
+
 //==============================================================================
 //                           class jni_auto_local
 //==============================================================================
@@ -1427,7 +1631,7 @@ inline jni_auto_monitor::jni_auto_monitor(JNIEnv * env, jobject object)
         throw jni_exception("can't enter monitor", false);
 }
 
-inline jni_auto_monitor::~jni_auto_monitor()
+inline jni_auto_monitor::~jni_auto_monitor() noexcept(false)
 {
     if (0 != d_env->MonitorExit(d_object))
         throw jni_exception("can't exit monitor", false);
@@ -1908,8 +2112,13 @@ jstring make_jstring(JNIEnv * env, char const * sz);
  * \throws jni_bad_alloc If the string cannot be constructed
  * \throws jni_exception If the JVM throws an OutOfMemoryError
  * \see widen(const char * sz)
+ * \see char_widen
  *
  * It is caller's responsibility to free the string returned.
+ *
+ * A string consisting entirely of 7-bit ASCII characters is passed to the JVM
+ * as is, since it is also valid modified UTF-8. Any other string is widened in
+ * one pass into a buffer on the stack, or onto the heap if it is long.
  */
 template<typename CharType>
 inline jstring make_jstring(JNIEnv * env, CharType const * sz)
@@ -1919,6 +2128,58 @@ inline jstring make_jstring(JNIEnv * env, CharType const * sz)
     return make_jstring(env, reinterpret_cast<const char *>(sz));
 }
 
+/**
+ * \brief Converts a zero-terminated string in a single-byte code page into a
+ *        Java string.
+ * \param env JNI environment
+ * \param sz Pointer to zero-terminated string
+ * \param cp Code page <code>sz</code> is encoded in
+ * \return Reference to a Java string
+ * \author Victor Schappert
+ * \since 20140908
+ * \throws jni_bad_alloc If the string cannot be constructed
+ * \throws jni_exception If the JVM throws an OutOfMemoryError
+ * \see make_jstring_ansi(JNIEnv *, char const *)
+ *
+ * It is caller's responsibility to free the string returned.
+ */
+jstring make_jstring(JNIEnv * env, char const * sz, code_page const& cp);
+
+/**
+ * \brief Converts a zero-terminated string in the system's ANSI code page into
+ *        a Java string.
+ * \param env JNI environment
+ * \param sz Pointer to zero-terminated string
+ * \return Reference to a Java string
+ * \author Victor Schappert
+ * \since 20140908
+ * \throws jni_bad_alloc If the string cannot be constructed
+ * \throws jni_exception If the JVM throws an OutOfMemoryError
+ * \see make_jstring(JNIEnv *, char const *, code_page const&)
+ *
+ * If the ANSI code page is a single-byte code page, the conversion is done
+ * with the corresponding \link code_page\endlink table. Otherwise it is done
+ * by <code>MultiByteToWideChar()</code>.
+ *
+ * It is caller's responsibility to free the string returned.
+ */
+jstring make_jstring_ansi(JNIEnv * env, char const * sz);
+
+/**
+ * \brief Converts a zero-terminated UTF-16 string into a Java string without
+ *        any conversion.
+ * \param env JNI environment
+ * \param sz Pointer to zero-terminated UTF-16 string
+ * \return Reference to a Java string
+ * \author Victor Schappert
+ * \since 20140908
+ * \throws jni_bad_alloc If the string cannot be constructed
+ * \throws jni_exception If the JVM throws an OutOfMemoryError
+ *
+ * It is caller's responsibility to free the string returned.
+ */
+jstring make_jstring_utf16(JNIEnv * env, jchar const * sz);
+
 } // namespace jsdi
 
 #endif // __INCLUDED_JNI_UTIL_H___
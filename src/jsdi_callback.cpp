@@ -11,6 +11,8 @@
 
 #include "jsdi_callback.h"
 
+#include "buffer_pool.h"
+#include "jni_thread_env.h"
 #include "log.h"
 #include "marshalling.h"
 
@@ -18,6 +20,54 @@
 
 namespace jsdi {
 
+//==============================================================================
+//                           class lazy_vi_frame
+//==============================================================================
+
+namespace {
+
+JSDI_THREAD_LOCAL lazy_vi_frame * this_thread_lazy_vi_top;
+
+} // anonymous namespace
+
+lazy_vi_frame::lazy_vi_frame(char const * const * vi_ptrs, jint vi_count)
+    : d_prev(this_thread_lazy_vi_top)
+    , d_vi_ptrs(vi_ptrs)
+    , d_vi_count(vi_count)
+{
+    assert(vi_ptrs || 0 == vi_count);
+    this_thread_lazy_vi_top = this;
+}
+
+lazy_vi_frame::~lazy_vi_frame()
+{
+    assert(this == this_thread_lazy_vi_top || !"frames must nest");
+    this_thread_lazy_vi_top = d_prev;
+}
+
+char const * lazy_vi_frame::vi_ptr(jint vi_index) const
+{
+    if (! (0 <= vi_index && vi_index < d_vi_count))
+    {
+        std::ostringstream() << "variable indirect index " << vi_index
+                             << " out of range [0.." << d_vi_count << ')'
+                             << throw_cpp<std::invalid_argument>();
+    }
+    return d_vi_ptrs[vi_index];
+}
+
+lazy_vi_frame const * lazy_vi_frame::find(jlong handle)
+{
+    // A callback rarely nests more than a couple of frames deep, so a linear
+    // search is fine.
+    for (lazy_vi_frame const * i = this_thread_lazy_vi_top; i; i = i->d_prev)
+        if (handle == i->handle()) return i;
+    std::ostringstream() << "no active variable indirect frame with handle "
+                         << handle << " on this thread"
+                         << throw_cpp<std::invalid_argument>();
+    return nullptr; // Squelch compiler warning (control never gets here)
+}
+
 //==============================================================================
 //                         class jsdi_callback_base
 //==============================================================================
@@ -26,12 +76,18 @@ namespace {
 
 static jint const EMPTY_PTR_ARRAY[1] = { 0 };
 
+std::atomic<size_t> global_refs_held(0);
+
 jobject globalize(JNIEnv * env, jobject value, char const * name)
 {
     assert(env || !"environment cannot be NULL");
     assert(value || !"can't globalize a null reference");
     jobject const result(env->NewGlobalRef(value));
-    if (result) return result;
+    if (result)
+    {
+        global_refs_held.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
     JNI_EXCEPTION_CHECK(env);
     std::ostringstream() << "NewGlobalRef(env => " << env << ", " << name
                          << " => " << value << ')'
@@ -39,8 +95,131 @@ jobject globalize(JNIEnv * env, jobject value, char const * name)
     return nullptr; // Squelch compiler warning (control never gets here)
 }
 
+void delete_global(JNIEnv * env, jobject global)
+{
+    env->DeleteGlobalRef(global);
+    global_refs_held.fetch_sub(1, std::memory_order_relaxed);
+}
+
+jmethodID fast_invoke_method(int num_params)
+{
+    switch (num_params)
+    {
+        case 1: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke1();
+        case 2: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke2();
+        case 3: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke3();
+        case 4: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke4();
+        case 5: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke5();
+        case 6: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke6();
+        case 7: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke7();
+        case 8: return GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke8();
+        default:
+            assert(!"control should never pass here");
+            return nullptr;
+    }
+}
+
+// Holds a callback's cached Java array for the duration of one invocation or,
+// if another invocation already holds it, a new local array.
+class jarray_lease : private non_copyable
+{
+        JNIEnv          * d_env;
+        callback_jarray * d_cache;  // NULL iff d_array is a local reference
+        jobject           d_array;
+
+    public:
+
+        template<typename NewArray>
+        jarray_lease(JNIEnv * env, callback_jarray& cache,
+                     char const * new_array_name, NewArray new_array);
+
+        ~jarray_lease();
+
+        jobject get() const { return d_array; }
+
+        // A cached array still contains whatever the last invocation put in
+        // it, whereas a new one is zeroed.
+        bool is_cached() const { return nullptr != d_cache; }
+};
+
+template<typename NewArray>
+jarray_lease::jarray_lease(JNIEnv * env, callback_jarray& cache,
+                           char const * new_array_name, NewArray new_array)
+    : d_env(env)
+    , d_cache(nullptr)
+    , d_array(nullptr)
+{
+    if (cache.try_acquire())
+    {
+        try
+        {
+            if (! cache.get())
+            {
+                jni_auto_local<jobject> local(env, new_array());
+                JNI_EXCEPTION_CHECK(env);
+                if (! local) throw jni_bad_alloc(new_array_name, __FUNCTION__);
+                cache.set(globalize(env, local, new_array_name));
+            }
+        }
+        catch (...)
+        {
+            cache.release();
+            throw;
+        }
+        d_cache = &cache;
+        d_array = cache.get();
+    }
+    else
+    {
+        d_array = new_array();
+        JNI_EXCEPTION_CHECK(env);
+        if (! d_array) throw jni_bad_alloc(new_array_name, __FUNCTION__);
+    }
+}
+
+jarray_lease::~jarray_lease()
+{
+    if (d_cache) d_cache->release();
+    else d_env->DeleteLocalRef(d_array);
+}
+
+// Native buffer of jlongs borrowed from the calling thread's pool.
+class pooled_words : private non_copyable
+{
+        buffer_pool& d_pool;
+        size_t       d_capacity;
+        char *       d_data;
+
+    public:
+
+        explicit pooled_words(jsize size)
+            : d_pool(buffer_pool::this_thread())
+            , d_capacity(0)
+            , d_data(d_pool.acquire(size * sizeof(jlong), d_capacity))
+        { }
+
+        ~pooled_words() { d_pool.release(d_data, d_capacity); }
+
+        jlong * data() { return reinterpret_cast<jlong *>(d_data); }
+};
+
+// Zeroes the part of an unmarshalled data array after the direct storage, for
+// when a cached array is reused.
+void zero_tail(jlong * data, jint size_direct, jsize size_total_words)
+{
+    char * const begin(reinterpret_cast<char *>(data));
+    std::memset(begin + size_direct, 0,
+                size_total_words * sizeof(jlong) - size_direct);
+}
+
 } // anonymous namespace
 
+void callback_jarray::clear(JNIEnv * env)
+{
+    if (d_global) delete_global(env, d_global);
+    d_global = nullptr;
+}
+
 jsdi_callback_base::jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
                                        jobject suneido_sucallable,
                                        jint size_direct, jint size_total,
@@ -62,199 +241,72 @@ jsdi_callback_base::jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
     }
 }
 
+jsdi_callback_base::jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
+                                       jobject suneido_sucallable,
+                                       jint size_direct, jint num_fast_params)
+    : jsdi_callback_base(env, suneido_callback, suneido_sucallable,
+                         size_direct, num_fast_params *
+                             static_cast<jint>(sizeof(marshall_word_t)),
+                         EMPTY_PTR_ARRAY, 0, 0)
+{
+    assert(0 <= num_fast_params &&
+           num_fast_params <= MAX_FAST_CALLBACK_PARAMS);
+    assert(0 < num_fast_params || 0 == size_direct);
+}
+
 jsdi_callback_base::~jsdi_callback_base()
 {
     JNIEnv * env(fetch_env());
     if (env)
     {
-        env->DeleteGlobalRef(d_suneido_callback_global_ref);
-        env->DeleteGlobalRef(d_suneido_bound_value_global_ref);
+        delete_global(env, d_suneido_callback_global_ref);
+        delete_global(env, d_suneido_bound_value_global_ref);
+        d_data_jarray.clear(env);
+        d_vi_jarray.clear(env);
     }
 }
 
 JNIEnv * jsdi_callback_base::fetch_env() const
 {
-    JNIEnv * env(nullptr);
-    JavaVMAttachArgs attach_args;
-    attach_args.version = JNI_VERSION_1_6;
-    attach_args.name    = nullptr;
-    attach_args.group   = nullptr;
-    if (JNI_OK == d_jni_jvm->AttachCurrentThread(reinterpret_cast<void **>(&env),
-                                                 &attach_args))
-        return env;
-    else
+    JNIEnv * const env(jni_thread_env::get(d_jni_jvm));
+    if (! env)
     {
         LOG_FATAL("Failed to get JNI environment with d_jni_jvm => " <<
                   d_jni_jvm);
-        return nullptr;
     }
+    return env;
 }
 
-//==============================================================================
-//                        struct jsdi_callback_fast0
-//==============================================================================
-
-jsdi_callback_fast0::jsdi_callback_fast0(JNIEnv * env, jobject suneido_callback,
-                                         jobject suneido_bound_value,
-                                         jint size_direct)
-    : jsdi_callback_base(env, suneido_callback, suneido_bound_value, 0, 0,
-                         EMPTY_PTR_ARRAY, 0, 0)
-{ assert(0 == size_direct); }
-
-uint64_t jsdi_callback_fast0::call(marshall_word_t const * args)
+uint64_t jsdi_callback_base::call_fast(int num_params, jvalue * out_args)
 {
     uint64_t result(0);
-    LOG_TRACE("jsdi_callback_fast0::call( this => " << this << ", args => "
-                                                    << args << " )");
+    LOG_TRACE("jsdi_callback_base::call_fast( this => " << this
+              << ", num_params => " << num_params << " )");
     JNIEnv * const env(fetch_env());
     if (! env) return 0;
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     JNI_EXCEPTION_CHECK(env);
-    result = env->CallStaticLongMethod(
-        GLOBAL_REFS->suneido_jsdi_type_Callback(),
-        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke0(),
-        d_suneido_bound_value_global_ref);
-    JNI_EXCEPTION_SAFE_CPP_END(env);
-    return result;
-}
-
-//==============================================================================
-//                        struct jsdi_callback_fast1
-//==============================================================================
-
-jsdi_callback_fast1::jsdi_callback_fast1(JNIEnv * env, jobject suneido_callback,
-                                         jobject suneido_bound_value,
-                                         jint size_direct)
-    : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
-                         size_direct,
-                         1 * static_cast<jint>(sizeof(marshall_word_t)),
-                         EMPTY_PTR_ARRAY, 0, 0)
-{ }
-
-uint64_t jsdi_callback_fast1::call(marshall_word_t const * args)
-{
-    uint64_t result(0);
-    LOG_TRACE("jsdi_callback_fast1::call( this => " << this << ", args => "
-                                                    << args << " )");
-    JNIEnv * const env(fetch_env());
-    if (! env) return 0;
-    JNI_EXCEPTION_SAFE_CPP_BEGIN
-    JNI_EXCEPTION_CHECK(env);
-    jvalue out_args[2];
-    out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].j = args[0];
-    result = env->CallNonvirtualLongMethodA(
-        d_suneido_callback_global_ref,
-        GLOBAL_REFS->suneido_jsdi_type_Callback(),
-        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke1(), out_args);
-    JNI_EXCEPTION_SAFE_CPP_END(env);
-    return result;
-}
-
-//==============================================================================
-//                        struct jsdi_callback_fast2
-//==============================================================================
-
-jsdi_callback_fast2::jsdi_callback_fast2(JNIEnv * env, jobject suneido_callback,
-                                         jobject suneido_bound_value,
-                                         jint size_direct)
-    : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
-                         size_direct,
-                         2 * static_cast<jint>(sizeof(marshall_word_t)),
-                         EMPTY_PTR_ARRAY, 0, 0)
-{ }
-
-uint64_t jsdi_callback_fast2::call(marshall_word_t const * args)
-{
-    uint64_t result(0);
-    LOG_TRACE("jsdi_callback_fast2::call( this => " << this << ", args => "
-                                                    << args << " )");
-    JNIEnv * const env(fetch_env());
-    if (! env) return 0;
-    JNI_EXCEPTION_SAFE_CPP_BEGIN
-    JNI_EXCEPTION_CHECK(env);
-    jvalue out_args[3];
-    out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].j = args[0];
-    out_args[2].j = args[1];
-    result = env->CallNonvirtualLongMethodA(
-        d_suneido_callback_global_ref,
-        GLOBAL_REFS->suneido_jsdi_type_Callback(),
-        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke2(), out_args);
+    if (0 == num_params)
+    {
+        result = env->CallStaticLongMethod(
+            GLOBAL_REFS->suneido_jsdi_type_Callback(),
+            GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke0(),
+            d_suneido_bound_value_global_ref);
+    }
+    else
+    {
+        out_args[0].l = d_suneido_bound_value_global_ref;
+        result = env->CallNonvirtualLongMethodA(
+            d_suneido_callback_global_ref,
+            GLOBAL_REFS->suneido_jsdi_type_Callback(),
+            fast_invoke_method(num_params), out_args);
+    }
     JNI_EXCEPTION_SAFE_CPP_END(env);
     return result;
 }
 
-//==============================================================================
-//                        struct jsdi_callback_fast3
-//==============================================================================
-
-jsdi_callback_fast3::jsdi_callback_fast3(JNIEnv * env, jobject suneido_callback,
-                                         jobject suneido_bound_value,
-                                         jint size_direct)
-    : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
-                         size_direct,
-                         3 * static_cast<jint>(sizeof(marshall_word_t)),
-                         EMPTY_PTR_ARRAY, 0, 0)
-{ }
-
-uint64_t jsdi_callback_fast3::call(marshall_word_t const * args)
-{
-    uint64_t result(0);
-    LOG_TRACE("jsdi_callback_fast3::call( this => " << this << ", args => "
-                                                    << args << " )");
-    JNIEnv * const env(fetch_env());
-    if (! env) return 0;
-    JNI_EXCEPTION_SAFE_CPP_BEGIN
-    JNI_EXCEPTION_CHECK(env);
-    jvalue out_args[4];
-    out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].j = args[0];
-    out_args[2].j = args[1];
-    out_args[3].j = args[2];
-    result = env->CallNonvirtualLongMethodA(
-        d_suneido_callback_global_ref,
-        GLOBAL_REFS->suneido_jsdi_type_Callback(),
-        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke3(), out_args);
-    JNI_EXCEPTION_SAFE_CPP_END(env);
-    return result;
-}
-
-//==============================================================================
-//                        struct jsdi_callback_fast4
-//==============================================================================
-
-jsdi_callback_fast4::jsdi_callback_fast4(JNIEnv * env, jobject suneido_callback,
-                                         jobject suneido_bound_value,
-                                         jint size_direct)
-    : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
-                         size_direct,
-                         4 * static_cast<jint>(sizeof(marshall_word_t)),
-                         EMPTY_PTR_ARRAY, 0, 0)
-{ }
-
-uint64_t jsdi_callback_fast4::call(marshall_word_t const * args)
-{
-    uint64_t result(0);
-    LOG_TRACE("jsdi_callback_fast4::call( this => " << this << ", args => "
-                                                    << args << " )");
-    JNIEnv * const env(fetch_env());
-    if (! env) return 0;
-    JNI_EXCEPTION_SAFE_CPP_BEGIN
-    JNI_EXCEPTION_CHECK(env);
-    jvalue out_args[5];
-    out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].j = args[0];
-    out_args[2].j = args[1];
-    out_args[3].j = args[2];
-    out_args[4].j = args[3];
-    result = env->CallNonvirtualLongMethodA(
-        d_suneido_callback_global_ref,
-        GLOBAL_REFS->suneido_jsdi_type_Callback(),
-        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invoke4(), out_args);
-    JNI_EXCEPTION_SAFE_CPP_END(env);
-    return result;
-}
+size_t jsdi_callback_base::global_ref_count()
+{ return global_refs_held.load(std::memory_order_relaxed); }
 
 //==============================================================================
 //                        struct jsdi_callback_direct
@@ -276,21 +328,20 @@ uint64_t jsdi_callback_direct::call(marshall_word_t const * args)
     if (! env) return 0;
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     JNI_EXCEPTION_CHECK(env);
-    jni_auto_local<jobject> out_jarray(env, env->NewLongArray(
-                                                d_size_total_words));
-    JNI_EXCEPTION_CHECK(env);
-    if (! out_jarray) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+    jarray_lease out_jarray(env, d_data_jarray, "NewLongArray", [env, this]()
+                            { return env->NewLongArray(d_size_total_words); });
     jvalue out_args[2];
     out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].l = out_jarray;
+    out_args[1].l = out_jarray.get();
     {
         // Scope the critical array so it is destroyed before we do any other
         // JNI operations on this thread.
         jni_critical_array<jlong> out(
-            env, static_cast<jlongArray>(static_cast<jobject>(out_jarray)),
-            d_size_total_words);
+            env, static_cast<jlongArray>(out_jarray.get()), d_size_total_words);
         // Unmarshall
         std::memcpy(out.data(), args, d_size_direct);
+        if (out_jarray.is_cached())
+            zero_tail(out.data(), d_size_direct, d_size_total_words);
     }
     result = env->CallNonvirtualLongMethodA(
         d_suneido_callback_global_ref,
@@ -301,7 +352,7 @@ uint64_t jsdi_callback_direct::call(marshall_word_t const * args)
 }
 
 //==============================================================================
-//                       struct jsdi_callback_indirect
+//                        class jsdi_callback_indirect
 //==============================================================================
 
 jsdi_callback_indirect::jsdi_callback_indirect(
@@ -310,6 +361,8 @@ jsdi_callback_indirect::jsdi_callback_indirect(
     jint ptr_array_size)
     : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
                          size_direct, size_total, ptr_array, ptr_array_size, 0)
+    , d_unmarshaller(d_size_direct, d_size_total_bytes, d_ptr_array.data(),
+                     d_ptr_array.data() + d_ptr_array.size())
 { }
 
 uint64_t jsdi_callback_indirect::call(marshall_word_t const * args)
@@ -321,25 +374,21 @@ uint64_t jsdi_callback_indirect::call(marshall_word_t const * args)
     if (! env) return 0;
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     JNI_EXCEPTION_CHECK(env);
-    jni_auto_local<jobject> out_jarray(env, env->NewLongArray(
-                                                d_size_total_words));
-    JNI_EXCEPTION_CHECK(env);
-    if (! out_jarray) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
+    jarray_lease out_jarray(env, d_data_jarray, "NewLongArray", [env, this]()
+                            { return env->NewLongArray(d_size_total_words); });
     jvalue out_args[2];
     out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].l = out_jarray;
+    out_args[1].l = out_jarray.get();
     {
         // Scope the critical array so it is destroyed before we do any other
         // JNI operations on this thread.
         jni_critical_array<jlong> out(
-            env, static_cast<jlongArray>(static_cast<jobject>(out_jarray)),
-            d_size_total_words);
+            env, static_cast<jlongArray>(out_jarray.get()), d_size_total_words);
         // Unmarshall
-        unmarshaller_indirect u(d_size_direct, d_size_total_bytes,
-                                d_ptr_array.data(),
-                                d_ptr_array.data() + d_ptr_array.size());
-        u.unmarshall_indirect(args,
-                              reinterpret_cast<marshall_word_t *>(out.data()));
+        if (out_jarray.is_cached())
+            zero_tail(out.data(), d_size_direct, d_size_total_words);
+        d_unmarshaller.unmarshall_indirect(
+            args, reinterpret_cast<marshall_word_t *>(out.data()));
     }
     result = env->CallNonvirtualLongMethodA(
         d_suneido_callback_global_ref,
@@ -356,7 +405,7 @@ uint64_t jsdi_callback_indirect::call(marshall_word_t const * args)
 jsdi_callback_vi::jsdi_callback_vi(
     JNIEnv * env, jobject suneido_callback, jobject suneido_bound_value,
     jint size_direct, jint size_total, jint const * ptr_array,
-    jint ptr_array_size, jint vi_count)
+    jint ptr_array_size, jint vi_count, bool lazy)
     : jsdi_callback_base(env, suneido_callback, suneido_bound_value,
                          size_direct, size_total, ptr_array, ptr_array_size,
                          vi_count)
@@ -365,6 +414,9 @@ jsdi_callback_vi::jsdi_callback_vi(
           static_cast<jint>(
               java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING)
       )
+    , d_unmarshaller(d_size_direct, d_size_total_bytes, d_ptr_array.data(),
+                     d_ptr_array.data() + d_ptr_array.size(), d_vi_count)
+    , d_lazy(lazy)
 { }
 
 uint64_t jsdi_callback_vi::call(marshall_word_t const * args)
@@ -374,37 +426,46 @@ uint64_t jsdi_callback_vi::call(marshall_word_t const * args)
                                                 << args << " )");
     JNIEnv * const env(fetch_env());
     if (!env) return 0;
+    if (d_lazy) return call_lazy(env, args);
     JNI_EXCEPTION_SAFE_CPP_BEGIN
     JNI_EXCEPTION_CHECK(env);
-    jni_auto_local<jobject> out_data_jarray(env, env->NewLongArray(
-                                                     d_size_total_words));
-    JNI_EXCEPTION_CHECK(env);
-    if (! out_data_jarray) throw jni_bad_alloc("NewLongArray", __FUNCTION__);
-    jni_auto_local<jobject> out_vi_jarray(
-        env,
-        env->NewObjectArray(d_vi_count, GLOBAL_REFS->java_lang_Object(),
-                            nullptr));
-    JNI_EXCEPTION_CHECK(env);
-    if (! out_vi_jarray) throw jni_bad_alloc("NewObjectArray", __FUNCTION__);
+    jarray_lease out_data_jarray(
+        env, d_data_jarray, "NewLongArray",
+        [env, this]() { return env->NewLongArray(d_size_total_words); });
+    jarray_lease out_vi_jarray(
+        env, d_vi_jarray, "NewObjectArray",
+        [env, this]()
+        {
+            return env->NewObjectArray(d_vi_count,
+                                       GLOBAL_REFS->java_lang_Object(),
+                                       nullptr);
+        });
+    jobjectArray const vi_array(
+        static_cast<jobjectArray>(out_vi_jarray.get()));
+    if (out_vi_jarray.is_cached())
+    {   // Unmarshalling only stores the non-NULL strings
+        for (jint k = 0; k < d_vi_count; ++k)
+            env->SetObjectArrayElement(vi_array, k, nullptr);
+        JNI_EXCEPTION_CHECK(env);
+    }
     jvalue out_args[3];
     out_args[0].l = d_suneido_bound_value_global_ref;
-    out_args[1].l = out_data_jarray;
-    out_args[2].l = out_vi_jarray;
+    out_args[1].l = out_data_jarray.get();
+    out_args[2].l = vi_array;
     {
-        // The reason this code is in a sub-block is because we want the
-        // destructor of the jni_array<jbyte> to run before we invoke the
-        // callback. This is because the destructor releases the byte array
-        // elements, which is necessary to ensure that the unmarshalled data is
-        // propagated into the Java side before the callback runs.
-        jni_array<jlong> out(
-            env, static_cast<jlongArray>(static_cast<jobject>(out_data_jarray)),
-            d_size_total_words);
-        unmarshaller_vi u(d_size_direct, d_size_total_bytes, d_ptr_array.data(),
-                          d_ptr_array.data() + d_ptr_array.size(), d_vi_count);
-        u.unmarshall_vi(
-            args,  reinterpret_cast<marshall_word_t *>(out.data()), env,
-            static_cast<jobjectArray>(static_cast<jobject>(out_vi_jarray)),
-            d_vi_inst_array.data());
+        // Variable indirect unmarshalling makes JNI calls, so it can't write
+        // into a critical array. Instead of fetching a copy of the Java array
+        // and copying it back again, unmarshall into a pooled native buffer
+        // and copy that into the Java array once.
+        pooled_words out(d_size_total_words);
+        zero_tail(out.data(), d_size_direct, d_size_total_words);
+        d_unmarshaller.unmarshall_vi(
+            args, reinterpret_cast<marshall_word_t *>(out.data()), env,
+            vi_array, d_vi_inst_array.data());
+        env->SetLongArrayRegion(
+            static_cast<jlongArray>(out_data_jarray.get()), 0,
+            d_size_total_words, out.data());
+        JNI_EXCEPTION_CHECK(env);
     }
     result = env->CallNonvirtualLongMethodA(
         d_suneido_callback_global_ref,
@@ -416,4 +477,87 @@ uint64_t jsdi_callback_vi::call(marshall_word_t const * args)
     return result;
 }
 
+uint64_t jsdi_callback_vi::call_lazy(JNIEnv * env,
+                                     marshall_word_t const * args)
+{
+    uint64_t result(0);
+    JNI_EXCEPTION_SAFE_CPP_BEGIN
+    JNI_EXCEPTION_CHECK(env);
+    jarray_lease out_jarray(env, d_data_jarray, "NewLongArray", [env, this]()
+                            { return env->NewLongArray(d_size_total_words); });
+    pooled_words vi_ptrs_words(d_vi_count);
+    char const ** const vi_ptrs(
+        reinterpret_cast<char const **>(vi_ptrs_words.data()));
+    {
+        // Lazy unmarshalling makes no JNI calls, so unlike the eager case it
+        // can write straight into a critical array.
+        jni_critical_array<jlong> out(
+            env, static_cast<jlongArray>(out_jarray.get()), d_size_total_words);
+        if (out_jarray.is_cached())
+            zero_tail(out.data(), d_size_direct, d_size_total_words);
+        d_unmarshaller.unmarshall_vi_lazy(
+            args, reinterpret_cast<marshall_word_t *>(out.data()), vi_ptrs);
+    }
+    lazy_vi_frame const frame(vi_ptrs, d_vi_count);
+    jvalue out_args[3];
+    out_args[0].l = d_suneido_bound_value_global_ref;
+    out_args[1].l = out_jarray.get();
+    out_args[2].j = frame.handle();
+    result = env->CallNonvirtualLongMethodA(
+        d_suneido_callback_global_ref,
+        GLOBAL_REFS->suneido_jsdi_type_Callback(),
+        GLOBAL_REFS->suneido_jsdi_type_Callback__m_invokeVariableIndirectLazy(),
+        out_args
+    );
+    JNI_EXCEPTION_SAFE_CPP_END(env);
+    return result;
+}
+
 } // namespace jni
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+using namespace jsdi;
+
+TEST(lazy_vi_frame_nesting,
+    char const * const outer_ptrs[] = { "outer", nullptr };
+    char const * const inner_ptrs[] = { "inner" };
+    jlong outer_handle(0), inner_handle(0);
+    {
+        lazy_vi_frame const outer(
+            outer_ptrs, static_cast<jint>(array_length(outer_ptrs)));
+        outer_handle = outer.handle();
+        assert_true(&outer == lazy_vi_frame::find(outer_handle));
+        {
+            lazy_vi_frame const inner(
+                inner_ptrs, static_cast<jint>(array_length(inner_ptrs)));
+            inner_handle = inner.handle();
+            // A nested callback can still use its caller's frame.
+            assert_true(&inner == lazy_vi_frame::find(inner_handle));
+            assert_true(&outer == lazy_vi_frame::find(outer_handle));
+            assert_true(inner_ptrs[0] == inner.vi_ptr(0));
+        }
+        assert_true(outer_ptrs[0] == outer.vi_ptr(0));
+        assert_true(nullptr == outer.vi_ptr(1));
+        bool caught(false);
+        try { lazy_vi_frame::find(inner_handle); }
+        catch (std::invalid_argument const&) { caught = true; }
+        assert_true(caught);
+        caught = false;
+        try { outer.vi_ptr(2); }
+        catch (std::invalid_argument const&) { caught = true; }
+        assert_true(caught);
+    }
+    bool caught(false);
+    try { lazy_vi_frame::find(outer_handle); }
+    catch (std::invalid_argument const&) { caught = true; }
+    assert_true(caught);
+);
+
+#endif // __NOTEST__
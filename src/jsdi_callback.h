@@ -18,218 +18,294 @@
 #include "java_enum.h"
 #include "jni_util.h"
 
+#include <atomic>
+
 namespace jsdi {
 
 //==============================================================================
-//                         class jsdi_callback_base
+//                          class callback_jarray
 //==============================================================================
 
 /**
- * \brief Ancestor class of all callbacks that are capable of calling back into
- *        the JVM
+ * \brief Java array owned by a callback and reused by every invocation of the
+ *        callback that doesn't overlap with another one
  * \author Victor Schappert
- * \since 20140801
+ * \since 20140912
+ * \see jsdi_callback_base
+ *
+ * An invocation claims the array with #try_acquire() and gives it back with
+ * #release(). If the callback is reentered, or is invoked concurrently on
+ * another thread, #try_acquire() fails and the invocation must use a new array
+ * of its own.
+ *
+ * The array itself is created lazily by the first invocation to claim it, and
+ * is held as a global reference which must be freed by #clear(JNIEnv *).
  */
-class jsdi_callback_base : public callback, private non_copyable
+class callback_jarray : private non_copyable
 {
         //
         // DATA
         //
 
-    protected:
-
-        /** \cond internal */
-        jobject   d_suneido_callback_global_ref;
-        jobject   d_suneido_bound_value_global_ref;
-        JavaVM  * d_jni_jvm;
-        /** \endcond internal */
+        jobject           d_global;
+        std::atomic<bool> d_busy;
 
         //
         // CONSTRUCTORS
         //
 
-    protected:
+    public:
 
-        /** \cond internal */
-        jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
-                           jobject suneido_bound_value, jint size_direct,
-                           jint size_total, jint const * ptr_array,
-                           jint ptr_array_size, jint vi_count);
-        /** \endcond internal */
+        /** \brief Constructs an unclaimed slot with no array */
+        callback_jarray();
+
+        //
+        // ACCESSORS
+        //
 
     public:
 
-        ~jsdi_callback_base();
+        /**
+         * \brief Returns the cached array
+         * \return Global reference to the array, or <code>nullptr</code> if it
+         *         hasn't been created yet
+         *
+         * Only the invocation which has claimed the array may call this
+         * function.
+         */
+        jobject get() const;
 
         //
-        // ACCESSORS
+        // MUTATORS
         //
 
-    protected:
+    public:
 
-        /** \cond internal */
-        JNIEnv * fetch_env() const;
-        /** \endcond internal */
-};
+        /**
+         * \brief Attempts to claim the array for the calling invocation
+         * \return Whether the array was claimed
+         */
+        bool try_acquire();
 
-//==============================================================================
-//                        struct jsdi_callback_fast0
-//==============================================================================
+        /**
+         * \brief Gives back an array claimed by #try_acquire()
+         */
+        void release();
 
-/**
- * \brief Zero-parameter callback
- * \author Victor Schappert
- * \since 20140801
- * \see jsdi_callback_direct
- */
-struct jsdi_callback_fast0 : public jsdi_callback_base
-{
         /**
-         * \brief Constructs a zero-parameter callback
-         * \param env Non-NULL pointer to the JNI environment for the current
-         *        thread
-         * \param suneido_callback Non-NULL reference to a Java
-         *        <code>Object</code> of type
-         *        <code>suneido.jsdi.type.Callback</code> (the Java entry-point
-         *        to be invoked when this C++ callback is called)
-         * \param suneido_bound_value Non-NULL reference to a Java
-         *        <code>Object</code> of type
-         *        <code>suneido.language.SuCallable</code> representing the
-         *        Suneido language callable value that is bound to the callback
-         *        (this is the code that is ultimately desired to be called by
-         *        the Suneido programmer)
-         * \param size_direct Size of the on-stack arguments:
-         *        <code>0 &le; size_direct &le;
-         *        sizeof(</code>\link marshall_word_t\endlink<code>)</code>
+         * \brief Stores a newly created array
+         * \param global Global reference to the array, which this slot owns
+         *
+         * Only the invocation which has claimed the array may call this
+         * function, and only if #get() returns <code>nullptr</code>.
          */
-        jsdi_callback_fast0(JNIEnv * env, jobject suneido_callback,
-                            jobject suneido_bound_value, jint size_direct);
+        void set(jobject global);
 
-        virtual uint64_t call(marshall_word_t const * args);
+        /**
+         * \brief Deletes the global reference to the array, if any
+         * \param env JNI environment
+         */
+        void clear(JNIEnv * env);
 };
 
+inline callback_jarray::callback_jarray()
+    : d_global(nullptr)
+    , d_busy(false)
+{ }
+
+inline jobject callback_jarray::get() const
+{ return d_global; }
+
+inline bool callback_jarray::try_acquire()
+{ return ! d_busy.exchange(true, std::memory_order_acquire); }
+
+inline void callback_jarray::release()
+{ d_busy.store(false, std::memory_order_release); }
+
+inline void callback_jarray::set(jobject global)
+{
+    assert(! d_global || !"array already set");
+    d_global = global;
+}
+
 //==============================================================================
-//                        struct jsdi_callback_fast1
+//                           class lazy_vi_frame
 //==============================================================================
 
 /**
- * \brief One-parameter fast callback for a limited class of situations
+ * \brief Variable indirect pointers of a callback invocation whose variable
+ *        indirect data is converted to Java values only on demand
  * \author Victor Schappert
- * \since 20140801
- * \see jsdi_callback_direct
+ * \since 20140914
+ * \see jsdi_callback_vi
  *
- * This callback may be used when the JSDI parameter type can be marshalled out
- * of a 64-bit integer value provided by the caller and the parameter type uses
- * no indirect storage.
+ * A frame exists for exactly the duration of the call into Java. While it
+ * exists, Java can ask for the value of any of the variable indirect pointers
+ * by passing the frame's #handle() const to a JNI function, which looks the
+ * frame up with #find(jlong).
+ *
+ * Each thread keeps a stack of the frames it has active, so a handle can only
+ * be used on the thread running the callback, and a stale handle is detected
+ * rather than dereferenced.
  */
- struct jsdi_callback_fast1 : public jsdi_callback_base
+class lazy_vi_frame : private non_copyable
 {
+        //
+        // DATA
+        //
+
+        lazy_vi_frame      * d_prev;
+        char const * const * d_vi_ptrs;
+        jint                 d_vi_count;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
         /**
-         * \brief Constructs a one parameter callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
-         * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param size_direct As described in \link jsdi_callback_fast0\endlink
+         * \brief Activates a frame on the calling thread
+         * \param vi_ptrs Values of the variable indirect pointers, which must
+         *        remain valid for the life of the frame
+         * \param vi_count Number of elements in <code>vi_ptrs</code>
          */
-        jsdi_callback_fast1(JNIEnv * env, jobject suneido_callback,
-                            jobject suneido_bound_value, jint size_direct);
+        lazy_vi_frame(char const * const * vi_ptrs, jint vi_count);
 
-        virtual uint64_t call(marshall_word_t const * args);
-};
+        /** \brief Deactivates the frame */
+        ~lazy_vi_frame();
 
-//==============================================================================
-//                        struct jsdi_callback_fast2
-//==============================================================================
+        //
+        // ACCESSORS
+        //
+
+    public:
 
-/**
- * \brief Two-parameter fast callback for a limited class of situations
- * \author Victor Schappert
- * \since 20140801
- * \see jsdi_callback_direct
- *
- * This callback may be used when the JSDI parameter types can be marshalled out
- * of 64-bit integer values provided by the caller and the parameter types use
- * no indirect storage.
- */
-struct jsdi_callback_fast2 : public jsdi_callback_base
-{
         /**
-         * \brief Constructs a one parameter callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
-         * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param size_direct As described in \link jsdi_callback_fast0\endlink
+         * \brief Returns the handle Java uses to refer to the frame
+         * \return Frame handle
          */
-        jsdi_callback_fast2(JNIEnv * env, jobject suneido_callback,
-                            jobject suneido_bound_value, jint size_direct);
+        jlong handle() const;
 
-        virtual uint64_t call(marshall_word_t const * args);
-};
+        /**
+         * \brief Returns the value of a variable indirect pointer
+         * \param vi_index Index of the variable indirect pointer
+         * \return Pointer value, which may be <code>nullptr</code>
+         * \throws std::invalid_argument If <code>vi_index</code> is out of
+         *         range
+         */
+        char const * vi_ptr(jint vi_index) const;
 
-//==============================================================================
-//                        struct jsdi_callback_fast3
-//==============================================================================
+        //
+        // STATICS
+        //
+
+    public:
 
-/**
- * \brief Three-parameter fast callback for a limited class of situations
- * \author Victor Schappert
- * \since 20140801
- * \see jsdi_callback_direct
- *
- * This callback may be used when the JSDI parameter types can be marshalled out
- * of 64-bit integer values provided by the caller and the parameter types use
- * no indirect storage.
- */
-struct jsdi_callback_fast3 : public jsdi_callback_base
-{
         /**
-         * \brief Constructs a one parameter callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
-         * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param size_direct As described in \link jsdi_callback_fast0\endlink
+         * \brief Looks up a frame that is active on the calling thread
+         * \param handle Handle returned by #handle() const
+         * \return Non-<code>null</code> pointer to the frame
+         * \throws std::invalid_argument If <code>handle</code> doesn't refer to
+         *         a frame active on the calling thread
          */
-        jsdi_callback_fast3(JNIEnv * env, jobject suneido_callback,
-                            jobject suneido_bound_value, jint size_direct);
-
-        virtual uint64_t call(marshall_word_t const * args);
+        static lazy_vi_frame const * find(jlong handle);
 };
 
+inline jlong lazy_vi_frame::handle() const
+{ return reinterpret_cast<jlong>(this); }
+
 //==============================================================================
-//                        struct jsdi_callback_fast4
+//                         class jsdi_callback_base
 //==============================================================================
 
 /**
- * \brief Four-parameter fast callback for a limited class of situations
+ * \brief Maximum number of parameters a fast callback can receive
+ *
+ * Each fast callback calls a Java method <code>Callback.invoke</code><em>N</em>
+ * for some <em>N</em> not exceeding this value.
+ */
+constexpr int MAX_FAST_CALLBACK_PARAMS = 8;
+
+/**
+ * \brief Ancestor class of all callbacks that are capable of calling back into
+ *        the JVM
  * \author Victor Schappert
  * \since 20140801
- * \see jsdi_callback_direct
- *
- * This callback may be used when the JSDI parameter types can be marshalled out
- * of 64-bit integer values provided by the caller and the parameter types use
- * no indirect storage.
  */
-struct jsdi_callback_fast4 : public jsdi_callback_base
+class jsdi_callback_base : public callback, private non_copyable
 {
+        //
+        // DATA
+        //
+
+    protected:
+
+        /** \cond internal */
+        jobject         d_suneido_callback_global_ref;
+        jobject         d_suneido_bound_value_global_ref;
+        JavaVM        * d_jni_jvm;
+        callback_jarray d_data_jarray;  // long[], if the callback needs one
+        callback_jarray d_vi_jarray;    // Object[], if the callback needs one
+        /** \endcond internal */
+
+        //
+        // CONSTRUCTORS
+        //
+
+    protected:
+
+        /** \cond internal */
+        jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
+                           jobject suneido_bound_value, jint size_direct,
+                           jint size_total, jint const * ptr_array,
+                           jint ptr_array_size, jint vi_count);
+        jsdi_callback_base(JNIEnv * env, jobject suneido_callback,
+                           jobject suneido_bound_value, jint size_direct,
+                           jint num_fast_params);
+        /** \endcond internal */
+
+    public:
+
+        ~jsdi_callback_base();
+
+        //
+        // ACCESSORS
+        //
+
+    protected:
+
+        /** \cond internal */
+        JNIEnv * fetch_env() const;
+        /** \endcond internal */
+
+        //
+        // MUTATORS
+        //
+
+    protected:
+
+        /** \cond internal */
+        uint64_t call_fast(int num_params, jvalue * out_args);
+        /** \endcond internal */
+
+        //
+        // STATICS
+        //
+
+    public:
+
         /**
-         * \brief Constructs a one parameter callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
-         * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param size_direct As described in \link jsdi_callback_fast0\endlink
+         * \brief Returns the number of JNI global references that callbacks
+         *        hold
+         * \return Number of global references created by callbacks and not yet
+         *         deleted
+         *
+         * This counts the references to the Suneido callback and bound value
+         * of every callback, and to the arrays that callbacks cache between
+         * invocations.
          */
-        jsdi_callback_fast4(JNIEnv * env, jobject suneido_callback,
-                            jobject suneido_bound_value, jint size_direct);
-
-        virtual uint64_t call(marshall_word_t const * args);
+        static size_t global_ref_count();
 };
 
 //==============================================================================
@@ -248,11 +324,18 @@ struct jsdi_callback_direct : public jsdi_callback_base
 {
         /**
          * \brief Constructs a direct-data-only callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
-         * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
-         * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
+         * \param env Non-NULL pointer to the JNI environment for the current
+         *        thread
+         * \param suneido_callback Non-NULL reference to a Java
+         *        <code>Object</code> of type
+         *        <code>suneido.jsdi.type.Callback</code> (the Java entry-point
+         *        to be invoked when this C++ callback is called)
+         * \param suneido_bound_value Non-NULL reference to a Java
+         *        <code>Object</code> of type
+         *        <code>suneido.language.SuCallable</code> representing the
+         *        Suneido language callable value that is bound to the callback
+         *        (this is the code that is ultimately desired to be called by
+         *        the Suneido programmer)
          * \param size_direct Size of the on-stack arguments:
          *        <code>0 &le; size_direct &le; size_total</code>
          * \param size_total Total size of the unmarshalled storage
@@ -266,7 +349,7 @@ struct jsdi_callback_direct : public jsdi_callback_base
 };
 
 //==============================================================================
-//                       struct jsdi_callback_indirect
+//                        class jsdi_callback_indirect
 //==============================================================================
 
 /**
@@ -277,15 +360,27 @@ struct jsdi_callback_direct : public jsdi_callback_base
  * \see jsdi_callback_direct
  * \see jsdi_callback_vi
  */
-struct jsdi_callback_indirect : public jsdi_callback_base
+class jsdi_callback_indirect : public jsdi_callback_base
 {
+        //
+        // DATA
+        //
+
+        unmarshaller_indirect d_unmarshaller;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
         /**
          * \brief Constructs an indirect-capable callback
-         * \param env As described in \link jsdi_callback_fast0\endlink
+         * \param env As described in \link jsdi_callback_direct\endlink
          * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
+         *        \link jsdi_callback_direct\endlink
          * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
+         *        \link jsdi_callback_direct\endlink
          * \param size_direct As described in \link jsdi_callback_direct\endlink
          * \param size_total As described in \link jsdi_callback_direct\endlink
          * \param ptr_array Array of tuples indicating which positions in the
@@ -298,6 +393,12 @@ struct jsdi_callback_indirect : public jsdi_callback_base
                                jint size_total, jint const * ptr_array,
                                jint ptr_array_size);
 
+        //
+        // ANCESTOR CLASS: callback
+        //
+
+    public:
+
         virtual uint64_t call(marshall_word_t const * args);
 };
 
@@ -319,6 +420,8 @@ class jsdi_callback_vi : public jsdi_callback_base
         //
 
         std::vector<jint> d_vi_inst_array;
+        unmarshaller_vi   d_unmarshaller;
+        bool              d_lazy;
 
         //
         // CONSTRUCTORS
@@ -329,11 +432,11 @@ class jsdi_callback_vi : public jsdi_callback_base
         /**
          * \brief Constructs a callback capable of variable indirect
          *        unmarshalling
-         * \param env As described in \link jsdi_callback_fast0\endlink
+         * \param env As described in \link jsdi_callback_direct\endlink
          * \param suneido_callback As described in
-         *        \link jsdi_callback_fast0\endlink
+         *        \link jsdi_callback_direct\endlink
          * \param suneido_bound_value As described in
-         *        \link jsdi_callback_fast0\endlink
+         *        \link jsdi_callback_direct\endlink
          * \param size_direct As described in \link jsdi_callback_direct\endlink
          * \param size_total As described in \link jsdi_callback_direct\endlink
          * \param ptr_array As described in \link jsdi_callback_indirect\endlink
@@ -341,11 +444,24 @@ class jsdi_callback_vi : public jsdi_callback_base
          *        \link jsdi_callback_indirect\endlink
          * \param vi_count Number of variable indirect pointers: <code>0 &le;
          *        vi_count</code>
+         * \param lazy If <code>true</code>, the variable indirect data isn't
+         *        converted to Java values before calling Java; instead, the
+         *        Java callback receives the handle of a
+         *        \link lazy_vi_frame\endlink through which it can convert the
+         *        values it actually needs
          */
         jsdi_callback_vi(JNIEnv * env, jobject suneido_callback,
                          jobject suneido_bound_value, jint size_direct,
                          jint size_total, jint const * ptr_array,
-                         jint ptr_array_size, jint vi_count);
+                         jint ptr_array_size, jint vi_count, bool lazy);
+
+        //
+        // INTERNALS
+        //
+
+    private:
+
+        uint64_t call_lazy(JNIEnv * env, marshall_word_t const * args);
 
         //
         // ANCESTOR CLASS: callback
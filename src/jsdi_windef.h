@@ -22,11 +22,12 @@
 #define NOMINMAX
 #endif
 
-#if _WIN32_WINNT < 0x0501
+#if _WIN32_WINNT < 0x0502
 #ifdef _WIN32_WINNT
 #undef _WIN32_WINNT
 #endif
-#define _WIN32_WINNT 0x0501 // Windows XP or higher
+#define _WIN32_WINNT 0x0502 // Windows Server 2003/XP x64 or higher, for fiber
+                            // local storage (see jni_thread_env.cpp)
 #endif
 
 /** \endcond internal */
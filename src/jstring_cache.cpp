@@ -0,0 +1,200 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: jstring_cache.cpp
+// auth: Victor Schappert
+// date: 20140909
+// desc: Bounded cache of Java strings keyed by the native text they were
+//       made from
+//==============================================================================
+
+#include "jstring_cache.h"
+
+#include "jni_exception.h"
+
+namespace jsdi {
+
+//==============================================================================
+//                            class jstring_cache
+//==============================================================================
+
+jstring_cache::jstring_cache()
+    : d_lru(0)
+    , d_enabled(false)
+{ }
+
+jstring_cache::stats_type jstring_cache::stats()
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    stats_type const result =
+    { d_lru.capacity(), d_lru.size(), d_lru.hits(), d_lru.misses() };
+    return result;
+}
+
+jstring jstring_cache::find(JNIEnv * env, int tag, void const * data,
+                            size_t size)
+{
+    jobject local(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        jobject global(nullptr);
+        if (! d_lru.find(tag, data, size, global)) return nullptr;
+        // The local reference has to be created while the lock is held, since
+        // as soon as it is released another thread may evict the string and
+        // delete the global reference.
+        local = env->NewLocalRef(global);
+    }
+    if (! local) throw jni_bad_alloc("NewLocalRef", __FUNCTION__);
+    return static_cast<jstring>(local);
+}
+
+void jstring_cache::insert(JNIEnv * env, int tag, void const * data,
+                           size_t size, jstring str)
+{
+    // If a global reference can't be made, the string simply isn't cached.
+    jobject const global(env->NewGlobalRef(str));
+    if (! global) return;
+    std::lock_guard<std::mutex> lock(d_mutex);
+    d_lru.insert(tag, data, size, global,
+                 [env](jobject ref) { env->DeleteGlobalRef(ref); });
+}
+
+void jstring_cache::set_capacity(JNIEnv * env, size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    d_lru.set_capacity(capacity,
+                       [env](jobject ref) { env->DeleteGlobalRef(ref); });
+    d_enabled.store(0 < capacity, std::memory_order_relaxed);
+}
+
+void jstring_cache::flush(JNIEnv * env)
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    d_lru.clear([env](jobject ref) { env->DeleteGlobalRef(ref); });
+}
+
+jstring_cache& jstring_cache::instance()
+{
+    // NOTE: Thread-safe "magic static". See log_manager::instance().
+    static jstring_cache cache;
+    return cache;
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <vector>
+
+using namespace jsdi;
+
+namespace {
+
+struct recorder
+{
+    std::vector<int> * d_released;
+    void operator()(int value) const { d_released->push_back(value); }
+};
+
+bool find_str(string_lru<int>& lru, int tag, char const * str, int& value)
+{ return lru.find(tag, str, std::strlen(str), value); }
+
+void insert_str(string_lru<int>& lru, int tag, char const * str, int value,
+                std::vector<int>& released)
+{
+    recorder const r = { &released };
+    lru.insert(tag, str, std::strlen(str), value, r);
+}
+
+} // anonymous namespace
+
+TEST(string_lru_basic,
+    std::vector<int> released;
+    string_lru<int> lru(3);
+    int value(0);
+    assert_false(find_str(lru, 0, "abc", value));
+    insert_str(lru, 0, "abc", 1, released);
+    insert_str(lru, 0, "abd", 2, released);
+    insert_str(lru, 1, "abc", 3, released); // same bytes, different tag
+    assert_equals(3, lru.size());
+    assert_true(find_str(lru, 0, "abc", value));
+    assert_equals(1, value);
+    assert_true(find_str(lru, 1, "abc", value));
+    assert_equals(3, value);
+    assert_false(find_str(lru, 0, "ab", value)); // prefix isn't a match
+    assert_equals(2, lru.hits());
+    assert_equals(2, lru.misses());
+    assert_true(released.empty());
+    // Inserting a duplicate key releases the new value
+    insert_str(lru, 0, "abd", 4, released);
+    assert_equals(1, released.size());
+    assert_equals(4, released[0]);
+    assert_true(find_str(lru, 0, "abd", value));
+    assert_equals(2, value);
+);
+
+TEST(string_lru_eviction,
+    std::vector<int> released;
+    recorder const r = { &released };
+    string_lru<int> lru(2);
+    int value(0);
+    insert_str(lru, 0, "one", 1, released);
+    insert_str(lru, 0, "two", 2, released);
+    assert_true(find_str(lru, 0, "one", value)); // "two" now least recent
+    insert_str(lru, 0, "three", 3, released);
+    assert_equals(1, released.size());
+    assert_equals(2, released[0]);
+    assert_false(find_str(lru, 0, "two", value));
+    assert_true(find_str(lru, 0, "one", value));
+    assert_true(find_str(lru, 0, "three", value));
+    // Shrinking evicts least recently used first
+    lru.set_capacity(1, r);
+    assert_equals(2, released.size());
+    assert_equals(1, released[1]);
+    assert_true(find_str(lru, 0, "three", value));
+    // Zero capacity stores nothing
+    lru.set_capacity(0, r);
+    assert_equals(3, released.size());
+    insert_str(lru, 0, "four", 4, released);
+    assert_equals(0, lru.size());
+    assert_equals(4, released[3]);
+    // Clearing zeroes the counters
+    lru.clear(r);
+    assert_equals(0, lru.hits());
+    assert_equals(0, lru.misses());
+);
+
+TEST(string_lru_many,
+    // Enough entries that many of them share hash buckets
+    std::vector<int> released;
+    recorder const r = { &released };
+    string_lru<int> lru(500);
+    std::vector<std::string> keys;
+    for (int k = 0; k < 1000; ++k)
+        keys.push_back(std::string(static_cast<size_t>(k % 7), 'x') +
+                       std::to_string(k));
+    for (int k = 0; k < 1000; ++k)
+        insert_str(lru, k % 3, keys[k].c_str(), k, released);
+    assert_equals(500, lru.size());
+    assert_equals(500, released.size());
+    for (int k = 0; k < 1000; ++k)
+    {
+        int value(-1);
+        bool const found(find_str(lru, k % 3, keys[k].c_str(), value));
+        assert_equals(500 <= k, found);
+        if (found) assert_equals(k, value);
+    }
+    lru.clear(r);
+    assert_equals(1000, released.size());
+    assert_equals(0, lru.size());
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,478 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_JSTRING_CACHE_H___
+#define __INCLUDED_JSTRING_CACHE_H___
+
+/**
+ * \file jstring_cache.h
+ * \author Victor Schappert
+ * \since 20140909
+ * \brief Bounded cache of Java strings keyed by the native text they were
+ *        made from
+ */
+
+#include "util.h"
+
+#include <jni.h>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace jsdi {
+
+//==============================================================================
+//                             class string_lru
+//==============================================================================
+
+/**
+ * \brief Least-recently-used map from a string of bytes to a value
+ * \author Victor Schappert
+ * \since 20140909
+ * \tparam Value Type of value stored in the map, which must be copyable
+ * \see jstring_cache
+ *
+ * Each key is a byte string together with an integer tag. Two keys are equal
+ * only if both their tags and their bytes are equal, so a hash collision can
+ * never cause the wrong value to be returned.
+ *
+ * Whenever a value leaves the map, whether by eviction, by reducing the
+ * capacity, or by clearing the map, it is passed to a caller-supplied
+ * <code>release</code> function so that the caller can free any resource it
+ * holds.
+ *
+ * This class is not thread-safe.
+ */
+template<typename Value>
+class string_lru : private non_copyable
+{
+        //
+        // TYPES
+        //
+
+        struct entry
+        {
+            uint64_t    d_hash;
+            int         d_tag;
+            std::string d_bytes;
+            Value       d_value;
+        };
+
+        typedef std::list<entry> list_t;
+        typedef std::unordered_multimap<uint64_t, typename list_t::iterator>
+            index_t;
+
+        //
+        // DATA
+        //
+
+        list_t   d_list;    // most recently used at front
+        index_t  d_index;
+        size_t   d_capacity;
+        uint64_t d_hits;
+        uint64_t d_misses;
+
+        //
+        // INTERNALS
+        //
+
+        static uint64_t hash(int tag, void const * data, size_t size);
+
+        typename index_t::iterator find_entry(uint64_t hash, int tag,
+                                              void const * data, size_t size);
+
+        template<typename Release>
+        void evict_back(Release release);
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Constructs an empty map
+         * \param capacity Maximum number of entries, where zero means the map
+         *        never stores anything
+         */
+        explicit string_lru(size_t capacity);
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the maximum number of entries
+         * \return Capacity
+         */
+        size_t capacity() const;
+
+        /**
+         * \brief Returns the current number of entries
+         * \return Number of entries
+         */
+        size_t size() const;
+
+        /**
+         * \brief Returns the number of successful lookups
+         * \return Number of calls to #find(int, void const *, size_t, Value&)
+         *         which found a value
+         */
+        uint64_t hits() const;
+
+        /**
+         * \brief Returns the number of unsuccessful lookups
+         * \return Number of calls to #find(int, void const *, size_t, Value&)
+         *         which didn't find a value
+         */
+        uint64_t misses() const;
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Looks up a value, making it the most recently used entry
+         * \param tag Tag of the key
+         * \param data Bytes of the key
+         * \param size Number of bytes in <code>data</code>
+         * \param value Receives the value if it is found
+         * \return Whether the value was found
+         */
+        bool find(int tag, void const * data, size_t size, Value& value);
+
+        /**
+         * \brief Inserts a value as the most recently used entry
+         * \param tag Tag of the key
+         * \param data Bytes of the key
+         * \param size Number of bytes in <code>data</code>
+         * \param value Value to insert
+         * \param release Function called with each value that leaves the map,
+         *        including <code>value</code> itself if it can't be inserted
+         *        because the key is already present or the capacity is zero
+         */
+        template<typename Release>
+        void insert(int tag, void const * data, size_t size, Value value,
+                    Release release);
+
+        /**
+         * \brief Changes the capacity, evicting the least recently used entries
+         *        if there are too many
+         * \param capacity New capacity
+         * \param release Function called with each evicted value
+         */
+        template<typename Release>
+        void set_capacity(size_t capacity, Release release);
+
+        /**
+         * \brief Removes every entry and zeroes the hit and miss counts
+         * \param release Function called with each value removed
+         */
+        template<typename Release>
+        void clear(Release release);
+};
+
+template<typename Value>
+inline uint64_t string_lru<Value>::hash(int tag, void const * data,
+                                        size_t size)
+{
+    // 64-bit FNV-1a
+    uint64_t result(14695981039346656037ull ^ static_cast<uint32_t>(tag));
+    unsigned char const * i(static_cast<unsigned char const *>(data));
+    unsigned char const * const e(i + size);
+    for (; i != e; ++i)
+    {
+        result ^= *i;
+        result *= 1099511628211ull;
+    }
+    return result;
+}
+
+template<typename Value>
+typename string_lru<Value>::index_t::iterator string_lru<Value>::find_entry(
+    uint64_t hash, int tag, void const * data, size_t size)
+{
+    auto range(d_index.equal_range(hash));
+    for (auto i = range.first; i != range.second; ++i)
+    {
+        entry const& e(*i->second);
+        if (tag == e.d_tag && size == e.d_bytes.size() &&
+            0 == std::memcmp(data, e.d_bytes.data(), size))
+            return i;
+    }
+    return d_index.end();
+}
+
+template<typename Value>
+template<typename Release>
+void string_lru<Value>::evict_back(Release release)
+{
+    assert(! d_list.empty());
+    entry const& e(d_list.back());
+    auto range(d_index.equal_range(e.d_hash));
+    for (auto i = range.first; i != range.second; ++i)
+    {
+        if (&*i->second == &e)
+        {
+            d_index.erase(i);
+            break;
+        }
+    }
+    release(e.d_value);
+    d_list.pop_back();
+}
+
+template<typename Value>
+inline string_lru<Value>::string_lru(size_t capacity)
+    : d_capacity(capacity)
+    , d_hits(0)
+    , d_misses(0)
+{ }
+
+template<typename Value>
+inline size_t string_lru<Value>::capacity() const
+{ return d_capacity; }
+
+template<typename Value>
+inline size_t string_lru<Value>::size() const
+{ return d_index.size(); }
+
+template<typename Value>
+inline uint64_t string_lru<Value>::hits() const
+{ return d_hits; }
+
+template<typename Value>
+inline uint64_t string_lru<Value>::misses() const
+{ return d_misses; }
+
+template<typename Value>
+bool string_lru<Value>::find(int tag, void const * data, size_t size,
+                             Value& value)
+{
+    auto i(find_entry(hash(tag, data, size), tag, data, size));
+    if (d_index.end() == i)
+    {
+        ++d_misses;
+        return false;
+    }
+    ++d_hits;
+    d_list.splice(d_list.begin(), d_list, i->second);
+    value = i->second->d_value;
+    return true;
+}
+
+template<typename Value>
+template<typename Release>
+void string_lru<Value>::insert(int tag, void const * data, size_t size,
+                               Value value, Release release)
+{
+    uint64_t const h(hash(tag, data, size));
+    if (0 == d_capacity || d_index.end() != find_entry(h, tag, data, size))
+    {
+        release(value);
+        return;
+    }
+    if (d_capacity <= d_list.size()) evict_back(release);
+    d_list.push_front(entry());
+    entry& e(d_list.front());
+    e.d_hash = h;
+    e.d_tag = tag;
+    e.d_bytes.assign(static_cast<char const *>(data), size);
+    e.d_value = value;
+    d_index.insert(std::make_pair(h, d_list.begin()));
+}
+
+template<typename Value>
+template<typename Release>
+void string_lru<Value>::set_capacity(size_t capacity, Release release)
+{
+    d_capacity = capacity;
+    while (d_capacity < d_list.size()) evict_back(release);
+}
+
+template<typename Value>
+template<typename Release>
+void string_lru<Value>::clear(Release release)
+{
+    while (! d_list.empty()) evict_back(release);
+    d_hits = 0;
+    d_misses = 0;
+}
+
+//==============================================================================
+//                            class jstring_cache
+//==============================================================================
+
+/**
+ * \brief Process-wide, opt-in cache of Java strings made from native strings
+ * \author Victor Schappert
+ * \since 20140909
+ * \see string_lru
+ *
+ * The cache holds a global reference to each Java string it contains, keyed
+ * by the native bytes the string was made from and a tag identifying how those
+ * bytes were interpreted (<em>eg</em> as ANSI or UTF-16 text). Since Java
+ * strings are immutable, a cached string can be handed out any number of
+ * times, which saves both the conversion and the Java allocation when the
+ * same text is read repeatedly.
+ *
+ * The cache is disabled, with a capacity of zero, until it is given a non-zero
+ * capacity by #set_capacity(JNIEnv *, size_t). Native strings longer than
+ * #MAX_STRING_SIZE bytes are never cached.
+ *
+ * All members are thread-safe.
+ */
+class jstring_cache : private non_copyable
+{
+    public:
+
+        /**
+         * \brief Size, in bytes, of the longest native string that is cached
+         */
+        static const size_t MAX_STRING_SIZE = 256;
+
+        //
+        // DATA
+        //
+
+    private:
+
+        std::mutex          d_mutex;
+        string_lru<jobject> d_lru;
+        std::atomic<bool>   d_enabled;
+
+        //
+        // CONSTRUCTORS
+        //
+
+        jstring_cache();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Indicates whether the cache has a non-zero capacity
+         * \return Whether the cache is enabled
+         *
+         * This function does not lock, so its result is only a hint. It is
+         * intended to let callers skip the work of preparing a lookup when the
+         * cache is disabled.
+         */
+        bool enabled() const;
+
+        /**
+         * \brief Cache statistics
+         * \see #stats()
+         */
+        struct stats_type
+        {
+            /** \brief Maximum number of strings */
+            size_t   capacity;
+            /** \brief Number of strings currently cached */
+            size_t   size;
+            /** \brief Number of lookups which found a string */
+            uint64_t hits;
+            /** \brief Number of lookups which didn't find a string */
+            uint64_t misses;
+        };
+
+        /**
+         * \brief Returns a snapshot of the cache statistics
+         * \return Statistics
+         */
+        stats_type stats();
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the Java string for a native string, making it and
+         *        caching it if necessary
+         * \param env JNI environment
+         * \param tag Identifies how the bytes of <code>data</code> are
+         *        interpreted
+         * \param data Bytes of the native string, excluding the terminator
+         * \param size Number of bytes in <code>data</code>
+         * \param make Function which makes the Java string on a cache miss
+         * \return New local reference to the Java string
+         * \throws jni_exception If the JVM throws an exception
+         *
+         * The cache is not locked while <code>make</code> runs.
+         */
+        template<typename Make>
+        jstring get(JNIEnv * env, int tag, void const * data, size_t size,
+                    Make make);
+
+        /**
+         * \brief Changes the capacity of the cache, evicting strings if
+         *        necessary
+         * \param env JNI environment
+         * \param capacity New maximum number of strings, where zero disables
+         *        the cache
+         */
+        void set_capacity(JNIEnv * env, size_t capacity);
+
+        /**
+         * \brief Removes every string from the cache and zeroes the hit and
+         *        miss counts, without changing the capacity
+         * \param env JNI environment
+         */
+        void flush(JNIEnv * env);
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the process-wide cache
+         * \return Reference to the cache
+         */
+        static jstring_cache& instance();
+
+    private:
+
+        jstring find(JNIEnv * env, int tag, void const * data, size_t size);
+
+        void insert(JNIEnv * env, int tag, void const * data, size_t size,
+                    jstring str);
+};
+
+inline bool jstring_cache::enabled() const
+{ return d_enabled.load(std::memory_order_relaxed); }
+
+template<typename Make>
+jstring jstring_cache::get(JNIEnv * env, int tag, void const * data,
+                           size_t size, Make make)
+{
+    if (! enabled() || MAX_STRING_SIZE < size) return make();
+    jstring result(find(env, tag, data, size));
+    if (! result)
+    {
+        result = make();
+        insert(env, tag, data, size, result);
+    }
+    return result;
+}
+
+} // namespace jsdi
+
+#endif // __INCLUDED_JSTRING_CACHE_H___
@@ -100,7 +100,7 @@
  * See the documentation for LOG_INFO(expr) for an explanation of how and when
  * this macro will generate log output.
  */
-#define LOG_FATAL(expr) (nullptr)
+#define LOG_FATAL(expr) ((void)0)
 /**
  * \brief Logs a non-fatal error message at the current location.
  * \param expr Any expression that can appear on the left side of a stream
@@ -113,7 +113,7 @@
  * See the documentation for LOG_INFO(expr) for an explanation of how and when
  * this macro will generate log output.
  */
-#define LOG_ERROR(expr) (nullptr)
+#define LOG_ERROR(expr) ((void)0)
 /**
  * \brief Logs a warning message at the current location.
  * \param expr Any expression that can appear on the left side of a stream
@@ -126,7 +126,7 @@
  * See the documentation for LOG_INFO(expr) for an explanation of how and when
  * this macro will generate log output.
  */
-#define LOG_WARN(expr)  (nullptr)
+#define LOG_WARN(expr)  ((void)0)
 /**
  * \brief Logs an informational message at the current location.
  * \param expr Any expression that can appear on the left side of a stream
@@ -148,7 +148,7 @@
  * threshold\endlink is at least jsdi::log_level::INFO. These conditions apply,
  * <i>mutatis mutandi</i> to the other <code>LOG_*</code> macros.
  */
-#define LOG_INFO(expr)  (nullptr)
+#define LOG_INFO(expr)  ((void)0)
 /**
  * \brief Logs a debug message at the current location.
  * \param expr Any expression that can appear on the left side of a stream
@@ -161,7 +161,7 @@
  * See the documentation for LOG_INFO(expr) for an explanation of how and when
  * this macro will generate log output.
  */
-#define LOG_DEBUG(expr) (nullptr)
+#define LOG_DEBUG(expr) ((void)0)
 /**
  * \brief Logs a trace message at the current location.
  * \param expr Any expression that can appear on the left side of a stream
@@ -174,7 +174,7 @@
  * See the documentation for LOG_INFO(expr) for an explanation of how and when
  * this macro will generate log output.
  */
-#define LOG_TRACE(expr) (nullptr)
+#define LOG_TRACE(expr) ((void)0)
 
 /** \cond internal */
 #if LOG_LEVEL_FATAL <= STATIC_LOG_THRESHOLD
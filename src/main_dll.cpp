@@ -11,6 +11,11 @@
 
 #include "jsdi_windows.h"
 
+#include "arena.h"
+#include "buffer_pool.h"
+#include "epoch.h"
+#include "marshall_plan.h"
+
 extern "C"
 {
 
@@ -34,9 +39,16 @@ BOOL WINAPI DllMain(
             break;
         case DLL_THREAD_DETACH:
             // A thread exits normally.
+            jsdi::arena::thread_detach();
+            jsdi::buffer_pool::thread_detach();
+            jsdi::epoch::thread_detach();
+            jsdi::marshall_plan::thread_detach();
             break;
         case DLL_PROCESS_DETACH:
             // A process unloads the DLL.
+            jsdi::arena::thread_detach();
+            jsdi::buffer_pool::thread_detach();
+            jsdi::marshall_plan::thread_detach();
             break;
     }
     return TRUE;
@@ -0,0 +1,240 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: marshall_plan.cpp
+// auth: Victor Schappert
+// date: 20140906
+// desc: Immutable native copy of marshalling metadata
+//==============================================================================
+
+#include "marshall_plan.h"
+
+#include "marshalling.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+namespace jsdi {
+
+namespace {
+
+// NOTE: The plan can't have thread storage duration because it isn't POD (see
+//       JSDI_THREAD_LOCAL), so it is allocated on first use and freed by
+//       DllMain() when the thread exits.
+JSDI_THREAD_LOCAL marshall_plan * this_thread_plan;
+
+} // anonymous namespace
+
+//==============================================================================
+//                            class marshall_plan
+//==============================================================================
+
+marshall_plan::marshall_plan(jsize size_direct, jsize size_total,
+                             jint const * ptr_array, jsize ptr_array_size,
+                             jint const * vi_inst_array,
+                             jsize vi_inst_array_size)
+    : d_size_direct(size_direct)
+    , d_size_total(size_total)
+    , d_ptr_array(ptr_array, ptr_array + ptr_array_size)
+    , d_vi_inst_array(vi_inst_array, vi_inst_array + vi_inst_array_size)
+{
+    if (size_direct < 0 || size_total < size_direct)
+    {
+        std::ostringstream() << "invalid marshall plan sizes: sizeDirect => "
+                             << size_direct << ", sizeTotal => " << size_total
+                             << throw_cpp<std::invalid_argument>();
+    }
+    if (0 != ptr_array_size % 2)
+    {
+        std::ostringstream() << "marshall plan pointer array must have even "
+                                "size but has size " << ptr_array_size
+                             << throw_cpp<std::invalid_argument>();
+    }
+    marshalling_roundtrip::ptrs_check(size_whole_words(size_total), ptr_array,
+                                      ptr_array_size, vi_inst_array_size);
+}
+
+marshall_plan::~marshall_plan()
+{ }
+
+void marshall_plan::check_data(jsize data_size, jsize vi_array_size) const
+{
+    if (min_whole_words(d_size_total) != data_size ||
+        vi_count() != vi_array_size)
+    {
+        std::ostringstream() << "data doesn't match marshall plan: "
+                                "sizeTotal => " << d_size_total
+                             << ", vi count => " << vi_count()
+                             << " but data has " << data_size
+                             << " words and vi array has " << vi_array_size
+                             << " elements"
+                             << throw_cpp<std::invalid_argument>();
+    }
+}
+
+bool marshall_plan::matches(jsize size_direct, jsize size_total,
+                            jint const * ptr_array, jsize ptr_array_size,
+                            jint const * vi_inst_array,
+                            jsize vi_inst_array_size) const
+{
+    return d_size_direct == size_direct && d_size_total == size_total &&
+           ptr_array_size == this->ptr_array_size() &&
+           vi_inst_array_size == vi_count() &&
+           (d_ptr_array.empty() ||
+               std::equal(d_ptr_array.begin(), d_ptr_array.end(),
+                          ptr_array)) &&
+           (d_vi_inst_array.empty() ||
+               std::equal(d_vi_inst_array.begin(), d_vi_inst_array.end(),
+                          vi_inst_array));
+}
+
+unmarshaller_vi& marshall_plan::unmarshaller() const
+{
+    std::call_once(d_unmarshaller_once, [this]() {
+        d_unmarshaller.reset(new unmarshaller_vi(
+            d_size_direct, size_whole_words(d_size_total), ptr_array(),
+            ptr_array() + ptr_array_size(), vi_count()));
+    });
+    return *d_unmarshaller;
+}
+
+marshall_plan const& marshall_plan::this_thread_last(
+    jsize size_direct, jsize size_total, jint const * ptr_array,
+    jsize ptr_array_size, jint const * vi_inst_array, jsize vi_inst_array_size)
+{
+    if (! this_thread_plan ||
+        ! this_thread_plan->matches(size_direct, size_total, ptr_array,
+                                    ptr_array_size, vi_inst_array,
+                                    vi_inst_array_size))
+    {
+        marshall_plan * const plan(new marshall_plan(
+            size_direct, size_total, ptr_array, ptr_array_size, vi_inst_array,
+            vi_inst_array_size));
+#if !defined(_WIN32)
+        if (! this_thread_plan)
+            call_at_thread_exit(&marshall_plan::thread_detach);
+#endif
+        delete this_thread_plan;
+        this_thread_plan = plan;
+    }
+    return *this_thread_plan;
+}
+
+void marshall_plan::thread_detach()
+{
+    delete this_thread_plan;
+    this_thread_plan = nullptr;
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <algorithm>
+
+using namespace jsdi;
+
+TEST(marshall_plan_basic,
+    const jint ptr_array[] = { 0, 8, 8, -1 };
+    const jint vi_inst_array[] = { 1 };
+    marshall_plan plan(8, 24, ptr_array, 4, vi_inst_array, 1);
+    assert_equals(8, plan.size_direct());
+    assert_equals(24, plan.size_total());
+    assert_equals(4, plan.ptr_array_size());
+    assert_true(std::equal(ptr_array, ptr_array + 4, plan.ptr_array()));
+    assert_equals(1, plan.vi_count());
+    assert_equals(1, plan.vi_inst_array()[0]);
+    assert_true(&plan == &marshall_plan::from_handle(plan.to_handle()));
+    plan.check_data(3, 1);
+);
+
+TEST(marshall_plan_empty,
+    marshall_plan plan(16, 16, nullptr, 0, nullptr, 0);
+    assert_equals(16, plan.size_direct());
+    assert_equals(0, plan.ptr_array_size());
+    assert_equals(0, plan.vi_count());
+);
+
+TEST(marshall_plan_invalid,
+    const jint ptr_array[] = { 0, 8, 8 };
+    bool caught(false);
+    try
+    { marshall_plan(8, 16, ptr_array, 3, nullptr, 0); }
+    catch (std::invalid_argument const&)
+    { caught = true; }
+    assert_true(caught);
+    caught = false;
+    try
+    { marshall_plan(16, 8, nullptr, 0, nullptr, 0); }
+    catch (std::invalid_argument const&)
+    { caught = true; }
+    assert_true(caught);
+);
+
+TEST(marshall_plan_out_of_range,
+    const jint vi_inst_array[] = { 0, 0 };
+    const jint bad_ptr_arrays[][2] =
+    {
+        { 20,  8 }, // pointer overlaps the end of the data
+        { -8,  8 },
+        {  0, 26 }, // past the last vi value
+        {  0, -2 },
+    };
+    for (auto const& ptr_array : bad_ptr_arrays)
+    {
+        bool caught(false);
+        try
+        { marshall_plan(8, 20, ptr_array, 2, vi_inst_array, 2); }
+        catch (std::out_of_range const&)
+        { caught = true; }
+        assert_true(caught);
+    }
+    // Without vi values, a pointer may point just past the end of the data.
+    // With two vi values, positions 24 and 25 are the vi values.
+    const jint ptr_array[] = { 0, 24, 8, -1 };
+    marshall_plan(8, 20, ptr_array, 4, nullptr, 0).check_data(3, 0);
+    marshall_plan plan(8, 20, ptr_array, 4, vi_inst_array, 2);
+    assert_true(plan.matches(8, 20, ptr_array, 4, vi_inst_array, 2));
+    assert_false(plan.matches(8, 20, ptr_array, 2, vi_inst_array, 2));
+    assert_false(plan.matches(8, 20, ptr_array, 4, vi_inst_array, 1));
+    bool caught(false);
+    try
+    { plan.check_data(2, 2); }
+    catch (std::invalid_argument const&)
+    { caught = true; }
+    assert_true(caught);
+    caught = false;
+    try
+    { plan.check_data(3, 1); }
+    catch (std::invalid_argument const&)
+    { caught = true; }
+    assert_true(caught);
+);
+
+TEST(marshall_plan_this_thread_last,
+    // The same structure type gets the same plan, and so the same compiled
+    // unmarshaller, until a different one is asked for.
+    const jint ptr_array[] = { 0, 8 };
+    const jint other_ptr_array[] = { 0, -1 };
+    marshall_plan const& a(
+        marshall_plan::this_thread_last(8, 16, ptr_array, 2, nullptr, 0));
+    marshall_plan const& b(
+        marshall_plan::this_thread_last(8, 16, ptr_array, 2, nullptr, 0));
+    assert_true(&a == &b);
+    assert_true(&a.unmarshaller() == &b.unmarshaller());
+    marshall_plan const& c(
+        marshall_plan::this_thread_last(8, 16, other_ptr_array, 2, nullptr, 0));
+    assert_true(c.matches(8, 16, other_ptr_array, 2, nullptr, 0));
+    marshall_plan::thread_detach();
+);
+
+#endif // __NOTEST__
@@ -0,0 +1,286 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_MARSHALL_PLAN_H___
+#define __INCLUDED_MARSHALL_PLAN_H___
+
+/**
+ * \file marshall_plan.h
+ * \author Victor Schappert
+ * \since 20140906
+ * \brief Immutable native copy of the marshalling metadata for a function
+ *        signature or structure type
+ */
+
+#include "util.h"
+
+#include <jni.h>
+
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace jsdi {
+
+class unmarshaller_vi;
+
+//==============================================================================
+//                            class marshall_plan
+//==============================================================================
+
+/**
+ * \brief Native copy of the pointer array and variable indirect instruction
+ *        array which describe how to marshall a particular function signature
+ *        or structure type
+ * \author Victor Schappert
+ * \since 20140906
+ * \see marshalling_roundtrip
+ *
+ * The pointer array and variable indirect instruction array are fixed for a
+ * given signature, but without a plan they have to be copied out of Java on
+ * every call. The Java side registers a plan once and refers to it thereafter
+ * by the handle returned from #to_handle(). The native call entry points then
+ * read the arrays directly from the plan.
+ *
+ * A plan is immutable once constructed, so any number of threads may use it
+ * concurrently. The Java side is responsible for not deleting a plan while a
+ * call using it is in progress.
+ *
+ * A plan for a structure type also holds the compiled unmarshaller used to
+ * copy the structure out, so the unmarshaller's copy program is built once
+ * per structure type rather than on every copy-out.
+ */
+class marshall_plan : private non_copyable
+{
+        //
+        // DATA
+        //
+
+        jsize             d_size_direct;
+        jsize             d_size_total;
+        std::vector<jint> d_ptr_array;
+        std::vector<jint> d_vi_inst_array;
+        mutable std::once_flag                   d_unmarshaller_once;
+        mutable std::unique_ptr<unmarshaller_vi> d_unmarshaller;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Constructs a plan
+         * \param size_direct Size, in bytes, of the directly-passed arguments
+         * \param size_total Size, in bytes, of the whole marshalled data block
+         * \param ptr_array Pointer array in the format expected by
+         *        \link marshalling_roundtrip\endlink
+         * \param ptr_array_size Number of <em>values</em> in
+         *        <code>ptr_array</code> (always an even number)
+         * \param vi_inst_array Variable indirect instruction array
+         * \param vi_inst_array_size Number of values in
+         *        <code>vi_inst_array</code>, which is also the number of
+         *        variable indirect values
+         * \throws std::invalid_argument If the sizes are inconsistent
+         * \throws std::out_of_range If a pointer in <code>ptr_array</code>
+         *         doesn't lie within the data block, or doesn't point into it
+         *         or at one of the variable indirect values
+         *
+         * The pointer array is checked against the data block as it will be
+         * passed to the native side, which is <code>size_total</code> rounded
+         * up to a whole number of \link marshall_word_t\endlink.
+         */
+        marshall_plan(jsize size_direct, jsize size_total,
+                      jint const * ptr_array, jsize ptr_array_size,
+                      jint const * vi_inst_array, jsize vi_inst_array_size);
+
+        ~marshall_plan();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the size of the directly-passed arguments
+         * \return Size in bytes
+         */
+        jsize size_direct() const;
+
+        /**
+         * \brief Returns the size of the whole marshalled data block
+         * \return Size in bytes
+         */
+        jsize size_total() const;
+
+        /**
+         * \brief Returns the pointer array
+         * \return Pointer to the first value of the pointer array, which may
+         *         be <code>nullptr</code> if #ptr_array_size() is zero
+         * \see #ptr_array_size() const
+         */
+        jint const * ptr_array() const;
+
+        /**
+         * \brief Returns the number of values in the pointer array
+         * \return Number of values, which is twice the number of pointers
+         * \see #ptr_array() const
+         */
+        jsize ptr_array_size() const;
+
+        /**
+         * \brief Returns the variable indirect instruction array
+         * \return Pointer to the first instruction, which may be
+         *         <code>nullptr</code> if #vi_count() is zero
+         * \see #vi_count() const
+         */
+        jint const * vi_inst_array() const;
+
+        /**
+         * \brief Returns the number of variable indirect values
+         * \return Number of values in the variable indirect instruction array
+         * \see #vi_inst_array() const
+         */
+        jsize vi_count() const;
+
+        /**
+         * \brief Checks that a marshalled data block and variable indirect
+         *        array are the ones this plan describes
+         * \param data_size Number of \link marshall_word_t\endlink in the data
+         *        block
+         * \param vi_array_size Number of elements in the variable indirect
+         *        array, or zero if there isn't one
+         * \throws std::invalid_argument If <code>data_size</code> isn't the
+         *         number of words needed for #size_total() or
+         *         <code>vi_array_size</code> isn't #vi_count()
+         * \since 20140907
+         *
+         * The pointer array was checked against #size_total() and #vi_count()
+         * when the plan was built, so a call using this plan is safe provided
+         * its data block and variable indirect array pass this check.
+         */
+        void check_data(jsize data_size, jsize vi_array_size) const;
+
+        /**
+         * \brief Indicates whether this plan was built from the given
+         *        metadata
+         * \param size_direct Size, in bytes, of the directly-passed arguments
+         * \param size_total Size, in bytes, of the whole marshalled data block
+         * \param ptr_array Pointer array
+         * \param ptr_array_size Number of values in <code>ptr_array</code>
+         * \param vi_inst_array Variable indirect instruction array
+         * \param vi_inst_array_size Number of values in
+         *        <code>vi_inst_array</code>
+         * \return Whether the plan's sizes and arrays equal the arguments
+         * \since 20140907
+         */
+        bool matches(jsize size_direct, jsize size_total,
+                     jint const * ptr_array, jsize ptr_array_size,
+                     jint const * vi_inst_array,
+                     jsize vi_inst_array_size) const;
+
+        /**
+         * \brief Returns an unmarshaller which copies out a structure laid out
+         *        according to this plan
+         * \return Unmarshaller, compiled on the first call and reused
+         *         thereafter
+         * \since 20140907
+         *
+         * The unmarshaller keeps no state between calls, so any number of
+         * threads may use it concurrently.
+         */
+        unmarshaller_vi& unmarshaller() const;
+
+        /**
+         * \brief Returns a handle that refers to this plan
+         * \return Handle which can be passed to the Java side
+         * \see #from_handle(jlong)
+         */
+        jlong to_handle() const;
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the plan referred to by a handle
+         * \param handle Handle previously returned by #to_handle() for a plan
+         *        that has not since been deleted
+         * \return Reference to the plan
+         * \see #to_handle() const
+         */
+        static marshall_plan const& from_handle(jlong handle);
+
+        /**
+         * \brief Returns a plan built from the given metadata, reusing the
+         *        calling thread's previous plan if it matches
+         * \param size_direct Size, in bytes, of the directly-passed arguments
+         * \param size_total Size, in bytes, of the whole marshalled data block
+         * \param ptr_array Pointer array
+         * \param ptr_array_size Number of values in <code>ptr_array</code>
+         * \param vi_inst_array Variable indirect instruction array
+         * \param vi_inst_array_size Number of values in
+         *        <code>vi_inst_array</code>
+         * \return Reference to a plan which is valid until the calling thread
+         *         next calls this function or exits
+         * \throws std::invalid_argument If the sizes are inconsistent
+         * \throws std::out_of_range If the pointer array is out of range
+         * \since 20140907
+         * \see #thread_detach()
+         *
+         * This lets callers which are still passed the metadata on every call,
+         * such as the per-call structure copy-outs, avoid compiling a new
+         * unmarshaller each time the same structure type is copied out.
+         */
+        static marshall_plan const& this_thread_last(
+            jsize size_direct, jsize size_total, jint const * ptr_array,
+            jsize ptr_array_size, jint const * vi_inst_array,
+            jsize vi_inst_array_size);
+
+        /**
+         * \brief Frees the calling thread's plan kept by
+         *        #this_thread_last(jsize, jsize, const jint *, jsize, const jint *, jsize)
+         *
+         * Called from <code>DllMain()</code> when a thread exits.
+         */
+        static void thread_detach();
+};
+
+inline jsize marshall_plan::size_direct() const
+{ return d_size_direct; }
+
+inline jsize marshall_plan::size_total() const
+{ return d_size_total; }
+
+inline jint const * marshall_plan::ptr_array() const
+{ return d_ptr_array.data(); }
+
+inline jsize marshall_plan::ptr_array_size() const
+{ return static_cast<jsize>(d_ptr_array.size()); }
+
+inline jint const * marshall_plan::vi_inst_array() const
+{ return d_vi_inst_array.data(); }
+
+inline jsize marshall_plan::vi_count() const
+{ return static_cast<jsize>(d_vi_inst_array.size()); }
+
+inline jlong marshall_plan::to_handle() const
+{
+    static_assert(sizeof(marshall_plan *) <= sizeof(jlong), "fatal data loss");
+    return reinterpret_cast<jlong>(this);
+}
+
+inline marshall_plan const& marshall_plan::from_handle(jlong handle)
+{
+    assert(handle || !"marshall plan handle cannot be zero");
+    return *reinterpret_cast<marshall_plan const *>(handle);
+}
+
+} // namespace jsdi
+
+#endif // __INCLUDED_MARSHALL_PLAN_H___
@@ -13,10 +13,111 @@
 #include "marshalling.h"
 
 #include "java_enum.h"
+#include "jstring_cache.h"
 #include "seh.h"
 
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
 namespace jsdi {
 
+namespace {
+
+typedef java_enum::suneido_jsdi_marshall_VariableIndirectInstruction
+    vi_instruction;
+
+jstring vi_make_jstring_uncached(JNIEnv * env, void const * str,
+                                 vi_instruction inst)
+{
+    switch (inst)
+    {
+        case vi_instruction::RETURN_JAVA_STRING_ANSI:
+            return make_jstring_ansi(env, static_cast<char const *>(str));
+        case vi_instruction::RETURN_JAVA_STRING_UTF16:
+            return make_jstring_utf16(env, static_cast<jchar const *>(str));
+        default:
+            return make_jstring(env, static_cast<char const *>(str));
+    }
+}
+
+// Returns the size in bytes, excluding the terminator, of the non-NULL string
+// 'str', or any value greater than 'limit' if the string is longer than that.
+// There's no point scanning past the limit since the string won't be cached.
+size_t vi_string_size(void const * str, vi_instruction inst, size_t limit)
+{
+    if (vi_instruction::RETURN_JAVA_STRING_UTF16 == inst)
+    {
+        jchar const * const begin(static_cast<jchar const *>(str));
+        jchar const * const end(begin + limit / sizeof(jchar) + 1);
+        jchar const * i(begin);
+        while (i != end && *i) ++i;
+        return static_cast<size_t>(i - begin) * sizeof(jchar);
+    }
+    else
+    {
+        char const * const begin(static_cast<char const *>(str));
+        char const * const end(begin + limit + 1);
+        char const * i(begin);
+        while (i != end && *i) ++i;
+        return static_cast<size_t>(i - begin);
+    }
+}
+
+// Converts the non-NULL string 'str' to a Java string as directed by one of the
+// RETURN_JAVA_STRING* instructions, or by RETURN_RESOURCE if 'str' isn't an
+// INTRESOURCE. If the string cache is enabled, the result may be an existing
+// string.
+jstring vi_make_jstring(JNIEnv * env, void const * str, vi_instruction inst)
+{
+    jstring_cache& cache(jstring_cache::instance());
+    if (! cache.enabled()) return vi_make_jstring_uncached(env, str, inst);
+    // Resource strings are converted exactly like RETURN_JAVA_STRING strings,
+    // so they share the same cache entries.
+    if (vi_instruction::RETURN_RESOURCE == inst)
+        inst = vi_instruction::RETURN_JAVA_STRING;
+    size_t const size(
+        vi_string_size(str, inst, jstring_cache::MAX_STRING_SIZE));
+    return cache.get(env, static_cast<int>(inst), str, size,
+                     [env, str, inst]()
+                     { return vi_make_jstring_uncached(env, str, inst); });
+}
+
+// Finds the smallest range [first, last) outside of which the 'size' bytes at
+// 'a' and 'b' are equal. If they are equal everywhere, first == last == size.
+void changed_range(jbyte const * a, jbyte const * b, size_t size,
+                   size_t& first, size_t& last)
+{
+    size_t const W(sizeof(uint64_t));
+    size_t i(0);
+    for (; i + W <= size; i += W)
+    {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, W);
+        std::memcpy(&y, b + i, W);
+        if (x != y) break;
+    }
+    while (i < size && a[i] == b[i]) ++i;
+    first = i;
+    if (size == i)
+    {
+        last = size;
+        return;
+    }
+    size_t j(size);
+    for (; i + W <= j; j -= W)
+    {
+        uint64_t x, y;
+        std::memcpy(&x, a + j - W, W);
+        std::memcpy(&y, b + j - W, W);
+        if (x != y) break;
+    }
+    while (a[j - 1] == b[j - 1]) --j;
+    last = j;
+}
+
+} // anonymous namespace
+
 //==============================================================================
 //                      class marshalling_vi_container
 //==============================================================================
@@ -28,18 +129,19 @@ marshalling_vi_container::~marshalling_vi_container()
     //       when there is a JNI exception pending. Ergo, you can't call any JNI
     //       functions which do anything other than legitimate cleanup from
     //       within this destructor.
+    //
+    //       Any changes the callee made to the arrays have already been copied
+    //       back by ptrs_finish_vi(), so all that's left is to give back the
+    //       pooled buffers and local references.
     try
     {
         const size_t N(d_arrays.size());
         for (size_t k = 0; k < N; ++k)
         {
             tuple& t(d_arrays[k]);
-            if (! t.d_elems) continue;
-            if (t.d_global)
-            {
-                d_env->ReleaseByteArrayElements(t.d_global, t.d_elems, 0);
-                d_env->DeleteGlobalRef(t.d_global);
-            }
+            if (t.d_elems) d_pool.release(reinterpret_cast<char *>(t.d_elems),
+                                          t.d_capacity);
+            if (t.d_array) d_env->DeleteLocalRef(t.d_array);
         }
     }
     catch (...)
@@ -52,25 +154,77 @@ inline void marshalling_vi_container::put_not_null(jint pos, jbyteArray array,
     assert(0 <= pos && static_cast<size_t>(pos) < d_arrays.size());
     tuple& t = d_arrays[pos];
     assert(! t.d_elems || !"duplicate variable indirect pointer");
-    t.d_elems = d_env->GetByteArrayElements(array, &t.d_is_copy);
-    JNI_EXCEPTION_CHECK(d_env);
-    if (! t.d_elems) throw jni_bad_alloc("GetByteArrayElements", __FUNCTION__);
-    assert(! t.d_global);
-    // Save a global reference to the array. This allows us to call
-    // ReleaseByteArrayElements from the destructor (A) regardless of whether
-    // the corresponding entry in d_object_array is subsequently replaced by a
-    // different value; and (B) without having to call GetObjectArrayElement(),
-    // which isn't permitted if a JNI exception has been flagged.
-    t.d_global = static_cast<jbyteArray>(d_env->NewGlobalRef(array));
+    assert(! t.d_array);
+    // Take ownership of the local reference first so that the destructor
+    // deletes it even if something below throws. Holding on to it lets us
+    // copy back to the array after the call regardless of whether the
+    // corresponding entry in d_object_array has been replaced.
+    t.d_array = array;
+    t.d_size = d_env->GetArrayLength(array);
+    t.d_elems = reinterpret_cast<jbyte *>(
+        d_pool.acquire(static_cast<size_t>(t.d_size), t.d_capacity));
+    d_env->GetByteArrayRegion(array, 0, t.d_size, t.d_elems);
     JNI_EXCEPTION_CHECK(d_env);
     t.d_pp_arr = pp_array;
     *pp_array = t.d_elems;
 }
 
+void marshalling_vi_container::copy_back(jint pos)
+{
+    assert(0 <= pos && static_cast<size_t>(pos) < d_arrays.size());
+    tuple const& t = d_arrays[pos];
+    if (! t.d_elems || 0 == t.d_size) return;
+    // The callee can only have changed the bytes in the pooled copy, so
+    // comparing it with the array finds exactly the range that has to be
+    // written back. This is far cheaper than copying the whole array when, as
+    // is typical, a large buffer receives a short result.
+    jbyte * const java_elems(static_cast<jbyte *>(
+        d_env->GetPrimitiveArrayCritical(t.d_array, nullptr)));
+    if (! java_elems)
+        throw jni_bad_alloc("GetPrimitiveArrayCritical", __FUNCTION__);
+    size_t first(0), last(0);
+    changed_range(t.d_elems, java_elems, static_cast<size_t>(t.d_size), first,
+                  last);
+    std::memcpy(java_elems + first, t.d_elems + first, last - first);
+    d_env->ReleasePrimitiveArrayCritical(t.d_array, java_elems, 0);
+}
+
 //==============================================================================
 //                       struct marshalling_roundtrip
 //==============================================================================
 
+void marshalling_roundtrip::ptrs_check(jint size_total,
+                                       jint const * ptr_array,
+                                       jsize ptr_array_size, jsize vi_count)
+{
+    if (0 != ptr_array_size % 2)
+    {
+        std::ostringstream() << "pointer array has odd size: "
+                             << ptr_array_size
+                             << throw_cpp<std::invalid_argument>();
+    }
+    // Compare in 64 bits so a large vi_count can't overflow the limit.
+    int64_t const ptd_to_limit(
+        static_cast<int64_t>(size_total) + (0 < vi_count ? vi_count : 1));
+    jint const * i(ptr_array), * e(ptr_array + ptr_array_size);
+    while (i < e)
+    {
+        jint const ptr_byte_offset = *i++;
+        jint const ptd_to_pos = *i++;
+        if (ptr_byte_offset < 0 ||
+            size_total - static_cast<jint>(sizeof(void *)) < ptr_byte_offset ||
+            (UNKNOWN_LOCATION != ptd_to_pos &&
+                (ptd_to_pos < 0 || ptd_to_limit <= ptd_to_pos)))
+        {
+            std::ostringstream() << "pointer out of range: " << ptr_byte_offset
+                                 << " => " << ptd_to_pos
+                                 << " with sizeTotal => " << size_total
+                                 << " and " << vi_count << " vi values"
+                                 << throw_cpp<std::out_of_range>();
+        }
+    }
+}
+
 void marshalling_roundtrip::ptrs_init_vi(
     marshall_word_t * args, jsize args_size, jint const * ptr_array,
     jsize ptr_array_size, JNIEnv * env, jobjectArray vi_array_in,
@@ -79,6 +233,11 @@ void marshalling_roundtrip::ptrs_init_vi(
     assert(0 == ptr_array_size % 2 || !"pointer array must have even size");
     jint const * i(ptr_array), * e(ptr_array + ptr_array_size);
     jint const total_size = args_size * sizeof(marshall_word_t);
+    // The container holds a local reference to each non-null byte array until
+    // it is destroyed, which may be more than the JVM guarantees by default.
+    jint const vi_count(static_cast<jint>(vi_array_out.size()));
+    if (0 < vi_count && env->EnsureLocalCapacity(vi_count) < 0)
+        throw jni_bad_alloc("EnsureLocalCapacity", __FUNCTION__);
     while (i < e)
     {
         jint ptr_byte_offset = *i++;
@@ -102,8 +261,9 @@ void marshalling_roundtrip::ptrs_init_vi(
                 static_cast<size_t>(ptd_to_pos) < vi_array_out.d_arrays.size()
                 || !"pointer points outside of variable indirect array"
             );
-            jni_auto_local<jobject> object(
-                env, env->GetObjectArrayElement(vi_array_in, ptd_to_pos));
+            // The container takes ownership of the local reference, if any.
+            jobject const object(
+                env->GetObjectArrayElement(vi_array_in, ptd_to_pos));
             JNI_EXCEPTION_CHECK(env);
             if (! object)
             {   // Note if this is a 'resource', the value at *ptr_addr is
@@ -114,10 +274,7 @@ void marshalling_roundtrip::ptrs_init_vi(
             {
                 assert(env->IsInstanceOf(object, GLOBAL_REFS->byte_ARRAY()));
                 vi_array_out.put_not_null(
-                    ptd_to_pos,
-                    static_cast<jbyteArray>(static_cast<jobject>(object)),
-                    ptr_addr
-                );
+                    ptd_to_pos, static_cast<jbyteArray>(object), ptr_addr);
             }
         }
     }
@@ -125,22 +282,29 @@ void marshalling_roundtrip::ptrs_init_vi(
 
 void marshalling_roundtrip::ptrs_finish_vi(
     jobjectArray vi_array_java, marshalling_vi_container& vi_array_cpp,
-    const jni_array_region<jint>& vi_inst_array)
+    jint const * vi_inst_array, jsize vi_inst_array_size)
 {
     jsize const N(static_cast<jsize>(vi_array_cpp.d_arrays.size()));
     JNIEnv * const env(vi_array_cpp.d_env);
     assert(
-        N == vi_inst_array.size() || !"variable indirect array size mismatch");
+        N == vi_inst_array_size || !"variable indirect array size mismatch");
     for (jsize k = 0; k < N; ++k)
     {
         const marshalling_vi_container::tuple& tuple(vi_array_cpp.d_arrays[k]);
-        switch (java_enum::ordinal_enum_to_cpp<
-            java_enum::suneido_jsdi_marshall_VariableIndirectInstruction>(vi_inst_array[k])
-        )
+        vi_instruction const inst(
+            java_enum::ordinal_enum_to_cpp<vi_instruction>(vi_inst_array[k]));
+        switch (inst)
         {
             case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::NO_ACTION:
+                // The byte array itself is the result, so any changes the
+                // callee made have to be copied back to it. For the other
+                // instructions, the array is replaced by a new value and the
+                // changes don't need to be copied back.
+                vi_array_cpp.copy_back(k);
                 break;
             case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING:
+            case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING_ANSI:
+            case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING_UTF16:
                 if (! *tuple.d_pp_arr)
                 {   // null pointer, so return a null String ref
                     vi_array_cpp.replace_byte_array(k, nullptr);
@@ -153,8 +317,10 @@ void marshalling_roundtrip::ptrs_finish_vi(
                     // wrapped, wrap the string access.
                     jni_auto_local<jstring> str(
                         env,
-                        seh::convert_to_cpp<jstring, JNIEnv *, jbyte const *>(
-                            make_jstring, env, *tuple.d_pp_arr));
+                        seh::convert_to_cpp<jstring, JNIEnv *, void const *,
+                                            vi_instruction>(
+                            vi_make_jstring, env,
+                            static_cast<void const *>(*tuple.d_pp_arr), inst));
                     vi_array_cpp.replace_byte_array(k, str);
                 }
                 break;
@@ -182,8 +348,10 @@ void marshalling_roundtrip::ptrs_finish_vi(
                     // wrapped, wrap the string access.
                     jni_auto_local<jstring> str(
                         env,
-                        seh::convert_to_cpp<jstring, JNIEnv *, jbyte const *>(
-                            make_jstring, env, *tuple.d_pp_arr));
+                        seh::convert_to_cpp<jstring, JNIEnv *, void const *,
+                                            vi_instruction>(
+                            vi_make_jstring, env,
+                            static_cast<void const *>(*tuple.d_pp_arr), inst));
                     vi_array_cpp.replace_byte_array(k, str);
                 }
                 break;
@@ -198,41 +366,53 @@ void marshalling_roundtrip::ptrs_finish_vi(
 //                        class unmarshaller_indirect
 //==============================================================================
 
-void unmarshaller_indirect::normal_ptr(
-    marshall_word_t * data, jint ptr_byte_offset, jint ptd_to_byte_offset,
-    ptr_iterator_t& ptr_i) const
+unmarshaller_indirect::unmarshaller_indirect(jint size_direct,
+                                             jint size_total,
+                                             const ptr_iterator_t& ptr_begin,
+                                             const ptr_iterator_t& ptr_end)
+    : unmarshaller_base(size_direct, size_total)
+    , d_program((ptr_end - ptr_begin) / 2)
 {
-    // STAGE 1: Copy
-    //     Look at the next pointer following this one.
-    //     - Its ptd_to_byte_offset sets the boundary of what needs to be
-    //       copied.
-    //     - If there is no next pointer, boundary of what needs to be copied is
-    //       the end of the data.
-    //
-    //     NOTE: If this normal pointer is NULL, we don't copy, we zero out.
+    assert(0 == (ptr_end - ptr_begin) % 2);
+    // Walk the pointer list backwards so that when a normal pointer is reached,
+    // the block it points to is known to end where the block pointed to by the
+    // next normal pointer starts, or at the end of the data if there is no next
+    // normal pointer. Variable indirect pointers don't point into the data
+    // block, so they don't affect the extent of any block.
     jint copy_end_byte_offset(d_size_total);
-    if (ptr_i != d_ptr_end) copy_end_byte_offset = *(ptr_i + 1);
-    auto ptr_addr = marshalling_util::addr_of_ptr(data, ptr_byte_offset);
-    auto ptd_to_addr = marshalling_util::addr_of_byte(data, ptd_to_byte_offset);
+    ptr_iterator_t ptr_i(ptr_end);
+    program_t::iterator op_i(d_program.end());
+    while (ptr_i != ptr_begin)
+    {
+        --op_i;
+        op_i->ptd_to_pos = *--ptr_i;
+        op_i->ptr_byte_offset = *--ptr_i;
+        if (is_vi_ptr(op_i->ptd_to_pos))
+        {
+            op_i->type = VI_STRING;
+            op_i->ptd_to_pos -= d_size_total;
+            op_i->size = 0;
+        }
+        else
+        {
+            assert(op_i->ptd_to_pos <= copy_end_byte_offset);
+            op_i->type = COPY;
+            op_i->size = copy_end_byte_offset - op_i->ptd_to_pos;
+            copy_end_byte_offset = op_i->ptd_to_pos;
+        }
+    }
+}
+
+void unmarshaller_indirect::copy_ptr(marshall_word_t * data, op const& o)
+{
+    // NOTE: If this normal pointer is NULL, we don't copy, we zero out.
+    assert(COPY == o.type);
+    auto ptr_addr = marshalling_util::addr_of_ptr(data, o.ptr_byte_offset);
+    auto ptd_to_addr = marshalling_util::addr_of_byte(data, o.ptd_to_pos);
     if (*ptr_addr)
-        std::memcpy(ptd_to_addr, *ptr_addr,
-                    copy_end_byte_offset - ptd_to_byte_offset);
+        std::memcpy(ptd_to_addr, *ptr_addr, o.size);
     else
-        std::memset(ptd_to_addr, 0,
-                    copy_end_byte_offset - ptd_to_byte_offset);
-    // STAGE 2: Handle sub-pointers
-    //     For each subsequent pointer that is within the block just copied or
-    //     zeroed, call this function recursively.
-    while (ptr_i != d_ptr_end)
-    {
-        jint const next_ptr_byte_offset = *ptr_i;
-        if (! (ptd_to_byte_offset <= next_ptr_byte_offset &&
-               next_ptr_byte_offset < copy_end_byte_offset))
-            break;
-        ++ptr_i;
-        jint const next_ptd_to_byte_offset = *ptr_i++;
-        normal_ptr(data, next_ptr_byte_offset, next_ptd_to_byte_offset, ptr_i);
-    }
+        std::memset(ptd_to_addr, 0, o.size);
 }
 
 void unmarshaller_indirect::unmarshall_indirect(
@@ -240,13 +420,8 @@ void unmarshaller_indirect::unmarshall_indirect(
 {
     SEH_CONVERT_TO_CPP_BEGIN
     std::memcpy(to, from, d_size_direct);
-    ptr_iterator_t ptr_i(d_ptr_begin), ptr_e(d_ptr_end);
-    while (ptr_i != ptr_e)
-    {
-        jint ptr_byte_offset = *ptr_i++;
-        jint ptd_to_byte_offset = *ptr_i++;
-        normal_ptr(to, ptr_byte_offset, ptd_to_byte_offset, ptr_i);
-    }
+    for (op const& o : d_program)
+        copy_ptr(to, o);
     SEH_CONVERT_TO_CPP_END
 }
 
@@ -255,10 +430,9 @@ void unmarshaller_indirect::unmarshall_indirect(
 //==============================================================================
 
 void unmarshaller_vi_base::vi_ptr(
-    marshall_word_t * data, jint ptr_byte_offset, jint ptd_to_pos, JNIEnv * env,
+    marshall_word_t * data, jint ptr_byte_offset, jint vi_index, JNIEnv * env,
     jobjectArray vi_array, jint const * vi_inst_array)
 {
-    jint vi_index = ptd_to_pos - unmarshaller_base::d_size_total;
     assert(0 <= vi_index && vi_index < d_vi_count);
     auto pstr = marshalling_util::addr_of_ptr(data, ptr_byte_offset);
     if (*pstr)
@@ -268,86 +442,39 @@ void unmarshaller_vi_base::vi_ptr(
     }
 }
 
-void unmarshaller_vi_base::normal_ptr(
-    marshall_word_t * data, jint ptr_byte_offset, jint ptd_to_byte_offset,
-    ptr_iterator_t& ptr_i, JNIEnv * env, jobjectArray vi_array,
-    jint const * vi_inst_array)
+void unmarshaller_vi_base::unmarshall_vi(
+    const void * from, marshall_word_t * to, JNIEnv * env,
+    jobjectArray vi_array, jint const * vi_inst_array)
 {
-    // STAGE 1: Copy
-    //     Look at the next pointer following this one.
-    //     - If it is a vi pointer, skip and keep looking.
-    //     - If it is a standard pointer, its ptd_to_pos sets the boundary of
-    //       what needs to be copied.
-    //     - If there is no next pointer, boundary of what needs to be copied is
-    //       the end of the data.
-    //
-    //     NOTE: If this normal pointer is NULL, we don't copy, we zero out.
-    jint copy_end_byte_offset(unmarshaller_base::d_size_total);
-    ptr_iterator_t ptr_e(unmarshaller_indirect::d_ptr_end);
-    if (ptr_i != ptr_e)
+    SEH_CONVERT_TO_CPP_BEGIN
+    std::memcpy(to, from, unmarshaller_base::d_size_direct);
+    for (op const& o : unmarshaller_indirect::d_program)
     {
-        ptr_iterator_t ptr_j(ptr_i);
-        do
-        {
-            ++ptr_j;
-            jint const next_ptd_to_pos = *ptr_j++;
-            if (! is_vi_ptr(next_ptd_to_pos))
-            {
-                copy_end_byte_offset = next_ptd_to_pos;
-                break;
-            }
-        }
-        while (ptr_j != ptr_e);
-    }
-    auto ptr_addr = marshalling_util::addr_of_ptr(data, ptr_byte_offset);
-    auto ptd_to_addr = marshalling_util::addr_of_byte(data, ptd_to_byte_offset);
-    if (*ptr_addr)
-        std::memcpy(ptd_to_addr, *ptr_addr,
-                    copy_end_byte_offset - ptd_to_byte_offset);
-    else
-        std::memset(ptd_to_addr, 0,
-                    copy_end_byte_offset - ptd_to_byte_offset);
-    // STAGE 2: Handle sub-pointers
-    //     For each subsequent pointer that is within the block just copied or
-    //     zeroed:
-    //     - If it's a vi pointer, just handle it, since it points to "flat"
-    //       string data.
-    //     - If it's a normal pointer, call this function recursively.
-    while (ptr_i != ptr_e)
-    {
-        jint const next_ptr_byte_offset = *ptr_i;
-        if (! (ptd_to_byte_offset <= next_ptr_byte_offset &&
-               next_ptr_byte_offset < copy_end_byte_offset))
-            break;
-        ++ptr_i;
-        jint const next_ptd_to_pos = *ptr_i++;
-        if (is_vi_ptr(next_ptd_to_pos))
-            vi_ptr(data, next_ptr_byte_offset, next_ptd_to_pos, env, vi_array,
+        if (VI_STRING == o.type)
+            vi_ptr(to, o.ptr_byte_offset, o.ptd_to_pos, env, vi_array,
                    vi_inst_array);
         else
-            normal_ptr(data, next_ptr_byte_offset, next_ptd_to_pos, ptr_i, env,
-                       vi_array, vi_inst_array);
+            copy_ptr(to, o);
     }
+    SEH_CONVERT_TO_CPP_END
 }
 
-void unmarshaller_vi_base::unmarshall_vi(
-    const void * from, marshall_word_t * to, JNIEnv * env,
-    jobjectArray vi_array, jint const * vi_inst_array)
+void unmarshaller_vi_base::unmarshall_vi_lazy(
+    const void * from, marshall_word_t * to, char const ** vi_ptrs) const
 {
+    std::fill(vi_ptrs, vi_ptrs + d_vi_count, nullptr);
     SEH_CONVERT_TO_CPP_BEGIN
     std::memcpy(to, from, unmarshaller_base::d_size_direct);
-    ptr_iterator_t ptr_i(unmarshaller_indirect::d_ptr_begin),
-                   ptr_e(unmarshaller_indirect::d_ptr_end);
-    while (ptr_i != ptr_e)
-    {
-        jint ptr_byte_offset = *ptr_i++;
-        jint ptd_to_byte_offset = *ptr_i++;
-        if (is_vi_ptr(ptd_to_byte_offset))  // vi pointer
-            vi_ptr(to, ptr_byte_offset, ptd_to_byte_offset, env, vi_array,
-                   vi_inst_array);
-        else                                // normal pointer
-            normal_ptr(to, ptr_byte_offset, ptd_to_byte_offset, ptr_i, env,
-                       vi_array, vi_inst_array);
+    for (op const& o : unmarshaller_indirect::d_program)
+    {
+        if (VI_STRING == o.type)
+        {
+            assert(0 <= o.ptd_to_pos && o.ptd_to_pos < d_vi_count);
+            vi_ptrs[o.ptd_to_pos] = reinterpret_cast<char const *>(
+                *marshalling_util::addr_of_ptr(to, o.ptr_byte_offset));
+        }
+        else
+            copy_ptr(to, o);
     }
     SEH_CONVERT_TO_CPP_END
 }
@@ -380,44 +507,49 @@ void unmarshaller_vi::vi_string_ptr(char const * str, jint vi_index,
 {
     assert(env || !"JNI environment cannot be NULL");
     assert(env || !"vi_array cannot be NULL");
-    switch (java_enum::ordinal_enum_to_cpp<
-        java_enum::suneido_jsdi_marshall_VariableIndirectInstruction>(vi_inst)
-    )
+    jni_auto_local<jobject> value(env, make_vi_object(env, str, vi_inst));
+    if (value)
+    {
+        env->SetObjectArrayElement(vi_array, vi_index, value);
+        JNI_EXCEPTION_CHECK(env);
+    }
+}
+
+jobject unmarshaller_vi::make_vi_object(JNIEnv * env, char const * str,
+                                        jint vi_inst)
+{
+    assert(env || !"JNI environment cannot be NULL");
+    vi_instruction const inst(
+        java_enum::ordinal_enum_to_cpp<vi_instruction>(vi_inst));
+    jobject result(nullptr);
+    switch (inst)
     {
         case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::NO_ACTION:
             break;
         case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_RESOURCE:
             if (IS_INTRESOURCE(str))
             {   // it's an INT resource, not a string, so return an Integer
-                jni_auto_local<jobject> int_resource(
-                    env,
-                    env->NewObject(
-                        GLOBAL_REFS->java_lang_Integer(),
-                        GLOBAL_REFS->java_lang_Integer__init(),
-                        reinterpret_cast<jint>(str)
-                    )
+                result = env->NewObject(
+                    GLOBAL_REFS->java_lang_Integer(),
+                    GLOBAL_REFS->java_lang_Integer__init(),
+                    reinterpret_cast<jint>(str)
                 );
                 JNI_EXCEPTION_CHECK(env);
-                if (! int_resource)
-                    throw jni_bad_alloc("NewObject", __FUNCTION__);
-                env->SetObjectArrayElement(vi_array, vi_index, int_resource);
-                JNI_EXCEPTION_CHECK(env);
+                if (! result) throw jni_bad_alloc("NewObject", __FUNCTION__);
                 break;
             }
             // Deliberately fall through if not IS_INTRESOURCE, because if it's
             // not an INTRESOURCE, it's a string.
         case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING:
-            if (str)
-            {
-                jni_auto_local<jstring> jstr(env, make_jstring(env, str));
-                env->SetObjectArrayElement(vi_array, vi_index, jstr);
-                JNI_EXCEPTION_CHECK(env);
-            }
+        case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING_ANSI:
+        case java_enum::suneido_jsdi_marshall_VariableIndirectInstruction::RETURN_JAVA_STRING_UTF16:
+            if (str) result = vi_make_jstring(env, str, inst);
             break;
         default:
             assert(!"control should never pass here");
             break;
     }
+    return result;
 }
 
 } // namespace jsdi
@@ -829,6 +961,96 @@ TEST(unmarshall_level_three_with_vi,
     assert_equals("level3", *y.vi_at(1));
     assert_equals("level2", *y.vi_at(2));
     assert_equals("level1", *y.vi_at(3));
+    // Lazy unmarshalling produces the same data block, and leaves the strings
+    // for later.
+    static combined lazy_result;
+    char const * vi_ptrs[VI_COUNT];
+    y.unmarshall_vi_lazy(DIRECT.args, lazy_result.args, vi_ptrs);
+    assert_equals(0, std::memcmp(&result, &lazy_result, sizeof(result)));
+    assert_true(nullptr == vi_ptrs[0]);
+    assert_true(s3.str == vi_ptrs[1]);
+    assert_true(s2.str == vi_ptrs[2]);
+    assert_true(s1.str == vi_ptrs[3]);
+);
+
+TEST(unmarshall_deep_chain,
+    // A linked list much deeper than any of the preceding tests, in which the
+    // native list is shorter than the marshalled layout so that the tail of the
+    // layout has to be zeroed out.
+    constexpr size_t NLAYOUT = 200;
+    constexpr size_t NNATIVE = 150;
+    struct node { node const * next; int64_t value; };
+    static node native[NNATIVE];
+    for (size_t k = 0; k < NNATIVE; ++k)
+    {
+        native[k].next = k + 1 < NNATIVE ? &native[k + 1] : nullptr;
+        native[k].value = static_cast<int64_t>(k) * 3 + 1;
+    }
+    union
+    {
+        node const * head;
+        ARGS(head);
+    } static const DIRECT = { &native[0] };
+    union combined
+    {
+        struct
+        {
+            node const * head;
+            node         nodes[NLAYOUT];
+        } data;
+        ARGS(data);
+    };
+    constexpr size_t SIZE_TOTAL = sizeof(combined);
+    static combined result;
+    std::vector<jint> ptr_array;
+    ptr_array.push_back(byte_offset(result.data, result.data.head));
+    ptr_array.push_back(byte_offset(result.data, result.data.nodes[0]));
+    for (size_t k = 0; k + 1 < NLAYOUT; ++k)
+    {
+        auto const& d(result.data);
+        ptr_array.push_back(byte_offset(d, d.nodes[k].next));
+        ptr_array.push_back(byte_offset(d, d.nodes[k + 1]));
+    }
+    unmarshaller_indirect x(sizeof(DIRECT), SIZE_TOTAL, ptr_array.data(),
+                            ptr_array.data() + ptr_array.size());
+    std::memset(result.args, 0xaa, sizeof(result));
+    x.unmarshall_indirect(DIRECT.args, result.args);
+    assert_true(DIRECT.head == result.data.head);
+    for (size_t k = 0; k < NNATIVE; ++k)
+    {
+        assert_true(native[k].next == result.data.nodes[k].next);
+        assert_equals(native[k].value, result.data.nodes[k].value);
+    }
+    for (size_t k = NNATIVE; k < NLAYOUT; ++k)
+    {
+        assert_true(nullptr == result.data.nodes[k].next);
+        assert_equals(0, result.data.nodes[k].value);
+    }
+);
+
+TEST(changed_range,
+    // Exhaustively check every single-byte range and a few wider ones over
+    // sizes that straddle the word size used by the comparison.
+    for (size_t size = 0; size <= 40; ++size)
+    {
+        std::vector<jbyte> a(size, 0x5a), b(a);
+        size_t first(99), last(99);
+        changed_range(a.data(), b.data(), size, first, last);
+        assert_equals(size, first);
+        assert_equals(size, last);
+        for (size_t i = 0; i < size; ++i)
+        {
+            for (size_t j = i + 1; j <= size; j += (j - i < 3 ? 1 : 7))
+            {
+                b = a;
+                b[i] = 0;
+                b[j - 1] = 0;
+                changed_range(a.data(), b.data(), size, first, last);
+                assert_equals(i, first);
+                assert_equals(j, last);
+            }
+        }
+    }
 );
 
 #endif // __NOTEST__
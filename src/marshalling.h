@@ -13,12 +13,17 @@
  *        jSuneido and the format expected by C
  */
 
+#include "arena.h"
+#include "buffer_pool.h"
 #include "global_refs.h"
 #include "java_enum.h"
 #include "jni_util.h"
-#include "jsdi_windows.h"
 #include "util.h"
 
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#endif
+
 #include <vector>
 #include <cassert>
 #include <cstring>
@@ -228,6 +233,16 @@ struct marshalling_roundtrip;
         const jint *, jsize, JNIEnv *, jobjectArray, marshalling_vi_container&)
  * \see marshalling_roundtrip#ptrs_finish_vi(jobjectArray,
  *      marshalling_vi_container&, const jni_array_region<jint>&)
+ * \see buffer_pool
+ *
+ * The contents of each non-<code>null</code> variable indirect
+ * <code>byte[]</code> are copied into a buffer taken from the calling thread's
+ * \link buffer_pool\endlink, and only a local reference to the array is kept
+ * for the duration of the call. Afterwards, only the range of bytes the callee
+ * actually changed is copied back, and nothing is copied back for arrays which
+ * are replaced by a result <code>String</code>. The tuples describing the
+ * arrays are themselves allocated from the calling thread's
+ * \link arena\endlink.
  */
 class marshalling_vi_container : private non_copyable
 {
@@ -243,23 +258,26 @@ class marshalling_vi_container : private non_copyable
 
         struct tuple
         {
-                jbyte *    d_elems;     // ptr to the byte array elements, OWNED
+                jbyte *    d_elems;     // pooled copy of the byte array
+                                        // elements, OWNED
                 jbyte **   d_pp_arr;    // points to the addr in the marshalled
                                         // data array which contains the pointer
                                         // to the byte array
-                jbyteArray d_global;    // non-NULL iff d_elems not NULL
-                jboolean   d_is_copy;
+                jbyteArray d_array;     // local ref to the byte array, OWNED
+                jsize      d_size;      // length of the byte array
+                size_t     d_capacity;  // capacity of d_elems
         };
 
-        typedef std::vector<tuple> vector_type;
+        typedef std::vector<tuple, arena_allocator<tuple>> vector_type;
 
         //
         // DATA
         //
 
-        vector_type  d_arrays;
-        JNIEnv     * d_env;
-        jobjectArray d_object_array;    // NOT OWNED
+        vector_type   d_arrays;
+        JNIEnv      * d_env;
+        jobjectArray  d_object_array;   // NOT OWNED
+        buffer_pool & d_pool;
 
         //
         // INTERNALS
@@ -271,6 +289,8 @@ class marshalling_vi_container : private non_copyable
 
         void replace_byte_array(jint pos, jobject new_object);
 
+        void copy_back(jint pos);
+
         //
         // CONSTRUCTORS
         //
@@ -322,9 +342,10 @@ class marshalling_vi_container : private non_copyable
 
 inline marshalling_vi_container::marshalling_vi_container(
     size_t size, JNIEnv * env, jobjectArray object_array)
-    : d_arrays(size, { nullptr, nullptr, nullptr, JNI_FALSE })
+    : d_arrays(size, { nullptr, nullptr, nullptr, 0, 0 })
     , d_env(env)
     , d_object_array(object_array)
+    , d_pool(buffer_pool::this_thread())
 { assert(env && object_array); }
 
 inline size_t marshalling_vi_container::size() const
@@ -346,7 +367,7 @@ inline void marshalling_vi_container::replace_byte_array(
     tuple& t = d_arrays[pos];
     if (t.d_elems)
     {
-        assert(t.d_global || !"no global reference allocated");
+        assert(t.d_array || !"no local reference held");
         jni_auto_local<jobject> prev_object(
             d_env, d_env->GetObjectArrayElement(d_object_array, pos));
         assert(d_env->IsInstanceOf(prev_object, GLOBAL_REFS->byte_ARRAY()));
@@ -361,8 +382,7 @@ inline void marshalling_vi_container::put_return_value(jbyte * str)
     assert(0 < size() || !"can't put return value in empty container");
     tuple& t = d_arrays[size()-1];
     assert(! t.d_elems   || !"return value must go in unused tuple");
-    assert(! t.d_global  || !"return value must go in unused tuple");
-    assert(! t.d_is_copy || !"return value must go in unused tuple");
+    assert(! t.d_array   || !"return value must go in unused tuple");
     *t.d_pp_arr = str; // t.d_pp_arr was initialized by ptrs_init_vi()
 }
 
@@ -426,6 +446,33 @@ struct marshalling_roundtrip : private marshalling_util
          */
         static constexpr jint UNKNOWN_LOCATION = -1;
 
+        /**
+         * \brief Checks that a pointer array stays within its storage block
+         * \param size_total Size of the storage block, in bytes
+         * \param ptr_array List of pointer pairs
+         * \param ptr_array_size Number of <em>values</em> in
+         *        <code>ptr_array</code>
+         * \param vi_count Number of variable indirect values, or zero if the
+         *        storage block has no variable indirect pointers
+         * \throws std::invalid_argument If <code>ptr_array_size</code> is odd
+         * \throws std::out_of_range If a pointer would not lie wholly within
+         *         the storage block, or would point neither into the block nor
+         *         at one of the <code>vi_count</code> variable indirect values
+         * \since 20140907
+         * \see #ptrs_init(marshall_word_t *, const jint *, jsize)
+         * \see #ptrs_init_vi(marshall_word_t *, jsize, const jint *, jsize,
+         *                    JNIEnv *, jobjectArray, marshalling_vi_container&)
+         *
+         * The "init" functions trust their pointer arrays. This function should
+         * be used before them whenever the pointer array, or the size of the
+         * storage block, doesn't come straight from the Java-side marshaller.
+         * A pointer to the end of a block without variable indirect values is
+         * allowed, since it can't be told apart from a pointer to an empty
+         * trailing member.
+         */
+        static void ptrs_check(jint size_total, jint const * ptr_array,
+                               jsize ptr_array_size, jsize vi_count);
+
         /**
          * \brief Initializes a storage block that contains ordinary pointers to
          *        locations within the block but no variable indirect pointers
@@ -493,6 +540,30 @@ struct marshalling_roundtrip : private marshalling_util
         static void ptrs_finish_vi(jobjectArray vi_array_java,
                                    marshalling_vi_container& vi_array_cpp,
                                    const jni_array_region<jint>& vi_inst_array);
+
+        /**
+         * \brief Converts variable indirect values back into Java
+         *        <code>Object</code> instances so they can be sent back to the
+         *        Java side
+         * \param vi_array_java Array to receive variable indirect values
+         * \param vi_array_cpp State initialized in
+         *        \link #ptrs_init_vi(marshall_word_t *, jsize, const jint *, jsize, JNIEnv *, jobjectArray, marshalling_vi_container&)
+         *        ptrs_init_vi(...)\endlink
+         * \param vi_inst_array Variable indirect instruction array
+         * \param vi_inst_array_size Number of instructions in
+         *        <code>vi_inst_array</code>
+         * \throws jsdi::seh_exception If a structure exception handling
+         *         exception is raised during the unmarshalling process
+         * \since 20140906
+         * \see #ptrs_finish_vi(jobjectArray, marshalling_vi_container&, const jni_array_region<jint>&)
+         *
+         * This overload allows the instructions to come from a native copy,
+         * such as a \link marshall_plan\endlink, rather than a Java array.
+         */
+        static void ptrs_finish_vi(jobjectArray vi_array_java,
+                                   marshalling_vi_container& vi_array_cpp,
+                                   jint const * vi_inst_array,
+                                   jsize vi_inst_array_size);
 };
 
 inline void marshalling_roundtrip::ptrs_init(marshall_word_t * args,
@@ -521,6 +592,14 @@ inline void marshalling_roundtrip::ptrs_init(marshall_word_t * args,
     }
 }
 
+inline void marshalling_roundtrip::ptrs_finish_vi(
+    jobjectArray vi_array_java, marshalling_vi_container& vi_array_cpp,
+    const jni_array_region<jint>& vi_inst_array)
+{
+    ptrs_finish_vi(vi_array_java, vi_array_cpp, vi_inst_array.data(),
+                   vi_inst_array.size());
+}
+
 //==============================================================================
 //                          class unmarshaller_base
 //==============================================================================
@@ -588,6 +667,17 @@ inline unmarshaller_base::unmarshaller_base(jint size_direct, jint size_total)
  * \see marshalling_roundtrip
  * \see unmarshaller_vi_base
  * \see unmarshaller_vi
+ *
+ * The constructor compiles the pointer list into a flat "copy program"
+ * containing one operation per pointer, so unmarshalling is a single loop over
+ * the program rather than a recursive walk of the pointer list. This works
+ * because every pointer nested inside a pointed-to block follows the pointer
+ * to that block in the pointer list. Consequently the extent of every block is
+ * known in advance and the only decision left until unmarshalling time is
+ * whether to copy a block or, if the pointer to it is <code>null</code>, to
+ * zero it out. The pointers within a zeroed block are themselves
+ * <code>null</code>, so the blocks they point to are zeroed in turn without any
+ * further bookkeeping.
  */
 class unmarshaller_indirect : public unmarshaller_base
 {
@@ -602,6 +692,26 @@ class unmarshaller_indirect : public unmarshaller_base
          */
         typedef jint const * ptr_iterator_t;
 
+    protected:
+
+        /** \cond internal */
+        enum op_type
+        {
+            COPY,       // copy (or zero) the block a normal pointer points to
+            VI_STRING   // hand a variable indirect pointer to derived class
+        };
+
+        struct op
+        {
+            op_type type;
+            jint    ptr_byte_offset;  // where the pointer is
+            jint    ptd_to_pos;       // byte offset if COPY, vi index otherwise
+            jint    size;             // bytes to copy if COPY, 0 otherwise
+        };
+
+        typedef std::vector<op> program_t;
+        /** \endcond internal */
+
         //
         // DATA
         //
@@ -609,18 +719,20 @@ class unmarshaller_indirect : public unmarshaller_base
     protected:
 
         /** \cond internal */
-        ptr_iterator_t d_ptr_begin;  // start of pointer list
-        ptr_iterator_t d_ptr_end;    // end of pointer list
+        program_t d_program;
         /** \endcond internal */
 
         //
         // INTERNALS
         //
 
-    private:
+    protected:
+
+        /** \cond internal */
+        bool is_vi_ptr(jint ptd_to_pos) const;
 
-        void normal_ptr(marshall_word_t * data, jint ptr_byte_offset,
-                        jint ptd_to_byte_offset,  ptr_iterator_t& ptr_i) const;
+        static void copy_ptr(marshall_word_t * data, op const& o);
+        /** \endcond internal */
 
         //
         // CONSTRUCTORS
@@ -639,7 +751,9 @@ class unmarshaller_indirect : public unmarshaller_base
          * \param ptr_begin Iterator to first element in pointer list
          * \param ptr_end Iterator one-past the last element in the pointer list
          *
-         * The pointer list must contain an even number of elements.
+         * The pointer list must contain an even number of elements. It is
+         * compiled into the unmarshaller's own copy program, so it need not
+         * remain valid after the constructor returns.
          */
         unmarshaller_indirect(jint size_direct, jint size_total,
                               const ptr_iterator_t& ptr_begin,
@@ -662,15 +776,8 @@ class unmarshaller_indirect : public unmarshaller_base
         void unmarshall_indirect(const void * from, marshall_word_t * to) const;
 };
 
-inline unmarshaller_indirect::unmarshaller_indirect(
-    jint size_direct,
-    jint size_total,
-    const ptr_iterator_t& ptr_begin,
-    const ptr_iterator_t& ptr_end)
-    : unmarshaller_base(size_direct, size_total)
-    , d_ptr_begin(ptr_begin)
-    , d_ptr_end(ptr_end)
-{ }
+inline bool unmarshaller_indirect::is_vi_ptr(jint ptd_to_pos) const
+{ return unmarshaller_base::d_size_total <= ptd_to_pos; }
 
 //==============================================================================
 //                        class unmarshaller_vi_base
@@ -702,17 +809,10 @@ class unmarshaller_vi_base : public unmarshaller_indirect
 
     private:
 
-        bool is_vi_ptr(jint ptd_to_pos) const;
-
-        void vi_ptr(marshall_word_t * data, jint ptr_word_index,
-                    jint ptd_to_pos, JNIEnv * env, jobjectArray vi_array,
+        void vi_ptr(marshall_word_t * data, jint ptr_byte_offset,
+                    jint vi_index, JNIEnv * env, jobjectArray vi_array,
                     jint const * vi_inst_array);
 
-        void normal_ptr(marshall_word_t * data, jint ptr_word_index,
-                        jint ptd_to_byte_offset, ptr_iterator_t& ptr_i,
-                        JNIEnv * env, jobjectArray vi_array,
-                        jint const * vi_inst_array);
-
     protected:
 
         /**
@@ -787,10 +887,29 @@ class unmarshaller_vi_base : public unmarshaller_indirect
         void unmarshall_vi(const void * from, marshall_word_t * to,
                            JNIEnv * env, jobjectArray vi_array,
                            jint const * vi_inst_array);
-};
 
-inline bool unmarshaller_vi_base::is_vi_ptr(jint ptd_to_pos) const
-{ return unmarshaller_base::d_size_total <= ptd_to_pos; }
+        /**
+         * \brief Unmarshalls a data block containing variable indirect pointers
+         *        without converting the variable indirect data
+         * \param from Address of marshalled data block
+         * \param to Address of data block to unmarshall into
+         * \param vi_ptrs Array with one element per variable indirect pointer
+         *        which receives the value of that pointer
+         * \throws jsdi::seh_exception If a structure exception handling
+         *         exception is raised during the unmarshalling process
+         * \since 20140914
+         * \see unmarshaller_vi::make_vi_object(JNIEnv *, char const *, jint)
+         *
+         * Unlike
+         * \link #unmarshall_vi(const void *, marshall_word_t *, JNIEnv *, jobjectArray, jint const *)
+         * unmarshall_vi(...)\endlink, this function makes no JNI calls. The
+         * variable indirect pointers are left in <code>to</code> unchanged,
+         * and their values are also stored in <code>vi_ptrs</code> so that the
+         * data they point to can be converted later, if it is needed at all.
+         */
+        void unmarshall_vi_lazy(const void * from, marshall_word_t * to,
+                                char const ** vi_ptrs) const;
+};
 
 inline unmarshaller_vi_base::unmarshaller_vi_base(
     jint size_direct, jint size_total, const ptr_iterator_t& ptr_begin,
@@ -926,6 +1045,31 @@ class unmarshaller_vi : public unmarshaller_vi_base
         unmarshaller_vi(jint size_direct, jint size_total,
                         const ptr_iterator_t& ptr_begin,
                         const ptr_iterator_t& ptr_end, jint vi_count);
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Converts the data pointed to by a variable indirect pointer
+         *        into a Java value
+         * \param env JNI environment
+         * \param str Value of the variable indirect pointer
+         * \param vi_inst Variable indirect instruction (specifies what kind of
+         *        Java value <code>str</code> should be converted to)
+         * \return Local reference to the Java value, or <code>nullptr</code>
+         *         if <code>str</code> is <code>null</code> or
+         *         <code>vi_inst</code> is <code>NO_ACTION</code>
+         * \since 20140914
+         *
+         * This function reads the memory <code>str</code> points to, so a
+         * caller that isn't already inside an SEH conversion block should call
+         * it through seh::convert_to_cpp().
+         */
+        static jobject make_vi_object(JNIEnv * env, char const * str,
+                                      jint vi_inst);
 };
 
 inline unmarshaller_vi::unmarshaller_vi(jint size_direct, jint size_total,
@@ -0,0 +1,234 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: message_filter.cpp
+// auth: Victor Schappert
+// date: 20140913
+// desc: Native pre-filter that keeps uninteresting window messages out of
+//       window procedure callbacks
+//==============================================================================
+
+#include "message_filter.h"
+
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#endif
+
+#include <cassert>
+
+namespace jsdi {
+
+//==============================================================================
+//                           class message_filter
+//==============================================================================
+
+message_filter::message_filter(jint const * wanted, size_t wanted_size,
+                               void * prev_wndproc, bool unicode)
+    : d_prev_wndproc(prev_wndproc)
+    , d_unicode(unicode)
+    , d_filtered(0)
+    , d_delivered(0)
+{
+    assert(wanted || 0 == wanted_size);
+    for (size_t k = 0; k < wanted_size; ++k)
+    {
+        unsigned const message(static_cast<unsigned>(wanted[k]));
+        if (message <= MAX_MESSAGE) d_wanted.set(message);
+    }
+}
+
+bool message_filter::handle(marshall_word_t const * args,
+                            uint64_t& result) const
+{
+    // The arguments are laid out exactly as the window procedure received them
+    // on the stack, one pointer-sized slot per parameter: HWND, UINT, WPARAM,
+    // LPARAM.
+    uintptr_t const * const w(reinterpret_cast<uintptr_t const *>(args));
+    unsigned const message(static_cast<unsigned>(w[1]));
+#if defined(_WIN32)
+    if (wants(message))
+    {
+        d_delivered.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    d_filtered.fetch_add(1, std::memory_order_relaxed);
+    HWND const hwnd(reinterpret_cast<HWND>(w[0]));
+    WPARAM const wparam(static_cast<WPARAM>(w[2]));
+    LPARAM const lparam(static_cast<LPARAM>(w[3]));
+    LRESULT lresult;
+    if (d_prev_wndproc)
+    {
+        WNDPROC const prev(reinterpret_cast<WNDPROC>(d_prev_wndproc));
+        lresult = d_unicode
+            ? CallWindowProcW(prev, hwnd, message, wparam, lparam)
+            : CallWindowProcA(prev, hwnd, message, wparam, lparam);
+    }
+    else
+    {
+        lresult = d_unicode
+            ? DefWindowProcW(hwnd, message, wparam, lparam)
+            : DefWindowProcA(hwnd, message, wparam, lparam);
+    }
+    result = static_cast<uint64_t>(static_cast<int64_t>(lresult));
+    return true;
+#else
+    // There are no window procedures to pass a message on to, so every
+    // message is delivered to the callback.
+    (void)message;
+    (void)result;
+    d_delivered.fetch_add(1, std::memory_order_relaxed);
+    return false;
+#endif // defined(_WIN32)
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+#include "callback.h"
+
+using namespace jsdi;
+
+namespace {
+
+// Most of the tests need real window messages and window procedures.
+#if defined(_WIN32)
+int prev_wndproc_calls;
+
+LRESULT CALLBACK prev_wndproc(HWND, UINT message, WPARAM wparam, LPARAM lparam)
+{
+    ++prev_wndproc_calls;
+    return static_cast<LRESULT>(message + wparam + lparam);
+}
+
+void make_args(uintptr_t (&args)[4], UINT message, WPARAM wparam,
+               LPARAM lparam)
+{
+    args[0] = 0;
+    args[1] = message;
+    args[2] = static_cast<uintptr_t>(wparam);
+    args[3] = static_cast<uintptr_t>(lparam);
+}
+
+marshall_word_t const * as_words(uintptr_t const (&args)[4])
+{ return reinterpret_cast<marshall_word_t const *>(args); }
+#endif // defined(_WIN32)
+
+struct counting_callback : public callback
+{
+    int d_calls;
+    explicit counting_callback(jint size_direct = message_filter::ARGS_SIZE)
+        : callback(size_direct, size_direct, nullptr, 0, 0)
+        , d_calls(0)
+    { }
+    virtual uint64_t call(marshall_word_t const *)
+    { ++d_calls; return 99; }
+};
+
+std::unique_ptr<message_filter> make_filter()
+{
+    jint const wanted[] = { 0x000f }; // WM_PAINT
+    return std::unique_ptr<message_filter>(
+        new message_filter(wanted, array_length(wanted), nullptr, true));
+}
+
+} // anonymous namespace
+
+TEST(message_filter_replace,
+    // A replaced filter is deleted once no invocation can be using it, and a
+    // filter can't be attached to a callback with the wrong argument size.
+    counting_callback cb;
+    for (int k = 0; k < 100; ++k)
+        cb.set_filter(make_filter());
+    assert_equals(0, cb.retired_filter_count());
+    {
+        epoch_region const region; // As if an invocation were in progress
+        message_filter const * const in_use(cb.filter());
+        cb.set_filter(make_filter());
+        assert_equals(1, cb.retired_filter_count());
+        assert_equals(0, in_use->filtered_count());
+    }
+    cb.set_filter(nullptr);
+    assert_equals(0, cb.retired_filter_count());
+    assert_true(nullptr == cb.filter());
+    counting_callback wrong_size(2 * message_filter::ARGS_SIZE);
+    bool caught(false);
+    try
+    { wrong_size.set_filter(make_filter()); }
+    catch (std::invalid_argument const&)
+    { caught = true; }
+    assert_true(caught);
+    assert_true(nullptr == wrong_size.filter());
+    wrong_size.set_filter(nullptr);
+);
+
+#if defined(_WIN32)
+
+TEST(message_filter_wants,
+    jint const wanted[] = { WM_PAINT, WM_SIZE, -1, 0x10000 };
+    message_filter f(wanted, array_length(wanted), nullptr, true);
+    assert_true(f.wants(WM_PAINT));
+    assert_true(f.wants(WM_SIZE));
+    assert_false(f.wants(WM_MOUSEMOVE));
+    assert_false(f.wants(0));
+    assert_true(f.wants(message_filter::MAX_MESSAGE + 1));
+    assert_true(f.wants(0xffffffffu));
+);
+
+TEST(message_filter_handle,
+    jint const wanted[] = { WM_PAINT };
+    message_filter f(wanted, array_length(wanted),
+                     reinterpret_cast<void *>(prev_wndproc), true);
+    prev_wndproc_calls = 0;
+    uintptr_t args[4];
+    uint64_t result(0);
+    make_args(args, WM_PAINT, 1, 2);
+    assert_false(f.handle(as_words(args), result));
+    assert_equals(0, prev_wndproc_calls);
+    make_args(args, WM_MOUSEMOVE, 10, 20);
+    assert_true(f.handle(as_words(args), result));
+    assert_equals(1, prev_wndproc_calls);
+    assert_equals(WM_MOUSEMOVE + 30, result);
+    make_args(args, WM_MOUSEMOVE, 0, -100000);
+    assert_true(f.handle(as_words(args), result));
+    assert_equals(static_cast<uint64_t>(WM_MOUSEMOVE - 100000LL), result);
+    assert_equals(2, f.filtered_count());
+    assert_equals(1, f.delivered_count());
+);
+
+TEST(message_filter_callback,
+    counting_callback cb;
+    jint const wanted[] = { WM_PAINT };
+    uintptr_t args[4];
+    make_args(args, WM_MOUSEMOVE, 0, 0);
+    assert_equals(99, cb.invoke(as_words(args))); // no filter attached
+    assert_equals(1, cb.d_calls);
+    cb.set_filter(std::unique_ptr<message_filter>(
+        new message_filter(wanted, array_length(wanted),
+                           reinterpret_cast<void *>(prev_wndproc), false)));
+    prev_wndproc_calls = 0;
+    assert_equals(WM_MOUSEMOVE, cb.invoke(as_words(args)));
+    assert_equals(1, cb.d_calls);
+    assert_equals(1, prev_wndproc_calls);
+    make_args(args, WM_PAINT, 0, 0);
+    assert_equals(99, cb.invoke(as_words(args)));
+    assert_equals(2, cb.d_calls);
+    assert_equals(1, cb.filter()->filtered_count());
+    assert_equals(1, cb.filter()->delivered_count());
+    cb.set_filter(nullptr);
+    assert_true(nullptr == cb.filter());
+    make_args(args, WM_MOUSEMOVE, 0, 0);
+    assert_equals(99, cb.invoke(as_words(args)));
+    assert_equals(3, cb.d_calls);
+);
+
+#endif // defined(_WIN32)
+
+#endif // __NOTEST__
@@ -0,0 +1,146 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_MESSAGE_FILTER_H___
+#define __INCLUDED_MESSAGE_FILTER_H___
+
+/**
+ * \file message_filter.h
+ * \author Victor Schappert
+ * \since 20140913
+ * \brief Native pre-filter that keeps uninteresting window messages out of
+ *        window procedure callbacks
+ */
+
+#include "marshalling.h"
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+
+namespace jsdi {
+
+//==============================================================================
+//                           class message_filter
+//==============================================================================
+
+/**
+ * \brief Handles the window messages a window procedure callback isn't
+ *        interested in without calling the callback
+ * \author Victor Schappert
+ * \since 20140913
+ * \see callback#set_filter(std::unique_ptr<message_filter>&&)
+ *
+ * A filter is attached to a callback that is used as a window procedure,
+ * typically one subclassing a window. It holds the set of message identifiers
+ * the callback wants to see. Any other message is passed straight to the
+ * previous window procedure (or to <code>DefWindowProc()</code> if there is
+ * none) via <code>CallWindowProc()</code>, exactly as the callback itself
+ * would have done, so the JVM is never entered.
+ *
+ * Message identifiers above #MAX_MESSAGE are always delivered to the callback.
+ *
+ * The counters are updated with relaxed atomic operations, so a filter may be
+ * used by several threads at once.
+ */
+class message_filter : private non_copyable
+{
+    public:
+
+        /** \brief Largest message identifier that can be filtered out */
+        static const unsigned MAX_MESSAGE = 0xffff;
+
+        /**
+         * \brief Size, in bytes, of the arguments #handle() reads
+         *
+         * These are the four pointer-sized window procedure parameters, which
+         * on amd64 is <code>4 * sizeof(marshall_word_t)</code>. A filter can
+         * only be attached to a callback whose direct arguments are exactly
+         * this size.
+         */
+        static const jint ARGS_SIZE = 4 * sizeof(uintptr_t);
+
+        //
+        // DATA
+        //
+
+    private:
+
+        std::bitset<MAX_MESSAGE + 1>  d_wanted;
+        void *                        d_prev_wndproc;
+        bool                          d_unicode;
+        mutable std::atomic<uint64_t> d_filtered;
+        mutable std::atomic<uint64_t> d_delivered;
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Constructs a filter
+         * \param wanted Array of message identifiers to deliver to the callback
+         * \param wanted_size Number of elements in <code>wanted</code>
+         * \param prev_wndproc Window procedure which handles the messages that
+         *        aren't delivered, or <code>nullptr</code> to use
+         *        <code>DefWindowProc()</code>
+         * \param unicode Whether to use the Unicode (<em>ie</em>
+         *        <code>CallWindowProcW()</code>) or ANSI versions of the
+         *        Win32 functions, which should match the function used to
+         *        obtain <code>prev_wndproc</code>
+         */
+        message_filter(jint const * wanted, size_t wanted_size,
+                       void * prev_wndproc, bool unicode);
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Indicates whether a message is delivered to the callback
+         * \param message Message identifier
+         * \return Whether <code>message</code> is delivered
+         */
+        bool wants(unsigned message) const;
+
+        /**
+         * \brief Returns the number of messages handled by the filter
+         * \return Number of invocations that didn't reach the callback
+         */
+        uint64_t filtered_count() const;
+
+        /**
+         * \brief Returns the number of messages passed on to the callback
+         * \return Number of invocations delivered to the callback
+         */
+        uint64_t delivered_count() const;
+
+        /**
+         * \brief Handles a window procedure invocation if the callback doesn't
+         *        want it
+         * \param args Window procedure arguments in the format passed to
+         *        callback#call(marshall_word_t const *)
+         * \param result Receives the window procedure's return value if the
+         *        invocation is handled
+         * \return Whether the invocation was handled, in which case the
+         *         callback must not be called
+         */
+        bool handle(marshall_word_t const * args, uint64_t& result) const;
+};
+
+inline bool message_filter::wants(unsigned message) const
+{ return MAX_MESSAGE < message || d_wanted[message]; }
+
+inline uint64_t message_filter::filtered_count() const
+{ return d_filtered.load(std::memory_order_relaxed); }
+
+inline uint64_t message_filter::delivered_count() const
+{ return d_delivered.load(std::memory_order_relaxed); }
+
+} // namespace jsdi
+
+#endif // __INCLUDED_MESSAGE_FILTER_H___
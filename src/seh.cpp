@@ -11,6 +11,8 @@
 
 #include "seh.h"
 
+#include "util.h"
+
 #include <sstream>
 #include <type_traits>
 
@@ -89,9 +91,7 @@ seh_exception::seh_exception(EXCEPTION_RECORD const& record)
 
 namespace {
 
-// TODO: Change MSFT "__declspec(thread)" to C++ "thread_local" once Visual C++
-//       supports the latter. It is not available as of November 2013 CTP.
-__declspec(thread) EXCEPTION_RECORD seh_record;
+JSDI_THREAD_LOCAL EXCEPTION_RECORD seh_record;
 static_assert(
     std::is_pod<decltype(seh_record)>::value,
     "static storage duration exception record must be plain old data");
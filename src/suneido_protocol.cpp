@@ -13,6 +13,7 @@
 
 #include "com_util.h"
 #include "global_refs.h"
+#include "jni_thread_env.h"
 #include "jni_util.h"
 #include "jsdi_windows.h"
 #include "log.h"
@@ -188,15 +189,10 @@ HRESULT __stdcall protocol::Start(LPCWSTR szUrl,
 canonicalized_ok:
     ;
     // Get a JNI handle to a Java string containing the decoded URL. This
-    // requires attaching the running thread to the JVM because we can't be sure
-    // whether it started out as a native thread or a JVM thread.
-    JNIEnv * env(nullptr);
-    JavaVMAttachArgs attach_args;
-    attach_args.version = JNI_VERSION_1_6;
-    attach_args.name    = nullptr;
-    attach_args.group   = nullptr;
-    if (JNI_OK != d_jni_jvm->AttachCurrentThread(reinterpret_cast<void **>(&env),
-                                                 &attach_args))
+    // may require attaching the running thread to the JVM because we can't be
+    // sure whether it started out as a native thread or a JVM thread.
+    JNIEnv * const env(jni_thread_env::get(d_jni_jvm));
+    if (! env)
     {
         LOG_ERROR("Failed to attach thread to JVM on URL '"
                   << narrow(szUrl, orig_url_len) << '\'');
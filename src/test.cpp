@@ -13,9 +13,15 @@
 
 #ifndef __NOTEST__
 
-#include "jsdi_windows.h"
+#include "log.h"
 #include "util.h"
 
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#else
+#include <dlfcn.h>
+#endif
+
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
@@ -38,37 +44,66 @@ struct cstr_less
 typedef std::map<const char *, std::shared_ptr<test>, cstr_less> test_map;
 typedef std::map<const char *, test_map, cstr_less> suite_map;
 
-HMODULE load_jvm_library()
+#if defined(_WIN32)
+typedef HMODULE library_t;
+const char DEFAULT_JVM_LIBRARY[] = "jvm.dll";
+
+inline library_t load_library(const char * path)
+{ return LoadLibraryExA(path, NULL, 0); }
+
+inline void * get_library_func(library_t library, const char * name)
+{ return reinterpret_cast<void *>(GetProcAddress(library, name)); }
+
+inline std::string library_error()
+{ return "error code " + std::to_string(GetLastError()); }
+#else
+typedef void * library_t;
+const char DEFAULT_JVM_LIBRARY[] = "libjvm.so";
+
+inline library_t load_library(const char * path)
+{ return dlopen(path, RTLD_NOW | RTLD_GLOBAL); }
+
+inline void * get_library_func(library_t library, const char * name)
+{ return dlsym(library, name); }
+
+inline std::string library_error()
+{
+    const char * const what(dlerror());
+    return what ? what : "unknown error";
+}
+#endif // defined(_WIN32)
+
+library_t load_jvm_library()
 {
     const char * path_var = getenv("JSDI_JVM_PATH");
-    std::string lib(path_var ? path_var : "jvm.dll");
-    HMODULE jvm_library = LoadLibraryExA(lib.c_str(), NULL, 0);
+    std::string lib(path_var ? path_var : DEFAULT_JVM_LIBRARY);
+    library_t jvm_library = load_library(lib.c_str());
     do
     {
         if (jvm_library) return jvm_library;
-        std::cerr << "failed to load '" << lib << "' (error code "
-                  << GetLastError() << ')' << std::endl;
+        std::cerr << "failed to load '" << lib << "' (" << library_error()
+                  << ')' << std::endl;
         if (!std::cin) break;
         std::cout << "enter full path to JVM library (enter to quit): ";
         std::getline(std::cin, lib);
         auto i = std::find_if(lib.begin(), lib.end(),
                               [] (char x) { return std::iswspace(x); });
         if (lib.end() == i) break;
-        jvm_library = LoadLibraryExA(lib.c_str(), NULL, 0);
+        jvm_library = load_library(lib.c_str());
     }
     while (true);
     throw test_java_vm_create_error("unable to load JVM library");
 }
 
-void * get_jvm_createfunc(HMODULE hmodule)
+void * get_jvm_createfunc(library_t hmodule)
 {
     const char * CREATEFUNC_NAME = "JNI_CreateJavaVM";
-    void * func_ptr = GetProcAddress(hmodule, CREATEFUNC_NAME);
+    void * func_ptr = get_library_func(hmodule, CREATEFUNC_NAME);
     if (!func_ptr)
     {
         std::ostringstream() << "failed to get address of '" << CREATEFUNC_NAME
-                             << "' within module " << hmodule << " (error code "
-                             << GetLastError() << ')'
+                             << "' within module " << hmodule << " ("
+                             << library_error() << ')'
                              << throw_cpp<test_java_vm_create_error>();
     }
     return func_ptr;
@@ -81,7 +116,7 @@ jint jni_create_java_vm(JavaVM ** vm, JNIEnv ** p_env, JavaVMInitArgs * vm_args)
     static createfunc_t createfunc(nullptr);
     if (!createfunc)
     {
-        HMODULE jvm_library = load_jvm_library();
+        library_t jvm_library = load_jvm_library();
         createfunc = reinterpret_cast<createfunc_t>(
                          get_jvm_createfunc(jvm_library));
     }
@@ -98,12 +133,14 @@ struct test_manager_impl
     std::vector<test_failure> d_cancels;  // Max 1 cancel per test
     std::shared_ptr<test> d_running_test;
     std::vector<std::string> d_jvm_args;
+    JavaVM * d_java_vm; // Shared by every test_java_vm; never destroyed
     int d_num_tests;
     int d_num_tests_run;
     int d_num_tests_failed;
     bool d_has_jvm_args;
     test_manager_impl()
-        : d_num_tests(0)
+        : d_java_vm(nullptr)
+        , d_num_tests(0)
         , d_num_tests_run(0)
         , d_num_tests_failed(0)
         , d_has_jvm_args(false)
@@ -181,6 +218,14 @@ void test::fail_assert_equals(const char * a_expr, const std::string& a_str,
     test_manager::instance().d_impl->add_failure(output);
 }
 
+void test::log_timing(const char * what, std::chrono::nanoseconds elapsed,
+                      long count)
+{
+    assert(what && 0 < count);
+    LOG_INFO(d_full_name << ": " << what << " => " << elapsed.count() / count
+                         << "ns each over " << count << " repetitions");
+}
+
 //==============================================================================
 //                            class test_manager
 //==============================================================================
@@ -309,7 +354,8 @@ test_manager& test_manager::instance()
 //==============================================================================
 
 test_java_vm::test_java_vm()
-    : d_env(nullptr)
+    : d_java_vm(nullptr)
+    , d_env(nullptr)
 {
     // Any exceptions thrown by this constructor during a test::run() will be
     // caught by test_manager_impl::run_test(...) an processed appropriately.
@@ -321,8 +367,10 @@ test_java_vm::test_java_vm()
         std::ostringstream() << "No /jvm switch specified"
                              << throw_cpp<test_java_vm_create_error>();
     }
-    // Otherwise, try to create the JVM.
-    else
+    // Otherwise, try to create the JVM if it doesn't exist yet. HotSpot can't
+    // create a JVM in a process which has already destroyed one, so the JVM is
+    // shared by every test and is left for the process exit to clean up.
+    else if (! impl->d_java_vm)
     {
         const size_t nopt(impl->d_jvm_args.size());
         JavaVMInitArgs vm_args;
@@ -338,9 +386,10 @@ test_java_vm::test_java_vm()
             options[k].extraInfo = nullptr;
         }
         JavaVM * vm(nullptr);
-        jint result = jni_create_java_vm(&vm, &d_env, &vm_args);
+        JNIEnv * env(nullptr);
+        jint result = jni_create_java_vm(&vm, &env, &vm_args);
         if (JNI_OK == result)
-            d_java_vm.reset(vm, std::mem_fn(&JavaVM::DestroyJavaVM));
+            impl->d_java_vm = vm;
         else
         {
             std::ostringstream() << "failed to create JVM: got error code "
@@ -348,6 +397,18 @@ test_java_vm::test_java_vm()
                                  << throw_cpp<test_java_vm_create_error>();
         }
     }
+    d_java_vm = impl->d_java_vm;
+    void * env(nullptr);
+    jint result = d_java_vm->GetEnv(&env, JNI_VERSION_1_2);
+    if (JNI_EDETACHED == result)
+        result = d_java_vm->AttachCurrentThread(&env, nullptr);
+    if (JNI_OK != result)
+    {
+        std::ostringstream() << "failed to get JNI environment: got error code "
+                             << result
+                             << throw_cpp<test_java_vm_create_error>();
+    }
+    d_env = static_cast<JNIEnv *>(env);
     // If we get to the end of the constructor without an exception having been
     // thrown, both the virtual machine pointer and the environment pointer must
     // be valid.
@@ -15,6 +15,7 @@
 #ifndef __NOTEST__
 
 #include <cassert>
+#include <chrono>
 #include <sstream>
 #include <vector>
 #include <string>
@@ -197,6 +198,20 @@ class test
                                 const char * b_expr, const std::string& b_str,
                                 const char * line);
         /** \endcond internal */
+
+        /**
+         * \brief Logs the average time taken by a repeated operation
+         * \param what Non-<code>null</code> pointer to zero-terminated string
+         *        describing the operation
+         * \param elapsed Total time taken by all repetitions of the operation
+         * \param count Number of repetitions, which must be positive
+         *
+         * Timing tests should assert their results and report their timings
+         * with this function. The timing is logged at level INFO, so nothing is
+         * logged unless INFO logging is compiled in.
+         */
+        void log_timing(const char * what, std::chrono::nanoseconds elapsed,
+                        long count);
 };
 
 inline test::test(const char * suite_name, const char * test_name)
@@ -418,6 +433,10 @@ inline test_java_vm_create_error::test_java_vm_create_error(const std::string& w
  * \brief Automatic managed object for obtaining a JVM for testing purposes
  * \author Victor Schappert
  * \since 20140510
+ *
+ * HotSpot cannot create a second JVM in a process once the first has been
+ * destroyed, so the JVM is created the first time a test_java_vm is
+ * constructed and every later test_java_vm shares it. It is never destroyed.
  */
 class test_java_vm
 {
@@ -425,7 +444,7 @@ class test_java_vm
         // DATA
         //
 
-        std::shared_ptr<JavaVM> d_java_vm;
+        JavaVM *                d_java_vm;
         JNIEnv *                d_env;
 
         //
@@ -435,7 +454,8 @@ class test_java_vm
     public:
 
         /**
-         * \brief Constructs a JVM
+         * \brief Obtains the test JVM, creating it if necessary, and the
+         *        calling thread's JNI environment
          * \throws test_java_vm_create_error If JVM creation fails
          *
          * A JVM may fail to be created in any of the following scenarios:
@@ -464,8 +484,7 @@ class test_java_vm
          * JVM.
          *
          * \warning
-         * Do not attempt to destroy the JVM. It will be destroyed when this
-         * object is destroyed.
+         * Do not attempt to destroy the JVM. It is shared by every test.
          */
         JavaVM * java_vm();
 
@@ -479,7 +498,7 @@ class test_java_vm
 };
 
 inline JavaVM * test_java_vm::java_vm()
-{ return d_java_vm.get(); }
+{ return d_java_vm; }
 
 inline JNIEnv * test_java_vm::env_of_creating_thread()
 { return d_env; }
@@ -11,15 +11,25 @@
 
 #include "test_exports.h"
 
+#if defined(_WIN32)
 #include "jsdi_windows.h"
+#endif
 #include "util.h"
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
 
+#if !defined(_WIN32)
+// Equivalents of the Win32 resource macros so the test functions can be built
+// for System V platforms.
+#define IS_INTRESOURCE(r)  ((((uintptr_t)(r)) >> 16) == 0)
+#define MAKEINTRESOURCE(i) ((char *)((uintptr_t)((uint16_t)(i))))
+#endif
+
 namespace {
 
 template <typename T, typename U>
@@ -239,7 +249,7 @@ EXPORT_STDCALL(int32_t) TestSumString(struct Recursive_StringSum * ptr)
         // adequate to our needs, but for a more general workaround, see here:
         // http://stackoverflow.com/a/8712996/1911388.
         char buffer[32];
-        sprintf(buffer, "%ld", sum);
+        sprintf(buffer, "%" PRId32, sum);
         strncpy(ptr->buffer, buffer,
                 std::max(static_cast<int32_t>(0), ptr->len - 1));
         if (0 < ptr->len) ptr->buffer[ptr->len - 1] = '\0';
@@ -251,7 +261,8 @@ EXPORT_STDCALL(int32_t) TestSumResource(const char * res, const char ** pres)
 {
     int32_t sum(0);
     if (IS_INTRESOURCE(res))
-        sum += static_cast<int32_t>(reinterpret_cast<uint16_t>(res));
+        sum += static_cast<int32_t>(
+                   static_cast<uint16_t>(reinterpret_cast<uintptr_t>(res)));
     else
     {
         assert(res);
@@ -261,7 +272,8 @@ EXPORT_STDCALL(int32_t) TestSumResource(const char * res, const char ** pres)
     {
         // Finish calculating sum.
         if (IS_INTRESOURCE(*pres))
-            sum += static_cast<int32_t>(reinterpret_cast<uint16_t>(*pres));
+            sum += static_cast<int32_t>(
+                static_cast<uint16_t>(reinterpret_cast<uintptr_t>(*pres)));
         else
         {
             assert(*pres);
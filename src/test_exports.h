@@ -30,6 +30,14 @@ extern "C"
 #elif defined(_M_AMD64)
 // For x64, don't specify __stdcall because, really, there's no such thing.
 #define EXPORT_STDCALL(return_type) __declspec(dllexport) return_type
+#elif defined(__x86_64__) && !defined(_WIN32)
+// For System V x64 platforms, export from the shared object and make the
+// __stdcall in the callback typedefs below a no-op.
+#define EXPORT_STDCALL(return_type) \
+    __attribute__((visibility("default"))) return_type
+#ifndef __stdcall
+#define __stdcall
+#endif
 #else
 #error unknown CPU architecture
 #endif
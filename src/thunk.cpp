@@ -11,11 +11,12 @@
 
 #include "thunk.h"
 
+#include "epoch.h"
 #include "log.h"
 
-#include <deque>
 #include <mutex>
 #include <sstream>
+#include <vector>
 
 namespace jsdi {
 
@@ -29,71 +30,40 @@ namespace {
 constexpr int MAGIC = 0x1baddeed;
 #endif // NDEBUG
 
-std::string bad_state_to_str(int_fast32_t state)
-{
-    switch (state)
-    {
-        case thunk_state::DELETED:
-            return std::string("DELETED");
-        case thunk_state::CLEARED:
-            return std::string("CLEARED");
-        case thunk_state::CLEARING:
-            return std::string("CLEARING");
-        default:
-            assert(state < thunk_state::DELETED);
-            std::ostringstream o;
-            o << "<unknown state " << state << '>';
-            return o.str();
-    }
-}
+std::atomic<size_t> live_thunks(0);
+std::atomic<size_t> clearing_thunks(0);
 
 } // anonymous namespace
 
-/* NOTE: The meaning of the thunk.d_state member is the following:
- *    -1: deleted
- *     0: cleared
- *     1: clearing
- *     2..N: if (d_clearing) clearing, else ready
- * For the clearing and ready states, the number of threads concurrently
- * executing the thunk is (d_state-clearing) or (d_state-ready), as appropriate.
- * The reason for structuring it this way is so all the concurrency issues that
- * arise if the thunk function is being called on two or more threads at the
- * same time can be solved with a simple atomic test-and-set approach.
+/* NOTE: The thunk.d_state member only records the thunk_state. It is written
+ *       when the thunk is cleared, reclaimed, and deleted, but never when the
+ *       thunk is called. Instead of counting the threads executing the thunk,
+ *       which would mean every call doing an atomic read-modify-write on the
+ *       same shared word, each call enters an epoch critical region, which
+ *       only writes the calling thread's own epoch record. Once the thunk is
+ *       cleared, thunk_clearing_list uses the epochs to work out when the last
+ *       call which could have been in progress has finished.
  */
 
-void thunk::setup_bad_state(int_fast32_t state)
-{
-    LOG_FATAL("Bad state " << state << " detected in setup_call() for "
-              "thunk " << this << " [func_addr() => " << func_addr() << ']');
-    std::abort();
-}
-
-void thunk::teardown_bad_state(int_fast32_t state)
-{
-    LOG_FATAL("Bad state " << state << " detected in setup_call() for "
-              "thunk " << this << " [func_addr() => " << func_addr() << ']');
-    std::abort();
-}
-
 void thunk::setup_call()
 {
     assert(MAGIC == d_magic);
-    int_fast32_t state = std::atomic_fetch_add(&d_state, 1);
-    if (state < thunk_state::READY)
-        setup_bad_state(state);
+    assert(thunk_state::CLEARING <= d_state.load(std::memory_order_relaxed) ||
+           !"thunk called after it was reclaimed");
+    epoch::enter();
 }
 
 void thunk::teardown_call()
 {
     assert(MAGIC == d_magic);
-    int_fast32_t state = std::atomic_fetch_sub(&d_state, 1) - 1;
-    if (state < thunk_state::READY)
-    {
-        if (thunk_state::CLEARING == state)
-            std::atomic_store(&d_state, thunk_state::CLEARED);
-        else
-            teardown_bad_state(state);
-    }
+    epoch::leave();
+}
+
+void thunk::set_cleared()
+{
+    int_fast32_t const state(
+        d_state.exchange(thunk_state::CLEARED, std::memory_order_relaxed));
+    assert(thunk_state::CLEARING == state || !"thunk not being cleared");
 }
 
 thunk::thunk(const std::shared_ptr<callback>& callback_ptr)
@@ -102,42 +72,46 @@ thunk::thunk(const std::shared_ptr<callback>& callback_ptr)
       d_magic(MAGIC),
 #endif // NDEBUG
       d_state(thunk_state::READY)
-    , d_clearing(false)
     , d_callback(callback_ptr)
-{ }
+{ live_thunks.fetch_add(1, std::memory_order_relaxed); }
 
 thunk::~thunk()
 {
 #ifndef NDEBUG
     d_magic = ~MAGIC;
 #endif // NDEBUG
+    // A thunk may be deleted directly, without going through a
+    // thunk_clearing_list, by an owner that knows no call is in progress. In
+    // that case it may have been cleared, but not yet moved to CLEARED.
     int_fast32_t state = std::atomic_exchange(&d_state, thunk_state::DELETED);
-    assert(thunk_state::CLEARED == state || thunk_state::READY == state);
+    assert(thunk_state::CLEARED <= state || !"thunk deleted twice");
+    live_thunks.fetch_sub(1, std::memory_order_relaxed);
+    if (thunk_state::READY != state)
+        clearing_thunks.fetch_sub(1, std::memory_order_relaxed);
 }
 
 thunk_state thunk::clear()
 {
     assert(MAGIC == d_magic);
-    bool already_clearing = std::atomic_exchange(&d_clearing, true);
-    assert(!already_clearing || !"clearing flag already set");
-    int_fast32_t state = std::atomic_fetch_sub(&d_state, 1) - 1;
-    assert(thunk_state::CLEARING <= state);
-    if (thunk_state::CLEARING == state)
-    {
-        std::atomic_store(&d_state, thunk_state::CLEARED);
-        return thunk_state::CLEARED;
-    }
-    else return thunk_state::CLEARING;
+    int_fast32_t state(thunk_state::READY);
+    bool const was_ready(d_state.compare_exchange_strong(
+        state, thunk_state::CLEARING));
+    assert(was_ready || !"thunk already cleared");
+    if (was_ready) clearing_thunks.fetch_add(1, std::memory_order_relaxed);
+    return was_ready ? thunk_state::CLEARING : static_cast<thunk_state>(state);
 }
 
+size_t thunk::live_count()
+{ return live_thunks.load(std::memory_order_relaxed); }
+
+size_t thunk::clearing_count()
+{ return clearing_thunks.load(std::memory_order_relaxed); }
+
 thunk_state thunk::state() const
 {
     int_fast32_t state = std::atomic_load(&d_state);
     assert(thunk_state::CLEARED <= state || !"bad thunk state");
-    if (state < thunk_state::READY)
-        return static_cast<thunk_state>(state);
-    else
-        return d_clearing.load() ? thunk_state::CLEARING : thunk_state::READY;
+    return static_cast<thunk_state>(state);
 }
 
 std::ostream& operator<<(std::ostream& o, thunk const& t)
@@ -153,47 +127,61 @@ std::ostream& operator<<(std::ostream& o, thunk const& t)
 
 struct thunk_clearing_list_impl
 {
-    std::deque<thunk *> d_cleared_list;
-    std::deque<thunk *> d_clearing_list;
-    std::mutex          d_mutex;
-    // Use default destructor. Thus it will leak whatever is on the lists at
+    struct retired
+    {
+        thunk *  d_thunk;
+        uint64_t d_epoch;
+    };
+    std::vector<retired> d_retired;
+    std::mutex           d_mutex;
+    // Use default destructor. Thus it will leak whatever is on the list at
     // time of destruction.
-    void clear_thunk(thunk * thunk_)
+    void take_safe(std::vector<thunk *>& safe)
     {
-        assert(thunk_ || !"thunk cannot be null");
+        uint64_t const oldest(epoch::oldest_active());
         std::lock_guard<std::mutex> lock(d_mutex);
-        switch (thunk_->clear())
+        auto out(d_retired.begin());
+        for (auto i = d_retired.begin(), e = d_retired.end(); i != e; ++i)
         {
-            case thunk_state::CLEARED:
-                LOG_DEBUG("Putting " << *thunk_ << " into cleared list");
-                d_cleared_list.push_back(thunk_);
-                break;
-            case thunk_state::CLEARING:
-                LOG_DEBUG("Putting " << *thunk_ << " into clearing list");
-                d_clearing_list.push_back(thunk_);
-                break;
-            default:
-                assert(!"invalid thunk state");
-                break;
+            if (epoch::is_safe(i->d_epoch, oldest))
+                safe.push_back(i->d_thunk);
+            else
+                *out++ = *i;
         }
-        // Don't let the cleared list grow indefinitely
-        if (10 < d_cleared_list.size())
+        d_retired.erase(out, d_retired.end());
+    }
+    size_t reclaim()
+    {
+        std::vector<thunk *> safe;
+        take_safe(safe);
+        // Delete outside the lock, since deleting a thunk releases its
+        // callback, which may in turn release JNI references.
+        for (auto i = safe.begin(), e = safe.end(); i != e; ++i)
         {
-            assert(thunk_ != d_cleared_list.front());
-            assert(thunk_state::CLEARED == d_cleared_list.front()->state());
-            LOG_DEBUG("Deleting " << *d_cleared_list.front());
-            delete d_cleared_list.front();
-            d_cleared_list.pop_front();
+            (*i)->set_cleared();
+            LOG_DEBUG("Deleting " << **i);
+            delete *i;
         }
-        // Don't let the clearing list grow indefinitely
-        if (1 < d_clearing_list.size() &&
-            thunk_state::CLEARED == d_clearing_list.front()->state())
+        return safe.size();
+    }
+    void clear_thunk(thunk * thunk_)
+    {
+        assert(thunk_ || !"thunk cannot be null");
+        thunk_->clear();
+        // The caller guarantees that no new call to the thunk will start, so
+        // only threads which are already in a callback can still be using it.
+        retired const r = { thunk_, epoch::retire() };
+        LOG_DEBUG("Retiring " << *thunk_ << " in epoch " << r.d_epoch);
         {
-            LOG_TRACE("Moving " << *d_clearing_list.front()
-                                << " to cleared list");
-            d_cleared_list.push_back(d_clearing_list.front());
-            d_clearing_list.pop_front();
+            std::lock_guard<std::mutex> lock(d_mutex);
+            d_retired.push_back(r);
         }
+        reclaim();
+    }
+    size_t pending_count()
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        return d_retired.size();
     }
 };
 
@@ -204,4 +192,143 @@ thunk_clearing_list::thunk_clearing_list()
 void thunk_clearing_list::clear_thunk(thunk * thunk_)
 { d_impl->clear_thunk(thunk_); }
 
+size_t thunk_clearing_list::reclaim()
+{ return d_impl->reclaim(); }
+
+size_t thunk_clearing_list::pending_count() const
+{ return d_impl->pending_count(); }
+
 } // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <thread>
+
+using namespace jsdi;
+
+namespace {
+
+std::atomic<int> stress_thunks_deleted(0);
+
+// thunk which can be "called" directly, and which can tell whether it was
+// called after it was deleted
+struct stress_thunk : public thunk
+{
+    std::atomic<bool> d_alive;
+    stress_thunk()
+        : thunk(std::shared_ptr<callback>())
+        , d_alive(true)
+    { }
+    ~stress_thunk()
+    {
+        d_alive.store(false);
+        ++stress_thunks_deleted;
+    }
+    void * func_addr() const
+    { return nullptr; }
+    bool call()
+    {
+        setup_call();
+        bool const alive(d_alive.load(std::memory_order_relaxed));
+        teardown_call();
+        return alive;
+    }
+};
+
+} // anonymous namespace
+
+TEST(thunk_clearing_stress,
+    // Many threads call whichever thunk is current while the main thread
+    // keeps replacing it and clearing the old one. A thread's epoch region
+    // stands in for the native code that got hold of the thunk's function
+    // address before the thunk was cleared.
+    const int NUM_THREADS = 8;
+    const int NUM_THUNKS  = 2000;
+    thunk_clearing_list list;
+    std::atomic<stress_thunk *> current(new stress_thunk);
+    std::atomic<bool> stop(false);
+    std::atomic<int> bad_calls(0);
+    std::atomic<long> calls(0);
+    stress_thunks_deleted = 0;
+    std::vector<std::thread> threads;
+    for (int k = 0; k < NUM_THREADS; ++k)
+    {
+        threads.emplace_back([&]()
+        {
+            while (! stop.load())
+            {
+                epoch_region region;
+                stress_thunk * const t(current.load());
+                if (! t->call()) ++bad_calls;
+                ++calls;
+            }
+            epoch::thread_detach();
+        });
+    }
+    // Don't start clearing until the threads are calling, or on a fast
+    // machine the clearing could be over before any thread gets going.
+    while (calls.load() < NUM_THREADS)
+        std::this_thread::yield();
+    for (int k = 1; k < NUM_THUNKS; ++k)
+        list.clear_thunk(current.exchange(new stress_thunk));
+    stop = true;
+    for (auto i = threads.begin(), e = threads.end(); i != e; ++i)
+        i->join();
+    list.clear_thunk(current.exchange(nullptr));
+    list.reclaim();
+    epoch::thread_detach();
+    assert_equals(0, bad_calls.load());
+    assert_true(0 < calls.load());
+    assert_equals(0, list.pending_count());
+    assert_equals(NUM_THUNKS, stress_thunks_deleted.load());
+);
+
+TEST(thunk_clear_in_callback,
+    // A thunk cleared from within a call to itself isn't deleted until the
+    // call finishes.
+    bool ok(false);
+    std::thread t([&ok]()
+    {
+        thunk_clearing_list list;
+        stress_thunk * const thunk_(new stress_thunk);
+        stress_thunks_deleted = 0;
+        {
+            epoch_region region; // as if in the thunk's callback
+            list.clear_thunk(thunk_);
+            ok = thunk_state::CLEARING == thunk_->state() &&
+                 1 == list.pending_count();
+        }
+        ok = ok && 1 == list.reclaim() && 1 == stress_thunks_deleted.load();
+        epoch::thread_detach();
+    });
+    t.join();
+    assert_true(ok);
+);
+
+TEST(thunk_counts,
+    size_t const live(thunk::live_count()), clearing(thunk::clearing_count());
+    thunk_clearing_list list;
+    std::unique_ptr<stress_thunk> direct(new stress_thunk);
+    stress_thunk * const listed(new stress_thunk);
+    assert_equals(live + 2, thunk::live_count());
+    assert_equals(clearing, thunk::clearing_count());
+    {
+        epoch_region region; // keeps the listed thunk from being deleted
+        direct->clear();
+        list.clear_thunk(listed);
+        assert_equals(clearing + 2, thunk::clearing_count());
+    }
+    direct.reset();
+    list.reclaim();
+    epoch::thread_detach();
+    assert_equals(live, thunk::live_count());
+    assert_equals(clearing, thunk::clearing_count());
+);
+
+#endif // __NOTEST__
@@ -43,11 +43,12 @@ enum thunk_state
     /** The thunk has been deleted. No live pointer or reference to a thunk
      *  should ever have this state. */
     DELETED = -1,
-    /** The thunk has been cleared and is ready to delete. It is an error to
-     *  attempt to call it. */
+    /** The thunk has been cleared and no thread can still be executing it, so
+     *  it is ready to delete. It is an error to attempt to call it. */
     CLEARED = 0,
-    /** The thunk is in the process of being cleared. It is an error to attempt
-     *  to call it. */
+    /** The thunk is in the process of being cleared. Calls which were already
+     *  in progress when it was cleared may still be running, but it is an
+     *  error to start a new call. */
     CLEARING = 1,
    /** The only state in which a thunk may validly be called */
     READY = 2
@@ -80,15 +81,15 @@ class thunk : private non_copyable
         int                         d_magic;
 #endif // NDEBUG
         std::atomic_int_fast32_t    d_state;
-        std::atomic<bool>           d_clearing;
         std::shared_ptr<callback>   d_callback;
 
         //
         // INTERNALS
         //
 
-        void setup_bad_state(int_fast32_t state);
-        void teardown_bad_state(int_fast32_t state);
+        friend struct thunk_clearing_list_impl;
+
+        void set_cleared();
 
     protected:
 
@@ -136,6 +137,12 @@ class thunk : private non_copyable
          */
         thunk_state state() const;
 
+        /**
+         * \brief Returns the callback invoked by the thunk
+         * \return Non-<code>null</code> pointer to the callback
+         */
+        std::shared_ptr<callback> const& callback_ptr() const;
+
         //
         // MUTATORS
         //
@@ -144,19 +151,41 @@ class thunk : private non_copyable
 
         /** 
          * \brief Marks a thunk as uncallable
+         * \return thunk_state#CLEARING
          * \see #state() const
+         * \see thunk_clearing_list#clear_thunk(thunk *)
          *
          * \warning
          * <em>As soon as</em> any thread calls this function, <em>and before
          * this function returns</em>, the thunk will be moved to
-         * thunk_state#CLEARED and no other thread may attempt to call
-         * #func_addr() const.
+         * thunk_state#CLEARING and no thread may start a new call to
+         * #func_addr() const. Calls that are already in progress may continue,
+         * including a call from whose callback this function is called.
          *
-         * \warning
-         * No thread may call this function while #func_addr() const is being
-         * called by any thread.
+         * The thunk only moves to thunk_state#CLEARED once no thread can still
+         * be executing it, as determined by thunk_clearing_list.
          */
         thunk_state clear();
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of thunks which haven't been deleted
+         * \return Live thunk count, including thunks being cleared
+         */
+        static size_t live_count();
+
+        /**
+         * \brief Returns the number of thunks which have been cleared but not
+         *        yet deleted
+         * \return Count of thunks in thunk_state#CLEARING or
+         *         thunk_state#CLEARED
+         */
+        static size_t clearing_count();
 };
 
 /**
@@ -167,6 +196,9 @@ class thunk : private non_copyable
  */
 std::ostream& operator<<(std::ostream& o, thunk const& t);
 
+inline std::shared_ptr<callback> const& thunk::callback_ptr() const
+{ return d_callback; }
+
 //==============================================================================
 //                         class thunk_clearing_list
 //==============================================================================
@@ -174,17 +206,25 @@ std::ostream& operator<<(std::ostream& o, thunk const& t);
 struct thunk_clearing_list_impl;
 
 /**
- * \brief Clears thunks but temporarily delays their destruction to facilitate
- *        debugging
+ * \brief Clears thunks and deletes them as soon as no thread can still be
+ *        executing them
  * \author Victor Schappert
  * \since 20140714
+ * \see epoch
+ *
+ * Every call to a thunk runs inside an \link epoch\endlink critical region.
+ * When a thunk is cleared, it is retired in the current epoch, and it is
+ * deleted by the first call to #clear_thunk(thunk *) or #reclaim() which finds
+ * that every thread which was in a critical region at that time has since left
+ * it. So a thunk is never kept longer than the longest callback in progress
+ * when it was cleared, and in particular a thunk which is cleared from within
+ * its own callback is deleted by the next reclamation after that callback
+ * returns.
  *
  * \warning
- * This class is <em>guaranteed</em> to <strong>leak</strong> a small amount of
- * memory as it will likely own a small number of undeleted thunks when it is
- * destroyed and it does not delete this small number of objects. Thus only one
- * instance of this class will preferably be instantiated over the lifetime of
- * the program.
+ * This class <strong>leaks</strong> any thunks that haven't been deleted when it
+ * is destroyed. Thus only one instance of this class will preferably be
+ * instantiated over the lifetime of the program.
  */
 class thunk_clearing_list
 {
@@ -216,9 +256,11 @@ class thunk_clearing_list
          * \brief Clears a thunk and queues it for deletion
          * \param thunk_ Valid pointer to a thunk to clear
          *
-         * After this function is called, the thunk cleared list becomes the
-         * owner of <code>thunk</code> and will delete it at some undefined time
-         * in the future.
+         * After this function is called, the thunk clearing list becomes the
+         * owner of <code>thunk</code>. It deletes the thunk, together with any
+         * other thunks that have become safe to delete, before returning if no
+         * thread can still be executing it, or otherwise during a later call
+         * to this function or to #reclaim().
          *
          * \note
          * This operation is thread-safe with respect to this list. In other
@@ -226,6 +268,26 @@ class thunk_clearing_list
          * respect to <em>different</em> thunks!) simultaneously.
          */
         void clear_thunk(thunk * thunk_);
+
+        /**
+         * \brief Deletes all the cleared thunks that no thread can still be
+         *        executing
+         * \return Number of thunks deleted
+         */
+        size_t reclaim();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of cleared thunks which haven't yet been
+         *        deleted
+         * \return Number of thunks waiting to be deleted
+         */
+        size_t pending_count() const;
 };
 
 } // namespace jsdi
@@ -0,0 +1,336 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+//==============================================================================
+// file: thunk_slab.cpp
+// auth: Victor Schappert
+// date: 20140915
+// desc: Allocator packing fixed-size thunk stubs into read-execute pages
+//==============================================================================
+
+#include "thunk_slab.h"
+
+#if defined(_WIN32)
+#include "jsdi_windows.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <new>
+
+namespace jsdi {
+
+//==============================================================================
+//                                  INTERNALS
+//==============================================================================
+
+namespace {
+
+std::atomic<size_t> total_slabs(0);
+
+size_t page_size()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<size_t>(info.dwPageSize);
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+inline size_t round_up(size_t n, size_t multiple)
+{ return (n + multiple - 1) / multiple * multiple; }
+
+// Returns SLAB_BYTES of zeroed read-write memory.
+void * map_slab()
+{
+#if defined(_WIN32)
+    void * const result(VirtualAlloc(nullptr, thunk_slab_allocator::SLAB_BYTES,
+                                     MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (! result) throw std::bad_alloc();
+#else
+    void * const result(mmap(nullptr, thunk_slab_allocator::SLAB_BYTES,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (MAP_FAILED == result) throw std::bad_alloc();
+#endif
+    return result;
+}
+
+void unmap_slab(void * slab)
+{
+#if defined(_WIN32)
+    VirtualFree(slab, 0, MEM_RELEASE);
+#else
+    munmap(slab, thunk_slab_allocator::SLAB_BYTES);
+#endif
+}
+
+// Turns freshly-written code pages into read-execute pages.
+bool protect_code(void * code, size_t size)
+{
+#if defined(_WIN32)
+    DWORD old_protect(0);
+    if (! VirtualProtect(code, size, PAGE_EXECUTE_READ, &old_protect))
+        return false;
+    FlushInstructionCache(GetCurrentProcess(), code, size);
+    return true;
+#else
+    char * const begin(static_cast<char *>(code));
+    __builtin___clear_cache(begin, begin + size);
+    return 0 == mprotect(code, size, PROT_READ | PROT_EXEC);
+#endif
+}
+
+} // anonymous namespace
+
+//==============================================================================
+//                        class thunk_slab_allocator
+//==============================================================================
+
+void thunk_slab_allocator::add_slab()
+{
+    uint8_t * const base(static_cast<uint8_t *>(map_slab()));
+    uint8_t * const code(base);
+    uint8_t * const data(base + d_code_region_bytes);
+    for (size_t k = 0; k < d_slots_per_slab; ++k)
+        d_writer(code + k * d_code_slot_bytes, data + k * d_data_slot_bytes);
+    if (! protect_code(code, d_code_region_bytes))
+    {
+        unmap_slab(base);
+        throw std::bad_alloc();
+    }
+    slab s = { base, nullptr };
+    try
+    {
+        if (d_on_create) s.registration = d_on_create(code, d_slots_per_slab);
+    }
+    catch (...)
+    {
+        unmap_slab(base);
+        throw;
+    }
+    try
+    {
+        d_slabs.push_back(s);
+        d_free.reserve(d_free.size() + d_slots_per_slab);
+    }
+    catch (...)
+    {
+        if (! d_slabs.empty() && base == d_slabs.back().base)
+            d_slabs.pop_back();
+        if (d_on_release) d_on_release(s.registration);
+        unmap_slab(base);
+        throw;
+    }
+    total_slabs.fetch_add(1, std::memory_order_relaxed);
+    // Push the slots in reverse so that they are handed out in address order.
+    for (size_t k = d_slots_per_slab; 0 < k; --k)
+    {
+        slot const s = { code + (k - 1) * d_code_slot_bytes,
+                         data + (k - 1) * d_data_slot_bytes };
+        d_free.push_back(s);
+    }
+}
+
+thunk_slab_allocator::thunk_slab_allocator(size_t code_slot_bytes,
+                                           size_t data_slot_bytes,
+                                           slot_writer writer,
+                                           slab_create_hook on_create,
+                                           slab_release_hook on_release)
+    : d_code_slot_bytes(code_slot_bytes)
+    , d_data_slot_bytes(data_slot_bytes)
+    , d_code_region_bytes(0)
+    , d_slots_per_slab(0)
+    , d_writer(writer)
+    , d_on_create(on_create)
+    , d_on_release(on_release)
+{
+    assert(0 < code_slot_bytes && 0 == code_slot_bytes % 16);
+    assert(0 < data_slot_bytes && 0 == data_slot_bytes % 16);
+    assert(writer || !"slot writer cannot be NULL");
+    assert((on_create || ! on_release) || !"release hook without create hook");
+    // Fit as many slots as possible into a slab while keeping the code and
+    // data on separate pages.
+    size_t const page(page_size());
+    size_t n(SLAB_BYTES / (code_slot_bytes + data_slot_bytes));
+    while (0 < n && SLAB_BYTES < round_up(n * code_slot_bytes, page) +
+                                 round_up(n * data_slot_bytes, page))
+        --n;
+    assert(0 < n || !"slots too big for a slab");
+    d_slots_per_slab   = n;
+    d_code_region_bytes = round_up(n * code_slot_bytes, page);
+}
+
+thunk_slab_allocator::~thunk_slab_allocator()
+{
+    for (auto i = d_slabs.begin(), e = d_slabs.end(); i != e; ++i)
+    {
+        if (d_on_release) d_on_release(i->registration);
+        unmap_slab(i->base);
+    }
+    total_slabs.fetch_sub(d_slabs.size(), std::memory_order_relaxed);
+}
+
+size_t thunk_slab_allocator::slab_count() const
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    return d_slabs.size();
+}
+
+size_t thunk_slab_allocator::slots_in_use() const
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    return d_slabs.size() * d_slots_per_slab - d_free.size();
+}
+
+thunk_slab_allocator::slot thunk_slab_allocator::allocate()
+{
+    std::lock_guard<std::mutex> lock(d_mutex);
+    if (d_free.empty()) add_slab();
+    slot const result(d_free.back());
+    d_free.pop_back();
+    return result;
+}
+
+size_t thunk_slab_allocator::total_slab_count()
+{ return total_slabs.load(std::memory_order_relaxed); }
+
+void thunk_slab_allocator::free(slot const& s)
+{
+    assert(s.code && s.data);
+    std::lock_guard<std::mutex> lock(d_mutex);
+    // Can't throw: add_slab() reserved room for every slot in the slab.
+    d_free.push_back(s);
+}
+
+} // namespace jsdi
+
+//==============================================================================
+//                                  TESTS
+//==============================================================================
+
+#ifndef __NOTEST__
+
+#include "test.h"
+
+#include <set>
+
+using namespace jsdi;
+
+namespace {
+
+void count_writer(uint8_t *, uint8_t * data)
+{ ++*reinterpret_cast<int *>(data); }
+
+#if defined(_M_AMD64) || defined(__x86_64__)
+
+// Writes a stub which returns the first word of its data slot.
+void load_writer(uint8_t * code, uint8_t * data)
+{
+    static uint8_t const LOAD[] =
+    {
+        0x48, 0x8b, 0x05, 0x00, 0x00, 0x00, 0x00,       // mov   rax, [rip+disp]
+        0xc3                                            // retq
+    };
+    std::memcpy(code, LOAD, sizeof(LOAD));
+    int32_t const disp(static_cast<int32_t>(data - (code + 7)));
+    std::memcpy(code + 3, &disp, sizeof(disp));
+}
+
+#endif
+
+struct hook_record
+{
+    uint8_t * code;
+    size_t    num_slots;
+    bool      released;
+};
+
+std::vector<hook_record> hook_records;
+
+void * record_create(uint8_t * code, size_t num_slots)
+{
+    hook_record const r = { code, num_slots, false };
+    hook_records.push_back(r);
+    return reinterpret_cast<void *>(hook_records.size());
+}
+
+void record_release(void * registration)
+{ hook_records[reinterpret_cast<size_t>(registration) - 1].released = true; }
+
+} // anonymous namespace
+
+TEST(thunk_slab_allocate_free,
+    thunk_slab_allocator a(32, 16, count_writer);
+    assert_true(0 < a.slots_per_slab());
+    assert_equals(0, a.slab_count());
+    std::set<uint8_t *> codes, datas;
+    std::vector<thunk_slab_allocator::slot> slots;
+    size_t const N(a.slots_per_slab() + 1);
+    for (size_t k = 0; k < N; ++k)
+    {
+        thunk_slab_allocator::slot const s(a.allocate());
+        assert_equals(1, *reinterpret_cast<int *>(s.data));
+        codes.insert(s.code);
+        datas.insert(s.data);
+        slots.push_back(s);
+    }
+    assert_equals(N, codes.size());
+    assert_equals(N, datas.size());
+    assert_equals(2, a.slab_count());
+    assert_equals(N, a.slots_in_use());
+    a.free(slots[3]);
+    assert_equals(N - 1, a.slots_in_use());
+    thunk_slab_allocator::slot const s(a.allocate());
+    assert_true(slots[3].code == s.code && slots[3].data == s.data);
+    assert_equals(2, a.slab_count());
+);
+
+TEST(thunk_slab_hooks,
+    // The hooks are called once per slab, not once per slot.
+    hook_records.clear();
+    {
+        thunk_slab_allocator a(32, 16, count_writer, record_create,
+                               record_release);
+        std::vector<thunk_slab_allocator::slot> slots;
+        for (size_t k = 0; k < 2 * a.slots_per_slab(); ++k)
+            slots.push_back(a.allocate());
+        assert_equals(2, hook_records.size());
+        assert_true(slots.front().code == hook_records[0].code);
+        assert_true(slots[a.slots_per_slab()].code == hook_records[1].code);
+        assert_equals(a.slots_per_slab(), hook_records[1].num_slots);
+        for (auto i = slots.begin(), e = slots.end(); i != e; ++i)
+            a.free(*i);
+        a.allocate();
+        assert_equals(2, hook_records.size());
+        assert_false(hook_records[0].released || hook_records[1].released);
+        assert_true(2 <= thunk_slab_allocator::total_slab_count());
+    }
+    assert_true(hook_records[0].released && hook_records[1].released);
+);
+
+#if defined(_M_AMD64) || defined(__x86_64__)
+
+TEST(thunk_slab_execute,
+    thunk_slab_allocator a(16, 16, load_writer);
+    thunk_slab_allocator::slot const s1(a.allocate()), s2(a.allocate());
+    *reinterpret_cast<uint64_t *>(s1.data) = 0x0123456789abcdefull;
+    *reinterpret_cast<uint64_t *>(s2.data) = 42;
+    auto f1(reinterpret_cast<uint64_t (*)()>(s1.code));
+    auto f2(reinterpret_cast<uint64_t (*)()>(s2.code));
+    assert_equals(0x0123456789abcdefull, f1());
+    assert_equals(42, f2());
+    *reinterpret_cast<uint64_t *>(s1.data) = 7;
+    assert_equals(7, f1());
+);
+
+#endif
+
+#endif // __NOTEST__
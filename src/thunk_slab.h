@@ -0,0 +1,242 @@
+/* Copyright 2014 (c) Suneido Software Corp. All rights reserved.
+ * Licensed under GPLv2.
+ */
+
+#ifndef __INCLUDED_THUNK_SLAB_H___
+#define __INCLUDED_THUNK_SLAB_H___
+
+/**
+ * \file thunk_slab.h
+ * \author Victor Schappert
+ * \since 20140915
+ * \brief Allocator packing fixed-size thunk stubs into read-execute pages
+ */
+
+#include "util.h"
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace jsdi {
+
+//==============================================================================
+//                        class thunk_slab_allocator
+//==============================================================================
+
+/**
+ * \brief Allocates thunk stubs from slabs of write-protected code pages, each
+ *        stub having a slot of writeable data
+ * \author Victor Schappert
+ * \since 20140915
+ * \see thunk
+ *
+ * A slab is a block of #SLAB_BYTES bytes of virtual memory divided into a run
+ * of code pages followed by a run of data pages. The code pages hold
+ * fixed-size code slots and the data pages hold the same number of data
+ * slots. The <em>n</em><sup>th</sup> code slot is paired with the
+ * <em>n</em><sup>th</sup> data slot.
+ *
+ * When a slab is created, the slot writer passed to the constructor writes
+ * the code for every slot. The code pages are then made read-execute and are
+ * never written again, so no page is ever both writeable and executable. The
+ * code in a slot therefore can't contain anything specific to a particular
+ * thunk. Instead it loads whatever it needs, such as the address of the thunk
+ * implementation, from its data slot, whose address it encodes when it is
+ * written.
+ *
+ * Anything that needs to know about the code in a slab as a whole, such as
+ * the unwind data which the operating system uses to walk the stack through a
+ * stub, can be registered once per slab by passing a slab create hook and a
+ * slab release hook to the constructor. Since every slot in a slab is written
+ * when the slab is created, this makes the cost of the registration
+ * independent of the number of slots allocated.
+ *
+ * Freed slots go onto a free list and are handed out again before any new
+ * slab is created. Slabs are only released when the allocator is destroyed.
+ *
+ * All member functions are thread-safe.
+ */
+class thunk_slab_allocator : private non_copyable
+{
+    public:
+
+        //
+        // TYPES
+        //
+
+        /**
+         * \brief Function which writes the code for a slot
+         * \param code Address of the code slot
+         * \param data Address of the corresponding data slot, which is zeroed
+         *
+         * The writer may also initialize the data slot. It must not write
+         * anything outside the two slots.
+         */
+        typedef void (* slot_writer)(uint8_t * code, uint8_t * data);
+
+        /**
+         * \brief Function which is called once for each new slab after the
+         *        code for all of its slots has been written
+         * \param code Address of the first code slot. The code pages are
+         *        already read-execute.
+         * \param num_slots Number of slots in the slab, which is always
+         *        #slots_per_slab()
+         * \return Value to pass to the slab release hook when the slab is
+         *         released
+         * \throws std::exception If the slab can't be registered, in which
+         *         case the slab is released without calling the release hook
+         *         and #allocate() propagates the exception
+         *
+         * The <em>n</em><sup>th</sup> code slot is at
+         * <code>code + n * code_slot_bytes</code>.
+         */
+        typedef void * (* slab_create_hook)(uint8_t * code, size_t num_slots);
+
+        /**
+         * \brief Function which is called for each slab when the allocator is
+         *        destroyed
+         * \param registration Value returned by the slab create hook for the
+         *        slab
+         */
+        typedef void (* slab_release_hook)(void * registration);
+
+        /**
+         * \brief A code slot and its corresponding data slot
+         */
+        struct slot
+        {
+            /** \brief Address of the code slot, which is read-execute */
+            uint8_t * code;
+            /** \brief Address of the data slot, which is read-write */
+            uint8_t * data;
+        };
+
+        //
+        // DATA
+        //
+
+    private:
+
+        struct slab
+        {
+            void * base;
+            void * registration;
+        };
+
+        size_t               d_code_slot_bytes;
+        size_t               d_data_slot_bytes;
+        size_t               d_code_region_bytes;
+        size_t               d_slots_per_slab;
+        slot_writer          d_writer;
+        slab_create_hook     d_on_create;
+        slab_release_hook    d_on_release;
+        std::vector<slab>    d_slabs;
+        std::vector<slot>    d_free;
+        mutable std::mutex   d_mutex;
+
+        //
+        // INTERNALS
+        //
+
+        void add_slab();
+
+        //
+        // CONSTRUCTORS
+        //
+
+    public:
+
+        /**
+         * \brief Number of bytes of virtual memory in each slab
+         */
+        static const size_t SLAB_BYTES = 64 * 1024;
+
+        /**
+         * \brief Constructs an allocator which hasn't yet created any slabs
+         * \param code_slot_bytes Size of each code slot, which must be a
+         *        non-zero multiple of 16
+         * \param data_slot_bytes Size of each data slot, which must be a
+         *        non-zero multiple of 16
+         * \param writer Non-<code>null</code> function which writes the code
+         *        for each slot
+         * \param on_create Function to call for each new slab, or
+         *        <code>null</code> if none
+         * \param on_release Function to call for each slab when the allocator
+         *        is destroyed, or <code>null</code> if none. Must be
+         *        <code>null</code> if <code>on_create</code> is.
+         */
+        thunk_slab_allocator(size_t code_slot_bytes, size_t data_slot_bytes,
+                             slot_writer writer,
+                             slab_create_hook on_create = nullptr,
+                             slab_release_hook on_release = nullptr);
+
+        ~thunk_slab_allocator();
+
+        //
+        // ACCESSORS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of slots in each slab
+         * \return Slots per slab
+         */
+        size_t slots_per_slab() const;
+
+        /**
+         * \brief Returns the number of slabs that have been created
+         * \return Slab count
+         */
+        size_t slab_count() const;
+
+        /**
+         * \brief Returns the number of slots which have been allocated and not
+         *        freed
+         * \return Slots in use
+         */
+        size_t slots_in_use() const;
+
+        //
+        // MUTATORS
+        //
+
+    public:
+
+        /**
+         * \brief Allocates a slot
+         * \return Slot, whose data slot contains whatever was left there by
+         *         the slot writer or by the slot's previous user
+         * \throws std::bad_alloc If a new slab is needed and can't be created
+         * \throws std::exception Whatever the slab create hook throws if a new
+         *         slab is needed and can't be registered
+         */
+        slot allocate();
+
+        /**
+         * \brief Returns a slot to the free list
+         * \param s Slot returned by #allocate()
+         */
+        void free(slot const& s);
+
+        //
+        // STATICS
+        //
+
+    public:
+
+        /**
+         * \brief Returns the number of slabs that all allocators together have
+         *        created and not yet released
+         * \return Slab count, each slab being #SLAB_BYTES bytes
+         */
+        static size_t total_slab_count();
+};
+
+inline size_t thunk_slab_allocator::slots_per_slab() const
+{ return d_slots_per_slab; }
+
+} // namespace jsdi
+
+#endif // __INCLUDED_THUNK_SLAB_H___
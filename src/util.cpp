@@ -11,8 +11,39 @@
 
 #include "util.h"
 
+#if !defined(_WIN32)
+#include <vector>
+#endif
+
 namespace jsdi {
 
+#if !defined(_WIN32)
+
+namespace {
+
+struct thread_exit_calls
+{
+    std::vector<void (*)()> d_funcs;
+    ~thread_exit_calls()
+    {
+        while (! d_funcs.empty())
+        {
+            void (* const func)() = d_funcs.back();
+            d_funcs.pop_back();
+            func();
+        }
+    }
+};
+
+thread_local thread_exit_calls this_thread_exit_calls;
+
+} // anonymous namespace
+
+void call_at_thread_exit(void (* func)())
+{ this_thread_exit_calls.d_funcs.push_back(func); }
+
+#endif // !defined(_WIN32)
+
 } // namespace jsdi
 
 //==============================================================================
@@ -19,6 +19,21 @@
 #include <typeinfo>
 #include <type_traits>
 
+/**
+ * \brief Storage class specifier giving a variable thread storage duration
+ *
+ * TODO: Replace with the C++ <code>thread_local</code> keyword once Visual
+ *       C++ supports it. It is not available as of November 2013 CTP. Until
+ *       then, a variable declared with this macro must be plain old data and
+ *       must not have a dynamic initializer, which is what MSFT
+ *       <code>__declspec(thread)</code> requires.
+ */
+#if defined(_MSC_VER)
+#define JSDI_THREAD_LOCAL __declspec(thread)
+#else
+#define JSDI_THREAD_LOCAL thread_local
+#endif
+
 namespace jsdi {
 
 /**
@@ -60,6 +75,20 @@ struct non_instantiable
         non_instantiable& operator=(non_instantiable const&) = delete;
 };
 
+#if !defined(_WIN32)
+/**
+ * \brief Arranges for a function to be called when the calling thread exits
+ * \param func Function to call
+ *
+ * On Windows, <code>DllMain()</code> calls the <code>thread_detach()</code>
+ * functions which release per-thread objects. Other platforms have no such
+ * notification, so a per-thread object registers its release function with
+ * this function when it is created. Functions registered by a thread are
+ * called in the reverse order of registration.
+ */
+void call_at_thread_exit(void (* func)());
+#endif // !defined(_WIN32)
+
 /**
  * \brief Return the length of the array parameter.
  * \author Victor Schappert